@@ -0,0 +1,721 @@
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <avro/Compiler.hh>
+#include <avro/Encoder.hh>
+#include <avro/Decoder.hh>
+#include <avro/Generic.hh>
+#include <avro/Specific.hh>
+#include <avro/Stream.hh>
+#include <csi_avro_utils/utils.h>
+#include <csi_avro_utils/arena_decoder.h>
+#include <csi_avro_utils/binary_codec.h>
+#include <csi_avro_utils/binary_validator.h>
+#include <csi_avro_utils/data_generator.h>
+#include <csi_avro_utils/envelope.h>
+#include <csi_avro_utils/hive_schema.h>
+#include <csi_avro_utils/json_writer.h>
+#include <csi_avro_utils/parallel_decoder.h>
+#include <csi_avro_utils/partitioner.h>
+#include <csi_avro_utils/pooled_output_stream.h>
+#include <csi_avro_utils/record_patch.h>
+#include <csi_avro_utils/schema_compatibility.h>
+#include <csi_avro_utils/schema_store.h>
+#include <csi_avro_utils/reflection.h>
+#include <csi_avro_utils/sortable_key.h>
+#include <benchmarks/harness/bench_harness.h>
+#include "wide.h"
+#include "deep.h"
+#include "union_heavy.h"
+#include "map_heavy.h"
+#include "logical.h"
+#include "samples.h"
+
+// benchmarks for the library hot paths and for csi_avrogencpp generated encode/decode
+// the schemas live in benchmarks/schemas, the code for them is generated at build time
+// usage: csi-avro-bench [--json path] [--filter substring] [--min-time seconds]
+
+static void fill(csi_bench::wide_row& r, int64_t i) {
+  r.c00 = i;             r.c01 = 1;     r.c02 = "alpha";   r.c03 = 0.5;   r.c04 = true;  r.c05 = 1.5f;  r.c06.assign(16, 0xab); r.c07 = "se";
+  r.c08 = i * 3;         r.c09 = 42;    r.c10 = "bravo";   r.c11 = 2.5;   r.c12 = false; r.c13 = 2.5f;  r.c14.assign(8, 0x01);  r.c15 = "no";
+  r.c16 = -i;            r.c17 = -7;    r.c18 = "charlie"; r.c19 = 3.25;  r.c20 = true;  r.c21 = 0.25f; r.c22.assign(4, 0x02);  r.c23 = "dk";
+  r.c24 = 1LL << 40;     r.c25 = 1000;  r.c26 = "delta";   r.c27 = -1e10; r.c28 = false; r.c29 = 8.0f;  r.c30.assign(32, 0x03); r.c31 = "fi";
+  r.c32 = 1500000000000; r.c33 = 65535; r.c34 = "echo";    r.c35 = 1e-3;  r.c36 = true;  r.c37 = 9.5f;  r.c38.assign(2, 0x04);  r.c39 = "de";
+  r.c40 = i + 5;         r.c41 = 3;     r.c42 = "foxtrot"; r.c43 = 7.75;  r.c44 = false; r.c45 = 3.5f;  r.c46.assign(64, 0x05); r.c47 = "us";
+}
+
+template<class T> static void fill_level(T& r, int64_t i) {
+  r.id = i;
+  r.label = "level";
+}
+
+static void fill(csi_bench::level1& r, int64_t i) {
+  fill_level(r, i);
+  fill_level(r.child, i + 1);
+  fill_level(r.child.child, i + 2);
+  fill_level(r.child.child.child, i + 3);
+  fill_level(r.child.child.child.child, i + 4);
+  fill_level(r.child.child.child.child.child, i + 5);
+  fill_level(r.child.child.child.child.child.child, i + 6);
+  fill_level(r.child.child.child.child.child.child.child, i + 7);
+}
+
+// roughly two thirds of the optional columns are set
+static void fill(csi_bench::union_row& r, int64_t i) {
+  r.id = i;
+  r.o00.set_string("user-123"); r.o01.set_long(i);      r.o02.set_null();    r.o03.set_double(0.5); r.o04.set_bool(true);
+  r.o05.set_null();             r.o06.set_long(i * 2);  r.o07.set_int(7);    r.o08.set_null();      r.o09.set_bool(false);
+  r.o10.set_string("se");       r.o11.set_null();       r.o12.set_int(-1);   r.o13.set_double(1.5); r.o14.set_null();
+  r.o15.set_string("abcdef");   r.o16.set_long(-i);     r.o17.set_null();    r.o18.set_double(2.5); r.o19.set_bool(true);
+  r.m0.set_string("str");       r.m1.set_long(i);       r.m2.set_double(3.5); r.m3.set_null();
+}
+
+static void fill(csi_bench::map_row& r, int64_t i) {
+  r.id = i;
+  for (int j = 0; j != 16; ++j) {
+    std::string k = "key-" + std::to_string(j);
+    r.counters[k] = i + j;
+    r.labels[k] = "label-" + std::to_string(j);
+    r.nested[k]["x"] = j * 0.5;
+    r.nested[k]["y"] = j * 1.5;
+    r.attributes[k].value = "value";
+    r.attributes[k].weight = j;
+  }
+  r.tags = { "a", "bb", "ccc", "dddd" };
+}
+
+// 256 samples of a time series, timestamps and counts are mostly single byte varints
+static void fill(csi_bench::series& r, int64_t i) {
+  r.id = i;
+  r.metric = "cpu.load";
+  for (int j = 0; j != 256; ++j) {
+    r.timestamps.push_back(1500000000000 + j * 1000);
+    r.deltas.push_back(j % 7 == 0 ? 300 : (j % 11) - 5);
+    r.counts.push_back(j % 50);
+    r.values.push_back(j * 0.125);
+    r.ratios.push_back(j / 256.0f);
+  }
+}
+
+// decimals, timestamps and uuid as native types, decode/logical against decode_generic/logical (raw bytes)
+static void fill(csi_bench::trade& r, int64_t i) {
+  csi::logical::parse_uuid("123e4567-e89b-12d3-a456-426614174000", 36, r.id);
+  r.price = csi::decimal64<4>(1234567 + i);
+  r.notional = csi::decimal128<8, 16>(i * 100000000);
+  r.ts = csi::timestamp_micros(std::chrono::microseconds(1700000000000000LL + i));
+  r.trade_date = csi::date(csi::days(19700));
+  for (int j = 0; j != 16; ++j)
+    r.fills.push_back(csi::decimal64<4>(j * 2500 - 10000));
+}
+
+template<class T> static std::vector<uint8_t> encode_to_vector(const T& v) {
+  auto os = avro::memoryOutputStream();
+  avro::EncoderPtr e = avro::binaryEncoder();
+  e->init(*os);
+  avro::encode(*e, v);
+  e->flush();
+  auto is = avro::memoryInputStream(*os);
+  std::vector<uint8_t> bytes;
+  const uint8_t* data;
+  size_t len;
+  while (is->next(&data, &len))
+    bytes.insert(bytes.end(), data, data + len);
+  return bytes;
+}
+
+template<class T> static void bench_codec(csi::bench::suite& s, const std::string& name) {
+  T v;
+  fill(v, 4711);
+  const std::vector<uint8_t> bytes = encode_to_vector(v);
+
+  s.run("construct/" + name, [&]() {
+    T empty;
+    csi::bench::do_not_optimize(empty);
+  });
+
+  T scratch(v);
+  s.run("reset/" + name, [&]() {
+    scratch = T::defaults();
+    csi::bench::do_not_optimize(scratch);
+  });
+
+  avro::EncoderPtr e = avro::binaryEncoder();
+  s.run("encode/" + name, [&]() {
+    auto os = avro::memoryOutputStream();
+    e->init(*os);
+    avro::encode(*e, v);
+    e->flush();
+    csi::bench::do_not_optimize(os);
+  }, bytes.size());
+
+  csi::pooled_output_stream pooled;
+  s.run("encode_pooled/" + name, [&]() {
+    csi::encode_to(pooled, *e, v);
+    csi::bench::do_not_optimize(pooled);
+  }, bytes.size());
+
+  // encoded and copied out, ie to hand to a producer
+  s.run("encode_to_string/" + name, [&]() {
+    auto os = avro::memoryOutputStream();
+    e->init(*os);
+    avro::encode(*e, v);
+    e->flush();
+    std::string str = to_string(*os);
+    csi::bench::do_not_optimize(str);
+  }, bytes.size());
+
+  s.run("encode_to_string_pooled/" + name, [&]() {
+    csi::encode_to(pooled, *e, v);
+    std::string str = pooled.str();
+    csi::bench::do_not_optimize(str);
+  }, bytes.size());
+
+  s.run("hash/" + name, [&]() {
+    size_t h = std::hash<T>()(v);
+    csi::bench::do_not_optimize(h);
+  });
+
+  // what keying a hash table on a record costs without generated operators
+  s.run("hash_via_encode/" + name, [&]() {
+    auto os = avro::memoryOutputStream();
+    e->init(*os);
+    avro::encode(*e, v);
+    e->flush();
+    size_t h = std::hash<std::string>()(to_string(*os));
+    csi::bench::do_not_optimize(h);
+  });
+
+  T copy = v;
+  s.run("equal/" + name, [&]() {
+    bool eq = (copy == v);
+    csi::bench::do_not_optimize(eq);
+  });
+
+  avro::DecoderPtr d = avro::binaryDecoder();
+  T out;
+  s.run("decode/" + name, [&]() {
+    auto is = avro::memoryInputStream(bytes.data(), bytes.size());
+    d->init(*is);
+    avro::decode(*d, out);
+    csi::bench::do_not_optimize(out);
+  }, bytes.size());
+
+  // checking a message without decoding it, compared with a generic decode
+  csi::binary_validator validator(*T::valid_schema());
+  s.run("validate/" + name, [&]() {
+    csi::validation_result r = validator.validate(bytes);
+    csi::bench::do_not_optimize(r);
+  }, bytes.size());
+
+  s.run("decode_generic/" + name, [&]() {
+    avro::GenericDatum generic(*T::valid_schema());
+    auto is = avro::memoryInputStream(bytes.data(), bytes.size());
+    d->init(*is);
+    avro::decode(*d, generic);
+    csi::bench::do_not_optimize(generic);
+  }, bytes.size());
+
+  // generic export through the generated field tables
+  std::string csv;
+  s.run("to_csv/" + name, [&]() {
+    csv.clear();
+    csi::to_csv(v, csv);
+    csi::bench::do_not_optimize(csv);
+  });
+
+  // generated json against the avro json encoder, same output format
+  csi::json_buffer json;
+  s.run("to_json/" + name, [&]() {
+    json.clear();
+    to_json(v, json);
+    csi::bench::do_not_optimize(json);
+  });
+
+  avro::EncoderPtr je;
+  s.run("avro_json_encode/" + name, [&]() {
+    if (!je)
+      je = avro::jsonEncoder(*T::valid_schema()); // on first use, only when the benchmark is selected
+    auto os = avro::memoryOutputStream();
+    je->init(*os);
+    avro::encode(*je, v);
+    je->flush();
+    csi::bench::do_not_optimize(os);
+  });
+
+  csi::arena_decoder arena_decoder(*T::valid_schema());
+  csi::arena arena;
+  s.run("decode_arena/" + name, [&]() {
+    arena.reset();
+    csi::arena_datum datum = arena_decoder.decode(bytes, arena);
+    csi::bench::do_not_optimize(datum);
+  }, bytes.size());
+}
+
+// csi::binary_encoder / binary_decoder, against encode/ and decode/ with the avro binary codec. the generated
+// code takes the --bulk-arrays path for int, long, float and double arrays, everything else goes item by item
+// varied messages from csi::data_generator instead of the one filled in record, lengths and branches differ.
+// not for logical types, the generator only sees the underlying types
+template<class T> static void bench_generated(csi::bench::suite& s, const std::string& name) {
+  csi::data_generator                generator(*T::valid_schema());
+  std::vector<std::vector<uint8_t> > generated(256);
+  size_t                             generated_bytes = 0;
+  for (auto& m : generated)
+    generated_bytes += generator.generate(m);
+  std::vector<uint8_t> message;
+  s.run("generate/" + name, [&]() {
+    message.clear();
+    generator.generate(message);
+    csi::bench::do_not_optimize(message);
+  }, generated_bytes / generated.size());
+
+  csi::binary_decoder bd;
+  T                   out;
+  size_t              next = 0;
+  s.run("decode_generated/" + name, [&]() {
+    const std::vector<uint8_t>& m = generated[next++ % generated.size()];
+    bd.init(m.data(), m.size());
+    avro::decode(bd, out);
+    csi::bench::do_not_optimize(out);
+  }, generated_bytes / generated.size());
+
+  csi::binary_validator validator(*T::valid_schema());
+  s.run("validate_generated/" + name, [&]() {
+    csi::validation_result r = validator.validate(generated[next++ % generated.size()]);
+    csi::bench::do_not_optimize(r);
+  }, generated_bytes / generated.size());
+}
+
+// an update stream: one or two fields move on per update, the rest of the record stays as it was
+static void update(csi_bench::wide_row& r, int64_t i) {
+  r.c00 = i;
+  if (i % 4 == 0)
+    r.c07 = i % 8 ? "se" : "no";
+}
+
+static void update(csi_bench::union_row& r, int64_t i) {
+  r.o01.set_long(i);
+  if (i % 4 == 0)
+    r.o03.set_double(i * 0.5);
+}
+
+static void update(csi_bench::map_row& r, int64_t i) {
+  r.counters["key-3"] = i;
+  if (i % 4 == 0)
+    r.labels["key-7"] = "label-" + std::to_string(i);
+}
+
+// --patch diff() and apply_patch() over an update stream, against encoding the whole record each time.
+// bytes_per_op is the average patch size for patch/ and the record size for patch/encode_full/
+template<class T> static void bench_patch(csi::bench::suite& s, const std::string& name) {
+  std::vector<T> versions(257);
+  fill(versions[0], 4711);
+  for (size_t i = 1; i != versions.size(); ++i) {
+    versions[i] = versions[i - 1];
+    update(versions[i], i);
+  }
+  std::vector<std::vector<uint8_t> > patches(versions.size() - 1);
+  size_t                             patch_bytes = 0;
+  size_t                             full_bytes = 0;
+  for (size_t i = 0; i != patches.size(); ++i) {
+    diff(versions[i], versions[i + 1], patches[i]);
+    patch_bytes += patches[i].size();
+    full_bytes += encode_to_vector(versions[i + 1]).size();
+  }
+
+  std::vector<uint8_t> patch;
+  size_t               next = 0;
+  s.run("patch/diff/" + name, [&]() {
+    size_t i = next++ % patches.size();
+    bool changed = diff(versions[i], versions[i + 1], patch);
+    csi::bench::do_not_optimize(changed);
+  }, patch_bytes / patches.size());
+
+  T state = versions[0];
+  s.run("patch/apply/" + name, [&]() {
+    apply_patch(state, patches[next++ % patches.size()]);
+    csi::bench::do_not_optimize(state);
+  }, patch_bytes / patches.size());
+
+  csi::pooled_output_stream os;
+  csi::binary_encoder       e;
+  s.run("patch/encode_full/" + name, [&]() {
+    os.reset();
+    e.init(os);
+    avro::encode(e, versions[1 + next++ % patches.size()]);
+    e.flush();
+    csi::bench::do_not_optimize(os);
+  }, full_bytes / patches.size());
+}
+
+template<class T> static void bench_bulk(csi::bench::suite& s, const std::string& name) {
+  T v;
+  fill(v, 4711);
+  const std::vector<uint8_t> bytes = encode_to_vector(v);
+
+  csi::binary_encoder e;
+  s.run("encode_bulk/" + name, [&]() {
+    auto os = avro::memoryOutputStream();
+    e.init(*os);
+    avro::encode(e, v);
+    e.flush();
+    csi::bench::do_not_optimize(os);
+  }, bytes.size());
+
+  csi::binary_decoder d;
+  T out;
+  s.run("decode_bulk/" + name, [&]() {
+    d.init(bytes.data(), bytes.size());
+    avro::decode(d, out);
+    csi::bench::do_not_optimize(out);
+  }, bytes.size());
+}
+
+// ordered decode of a message stream on 1, 2, 4 .. hardware_concurrency threads, one op is a batch of 1000 messages
+template<class T> static void bench_parallel_decode(csi::bench::suite& s, const std::string& name) {
+  const size_t batch = 1000;
+  std::vector<std::vector<uint8_t>> messages(batch);
+  for (size_t i = 0; i != batch; ++i) {
+    T v;
+    fill(v, i);
+    messages[i] = encode_to_vector(v);
+  }
+  uint64_t bytes = 0;
+  for (auto& m : messages)
+    bytes += m.size();
+
+  const size_t max_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+  for (size_t threads = 1;; threads = std::min(2 * threads, max_threads)) {
+    size_t delivered = 0;
+    csi::parallel_decoder<T> decoder(*T::valid_schema(), threads, [&](T& v) { ++delivered; csi::bench::do_not_optimize(v); });
+    s.run("parallel_decode/" + name + "/" + std::to_string(threads), [&]() {
+      for (auto& m : messages)
+        decoder.push(m);
+      decoder.flush();
+    }, bytes);
+    if (threads == max_threads)
+      break;
+  }
+}
+
+static void bench_schema(csi::bench::suite& s, const std::string& name, const avro::ValidSchema& schema) {
+  s.run("normalize/" + name, [&]() {
+    std::string n = normalize(schema);
+    csi::bench::do_not_optimize(n);
+  });
+  s.run("generate_hash/" + name, [&]() {
+    boost::uuids::uuid h = generate_hash(schema);
+    csi::bench::do_not_optimize(h);
+  });
+}
+
+// a consumer checking the writer schema of every message against its reader, reader == writer here
+static void bench_compatibility(csi::bench::suite& s, const std::string& name, const avro::ValidSchema& schema) {
+  s.run("compatibility/check/" + name, [&]() {
+    csi::compatibility_verdict v = csi::check_compatibility(schema, schema);
+    csi::bench::do_not_optimize(v);
+  });
+
+  csi::compatibility_checker checker;
+  const boost::uuids::uuid   hash = csi::schema_fingerprint(schema);
+  s.run("compatibility/cached/" + name, [&]() {
+    csi::compatibility_checker::verdict_ptr v = checker.check(hash, schema, hash, schema);
+    csi::bench::do_not_optimize(v);
+  });
+
+  s.run("compatibility/resolving_decoder/" + name, [&]() {
+    avro::DecoderPtr d = avro::resolvingDecoder(schema, schema, avro::binaryDecoder());
+    csi::bench::do_not_optimize(d);
+  });
+
+  // a registry with 100 versions of an envelope around the schema, interned so they share the payload record,
+  // which is walked once for the whole batch
+  csi::schema_store                                                     store;
+  std::vector<std::pair<boost::uuids::uuid, const avro::ValidSchema*> > registry;
+  std::string fields = "{\"name\":\"payload\",\"type\":" + to_string(schema) + "}";
+  for (int version = 0; version != 100; ++version) {
+    const avro::ValidSchema* p = store.intern("{\"type\":\"record\",\"name\":\"csi_bench.envelope\",\"fields\":[" + fields + "]}").get();
+    registry.push_back(std::make_pair(csi::schema_fingerprint(*p), p));
+    fields += ",{\"name\":\"attribute_" + std::to_string(version) + "\",\"type\":\"int\"}";
+  }
+  const avro::ValidSchema& reader = *registry.front().second;
+  s.run("compatibility/check_all_100/" + name, [&]() {
+    csi::compatibility_checker batch;
+    std::vector<csi::compatibility_checker::verdict_ptr> v = batch.check_all(registry, reader);
+    csi::bench::do_not_optimize(v);
+  });
+  s.run("compatibility/check_100/" + name, [&]() {
+    std::vector<csi::compatibility_verdict> v;
+    for (auto& writer : registry)
+      v.push_back(csi::check_compatibility(*writer.second, reader));
+    csi::bench::do_not_optimize(v);
+  });
+}
+
+int main(int argc, char** argv) {
+  csi::bench::suite s("csi-avro-bench", argc, argv);
+
+  bench_schema(s, "wide", *csi_bench::wide_row::valid_schema());
+  bench_schema(s, "deep", *csi_bench::level1::valid_schema());
+  bench_schema(s, "union_heavy", *csi_bench::union_row::valid_schema());
+  bench_schema(s, "map_heavy", *csi_bench::map_row::valid_schema());
+
+  bench_compatibility(s, "wide", *csi_bench::wide_row::valid_schema());
+  bench_compatibility(s, "deep", *csi_bench::level1::valid_schema());
+  bench_compatibility(s, "union_heavy", *csi_bench::union_row::valid_schema());
+
+  bench_codec<csi_bench::wide_row>(s, "wide");
+  bench_codec<csi_bench::level1>(s, "deep");
+  bench_codec<csi_bench::union_row>(s, "union_heavy");
+  bench_codec<csi_bench::map_row>(s, "map_heavy");
+  bench_codec<csi_bench::trade>(s, "logical");
+  bench_codec<csi_bench::series>(s, "samples");
+
+  bench_generated<csi_bench::wide_row>(s, "wide");
+  bench_generated<csi_bench::level1>(s, "deep");
+  bench_generated<csi_bench::union_row>(s, "union_heavy");
+  bench_generated<csi_bench::map_row>(s, "map_heavy");
+  bench_generated<csi_bench::series>(s, "samples");
+
+  bench_bulk<csi_bench::wide_row>(s, "wide");
+  bench_bulk<csi_bench::map_row>(s, "map_heavy");
+  bench_bulk<csi_bench::series>(s, "samples");
+
+  bench_patch<csi_bench::wide_row>(s, "wide");
+  bench_patch<csi_bench::union_row>(s, "union_heavy");
+  bench_patch<csi_bench::map_row>(s, "map_heavy");
+
+  bench_parallel_decode<csi_bench::level1>(s, "deep");
+  bench_parallel_decode<csi_bench::map_row>(s, "map_heavy");
+
+  {
+    csi_bench::wide_row row;
+    fill(row, 1);
+    auto os = avro::memoryOutputStream();
+    avro::EncoderPtr e = avro::binaryEncoder();
+    e->init(*os);
+    avro::encode(*e, row);
+    e->flush();
+    s.run("to_string/output_stream", [&]() {
+      std::string str = to_string(*os);
+      csi::bench::do_not_optimize(str);
+    }, os->byteCount());
+  }
+
+  {
+    csi_bench::wide_row row;
+    fill(row, 1);
+    avro::EncoderPtr e = avro::binaryEncoder();
+    const boost::uuids::uuid hash = csi_bench::wide_row::schema_hash();
+
+    // what services do by hand: encode, copy out, prepend the hash
+    s.run("envelope/encode_by_hand", [&]() {
+      auto os = avro::memoryOutputStream();
+      e->init(*os);
+      avro::encode(*e, row);
+      e->flush();
+      std::string msg(reinterpret_cast<const char*>(hash.data), 16);
+      msg += to_string(*os);
+      csi::bench::do_not_optimize(msg);
+    });
+
+    csi::envelope_codec        codec(csi::HASH_ENVELOPE);
+    csi::pooled_output_stream  pooled;
+    codec.add(csi_bench::wide_row::valid_schema());
+    s.run("envelope/encode", [&]() {
+      codec.encode(pooled, *e, row);
+      csi::bench::do_not_optimize(pooled);
+    });
+
+    const std::string msg = pooled.str();
+    const uint8_t*    data = reinterpret_cast<const uint8_t*>(msg.data());
+    s.run("envelope/parse", [&]() {
+      csi::envelope env = codec.parse(data, msg.size());
+      csi::bench::do_not_optimize(env);
+    });
+
+    std::vector<std::pair<const uint8_t*, size_t> > batch(1000, std::make_pair(data, msg.size()));
+    std::vector<csi::envelope>                     parsed;
+    s.run("envelope/parse_batch_1000", [&]() {
+      size_t n = codec.parse_batch(batch, parsed);
+      csi::bench::do_not_optimize(n);
+    });
+
+    csi::binary_decoder   d;
+    csi_bench::wide_row   out;
+    s.run("envelope/parse_decode", [&]() {
+      codec.decode(codec.parse(data, msg.size()), d, out);
+      csi::bench::do_not_optimize(out);
+    }, msg.size());
+  }
+
+  // hive key extraction works on generic data
+  const avro::ValidSchema& value_schema = *csi_bench::union_row::valid_schema();
+  const std::vector<std::string> keys = { "o00", "o01", "o06" };
+  s.run("get_key_schema/union_heavy", [&]() {
+    auto key_schema = csi::avro_hive::get_key_schema(avro::Name("csi.bench.union_row_key"), keys, true, value_schema);
+    csi::bench::do_not_optimize(key_schema);
+  });
+
+  {
+    csi_bench::union_row row;
+    fill(row, 1);
+    const std::vector<uint8_t> bytes = encode_to_vector(row);
+    avro::GenericDatum datum(value_schema);
+    auto is = avro::memoryInputStream(bytes.data(), bytes.size());
+    avro::DecoderPtr d = avro::binaryDecoder();
+    d->init(*is);
+    avro::decode(*d, datum);
+
+    auto key_schema = csi::avro_hive::get_key_schema(avro::Name("csi.bench.union_row_key"), keys, true, value_schema);
+    s.run("get_key/union_heavy", [&]() {
+      auto key = csi::avro_hive::get_key(datum, *key_schema);
+      csi::bench::do_not_optimize(key);
+    });
+
+    auto strict_key_schema = csi::avro_hive::get_key_schema(avro::Name("csi.bench.union_row_key"), keys, false, value_schema);
+    s.run("get_key/union_heavy_strict", [&]() {
+      auto key = csi::avro_hive::get_key(datum, *strict_key_schema);
+      csi::bench::do_not_optimize(key);
+    });
+
+    csi::avro_hive::hive_row_converter converter(value_schema, keys, true, avro::Name("csi.bench.union_row_key"), avro::Name("csi.bench.union_row_value"));
+    avro::GenericDatum hive_key(*converter.key_schema());
+    avro::GenericDatum hive_value(*converter.value_schema());
+    s.run("hive_row_converter/convert", [&]() {
+      converter.convert(datum, hive_key, hive_value);
+      csi::bench::do_not_optimize(hive_value);
+    });
+
+    const std::vector<avro::GenericDatum> rows(100, datum);
+    std::vector<avro::GenericDatum> hive_keys;
+    std::vector<avro::GenericDatum> hive_values;
+    s.run("hive_row_converter/convert_batch_100", [&]() {
+      converter.convert(rows, hive_keys, hive_values);
+      csi::bench::do_not_optimize(hive_values);
+    });
+
+    // kafka partition routing, the old way serializes the key from get_key for every message
+    csi::key_partitioner partitioner(value_schema, *key_schema);
+    std::vector<uint8_t> key_bytes;
+    s.run("key_partitioner/get_key_encode_murmur2", [&]() {
+      auto key = csi::avro_hive::get_key(datum, *key_schema);
+      auto os = avro::memoryOutputStream();
+      avro::EncoderPtr e = avro::binaryEncoder();
+      e->init(*os);
+      avro::encode(*e, *key);
+      e->flush();
+      key_bytes.clear();
+      auto is = avro::memoryInputStream(*os);
+      const uint8_t* data;
+      size_t len;
+      while (is->next(&data, &len))
+        key_bytes.insert(key_bytes.end(), data, data + len);
+      int32_t p = csi::kafka_partition(key_bytes.data(), key_bytes.size(), 64);
+      csi::bench::do_not_optimize(p);
+    });
+
+    std::vector<avro::GenericDatum> batch;
+    for (int i = 0; i != 1000; ++i) {
+      csi_bench::union_row r;
+      fill(r, i);
+      const std::vector<uint8_t> b = encode_to_vector(r);
+      avro::GenericDatum d(value_schema);
+      auto bis = avro::memoryInputStream(b.data(), b.size());
+      avro::DecoderPtr bd = avro::binaryDecoder();
+      bd->init(*bis);
+      avro::decode(*bd, d);
+      batch.push_back(d);
+    }
+    std::vector<int32_t> partitions;
+    s.run("key_partitioner/partition_batch_1000", [&]() {
+      partitioner.partition(batch, 64, partitions);
+      csi::bench::do_not_optimize(partitions);
+    });
+
+    s.run("get_field_by_name/long", [&]() {
+      int64_t id = get_field_by_name<int64_t>(datum, "id");
+      csi::bench::do_not_optimize(id);
+    });
+    s.run("get_field_by_name/union_string", [&]() {
+      std::string v = get_field_by_name<std::string>(datum, "o00");
+      csi::bench::do_not_optimize(v);
+    });
+
+    csi::arena_decoder arena_decoder(value_schema);
+    csi::arena arena;
+    csi::arena_datum arena_datum = arena_decoder.decode(bytes, arena);
+    s.run("get_field_by_name/arena_union_string", [&]() {
+      std::string v = get_field_by_name<std::string>(arena_datum, "o00");
+      csi::bench::do_not_optimize(v);
+    });
+    s.run("get_key/arena_union_heavy", [&]() {
+      auto key = csi::avro_hive::get_key(arena_datum, *key_schema);
+      csi::bench::do_not_optimize(key);
+    });
+  }
+
+  // order preserving key encoding, compared with sorting decoded generic keys
+  {
+    avro::ValidSchema key_schema = avro::compileJsonSchemaFromString(
+      "{\"type\":\"record\",\"name\":\"bench_key\",\"fields\":["
+      "{\"name\":\"user\",\"type\":[\"null\",\"string\"]},"
+      "{\"name\":\"day\",\"type\":\"int\"},"
+      "{\"name\":\"id\",\"type\":\"long\"}]}");
+    csi::avro_hive::sortable_key_codec codec(key_schema);
+    std::vector<avro::GenericDatum> keys;
+    std::vector<std::string> encoded;
+    for (int i = 0; i != 1000; ++i) {
+      avro::GenericDatum key(key_schema);
+      avro::GenericRecord& r = key.value<avro::GenericRecord>();
+      r.fieldAt(0).selectBranch(i % 10 ? 1 : 0);
+      if (i % 10)
+        r.fieldAt(0).value<std::string>() = "user-" + std::to_string((i * 7919) % 97);
+      r.fieldAt(1).value<int32_t>() = 17000 + (i * 31) % 30;
+      r.fieldAt(2).value<int64_t>() = (i * 104729) % 1000 - 500;
+      keys.push_back(key);
+      encoded.push_back(codec.encode(key));
+    }
+
+    std::string buf;
+    s.run("sortable_key/encode", [&]() {
+      buf.clear();
+      codec.encode(keys[17], buf);
+      csi::bench::do_not_optimize(buf);
+    });
+
+    avro::GenericDatum out(key_schema);
+    s.run("sortable_key/decode", [&]() {
+      codec.decode(encoded[17], out);
+      csi::bench::do_not_optimize(out);
+    });
+
+    s.run("sortable_key/sort_1000_encoded", [&]() {
+      std::vector<std::string> v(encoded);
+      std::sort(v.begin(), v.end());
+      csi::bench::do_not_optimize(v);
+    });
+
+    // without the encoding a sort has to compare the generic datums column by column
+    s.run("sortable_key/sort_1000_generic", [&]() {
+      std::vector<const avro::GenericDatum*> v;
+      for (auto& k : keys)
+        v.push_back(&k);
+      std::sort(v.begin(), v.end(), [](const avro::GenericDatum* a, const avro::GenericDatum* b) {
+        const avro::GenericRecord& ra = a->value<avro::GenericRecord>();
+        const avro::GenericRecord& rb = b->value<avro::GenericRecord>();
+        size_t ba = ra.fieldAt(0).unionBranch(), bb = rb.fieldAt(0).unionBranch();
+        if (ba != bb)
+          return ba < bb;
+        if (ba == 1 && ra.fieldAt(0).value<std::string>() != rb.fieldAt(0).value<std::string>())
+          return ra.fieldAt(0).value<std::string>() < rb.fieldAt(0).value<std::string>();
+        if (ra.fieldAt(1).value<int32_t>() != rb.fieldAt(1).value<int32_t>())
+          return ra.fieldAt(1).value<int32_t>() < rb.fieldAt(1).value<int32_t>();
+        return ra.fieldAt(2).value<int64_t>() < rb.fieldAt(2).value<int64_t>();
+      });
+      csi::bench::do_not_optimize(v);
+    });
+  }
+
+  return s.finish();
+}
@@ -0,0 +1,89 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <avro/Compiler.hh>
+#include <avro/DataFile.hh>
+#include <avro/Generic.hh>
+#include <csi_avro_utils/data_file_reader.h>
+
+// compares the stock single threaded avro::DataFileReader with csi::read_data_file
+// usage: bench-data-file-reader [records] [null|deflate] [max threads]
+
+static const char* schema_json =
+"{\"type\":\"record\",\"name\":\"bench_row\",\"fields\":["
+"{\"name\":\"id\",\"type\":\"long\"},"
+"{\"name\":\"ts\",\"type\":\"long\"},"
+"{\"name\":\"user\",\"type\":\"string\"},"
+"{\"name\":\"country\",\"type\":[\"null\",\"string\"]},"
+"{\"name\":\"score\",\"type\":\"double\"},"
+"{\"name\":\"count\",\"type\":\"int\"},"
+"{\"name\":\"tags\",\"type\":{\"type\":\"array\",\"items\":\"string\"}}"
+"]}";
+
+static void write_file(const std::string& path, const avro::ValidSchema& schema, size_t nr_of_records, avro::Codec codec) {
+  avro::DataFileWriter<avro::GenericDatum> writer(path.c_str(), schema, 64 * 1024, codec);
+  avro::GenericDatum datum(schema);
+  avro::GenericRecord& r = datum.value<avro::GenericRecord>();
+  for (size_t i = 0; i != nr_of_records; ++i) {
+    r.field("id").value<int64_t>() = i;
+    r.field("ts").value<int64_t>() = 1500000000000LL + i;
+    r.field("user").value<std::string>() = "user-" + std::to_string(i % 10000);
+    r.field("country").selectBranch(i % 3 ? 1 : 0);
+    if (i % 3)
+      r.field("country").value<std::string>() = "se";
+    r.field("score").value<double>() = i * 0.5;
+    r.field("count").value<int32_t>() = static_cast<int32_t>(i % 1000);
+    avro::GenericArray::Value& tags = r.field("tags").value<avro::GenericArray>().value();
+    tags.clear();
+    for (size_t j = 0; j != i % 4; ++j)
+      tags.push_back(avro::GenericDatum(std::string("tag") + std::to_string(j)));
+    writer.write(datum);
+  }
+  writer.close();
+}
+
+static void report(const std::string& name, size_t records, size_t bytes, std::chrono::steady_clock::duration d) {
+  double s = std::chrono::duration_cast<std::chrono::duration<double>>(d).count();
+  std::cout << name << ": " << records << " records in " << s << " s, " << (records / s) << " records/s, " << (bytes / s / 1024 / 1024) << " MB/s (file)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  size_t nr_of_records = argc > 1 ? atol(argv[1]) : 1000000;
+  avro::Codec codec = (argc > 2 && std::string(argv[2]) == "null") ? avro::NULL_CODEC : avro::DEFLATE_CODEC;
+  size_t max_threads = argc > 3 ? atol(argv[3]) : std::max<size_t>(1, std::thread::hardware_concurrency());
+
+  avro::ValidSchema schema = avro::compileJsonSchemaFromString(schema_json);
+  std::string path = "bench-data-file-reader.avro";
+  write_file(path, schema, nr_of_records, codec);
+
+  size_t file_size = 0;
+  {
+    csi::mmap_data_file file(path);
+    std::cout << "file: " << path << ", codec: " << file.codec() << ", blocks: " << file.blocks().size() << ", records: " << file.records() << std::endl;
+    for (auto& b : file.blocks())
+      file_size += b.size;
+  }
+
+  {
+    auto start = std::chrono::steady_clock::now();
+    avro::DataFileReader<avro::GenericDatum> reader(path.c_str());
+    avro::GenericDatum datum(reader.dataSchema());
+    size_t n = 0;
+    while (reader.read(datum))
+      ++n;
+    report("avro::DataFileReader", n, file_size, std::chrono::steady_clock::now() - start);
+  }
+
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    auto start = std::chrono::steady_clock::now();
+    csi::mmap_data_file file(path);
+    size_t n = 0;
+    csi::read_data_file<avro::GenericDatum>(file, threads, [&n](avro::GenericDatum&) { ++n; });
+    report("csi::read_data_file threads=" + std::to_string(threads), n, file_size, std::chrono::steady_clock::now() - start);
+  }
+
+  remove(path.c_str());
+  return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <avro/Compiler.hh>
+#include <avro/DataFile.hh>
+#include <avro/Generic.hh>
+#include <csi_avro_utils/data_file_reader.h>
+#include <csi_avro_utils/data_file_writer.h>
+
+// compares the stock single threaded avro::DataFileWriter with csi::data_file_writer
+// usage: bench-data-file-writer [records] [null|deflate] [max threads]
+
+static const char* schema_json =
+"{\"type\":\"record\",\"name\":\"bench_row\",\"fields\":["
+"{\"name\":\"id\",\"type\":\"long\"},"
+"{\"name\":\"ts\",\"type\":\"long\"},"
+"{\"name\":\"user\",\"type\":\"string\"},"
+"{\"name\":\"country\",\"type\":[\"null\",\"string\"]},"
+"{\"name\":\"score\",\"type\":\"double\"},"
+"{\"name\":\"count\",\"type\":\"int\"},"
+"{\"name\":\"tags\",\"type\":{\"type\":\"array\",\"items\":\"string\"}}"
+"]}";
+
+static void fill(avro::GenericDatum& datum, size_t i) {
+  avro::GenericRecord& r = datum.value<avro::GenericRecord>();
+  r.field("id").value<int64_t>() = i;
+  r.field("ts").value<int64_t>() = 1500000000000LL + i;
+  r.field("user").value<std::string>() = "user-" + std::to_string(i % 10000);
+  r.field("country").selectBranch(i % 3 ? 1 : 0);
+  if (i % 3)
+    r.field("country").value<std::string>() = "se";
+  r.field("score").value<double>() = i * 0.5;
+  r.field("count").value<int32_t>() = static_cast<int32_t>(i % 1000);
+  avro::GenericArray::Value& tags = r.field("tags").value<avro::GenericArray>().value();
+  tags.clear();
+  for (size_t j = 0; j != i % 4; ++j)
+    tags.push_back(avro::GenericDatum(std::string("tag") + std::to_string(j)));
+}
+
+static void report(const std::string& name, size_t records, std::chrono::steady_clock::duration d) {
+  double s = std::chrono::duration_cast<std::chrono::duration<double>>(d).count();
+  std::cout << name << ": " << records << " records in " << s << " s, " << (records / s) << " records/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  size_t nr_of_records = argc > 1 ? atol(argv[1]) : 1000000;
+  bool deflate = !(argc > 2 && std::string(argv[2]) == "null");
+  size_t max_threads = argc > 3 ? atol(argv[3]) : std::max<size_t>(1, std::thread::hardware_concurrency());
+
+  avro::ValidSchema schema = avro::compileJsonSchemaFromString(schema_json);
+  std::string path = "bench-data-file-writer.avro";
+  avro::GenericDatum datum(schema);
+
+  {
+    auto start = std::chrono::steady_clock::now();
+    avro::DataFileWriter<avro::GenericDatum> writer(path.c_str(), schema, 64 * 1024, deflate ? avro::DEFLATE_CODEC : avro::NULL_CODEC);
+    for (size_t i = 0; i != nr_of_records; ++i) {
+      fill(datum, i);
+      writer.write(datum);
+    }
+    writer.close();
+    report("avro::DataFileWriter", nr_of_records, std::chrono::steady_clock::now() - start);
+  }
+
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    auto start = std::chrono::steady_clock::now();
+    csi::data_file_writer<avro::GenericDatum> writer(path, schema, deflate ? "deflate" : "null", threads);
+    for (size_t i = 0; i != nr_of_records; ++i) {
+      fill(datum, i);
+      writer.write(datum);
+    }
+    writer.close();
+    report("csi::data_file_writer threads=" + std::to_string(threads), nr_of_records, std::chrono::steady_clock::now() - start);
+  }
+
+  // sanity check the last file with our own reader
+  csi::mmap_data_file file(path);
+  if (file.records() != static_cast<int64_t>(nr_of_records)) {
+    std::cerr << "record count mismatch: " << file.records() << " != " << nr_of_records << std::endl;
+    return 1;
+  }
+
+  remove(path.c_str());
+  return 0;
+}
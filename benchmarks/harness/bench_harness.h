@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+
+#pragma once
+
+// minimal self contained benchmark harness
+// every case is run in growing batches until it has run for at least min_time seconds, results are
+// printed as text and optionally written as json so runs can be compared across releases
+//
+// usage: <bench> [--json path] [--filter substring] [--min-time seconds]
+
+namespace csi {
+  namespace bench {
+    // keeps the compiler from optimizing away a computed value
+    template<class T> inline void do_not_optimize(const T& v) {
+#if defined(__GNUC__) || defined(__clang__)
+      asm volatile("" : : "g"(&v) : "memory");
+#else
+      static volatile const void* sink;
+      sink = &v;
+#endif
+    }
+
+    struct result {
+      std::string name;
+      uint64_t    iterations;
+      double      ns_per_op;
+      uint64_t    bytes_per_op;
+    };
+
+    class suite {
+      public:
+      suite(const std::string& name, int argc, char** argv)
+        : name_(name)
+        , min_time_(0.5) {
+        for (int i = 1; i < argc; ++i) {
+          std::string arg(argv[i]);
+          if (arg == "--json" && i + 1 < argc)
+            json_path_ = argv[++i];
+          else if (arg == "--filter" && i + 1 < argc)
+            filter_ = argv[++i];
+          else if (arg == "--min-time" && i + 1 < argc)
+            min_time_ = atof(argv[++i]);
+          else
+            std::cerr << "ignoring unknown argument: " << arg << std::endl;
+        }
+      }
+
+      // f is called once per iteration, bytes_per_op is only used for reporting throughput
+      template<class F>
+      void run(const std::string& name, F f, uint64_t bytes_per_op = 0) {
+        if (!filter_.empty() && name.find(filter_) == std::string::npos)
+          return;
+
+        f(); // warm up caches and lazily initialized statics
+        uint64_t total = 0;
+        double elapsed = 0;
+        for (uint64_t batch = 1; elapsed < min_time_; batch *= 2) {
+          auto start = std::chrono::steady_clock::now();
+          for (uint64_t i = 0; i != batch; ++i)
+            f();
+          elapsed += std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count();
+          total += batch;
+        }
+
+        result r = { name, total, elapsed * 1e9 / total, bytes_per_op };
+        results_.push_back(r);
+        std::cout << name << ": " << r.ns_per_op << " ns/op, " << total << " iterations";
+        if (bytes_per_op)
+          std::cout << ", " << (bytes_per_op * 1e3 / r.ns_per_op) << " MB/s";
+        std::cout << std::endl;
+      }
+
+      // writes the json report if requested, returns the process exit code
+      int finish() const {
+        if (json_path_.empty())
+          return 0;
+        std::ofstream os(json_path_.c_str());
+        if (!os) {
+          std::cerr << "cannot write " << json_path_ << std::endl;
+          return 1;
+        }
+        write_json(os);
+        return 0;
+      }
+
+      void write_json(std::ostream& os) const {
+        os << "{\n  \"suite\": \"" << escape(name_) << "\",\n  \"timestamp\": " << time(nullptr) << ",\n  \"results\": [";
+        for (size_t i = 0; i != results_.size(); ++i) {
+          const result& r = results_[i];
+          os << (i ? ",\n" : "\n") << "    { \"name\": \"" << escape(r.name) << "\", \"iterations\": " << r.iterations
+            << ", \"ns_per_op\": " << r.ns_per_op << ", \"bytes_per_op\": " << r.bytes_per_op << " }";
+        }
+        os << "\n  ]\n}\n";
+      }
+
+      const std::vector<result>& results() const { return results_; }
+
+      private:
+      static std::string escape(const std::string& s) {
+        std::string e;
+        for (char c : s) {
+          if (c == '"' || c == '\\')
+            e += '\\';
+          e += c;
+        }
+        return e;
+      }
+
+      std::string         name_;
+      std::string         json_path_;
+      std::string         filter_;
+      double              min_time_;
+      std::vector<result> results_;
+    };
+  };
+};
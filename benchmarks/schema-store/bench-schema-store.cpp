@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <avro/Compiler.hh>
+#include <csi_avro_utils/schema_store.h>
+#include <csi_avro_utils/utils.h>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+// resident memory of a registry of schemas held as one compiled avro::ValidSchema per generate_hash (plain)
+// against the same schemas in a csi::schema_store (store). run once per mode, the two do not share a process
+// so freed memory of the first does not hide the cost of the second
+// usage: bench-schema-store plain|store [registry dump, one schema per line]
+// without a dump 200 subjects with 50 versions each are made up, all using the same few named sub-records
+
+static size_t resident_bytes() {
+#ifdef __linux__
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0;
+  size_t resident = 0;
+  statm >> pages >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+#else
+  return 0;
+#endif
+}
+
+static const char* shared_types =
+"{\"name\":\"customer\",\"type\":{\"type\":\"record\",\"name\":\"com.example.customer\",\"fields\":["
+"{\"name\":\"id\",\"type\":\"string\"},"
+"{\"name\":\"name\",\"type\":\"string\"},"
+"{\"name\":\"segment\",\"type\":{\"type\":\"enum\",\"name\":\"com.example.segment\",\"symbols\":[\"RETAIL\",\"SMB\",\"ENTERPRISE\",\"PUBLIC\"]}},"
+"{\"name\":\"billing\",\"type\":{\"type\":\"record\",\"name\":\"com.example.address\",\"fields\":["
+"{\"name\":\"street\",\"type\":\"string\"},{\"name\":\"city\",\"type\":\"string\"},{\"name\":\"zip\",\"type\":\"string\"},"
+"{\"name\":\"country\",\"type\":\"string\"},{\"name\":\"region\",\"type\":[\"null\",\"string\"],\"default\":null}]}},"
+"{\"name\":\"shipping\",\"type\":[\"null\",\"com.example.address\"],\"default\":null}]}},"
+"{\"name\":\"amount\",\"type\":{\"type\":\"record\",\"name\":\"com.example.money\",\"fields\":["
+"{\"name\":\"units\",\"type\":\"long\"},{\"name\":\"nanos\",\"type\":\"int\"},"
+"{\"name\":\"currency\",\"type\":{\"type\":\"enum\",\"name\":\"com.example.currency\",\"symbols\":[\"SEK\",\"NOK\",\"DKK\",\"EUR\",\"USD\",\"GBP\"]}}]}},"
+"{\"name\":\"audit\",\"type\":{\"type\":\"record\",\"name\":\"com.example.audit\",\"fields\":["
+"{\"name\":\"created_by\",\"type\":\"string\"},{\"name\":\"created_at\",\"type\":\"long\"},"
+"{\"name\":\"updated_by\",\"type\":[\"null\",\"string\"],\"default\":null},{\"name\":\"updated_at\",\"type\":[\"null\",\"long\"],\"default\":null},"
+"{\"name\":\"tags\",\"type\":{\"type\":\"map\",\"values\":\"string\"}}]}}";
+
+static std::vector<std::string> made_up_registry() {
+  std::vector<std::string> schemas;
+  for (int subject = 0; subject != 200; ++subject) {
+    for (int version = 0; version != 50; ++version) {
+      std::string s = "{\"type\":\"record\",\"name\":\"com.example.event_" + std::to_string(subject) + "\",\"fields\":[";
+      s += "{\"name\":\"id\",\"type\":\"string\"},{\"name\":\"ts\",\"type\":\"long\"},";
+      s += shared_types;
+      for (int f = 0; f != version; ++f)
+        s += ",{\"name\":\"attribute_" + std::to_string(f) + "\",\"type\":[\"null\",\"string\"],\"default\":null}";
+      s += "]}";
+      schemas.push_back(s);
+    }
+  }
+  return schemas;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2 || (std::string(argv[1]) != "plain" && std::string(argv[1]) != "store")) {
+    std::cerr << "usage: bench-schema-store plain|store [registry dump, one schema per line]" << std::endl;
+    return 1;
+  }
+  const bool use_store = std::string(argv[1]) == "store";
+
+  std::vector<std::string> schemas;
+  if (argc > 2) {
+    std::ifstream in(argv[2]);
+    std::string line;
+    while (std::getline(in, line))
+      if (!line.empty())
+        schemas.push_back(line);
+  } else {
+    schemas = made_up_registry();
+  }
+  size_t text_bytes = 0;
+  for (auto& s : schemas)
+    text_bytes += s.size();
+
+  const size_t before = resident_bytes();
+  auto start = std::chrono::steady_clock::now();
+
+  std::map<boost::uuids::uuid, boost::shared_ptr<const avro::ValidSchema>> plain;
+  csi::schema_store store;
+  for (auto& s : schemas) {
+    if (use_store) {
+      store.intern(s);
+    } else {
+      boost::shared_ptr<const avro::ValidSchema> p(new avro::ValidSchema(avro::compileJsonSchemaFromString(s)));
+      plain.insert(std::make_pair(generate_hash(*p), p));
+    }
+  }
+
+  double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count();
+  const size_t after = resident_bytes();
+  const size_t nr_of_schemas = use_store ? store.size() : plain.size();
+  std::cout << argv[1] << ": " << schemas.size() << " schemas (" << text_bytes / 1024 << " KB json), " << nr_of_schemas << " distinct, "
+            << (after - before) / 1024 << " KB resident, " << (after - before) / std::max<size_t>(1, nr_of_schemas) << " bytes/schema, "
+            << seconds << " s" << std::endl;
+  if (use_store)
+    std::cout << "store: " << store.subtrees() << " shared subtrees, " << store.reused() << " reused" << std::endl;
+  return 0;
+}
@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <cstring>
+#include <avro/Exception.hh>
+#include "arena_decoder.h"
+
+namespace csi {
+  arena::arena(size_t chunk_size)
+    : chunk_size_(chunk_size)
+    , current_(0)
+    , p_(0)
+    , end_(0) {}
+
+  void* arena::allocate(size_t size, size_t align) {
+    uint8_t* p = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(p_) + align - 1) & ~(uintptr_t(align) - 1));
+    if (p_ && p + size <= end_) {
+      p_ = p + size;
+      return p;
+    }
+
+    // next chunk that is large enough, chunks kept from before a reset() are reused in order
+    size_t i = chunks_.empty() ? 0 : current_ + 1;
+    while (i < chunks_.size() && chunks_[i].size < size + align)
+      ++i;
+    if (i == chunks_.size()) {
+      chunk c;
+      c.size = std::max(chunk_size_, size + align);
+      c.data.reset(new uint8_t[c.size]);
+      chunks_.push_back(std::move(c));
+    }
+    current_ = i;
+    p_ = chunks_[i].data.get();
+    end_ = p_ + chunks_[i].size;
+    return allocate(size, align);
+  }
+
+  void arena::reset() {
+    current_ = 0;
+    p_ = chunks_.empty() ? 0 : chunks_[0].data.get();
+    end_ = chunks_.empty() ? 0 : p_ + chunks_[0].size;
+  }
+
+  size_t arena::capacity() const {
+    size_t sz = 0;
+    for (size_t i = 0; i != chunks_.size(); ++i)
+      sz += chunks_[i].size;
+    return sz;
+  }
+
+  size_t arena_datum::size() const {
+    switch (type()) {
+    case avro::AVRO_RECORD:
+    case avro::AVRO_ARRAY:
+    return v_->items.size;
+    case avro::AVRO_MAP:
+    return v_->items.size / 2;
+    case avro::AVRO_STRING:
+    case avro::AVRO_BYTES:
+    case avro::AVRO_FIXED:
+    return v_->bytes.size;
+    default:
+    throw std::bad_cast();
+    };
+  }
+
+  bool arena_datum::hasField(const std::string& name) const {
+    size_t index;
+    return type() == avro::AVRO_RECORD && schema()->nameIndex(name, index);
+  }
+
+  size_t arena_datum::fieldIndex(const std::string& name) const {
+    size_t index;
+    if (type() != avro::AVRO_RECORD || !schema()->nameIndex(name, index))
+      throw std::domain_error(std::string("no such field: ") + name);
+    return index;
+  }
+
+  struct arena_decoder::cursor {
+    const uint8_t* p;
+    const uint8_t* end;
+    arena*         a;
+
+    size_t remaining() const { return end - p; }
+
+    int64_t read_long() {
+      uint64_t n = 0;
+      for (int shift = 0; shift != 70; shift += 7) {
+        if (p == end)
+          throw avro::Exception("arena_decoder: truncated varint");
+        uint8_t b = *p++;
+        n |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80))
+          return static_cast<int64_t>(n >> 1) ^ -static_cast<int64_t>(n & 1);
+      }
+      throw avro::Exception("arena_decoder: varint overflows long");
+    }
+
+    size_t read_length() {
+      int64_t len = read_long();
+      if (len < 0 || static_cast<uint64_t>(len) > remaining())
+        throw avro::Exception("arena_decoder: invalid length");
+      return static_cast<size_t>(len);
+    }
+
+    template<class T> void read_raw(T& v) {
+      if (remaining() < sizeof(T))
+        throw avro::Exception("arena_decoder: truncated value");
+      memcpy(&v, p, sizeof(T)); // avro is little endian
+      p += sizeof(T);
+    }
+
+    void copy_bytes(size_t len, arena_value& dst) {
+      uint8_t* data = static_cast<uint8_t*>(a->allocate(len, 1));
+      memcpy(data, p, len);
+      p += len;
+      dst.bytes.data = data;
+      dst.bytes.size = len;
+    }
+
+    arena_value* allocate_values(size_t n) {
+      return static_cast<arena_value*>(a->allocate(n * sizeof(arena_value), alignof(arena_value)));
+    }
+  };
+
+  arena_decoder::arena_decoder(const avro::ValidSchema& schema, size_t max_depth)
+    : program_(schema)
+    , max_depth_(max_depth) {}
+
+  arena_datum arena_decoder::decode(const uint8_t* data, size_t size, arena& a) const {
+    cursor c = { data, data + size, &a };
+    arena_value* root = c.allocate_values(1);
+    decode(program_.root(), c, *root, 0);
+    if (c.p != c.end)
+      throw avro::Exception("arena_decoder: trailing bytes");
+    return arena_datum(&program_, root);
+  }
+
+  void arena_decoder::decode(uint32_t index, cursor& c, arena_value& dst, size_t depth) const {
+    const schema_program::op& o = program_.at(index);
+    dst.op = index;
+    dst.branch = -1;
+    switch (o.code) {
+    case schema_program::NUL:
+    break;
+    case schema_program::BOOL:
+    if (c.p == c.end || *c.p > 1)
+      throw avro::Exception("arena_decoder: invalid boolean");
+    dst.b = (*c.p++ != 0);
+    break;
+    case schema_program::INT:
+    {
+      int64_t v = c.read_long();
+      if (v < INT32_MIN || v > INT32_MAX)
+        throw avro::Exception("arena_decoder: varint overflows int");
+      dst.i = static_cast<int32_t>(v);
+    }
+    break;
+    case schema_program::LONG:
+    dst.l = c.read_long();
+    break;
+    case schema_program::FLOAT:
+    c.read_raw(dst.f);
+    break;
+    case schema_program::DOUBLE:
+    c.read_raw(dst.d);
+    break;
+    case schema_program::STRING:
+    case schema_program::BYTES:
+    c.copy_bytes(c.read_length(), dst);
+    break;
+    case schema_program::FIXED:
+    if (c.remaining() < o.size)
+      throw avro::Exception("arena_decoder: truncated fixed");
+    c.copy_bytes(o.size, dst);
+    break;
+    case schema_program::ENUM:
+    {
+      int64_t v = c.read_long();
+      if (v < 0 || v >= o.size)
+        throw avro::Exception("arena_decoder: enum index out of range");
+      dst.i = static_cast<int32_t>(v);
+    }
+    break;
+    case schema_program::UNION:
+    {
+      int64_t v = c.read_long();
+      if (v < 0 || v >= o.size)
+        throw avro::Exception("arena_decoder: union branch out of range");
+      decode(program_.child(o, static_cast<size_t>(v)), c, dst, depth);
+      dst.branch = static_cast<int32_t>(v);
+    }
+    break;
+    case schema_program::RECORD:
+    {
+      if (depth == max_depth_)
+        throw avro::Exception("arena_decoder: nesting too deep");
+      arena_value* fields = c.allocate_values(o.size);
+      for (size_t i = 0; i != o.size; ++i)
+        decode(program_.child(o, i), c, fields[i], depth + 1);
+      dst.items.data = fields;
+      dst.items.size = o.size;
+    }
+    break;
+    case schema_program::ARRAY:
+    case schema_program::MAP:
+    {
+      if (depth == max_depth_)
+        throw avro::Exception("arena_decoder: nesting too deep");
+      // maps are stored as key, value pairs. when a later block does not fit the items are moved,
+      // the old space is only given back on reset
+      const size_t per_item = (o.code == schema_program::MAP) ? 2 : 1;
+      // items that are not always empty take at least a byte, even a record still being compiled when min_bytes was set
+      const schema_program::op& item = program_.at(o.children);
+      const uint32_t item_min = (item.empty ? 0 : std::max<uint32_t>(item.min_bytes, 1)) + (per_item - 1);
+      arena_value* items = 0;
+      size_t size = 0;
+      size_t capacity = 0;
+      while (true) {
+        int64_t count = c.read_long();
+        if (count == 0)
+          break;
+        if (count < 0) {
+          if (count == INT64_MIN)
+            throw avro::Exception("arena_decoder: invalid block count");
+          count = -count;
+          c.read_length(); // block size in bytes
+        }
+        // bounds the allocation by the message size, items that always encode to nothing (null) are limited to 1M
+        // over all blocks
+        if (item_min ? static_cast<uint64_t>(count) > c.remaining() / item_min : size + static_cast<uint64_t>(count) > 1024 * 1024)
+          throw avro::Exception("arena_decoder: block count exceeds message");
+        if (size + count > capacity) {
+          capacity = std::max<size_t>(size + count, 2 * capacity);
+          arena_value* grown = c.allocate_values(capacity * per_item);
+          if (size)
+            memcpy(grown, items, size * per_item * sizeof(arena_value));
+          items = grown;
+        }
+        for (int64_t i = 0; i != count; ++i, ++size) {
+          if (per_item == 2) {
+            arena_value& key = items[2 * size];
+            key.op = o.size;
+            key.branch = -1;
+            c.copy_bytes(c.read_length(), key);
+          }
+          decode(o.children, c, items[size * per_item + per_item - 1], depth + 1);
+        }
+      }
+      dst.items.data = items;
+      dst.items.size = size * per_item;
+    }
+    break;
+    };
+  }
+};
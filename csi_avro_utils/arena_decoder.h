@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <typeinfo>
+#include <avro/ValidSchema.hh>
+#include "schema_program.h"
+
+#pragma once
+
+namespace csi {
+  // bump allocator for decoded messages, nothing is freed until reset() which is O(1) and keeps the memory
+  // decode a message or a whole batch into one arena and reset it when the datums are no longer used
+  class arena {
+    public:
+    explicit arena(size_t chunk_size = 64 * 1024);
+
+    void*  allocate(size_t size, size_t align = 8);
+    void   reset();
+    size_t capacity() const; // bytes held, used or not
+
+    private:
+    arena(const arena&);
+    arena& operator=(const arena&);
+
+    struct chunk {
+      std::unique_ptr<uint8_t[]> data;
+      size_t                     size;
+    };
+    size_t             chunk_size_;
+    std::vector<chunk> chunks_;
+    size_t             current_;
+    uint8_t*           p_;
+    uint8_t*           end_;
+  };
+
+  // a decoded value, lives in an arena. strings and bytes are copied into the arena as well
+  struct arena_value {
+    uint32_t op;     // schema_program op, for unions the op of the selected branch
+    int32_t  branch; // union branch, -1 if not a union
+    union {
+      bool    b;
+      int32_t i;     // int and enum index
+      int64_t l;
+      float   f;
+      double  d;
+      struct {
+        const uint8_t* data;
+        size_t         size;
+      } bytes;       // string, bytes, fixed
+      struct {
+        const arena_value* data;
+        size_t             size;
+      } items;       // record fields, array items, map key, value pairs
+    };
+  };
+
+  // read only view of a decoded value with the GenericDatum / GenericRecord accessors that
+  // get_field_by_name and avro_hive::get_key need. valid as long as the arena and the decoder are
+  class arena_datum {
+    public:
+    arena_datum() : program_(0), v_(0) {}
+    arena_datum(const schema_program* program, const arena_value* v) : program_(program), v_(v) {}
+
+    avro::Type           type() const { return program_->at(v_->op).node->type(); } // looks through unions
+    bool                 isUnion() const { return v_->branch >= 0; }
+    size_t               unionBranch() const { return static_cast<size_t>(v_->branch); }
+    const avro::NodePtr& schema() const { return program_->at(v_->op).node; }
+
+    // bool, int32_t, int64_t, float, double, std::string and std::vector<uint8_t> (bytes and fixed)
+    template<class T> T value() const;
+
+    // string, bytes and fixed without copying
+    const uint8_t* data() const { return v_->bytes.data; }
+
+    // record fields, array items or map entries, string / bytes / fixed length
+    size_t size() const;
+
+    // records
+    bool        hasField(const std::string& name) const;
+    size_t      fieldIndex(const std::string& name) const; // throws std::domain_error
+    arena_datum fieldAt(size_t i) const { return arena_datum(program_, v_->items.data + i); }
+    arena_datum field(const std::string& name) const { return fieldAt(fieldIndex(name)); }
+
+    // arrays and maps, for maps at() is the value and key() the key
+    arena_datum at(size_t i) const { return arena_datum(program_, v_->items.data + (type() == avro::AVRO_MAP ? 2 * i + 1 : i)); }
+    arena_datum key(size_t i) const { return arena_datum(program_, v_->items.data + 2 * i); }
+
+    // enums
+    size_t             enum_index() const { return static_cast<size_t>(v_->i); }
+    const std::string& symbol() const { return schema()->nameAt(v_->i); }
+
+    private:
+    void check(avro::Type t) const {
+      if (type() != t)
+        throw std::bad_cast();
+    }
+
+    const schema_program* program_;
+    const arena_value*    v_;
+  };
+
+  template<> inline bool arena_datum::value<bool>() const { check(avro::AVRO_BOOL); return v_->b; }
+  template<> inline int32_t arena_datum::value<int32_t>() const { check(avro::AVRO_INT); return v_->i; }
+  template<> inline int64_t arena_datum::value<int64_t>() const { check(avro::AVRO_LONG); return v_->l; }
+  template<> inline float arena_datum::value<float>() const { check(avro::AVRO_FLOAT); return v_->f; }
+  template<> inline double arena_datum::value<double>() const { check(avro::AVRO_DOUBLE); return v_->d; }
+
+  template<> inline std::string arena_datum::value<std::string>() const {
+    check(avro::AVRO_STRING);
+    return std::string(reinterpret_cast<const char*>(v_->bytes.data), v_->bytes.size);
+  }
+
+  template<> inline std::vector<uint8_t> arena_datum::value<std::vector<uint8_t>>() const {
+    if (type() != avro::AVRO_FIXED)
+      check(avro::AVRO_BYTES);
+    return std::vector<uint8_t>(v_->bytes.data, v_->bytes.data + v_->bytes.size);
+  }
+
+  // decodes avro binary messages into an arena instead of a GenericDatum tree
+  // one decoder can be used from many threads, each with its own arena
+  class arena_decoder {
+    public:
+    explicit arena_decoder(const avro::ValidSchema& schema, size_t max_depth = 256); // max_depth limits nesting in recursive schemas
+
+    // the message must be exactly one value, throws avro::Exception otherwise
+    arena_datum decode(const uint8_t* data, size_t size, arena& a) const;
+    arena_datum decode(const std::vector<uint8_t>& data, arena& a) const { return decode(data.data(), data.size(), a); }
+
+    const schema_program& program() const { return program_; }
+
+    private:
+    struct cursor;
+    void decode(uint32_t index, cursor& c, arena_value& dst, size_t depth) const;
+
+    schema_program program_;
+    size_t         max_depth_;
+  };
+};
+
+// get_field_by_name (utils.h) for arena decoded records
+template<typename T> T get_field_by_name(const csi::arena_datum& record, const std::string& field_name) {
+  if(record.type() != avro::AVRO_RECORD)
+    throw std::domain_error(std::string("expected: AVRO_RECORD, actual: ") + avro::toString(record.type()));
+  if(!record.hasField(field_name))
+    throw std::domain_error(std::string("no such field: ") + field_name);
+  return record.field(field_name).value<T>(); // looks through unions
+}
@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <boost/array.hpp>
+#include "logical_types.h"
+
+#pragma once
+
+// fast non cryptographic hashing of avro values, used by csi_avrogencpp --operators generated code
+// hash_value() overloads for the c++ types that avro maps to, generated types add their own in their namespace
+// the values depend on the platform (size_t, endianess) so do not persist them
+
+namespace csi {
+  namespace avro_hash {
+    const uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+    // murmur3 finalizer
+    inline uint64_t mix(uint64_t k) {
+      k ^= k >> 33;
+      k *= 0xff51afd7ed558ccdULL;
+      k ^= k >> 33;
+      k *= 0xc4ceb9fe1a85ec53ULL;
+      k ^= k >> 33;
+      return k;
+    }
+
+    inline size_t combine(size_t h, size_t v) {
+      return static_cast<size_t>(mix(h ^ (v + seed + (h << 6) + (h >> 2))));
+    }
+
+    // MurmurHash64A
+    inline size_t hash_bytes(const void* data, size_t len) {
+      const uint64_t m = 0xc6a4a7935bd1e995ULL;
+      const int r = 47;
+      uint64_t h = seed ^ (len * m);
+      const uint8_t* p = static_cast<const uint8_t*>(data);
+      const uint8_t* end = p + (len & ~static_cast<size_t>(7));
+      for (; p != end; p += 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+      }
+      switch (len & 7) {
+      case 7: h ^= uint64_t(p[6]) << 48; // fall through
+      case 6: h ^= uint64_t(p[5]) << 40; // fall through
+      case 5: h ^= uint64_t(p[4]) << 32; // fall through
+      case 4: h ^= uint64_t(p[3]) << 24; // fall through
+      case 3: h ^= uint64_t(p[2]) << 16; // fall through
+      case 2: h ^= uint64_t(p[1]) << 8; // fall through
+      case 1: h ^= uint64_t(p[0]);
+        h *= m;
+      };
+      h ^= h >> r;
+      h *= m;
+      h ^= h >> r;
+      return static_cast<size_t>(h);
+    }
+
+    inline size_t hash_value(bool v) { return static_cast<size_t>(mix(v ? 1 : 0)); }
+    inline size_t hash_value(int32_t v) { return static_cast<size_t>(mix(static_cast<uint64_t>(static_cast<int64_t>(v)))); }
+    inline size_t hash_value(int64_t v) { return static_cast<size_t>(mix(static_cast<uint64_t>(v))); }
+
+    // -0.0 == 0.0 so they must hash the same
+    inline size_t hash_value(float v) {
+      if (v == 0)
+        v = 0;
+      uint32_t bits;
+      memcpy(&bits, &v, sizeof(bits));
+      return static_cast<size_t>(mix(bits));
+    }
+
+    inline size_t hash_value(double v) {
+      if (v == 0)
+        v = 0;
+      uint64_t bits;
+      memcpy(&bits, &v, sizeof(bits));
+      return static_cast<size_t>(mix(bits));
+    }
+
+    inline size_t hash_value(const std::string& v) { return hash_bytes(v.data(), v.size()); }
+    inline size_t hash_value(const std::vector<uint8_t>& v) { return hash_bytes(v.data(), v.size()); }
+    template<size_t N> inline size_t hash_value(const boost::array<uint8_t, N>& v) { return hash_bytes(v.data(), N); }
+
+    // logical types, see logical_types.h. csi::uuid uses the hash_value() of boost::uuids::uuid
+    template<int S, size_t F> inline size_t hash_value(const decimal64<S, F>& v) { return hash_value(v.unscaled); }
+    template<int S, size_t F> inline size_t hash_value(const decimal128<S, F>& v) { return combine(hash_value(v.hi), static_cast<size_t>(mix(v.lo))); }
+    template<class C, class D> inline size_t hash_value(const std::chrono::time_point<C, D>& v) { return hash_value(static_cast<int64_t>(v.time_since_epoch().count())); }
+    template<class R, class P> inline size_t hash_value(const std::chrono::duration<R, P>& v) { return hash_value(static_cast<int64_t>(v.count())); }
+
+    template<class T> size_t hash_value(const std::vector<T>& v);
+    template<class T> size_t hash_value(const std::map<std::string, T>& v);
+
+    template<class T> size_t hash_value(const std::vector<T>& v) {
+      size_t h = combine(seed, v.size());
+      for (typename std::vector<T>::const_iterator i = v.begin(); i != v.end(); ++i)
+        h = combine(h, hash_value(*i));
+      return h;
+    }
+
+    // std::map is ordered so equal maps hash the same
+    template<class T> size_t hash_value(const std::map<std::string, T>& v) {
+      size_t h = combine(seed, v.size());
+      for (typename std::map<std::string, T>::const_iterator i = v.begin(); i != v.end(); ++i)
+        h = combine(combine(h, hash_value(i->first)), hash_value(i->second));
+      return h;
+    }
+
+    // for containers keyed on types that cannot have a std::hash, ie fixed
+    struct hasher {
+      template<class T> size_t operator()(const T& v) const {
+        using csi::avro_hash::hash_value;
+        return hash_value(v);
+      }
+    };
+  };
+};
@@ -0,0 +1,567 @@
+#include "binary_codec.h"
+#include <cstring>
+#include <algorithm>
+#include <avro/Exception.hh>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CSI_BINARY_CODEC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_X64) || defined(_M_IX86)
+#define CSI_BINARY_CODEC_LITTLE_ENDIAN 1
+#endif
+
+namespace csi {
+  static inline int64_t unzigzag(uint64_t v) { return static_cast<int64_t>((v >> 1) ^ (0 - (v & 1))); }
+  static inline uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+
+  static inline int32_t to_int(int64_t v) {
+    if (v < INT32_MIN || v > INT32_MAX)
+      throw avro::Exception("Value out of range for Avro int");
+    return static_cast<int32_t>(v);
+  }
+
+  // avro floats and doubles are little endian
+  template<class T> static inline void load_le(const uint8_t* p, T* out, size_t n) {
+#ifdef CSI_BINARY_CODEC_LITTLE_ENDIAN
+    memcpy(out, p, n * sizeof(T));
+#else
+    for (size_t i = 0; i != n; ++i, p += sizeof(T)) {
+      uint8_t b[sizeof(T)];
+      for (size_t j = 0; j != sizeof(T); ++j)
+        b[j] = p[sizeof(T) - 1 - j];
+      memcpy(out + i, b, sizeof(T));
+    }
+#endif
+  }
+
+  template<class T> static inline void store_le(const T* v, uint8_t* p, size_t n) {
+#ifdef CSI_BINARY_CODEC_LITTLE_ENDIAN
+    memcpy(p, v, n * sizeof(T));
+#else
+    for (size_t i = 0; i != n; ++i, p += sizeof(T)) {
+      uint8_t b[sizeof(T)];
+      memcpy(b, v + i, sizeof(T));
+      for (size_t j = 0; j != sizeof(T); ++j)
+        p[j] = b[sizeof(T) - 1 - j];
+    }
+#endif
+  }
+
+#ifdef CSI_BINARY_CODEC_SSE2
+  static inline unsigned trailing_zeros(unsigned v) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, v);
+    return i;
+#else
+    return __builtin_ctz(v);
+#endif
+  }
+
+  // 16 single byte varints to 8 bit signed values widened to 16 bits, lo and hi half
+  static inline void unzigzag16(__m128i b, __m128i& lo, __m128i& hi) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    lo = _mm_unpacklo_epi8(b, zero);
+    hi = _mm_unpackhi_epi8(b, zero);
+    lo = _mm_xor_si128(_mm_srli_epi16(lo, 1), _mm_sub_epi16(zero, _mm_and_si128(lo, one)));
+    hi = _mm_xor_si128(_mm_srli_epi16(hi, 1), _mm_sub_epi16(zero, _mm_and_si128(hi, one)));
+  }
+
+  static inline void store_int32x8(__m128i v16, int32_t* out) {
+    const __m128i sign = _mm_srai_epi16(v16, 15);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(v16, sign));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi16(v16, sign));
+  }
+
+  static inline void store_int64x4(__m128i v32, int64_t* out) {
+    const __m128i sign = _mm_srai_epi32(v32, 31);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi32(v32, sign));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2), _mm_unpackhi_epi32(v32, sign));
+  }
+
+  static inline void store_int64x8(__m128i v16, int64_t* out) {
+    const __m128i sign = _mm_srai_epi16(v16, 15);
+    store_int64x4(_mm_unpacklo_epi16(v16, sign), out);
+    store_int64x4(_mm_unpackhi_epi16(v16, sign), out + 4);
+  }
+#endif
+
+  binary_decoder::binary_decoder()
+    : p_(nullptr)
+    , end_(nullptr)
+    , stream_(nullptr)
+    , copied_(false) {}
+
+  void binary_decoder::init(const uint8_t* data, size_t size) {
+    p_ = data;
+    end_ = data + size;
+    stream_ = nullptr;
+    copied_ = false;
+  }
+
+  void binary_decoder::init(avro::InputStream& is) {
+    stream_ = &is;
+    copied_ = false;
+    const uint8_t* data;
+    size_t         size;
+    if (!is.next(&data, &size)) {
+      p_ = end_ = nullptr;
+      return;
+    }
+    const uint8_t* more;
+    size_t         more_size;
+    if (!is.next(&more, &more_size)) {
+      p_ = data;
+      end_ = data + size;
+      return;
+    }
+    buffer_.assign(data, data + size);
+    do {
+      buffer_.insert(buffer_.end(), more, more + more_size);
+    } while (is.next(&more, &more_size));
+    copied_ = true;
+    p_ = buffer_.data();
+    end_ = p_ + buffer_.size();
+  }
+
+  void binary_decoder::drain() {
+    if (stream_ && !copied_ && p_ != end_)
+      stream_->backup(end_ - p_);
+    p_ = end_;
+  }
+
+  const uint8_t* binary_decoder::take(size_t n) {
+    if (static_cast<size_t>(end_ - p_) < n)
+      throw avro::Exception("EOF reached");
+    const uint8_t* p = p_;
+    p_ += n;
+    return p;
+  }
+
+  uint64_t binary_decoder::read_varint() {
+    const uint8_t* p = p_;
+    uint64_t       v = 0;
+    for (int shift = 0;; shift += 7) {
+      if (p == end_)
+        throw avro::Exception("EOF reached");
+      if (shift > 63)
+        throw avro::Exception("Invalid Integer");
+      uint8_t b = *p++;
+      v |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if (b < 0x80)
+        break;
+    }
+    p_ = p;
+    return v;
+  }
+
+  int64_t binary_decoder::read_long() {
+    return unzigzag(read_varint());
+  }
+
+  size_t binary_decoder::read_size() {
+    int64_t n = read_long();
+    if (n < 0 || static_cast<uint64_t>(n) > static_cast<uint64_t>(end_ - p_))
+      throw avro::Exception("EOF reached");
+    return static_cast<size_t>(n);
+  }
+
+  // item count of an array or map block, blocks with a negative count also carry their size in bytes
+  size_t binary_decoder::read_count() {
+    int64_t n = read_long();
+    if (n < 0) {
+      read_long();
+      n = -n;
+    }
+    return static_cast<size_t>(n);
+  }
+
+  bool binary_decoder::decodeBool() {
+    uint8_t b = *take(1);
+    if (b > 1)
+      throw avro::Exception("Invalid value for bool");
+    return b == 1;
+  }
+
+  int32_t binary_decoder::decodeInt() {
+    return to_int(read_long());
+  }
+
+  int64_t binary_decoder::decodeLong() {
+    return read_long();
+  }
+
+  float binary_decoder::decodeFloat() {
+    float v;
+    load_le(take(4), &v, 1);
+    return v;
+  }
+
+  double binary_decoder::decodeDouble() {
+    double v;
+    load_le(take(8), &v, 1);
+    return v;
+  }
+
+  void binary_decoder::decodeString(std::string& value) {
+    size_t n = read_size();
+    value.assign(reinterpret_cast<const char*>(take(n)), n);
+  }
+
+  void binary_decoder::skipString() {
+    take(read_size());
+  }
+
+  void binary_decoder::decodeBytes(std::vector<uint8_t>& value) {
+    size_t n = read_size();
+    const uint8_t* p = take(n);
+    value.assign(p, p + n);
+  }
+
+  void binary_decoder::skipBytes() {
+    take(read_size());
+  }
+
+  void binary_decoder::decodeFixed(size_t n, std::vector<uint8_t>& value) {
+    const uint8_t* p = take(n);
+    value.assign(p, p + n);
+  }
+
+  void binary_decoder::skipFixed(size_t n) {
+    take(n);
+  }
+
+  size_t binary_decoder::decodeEnum() {
+    int64_t v = read_long();
+    if (v < 0)
+      throw avro::Exception("Invalid enum index");
+    return static_cast<size_t>(v);
+  }
+
+  size_t binary_decoder::arrayStart() {
+    return read_count();
+  }
+
+  size_t binary_decoder::arrayNext() {
+    return read_count();
+  }
+
+  // skips the blocks that carry their size, returns the item count of a block that does not (0 at the end)
+  size_t binary_decoder::skipArray() {
+    for (;;) {
+      int64_t n = read_long();
+      if (n >= 0)
+        return static_cast<size_t>(n);
+      take(read_size());
+    }
+  }
+
+  size_t binary_decoder::mapStart() {
+    return read_count();
+  }
+
+  size_t binary_decoder::mapNext() {
+    return read_count();
+  }
+
+  size_t binary_decoder::skipMap() {
+    return skipArray();
+  }
+
+  size_t binary_decoder::decodeUnionIndex() {
+    int64_t v = read_long();
+    if (v < 0)
+      throw avro::Exception("Invalid union index");
+    return static_cast<size_t>(v);
+  }
+
+  void binary_decoder::decode_items(int32_t* out, size_t n) {
+    size_t i = 0;
+#ifdef CSI_BINARY_CODEC_SSE2
+    while (n - i >= 16 && end_ - p_ >= 16) {
+      __m128i  b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_));
+      unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(b));
+      if (mask == 0) {
+        __m128i lo, hi;
+        unzigzag16(b, lo, hi);
+        store_int32x8(lo, out + i);
+        store_int32x8(hi, out + i + 8);
+        p_ += 16;
+        i += 16;
+        continue;
+      }
+      // the single byte values before the first longer one, then that one
+      unsigned run = trailing_zeros(mask);
+      for (unsigned j = 0; j != run; ++j)
+        out[i++] = static_cast<int32_t>(unzigzag(p_[j]));
+      p_ += run;
+      out[i++] = to_int(read_long());
+    }
+#endif
+    for (; i != n; ++i)
+      out[i] = to_int(read_long());
+  }
+
+  void binary_decoder::decode_items(int64_t* out, size_t n) {
+    size_t i = 0;
+#ifdef CSI_BINARY_CODEC_SSE2
+    while (n - i >= 16 && end_ - p_ >= 16) {
+      __m128i  b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_));
+      unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(b));
+      if (mask == 0) {
+        __m128i lo, hi;
+        unzigzag16(b, lo, hi);
+        store_int64x8(lo, out + i);
+        store_int64x8(hi, out + i + 8);
+        p_ += 16;
+        i += 16;
+        continue;
+      }
+      unsigned run = trailing_zeros(mask);
+      for (unsigned j = 0; j != run; ++j)
+        out[i++] = unzigzag(p_[j]);
+      p_ += run;
+      out[i++] = read_long();
+    }
+#endif
+    for (; i != n; ++i)
+      out[i] = read_long();
+  }
+
+  void binary_decoder::decode_items(float* out, size_t n) {
+    if (n > remaining() / sizeof(float))
+      throw avro::Exception("EOF reached");
+    load_le(take(n * sizeof(float)), out, n);
+  }
+
+  void binary_decoder::decode_items(double* out, size_t n) {
+    if (n > remaining() / sizeof(double))
+      throw avro::Exception("EOF reached");
+    load_le(take(n * sizeof(double)), out, n);
+  }
+
+  binary_encoder::binary_encoder()
+    : os_(nullptr)
+    , p_(nullptr)
+    , end_(nullptr) {}
+
+  void binary_encoder::init(avro::OutputStream& os) {
+    os_ = &os;
+    p_ = end_ = nullptr;
+  }
+
+  void binary_encoder::flush() {
+    if (!os_)
+      return;
+    if (p_ != end_)
+      os_->backup(end_ - p_);
+    p_ = end_ = nullptr;
+    os_->flush();
+  }
+
+  int64_t binary_encoder::byteCount() const {
+    return os_ ? static_cast<int64_t>(os_->byteCount()) - (end_ - p_) : 0;
+  }
+
+  void binary_encoder::next_chunk() {
+    size_t len = 0;
+    while (len == 0) {
+      if (!os_->next(&p_, &len))
+        throw avro::Exception("EOF reached");
+    }
+    end_ = p_ + len;
+  }
+
+  void binary_encoder::write(const uint8_t* data, size_t len) {
+    while (len) {
+      if (p_ == end_)
+        next_chunk();
+      size_t n = std::min(len, static_cast<size_t>(end_ - p_));
+      memcpy(p_, data, n);
+      p_ += n;
+      data += n;
+      len -= n;
+    }
+  }
+
+  void binary_encoder::write_varint(uint64_t v) {
+    if (end_ - p_ >= 10) {
+      while (v >= 0x80) {
+        *p_++ = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+      }
+      *p_++ = static_cast<uint8_t>(v);
+      return;
+    }
+    uint8_t buf[10];
+    size_t  n = 0;
+    while (v >= 0x80) {
+      buf[n++] = static_cast<uint8_t>(v | 0x80);
+      v >>= 7;
+    }
+    buf[n++] = static_cast<uint8_t>(v);
+    write(buf, n);
+  }
+
+  void binary_encoder::encodeBool(bool b) {
+    uint8_t v = b ? 1 : 0;
+    write(&v, 1);
+  }
+
+  void binary_encoder::encodeInt(int32_t i) {
+    write_varint(zigzag(i));
+  }
+
+  void binary_encoder::encodeLong(int64_t l) {
+    write_varint(zigzag(l));
+  }
+
+  void binary_encoder::encodeFloat(float f) {
+    uint8_t buf[4];
+    store_le(&f, buf, 1);
+    write(buf, 4);
+  }
+
+  void binary_encoder::encodeDouble(double d) {
+    uint8_t buf[8];
+    store_le(&d, buf, 1);
+    write(buf, 8);
+  }
+
+  void binary_encoder::encodeString(const std::string& s) {
+    write_varint(zigzag(static_cast<int64_t>(s.size())));
+    write(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+  }
+
+  void binary_encoder::encodeBytes(const uint8_t* bytes, size_t len) {
+    write_varint(zigzag(static_cast<int64_t>(len)));
+    write(bytes, len);
+  }
+
+  void binary_encoder::encodeFixed(const uint8_t* bytes, size_t len) {
+    write(bytes, len);
+  }
+
+  void binary_encoder::encodeEnum(size_t e) {
+    write_varint(zigzag(static_cast<int64_t>(e)));
+  }
+
+  void binary_encoder::arrayEnd() {
+    write_varint(0);
+  }
+
+  void binary_encoder::mapEnd() {
+    write_varint(0);
+  }
+
+  void binary_encoder::setItemCount(size_t count) {
+    if (count == 0)
+      throw avro::Exception("Count cannot be zero");
+    write_varint(zigzag(static_cast<int64_t>(count)));
+  }
+
+  void binary_encoder::encodeUnionIndex(size_t e) {
+    write_varint(zigzag(static_cast<int64_t>(e)));
+  }
+
+  void binary_encoder::encode_items(const int32_t* v, size_t n) {
+    size_t i = 0;
+#ifdef CSI_BINARY_CODEC_SSE2
+    // 16 values in -64..63 are 16 single bytes
+    const __m128i high = _mm_set1_epi32(~0x7f);
+    const __m128i zero = _mm_setzero_si128();
+    for (; n - i >= 16; i += 16) {
+      __m128i z[4];
+      __m128i any = zero;
+      for (int k = 0; k != 4; ++k) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i + 4 * k));
+        z[k] = _mm_xor_si128(_mm_slli_epi32(x, 1), _mm_srai_epi32(x, 31));
+        any = _mm_or_si128(any, z[k]);
+      }
+      if (end_ - p_ >= 16 && _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(any, high), zero)) == 0xffff) {
+        __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(z[0], z[1]), _mm_packs_epi32(z[2], z[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_), bytes);
+        p_ += 16;
+      } else {
+        for (size_t j = i; j != i + 16; ++j)
+          write_varint(zigzag(v[j]));
+      }
+    }
+#endif
+    for (; i != n; ++i)
+      write_varint(zigzag(v[i]));
+  }
+
+  void binary_encoder::encode_items(const int64_t* v, size_t n) {
+    for (size_t i = 0; i != n; ++i)
+      write_varint(zigzag(v[i]));
+  }
+
+  void binary_encoder::encode_items(const float* v, size_t n) {
+#ifdef CSI_BINARY_CODEC_LITTLE_ENDIAN
+    write(reinterpret_cast<const uint8_t*>(v), n * sizeof(float));
+#else
+    for (size_t i = 0; i != n; ++i)
+      encodeFloat(v[i]);
+#endif
+  }
+
+  void binary_encoder::encode_items(const double* v, size_t n) {
+#ifdef CSI_BINARY_CODEC_LITTLE_ENDIAN
+    write(reinterpret_cast<const uint8_t*>(v), n * sizeof(double));
+#else
+    for (size_t i = 0; i != n; ++i)
+      encodeDouble(v[i]);
+#endif
+  }
+
+  namespace bulk {
+    template<class T> static void encode_array(avro::Encoder& e, const std::vector<T>& v) {
+      binary_encoder* be = dynamic_cast<binary_encoder*>(&e);
+      if (!be) {
+        avro::encode(e, v);
+        return;
+      }
+      be->arrayStart();
+      if (!v.empty()) {
+        be->setItemCount(v.size());
+        be->encode_items(v.data(), v.size());
+      }
+      be->arrayEnd();
+    }
+
+    // every item is at least min_item_size bytes, a block count beyond the data is rejected before resizing
+    template<class T> static void decode_array(avro::Decoder& d, std::vector<T>& v, size_t min_item_size) {
+      binary_decoder* bd = dynamic_cast<binary_decoder*>(&d);
+      if (!bd) {
+        avro::decode(d, v);
+        return;
+      }
+      v.clear();
+      for (size_t n = bd->arrayStart(); n != 0; n = bd->arrayNext()) {
+        if (n > bd->remaining() / min_item_size)
+          throw avro::Exception("EOF reached");
+        size_t first = v.size();
+        v.resize(first + n);
+        bd->decode_items(&v[first], n);
+      }
+    }
+
+    void encode(avro::Encoder& e, const std::vector<int32_t>& v) { encode_array(e, v); }
+    void encode(avro::Encoder& e, const std::vector<int64_t>& v) { encode_array(e, v); }
+    void encode(avro::Encoder& e, const std::vector<float>& v) { encode_array(e, v); }
+    void encode(avro::Encoder& e, const std::vector<double>& v) { encode_array(e, v); }
+
+    void decode(avro::Decoder& d, std::vector<int32_t>& v) { decode_array(d, v, 1); }
+    void decode(avro::Decoder& d, std::vector<int64_t>& v) { decode_array(d, v, 1); }
+    void decode(avro::Decoder& d, std::vector<float>& v) { decode_array(d, v, sizeof(float)); }
+    void decode(avro::Decoder& d, std::vector<double>& v) { decode_array(d, v, sizeof(double)); }
+  };
+};
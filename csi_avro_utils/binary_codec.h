@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <avro/Encoder.hh>
+#include <avro/Decoder.hh>
+#include <avro/Specific.hh>
+#include <avro/Stream.hh>
+
+#pragma once
+
+// avro binary encoder and decoder that can be used instead of avro::binaryEncoder() / avro::binaryDecoder()
+// and that also take arrays of int, long, float and double in bulk. csi::bulk::encode / decode use the bulk
+// path when given one of these and fall back to avro::encode / decode for any other encoder or decoder, so
+// csi_avrogencpp --bulk-arrays generated code works with both
+//
+// varints are decoded 16 bytes at a time with SSE2 where available (runs of single byte values, ie small
+// samples and deltas, are decoded without a branch per value), float and double blocks are copied as is on
+// little endian hosts
+
+namespace csi {
+  // decodes from one contiguous buffer
+  class binary_decoder : public avro::Decoder {
+    public:
+    binary_decoder();
+
+    // data must outlive the decode
+    void init(const uint8_t* data, size_t size);
+
+    // takes the rest of the stream, copied if it is not one contiguous chunk. for message sized streams,
+    // not for streaming a data file
+    void init(avro::InputStream& is);
+
+    void    decodeNull() {}
+    bool    decodeBool();
+    int32_t decodeInt();
+    int64_t decodeLong();
+    float   decodeFloat();
+    double  decodeDouble();
+    void    decodeString(std::string& value);
+    void    skipString();
+    void    decodeBytes(std::vector<uint8_t>& value);
+    void    skipBytes();
+    void    decodeFixed(size_t n, std::vector<uint8_t>& value);
+    void    skipFixed(size_t n);
+    size_t  decodeEnum();
+    size_t  arrayStart();
+    size_t  arrayNext();
+    size_t  skipArray();
+    size_t  mapStart();
+    size_t  mapNext();
+    size_t  skipMap();
+    size_t  decodeUnionIndex();
+    void    drain(); // gives the undecoded bytes back to the stream given to init
+
+    // n items of one array block
+    void decode_items(int32_t* out, size_t n);
+    void decode_items(int64_t* out, size_t n);
+    void decode_items(float* out, size_t n);
+    void decode_items(double* out, size_t n);
+
+    size_t remaining() const { return end_ - p_; }
+
+    private:
+    uint64_t       read_varint();
+    int64_t        read_long();
+    size_t         read_size();
+    size_t         read_count();
+    const uint8_t* take(size_t n);
+
+    const uint8_t*       p_;
+    const uint8_t*       end_;
+    avro::InputStream*   stream_;  // to give back unused bytes in drain()
+    bool                 copied_;  // stream_ contents were concatenated into buffer_
+    std::vector<uint8_t> buffer_;
+  };
+
+  // encodes into the chunks of an avro::OutputStream
+  class binary_encoder : public avro::Encoder {
+    public:
+    binary_encoder();
+
+    void    init(avro::OutputStream& os);
+    void    flush();
+    int64_t byteCount() const;
+
+    void encodeNull() {}
+    void encodeBool(bool b);
+    void encodeInt(int32_t i);
+    void encodeLong(int64_t l);
+    void encodeFloat(float f);
+    void encodeDouble(double d);
+    void encodeString(const std::string& s);
+    void encodeBytes(const uint8_t* bytes, size_t len);
+    void encodeFixed(const uint8_t* bytes, size_t len);
+    void encodeEnum(size_t e);
+    void arrayStart() {}
+    void arrayEnd();
+    void mapStart() {}
+    void mapEnd();
+    void setItemCount(size_t count);
+    void startItem() {}
+    void encodeUnionIndex(size_t e);
+
+    // n items of one array block, after setItemCount(n)
+    void encode_items(const int32_t* v, size_t n);
+    void encode_items(const int64_t* v, size_t n);
+    void encode_items(const float* v, size_t n);
+    void encode_items(const double* v, size_t n);
+
+    private:
+    void write_varint(uint64_t v);
+    void write(const uint8_t* data, size_t len);
+    void next_chunk();
+
+    avro::OutputStream* os_;
+    uint8_t*            p_;
+    uint8_t*            end_;
+  };
+
+  namespace bulk {
+    void encode(avro::Encoder& e, const std::vector<int32_t>& v);
+    void encode(avro::Encoder& e, const std::vector<int64_t>& v);
+    void encode(avro::Encoder& e, const std::vector<float>& v);
+    void encode(avro::Encoder& e, const std::vector<double>& v);
+
+    void decode(avro::Decoder& d, std::vector<int32_t>& v);
+    void decode(avro::Decoder& d, std::vector<int64_t>& v);
+    void decode(avro::Decoder& d, std::vector<float>& v);
+    void decode(avro::Decoder& d, std::vector<double>& v);
+  };
+};
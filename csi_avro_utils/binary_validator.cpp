@@ -0,0 +1,185 @@
+#include <algorithm>
+#include "binary_validator.h"
+
+namespace csi {
+  struct binary_validator::cursor {
+    const uint8_t* p;
+    const uint8_t* end;
+    const uint8_t* error_at;
+    const char*    error;
+
+    bool fail(const uint8_t* at, const char* e) {
+      error_at = at;
+      error = e;
+      return false;
+    }
+
+    size_t remaining() const { return end - p; }
+  };
+
+  // zigzag varint, at most 10 bytes and 64 bits
+  static inline bool read_long(const uint8_t*& p, const uint8_t* end, int64_t& v, const char*& error) {
+    uint64_t n = 0;
+    for (int shift = 0; shift != 70; shift += 7) {
+      if (p == end) {
+        error = "truncated varint";
+        return false;
+      }
+      uint8_t b = *p++;
+      if (shift == 63 && b > 1) {
+        error = "varint overflows long";
+        return false;
+      }
+      n |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if (!(b & 0x80)) {
+        v = static_cast<int64_t>(n >> 1) ^ -static_cast<int64_t>(n & 1);
+        return true;
+      }
+    }
+    error = "varint overflows long";
+    return false;
+  }
+
+  binary_validator::binary_validator(const avro::ValidSchema& schema, size_t max_depth)
+    : program_(schema)
+    , max_depth_(max_depth) {}
+
+  validation_result binary_validator::validate(const uint8_t* data, size_t size) const {
+    cursor c = { data, data + size, 0, 0 };
+    validation_result r;
+    if (!walk(program_.root(), c, 0)) {
+      r.error = c.error;
+      r.offset = c.error_at - data;
+    } else if (c.p != c.end) {
+      r.error = "trailing bytes";
+      r.offset = c.p - data;
+    } else {
+      r.error = 0;
+      r.offset = size;
+    }
+    return r;
+  }
+
+  bool binary_validator::walk(uint32_t index, cursor& c, size_t depth) const {
+    const schema_program::op& o = program_.at(index);
+    const uint8_t* start = c.p;
+    const char* error = 0;
+    int64_t v;
+    switch (o.code) {
+    case schema_program::NUL:
+    return true;
+
+    case schema_program::BOOL:
+    if (c.p == c.end)
+      return c.fail(start, "truncated boolean");
+    if (*c.p > 1)
+      return c.fail(start, "invalid boolean");
+    ++c.p;
+    return true;
+
+    case schema_program::INT:
+    if (!read_long(c.p, c.end, v, error))
+      return c.fail(start, error);
+    if (v < INT32_MIN || v > INT32_MAX)
+      return c.fail(start, "varint overflows int");
+    return true;
+
+    case schema_program::LONG:
+    if (!read_long(c.p, c.end, v, error))
+      return c.fail(start, error);
+    return true;
+
+    case schema_program::FLOAT:
+    case schema_program::DOUBLE:
+    case schema_program::FIXED:
+    if (c.remaining() < o.min_bytes)
+      return c.fail(start, "truncated fixed size value");
+    c.p += o.min_bytes;
+    return true;
+
+    case schema_program::STRING:
+    case schema_program::BYTES:
+    if (!read_long(c.p, c.end, v, error))
+      return c.fail(start, error);
+    if (v < 0)
+      return c.fail(start, "negative length");
+    if (static_cast<uint64_t>(v) > c.remaining())
+      return c.fail(start, "length exceeds message");
+    c.p += v;
+    return true;
+
+    case schema_program::ENUM:
+    if (!read_long(c.p, c.end, v, error))
+      return c.fail(start, error);
+    if (v < 0 || v >= o.size)
+      return c.fail(start, "enum index out of range");
+    return true;
+
+    case schema_program::UNION:
+    if (!read_long(c.p, c.end, v, error))
+      return c.fail(start, error);
+    if (v < 0 || v >= o.size)
+      return c.fail(start, "union branch out of range");
+    return walk(program_.child(o, static_cast<size_t>(v)), c, depth);
+
+    case schema_program::RECORD:
+    if (depth == max_depth_)
+      return c.fail(start, "nesting too deep");
+    for (size_t i = 0; i != o.size; ++i)
+      if (!walk(program_.child(o, i), c, depth + 1))
+        return false;
+    return true;
+
+    case schema_program::ARRAY:
+    case schema_program::MAP:
+    {
+      if (depth == max_depth_)
+        return c.fail(start, "nesting too deep");
+      // items that are not always empty take at least a byte, even if min_bytes is 0 for a record still
+      // being compiled. map entries are a string key (at least one byte) and the value
+      const schema_program::op& item = program_.at(o.children);
+      uint32_t item_min = (item.empty ? 0 : std::max<uint32_t>(item.min_bytes, 1)) + (o.code == schema_program::MAP ? 1 : 0);
+      while (true) {
+        const uint8_t* block = c.p;
+        int64_t count;
+        int64_t block_size = -1; // given with negative counts
+        if (!read_long(c.p, c.end, count, error))
+          return c.fail(block, error);
+        if (count == 0)
+          return true;
+        if (count < 0) {
+          if (count == INT64_MIN)
+            return c.fail(block, "invalid block count");
+          count = -count;
+          if (!read_long(c.p, c.end, block_size, error))
+            return c.fail(block, error);
+          if (block_size < 0 || static_cast<uint64_t>(block_size) > c.remaining())
+            return c.fail(block, "block size exceeds message");
+        }
+        if (item_min && static_cast<uint64_t>(count) > c.remaining() / item_min)
+          return c.fail(block, "block count exceeds message");
+        const uint8_t* items = c.p;
+        if (item_min) { // items that always encode to nothing, ie null, cannot be invalid
+          for (int64_t i = 0; i != count; ++i) {
+            if (o.code == schema_program::MAP) {
+              const uint8_t* key = c.p;
+              if (!read_long(c.p, c.end, v, error))
+                return c.fail(key, error);
+              if (v < 0)
+                return c.fail(key, "negative length");
+              if (static_cast<uint64_t>(v) > c.remaining())
+                return c.fail(key, "length exceeds message");
+              c.p += v;
+            }
+            if (!walk(o.children, c, depth + 1))
+              return false;
+          }
+        }
+        if (block_size >= 0 && c.p - items != block_size)
+          return c.fail(block, "block size does not match its items");
+      }
+    }
+    };
+    return c.fail(start, "invalid schema program");
+  }
+};
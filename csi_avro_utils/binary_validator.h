@@ -0,0 +1,37 @@
+#include <stdint.h>
+#include <vector>
+#include <avro/ValidSchema.hh>
+#include "schema_program.h"
+
+#pragma once
+
+namespace csi {
+  struct validation_result {
+    const char* error;  // null when valid, otherwise a static string
+    size_t      offset; // where in the message the error was found
+
+    bool ok() const { return error == 0; }
+  };
+
+  // checks that a message is a complete avro binary encoding of a schema without decoding it
+  // varints must fit their type, union branches and enum symbols must exist, string, bytes and
+  // fixed lengths and array / map block counts must fit the remaining bytes, block sizes must match their items and
+  // nothing may follow the value.
+  // nothing is allocated, one validator can be used from many threads
+  class binary_validator {
+    public:
+    explicit binary_validator(const avro::ValidSchema& schema, size_t max_depth = 256); // max_depth limits nesting in recursive schemas
+
+    validation_result validate(const uint8_t* data, size_t size) const;
+    validation_result validate(const std::vector<uint8_t>& data) const { return validate(data.data(), data.size()); }
+
+    const schema_program& program() const { return program_; }
+
+    private:
+    struct cursor;
+    bool walk(uint32_t index, cursor& c, size_t depth) const;
+
+    schema_program program_;
+    size_t         max_depth_;
+  };
+};
@@ -0,0 +1,170 @@
+#include <map>
+#include <set>
+#include <mutex>
+#include <stdexcept>
+#include "codec_stats.h"
+
+namespace csi {
+  namespace codec_stats {
+    static const size_t chunk_size = 64;
+    static const size_t max_chunks = 1024;
+
+    struct chunk {
+      counters c[chunk_size];
+    };
+
+    struct thread_block {
+      thread_block();
+      ~thread_block();
+      std::atomic<chunk*> chunks[max_chunks];
+    };
+
+    struct registry {
+      std::mutex                    mutex;
+      std::vector<std::string>      names;
+      std::map<std::string, size_t> ids;
+      std::set<thread_block*>       threads;
+      std::vector<type_stats>       retired; // counts from threads that have exited, indexed by id
+    };
+
+    // never destroyed so threads exiting during static destruction can still fold in their counts
+    static registry& get_registry() {
+      static registry* r = new registry();
+      return *r;
+    }
+
+    static void clear(counters& c) {
+      for (int d = 0; d != 2; ++d) {
+        c.calls[d].store(0, std::memory_order_relaxed);
+        c.ns[d].store(0, std::memory_order_relaxed);
+        for (size_t b = 0; b != max_branches; ++b)
+          c.branches[d][b].store(0, std::memory_order_relaxed);
+      }
+      c.bytes.store(0, std::memory_order_relaxed);
+    }
+
+    static void accumulate(const counters& c, type_stats& s) {
+      s.encode_calls += c.calls[ENCODE].load(std::memory_order_relaxed);
+      s.decode_calls += c.calls[DECODE].load(std::memory_order_relaxed);
+      s.encode_ns += c.ns[ENCODE].load(std::memory_order_relaxed);
+      s.decode_ns += c.ns[DECODE].load(std::memory_order_relaxed);
+      s.encode_bytes += c.bytes.load(std::memory_order_relaxed);
+      for (size_t b = 0; b != max_branches; ++b) {
+        s.encode_branches[b] += c.branches[ENCODE][b].load(std::memory_order_relaxed);
+        s.decode_branches[b] += c.branches[DECODE][b].load(std::memory_order_relaxed);
+      }
+    }
+
+    static type_stats empty_stats(const std::string& name) {
+      type_stats s;
+      s.name = name;
+      s.encode_calls = s.decode_calls = s.encode_ns = s.decode_ns = s.encode_bytes = 0;
+      s.encode_branches.assign(max_branches, 0);
+      s.decode_branches.assign(max_branches, 0);
+      return s;
+    }
+
+    // caller holds the registry mutex
+    static void accumulate(const thread_block& tb, std::vector<type_stats>& stats) {
+      for (size_t i = 0; i != max_chunks; ++i) {
+        const chunk* c = tb.chunks[i].load(std::memory_order_acquire);
+        if (!c)
+          continue;
+        for (size_t j = 0; j != chunk_size && i * chunk_size + j < stats.size(); ++j)
+          accumulate(c->c[j], stats[i * chunk_size + j]);
+      }
+    }
+
+    thread_block::thread_block() {
+      for (size_t i = 0; i != max_chunks; ++i)
+        chunks[i].store(nullptr, std::memory_order_relaxed);
+      registry& r = get_registry();
+      std::lock_guard<std::mutex> lock(r.mutex);
+      r.threads.insert(this);
+    }
+
+    thread_block::~thread_block() {
+      registry& r = get_registry();
+      {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (size_t i = r.retired.size(); i != r.names.size(); ++i)
+          r.retired.push_back(empty_stats(r.names[i]));
+        accumulate(*this, r.retired);
+        r.threads.erase(this);
+      }
+      for (size_t i = 0; i != max_chunks; ++i)
+        delete chunks[i].load(std::memory_order_relaxed);
+    }
+
+    size_t register_type(const char* type_name) {
+      registry& r = get_registry();
+      std::lock_guard<std::mutex> lock(r.mutex);
+      auto i = r.ids.find(type_name);
+      if (i != r.ids.end())
+        return i->second;
+      if (r.names.size() == chunk_size * max_chunks)
+        throw std::length_error("csi::codec_stats: too many types");
+      size_t id = r.names.size();
+      r.names.push_back(type_name);
+      r.ids[type_name] = id;
+      return id;
+    }
+
+    counters& local_counters(size_t id) {
+      static thread_local thread_block tb;
+      std::atomic<chunk*>& slot = tb.chunks[id / chunk_size];
+      chunk* c = slot.load(std::memory_order_relaxed);
+      if (!c) {
+        c = new chunk();
+        for (size_t i = 0; i != chunk_size; ++i)
+          clear(c->c[i]);
+        slot.store(c, std::memory_order_release);
+      }
+      return c->c[id % chunk_size];
+    }
+
+    std::vector<type_stats> snapshot() {
+      registry& r = get_registry();
+      std::lock_guard<std::mutex> lock(r.mutex);
+      std::vector<type_stats> result;
+      for (size_t i = 0; i != r.names.size(); ++i)
+        result.push_back(i < r.retired.size() ? r.retired[i] : empty_stats(r.names[i]));
+      for (auto tb : r.threads)
+        accumulate(*tb, result);
+
+      // trim histograms to the used branches, non unions end up empty
+      for (auto& s : result) {
+        while (!s.encode_branches.empty() && s.encode_branches.back() == 0 && s.decode_branches.back() == 0) {
+          s.encode_branches.pop_back();
+          s.decode_branches.pop_back();
+        }
+      }
+      return result;
+    }
+
+    static void write_array(std::ostream& os, const std::vector<uint64_t>& v) {
+      os << "[";
+      for (size_t i = 0; i != v.size(); ++i)
+        os << (i ? ", " : "") << v[i];
+      os << "]";
+    }
+
+    void write_json(std::ostream& os, const std::vector<type_stats>& stats) {
+      os << "[";
+      for (size_t i = 0; i != stats.size(); ++i) {
+        const type_stats& s = stats[i];
+        os << (i ? ",\n" : "\n") << "  { \"name\": \"" << s.name << "\""
+          << ", \"encode_calls\": " << s.encode_calls << ", \"encode_ns\": " << s.encode_ns << ", \"encode_bytes\": " << s.encode_bytes
+          << ", \"decode_calls\": " << s.decode_calls << ", \"decode_ns\": " << s.decode_ns;
+        if (!s.encode_branches.empty()) {
+          os << ", \"encode_branches\": ";
+          write_array(os, s.encode_branches);
+          os << ", \"decode_branches\": ";
+          write_array(os, s.decode_branches);
+        }
+        os << " }";
+      }
+      os << "\n]\n";
+    }
+  };
+};
@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <avro/Encoder.hh>
+#include <avro/Decoder.hh>
+#include "binary_codec.h"
+
+#pragma once
+
+// per type counters for csi_avrogencpp --instrument generated codec_traits
+// the generated code calls the CSI_AVRO_STATS_* macros below, they expand to nothing unless
+// CSI_AVRO_ENABLE_STATS is defined so instrumented code costs nothing in normal builds
+//
+// counters are kept per thread and only written by the owning thread - snapshot() sums them up
+// times and byte counts are inclusive, a record includes its nested records
+// bytes are only counted when encoding since avro decoders do not expose a position, see encode_scope
+
+namespace csi {
+  namespace codec_stats {
+    enum direction { ENCODE = 0, DECODE = 1 };
+    const size_t max_branches = 16; // higher union branches are counted in the last bucket
+
+    struct counters {
+      std::atomic<uint64_t> calls[2];
+      std::atomic<uint64_t> ns[2];
+      std::atomic<uint64_t> bytes;
+      std::atomic<uint64_t> branches[2][max_branches];
+    };
+
+    struct type_stats {
+      std::string           name;
+      uint64_t              encode_calls;
+      uint64_t              decode_calls;
+      uint64_t              encode_ns;
+      uint64_t              decode_ns;
+      uint64_t              encode_bytes;
+      std::vector<uint64_t> encode_branches; // empty for non unions
+      std::vector<uint64_t> decode_branches;
+    };
+
+    size_t                  register_type(const char* type_name); // same name gives same id
+    counters&               local_counters(size_t id);            // this thread's counters for a type
+    std::vector<type_stats> snapshot();                           // totals of all threads, including exited ones
+    void                    write_json(std::ostream& os, const std::vector<type_stats>& stats);
+
+    // only the owning thread writes so a plain load/store is enough, no locked instructions
+    inline void add(std::atomic<uint64_t>& c, uint64_t v) {
+      c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+
+    class scope {
+      public:
+      scope(size_t id, direction dir)
+        : counters_(local_counters(id))
+        , dir_(dir)
+        , start_(std::chrono::steady_clock::now()) {}
+
+      ~scope() {
+        add(counters_.calls[dir_], 1);
+        add(counters_.ns[dir_], std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+      }
+
+      void branch(size_t n) {
+        add(counters_.branches[dir_][n < max_branches ? n : max_branches - 1], 1);
+      }
+
+      protected:
+      counters&                             counters_;
+      const direction                       dir_;
+      std::chrono::steady_clock::time_point start_;
+    };
+
+    // nesting of instrumented encodes on this thread
+    inline size_t& encode_depth() {
+      static thread_local size_t depth = 0;
+      return depth;
+    }
+
+    // csi::binary_encoder knows its exact position at any time. other encoders only after a flush, which
+    // costs time and may write to the stream, so they are only flushed around the outermost instrumented
+    // encode and nested types get no bytes counted
+    class encode_scope : public scope {
+      public:
+      encode_scope(size_t id, avro::Encoder& e)
+        : scope(id, ENCODE)
+        , e_(e)
+        , exact_(dynamic_cast<binary_encoder*>(&e) != 0)
+        , outermost_(encode_depth()++ == 0) {
+        if (!exact_ && outermost_)
+          e_.flush();
+        bytes_ = e_.byteCount();
+      }
+
+      ~encode_scope() {
+        --encode_depth();
+        if (std::uncaught_exception() || !(exact_ || outermost_))
+          return;
+        if (!exact_)
+          e_.flush();
+        add(counters_.bytes, e_.byteCount() - bytes_);
+      }
+
+      private:
+      avro::Encoder& e_;
+      const bool     exact_;
+      const bool     outermost_;
+      int64_t        bytes_;
+    };
+  };
+};
+
+#ifdef CSI_AVRO_ENABLE_STATS
+#define CSI_AVRO_STATS_ENCODE(type_name, e) \
+  static const size_t csi_stats_id = csi::codec_stats::register_type(type_name); \
+  csi::codec_stats::encode_scope csi_stats_scope(csi_stats_id, e)
+#define CSI_AVRO_STATS_DECODE(type_name, d) \
+  static const size_t csi_stats_id = csi::codec_stats::register_type(type_name); \
+  csi::codec_stats::scope csi_stats_scope(csi_stats_id, csi::codec_stats::DECODE)
+#define CSI_AVRO_STATS_BRANCH(n) csi_stats_scope.branch(n)
+#else
+#define CSI_AVRO_STATS_ENCODE(type_name, e)
+#define CSI_AVRO_STATS_DECODE(type_name, d)
+#define CSI_AVRO_STATS_BRANCH(n)
+#endif
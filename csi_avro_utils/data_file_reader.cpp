@@ -0,0 +1,164 @@
+#include <cstring>
+#include <zlib.h>
+#ifdef CSI_AVRO_HAS_SNAPPY
+#include <snappy.h>
+#endif
+#include <avro/Compiler.hh>
+#include "data_file_reader.h"
+#include "schema_program.h"
+
+namespace csi {
+  static const uint8_t avro_magic[4] = { 'O', 'b', 'j', '\x01' };
+
+  static int64_t read_long(const uint8_t*& p, const uint8_t* end) {
+    uint64_t encoded = 0;
+    int shift = 0;
+    uint8_t u;
+    do {
+      if (p == end)
+        throw avro::Exception("unexpected end of avro data file");
+      if (shift >= 64)
+        throw avro::Exception("invalid varint in avro data file");
+      u = *p++;
+      encoded |= static_cast<uint64_t>(u & 0x7f) << shift;
+      shift += 7;
+    } while(u & 0x80);
+    return static_cast<int64_t>((encoded >> 1) ^ -(encoded & 1));
+  }
+
+  static const uint8_t* read_span(const uint8_t*& p, const uint8_t* end, int64_t len) {
+    if (len < 0 || len > end - p)
+      throw avro::Exception("truncated avro data file");
+    const uint8_t* result = p;
+    p += len;
+    return result;
+  }
+
+  mmap_data_file::mmap_data_file(const std::string& path)
+    : file_(path)
+    , records_(0)
+    , empty_records_(false) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(file_.data());
+    const uint8_t* end = p + file_.size();
+
+    if (memcmp(read_span(p, end, 4), avro_magic, 4) != 0)
+      throw avro::Exception("not an avro data file: " + path);
+
+    // metadata is a map<bytes>
+    for (int64_t n = read_long(p, end); n != 0; n = read_long(p, end)) {
+      if (n < 0) {
+        n = -n;
+        read_long(p, end); // block size in bytes
+      }
+      for (int64_t i = 0; i != n; ++i) {
+        int64_t klen = read_long(p, end);
+        const uint8_t* k = read_span(p, end, klen);
+        int64_t vlen = read_long(p, end);
+        const uint8_t* v = read_span(p, end, vlen);
+        metadata_[std::string(reinterpret_cast<const char*>(k), klen)].assign(v, v + vlen);
+      }
+    }
+    memcpy(sync_, read_span(p, end, 16), 16);
+
+    auto schema = metadata_.find("avro.schema");
+    if (schema == metadata_.end())
+      throw avro::Exception("no schema in avro data file: " + path);
+    schema_ = avro::compileJsonSchemaFromMemory(schema->second.data(), schema->second.size());
+    empty_records_ = schema_program(schema_).at(0).empty;
+
+    auto codec = metadata_.find("avro.codec");
+    codec_ = (codec == metadata_.end()) ? "null" : std::string(codec->second.begin(), codec->second.end());
+    if (codec_ != "null" && codec_ != "deflate"
+#ifdef CSI_AVRO_HAS_SNAPPY
+      && codec_ != "snappy"
+#endif
+      )
+      throw avro::Exception("unsupported avro data file codec: " + codec_);
+
+    index_blocks(p, end);
+  }
+
+  // every block is count, size, data, sync - we jump using size and check the sync marker.
+  // each record takes at least a byte, so a count larger than the size is corrupt and would only make
+  // the reader allocate for records that are not there. compressed blocks are checked in block_data
+  void mmap_data_file::index_blocks(const uint8_t* p, const uint8_t* end) {
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(file_.data());
+    while (p != end) {
+      block b;
+      b.count = read_long(p, end);
+      int64_t size = read_long(p, end);
+      if (b.count < 0)
+        throw avro::Exception("invalid block count in avro data file");
+      b.offset = read_span(p, end, size) - begin;
+      b.size = static_cast<size_t>(size);
+      if (codec_ == "null" && !empty_records_ && b.count > size)
+        throw avro::Exception("block record count exceeds block size in avro data file");
+      if (memcmp(read_span(p, end, 16), sync_, 16) != 0)
+        throw avro::Exception("sync marker mismatch in avro data file");
+      records_ += b.count;
+      blocks_.push_back(b);
+    }
+  }
+
+  static void inflate_raw(const uint8_t* src, size_t len, std::vector<uint8_t>& dst) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -15) != Z_OK) // raw deflate, no zlib header
+      throw avro::Exception("inflateInit2 failed");
+    if (dst.size() < 4 * len)
+      dst.resize(4 * len + 1024);
+    zs.next_in = const_cast<Bytef*>(src);
+    zs.avail_in = static_cast<uInt>(len);
+    size_t produced = 0;
+    int rc = Z_OK;
+    while (rc != Z_STREAM_END) {
+      if (produced == dst.size())
+        dst.resize(2 * dst.size());
+      zs.next_out = dst.data() + produced;
+      zs.avail_out = static_cast<uInt>(dst.size() - produced);
+      rc = inflate(&zs, Z_NO_FLUSH);
+      produced = dst.size() - zs.avail_out;
+      if (rc != Z_OK && rc != Z_STREAM_END && !(rc == Z_BUF_ERROR && zs.avail_out == 0)) {
+        inflateEnd(&zs);
+        throw avro::Exception("corrupt deflate block in avro data file");
+      }
+    }
+    inflateEnd(&zs);
+    dst.resize(produced);
+  }
+
+  void mmap_data_file::block_data(size_t index, std::vector<uint8_t>& scratch, const uint8_t** data, size_t* size) const {
+    const block& b = blocks_[index];
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(file_.data()) + b.offset;
+    if (codec_ == "null") {
+      *data = src;
+      *size = b.size;
+      return;
+    }
+
+    if (codec_ == "deflate") {
+      inflate_raw(src, b.size, scratch);
+    }
+#ifdef CSI_AVRO_HAS_SNAPPY
+    else if (codec_ == "snappy") {
+      // snappy blocks carry a trailing 4 byte crc32 of the uncompressed data
+      if (b.size < 4)
+        throw avro::Exception("corrupt snappy block in avro data file");
+      const char* csrc = reinterpret_cast<const char*>(src);
+      size_t len = 0;
+      if (!snappy::GetUncompressedLength(csrc, b.size - 4, &len))
+        throw avro::Exception("corrupt snappy block in avro data file");
+      scratch.resize(len);
+      if (!snappy::RawUncompress(csrc, b.size - 4, reinterpret_cast<char*>(scratch.data())))
+        throw avro::Exception("corrupt snappy block in avro data file");
+      uint32_t crc = (uint32_t(src[b.size - 4]) << 24) | (uint32_t(src[b.size - 3]) << 16) | (uint32_t(src[b.size - 2]) << 8) | uint32_t(src[b.size - 1]);
+      if (crc != crc32(0, scratch.data(), static_cast<uInt>(len)))
+        throw avro::Exception("crc mismatch in snappy block in avro data file");
+    }
+#endif
+    if (!empty_records_ && static_cast<uint64_t>(b.count) > scratch.size())
+      throw avro::Exception("block record count exceeds block size in avro data file");
+    *data = scratch.data();
+    *size = scratch.size();
+  }
+};
@@ -0,0 +1,157 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <avro/ValidSchema.hh>
+#include <avro/Decoder.hh>
+#include <avro/Specific.hh>
+#include <avro/Generic.hh>
+
+#pragma once
+
+namespace csi {
+  // read only view of an avro object container file
+  // the file is memory mapped and the block boundaries are indexed on open
+  class mmap_data_file {
+    public:
+    struct block {
+      size_t  offset; // start of (compressed) block data in file
+      size_t  size;   // size of (compressed) block data
+      int64_t count;  // nr of records in block
+    };
+
+    mmap_data_file(const std::string& path); // throws avro::Exception on bad format
+    const avro::ValidSchema&  writer_schema() const { return schema_; }
+    const std::string&        codec() const { return codec_; }
+    const std::map<std::string, std::vector<uint8_t>>& metadata() const { return metadata_; }
+    const std::vector<block>& blocks() const { return blocks_; }
+    int64_t                   records() const { return records_; }
+
+    // gives the uncompressed block data, either pointing into the mapping (null codec) or into scratch
+    // thread safe as long as each thread uses its own scratch
+    void block_data(size_t index, std::vector<uint8_t>& scratch, const uint8_t** data, size_t* size) const;
+
+    private:
+    void index_blocks(const uint8_t* p, const uint8_t* end);
+
+    boost::iostreams::mapped_file_source              file_;
+    std::map<std::string, std::vector<uint8_t>>       metadata_;
+    avro::ValidSchema                                 schema_;
+    std::string                                       codec_;
+    uint8_t                                           sync_[16];
+    std::vector<block>                                blocks_;
+    int64_t                                           records_;
+    bool                                              empty_records_; // records encode to nothing, their count can not be checked against the block size
+  };
+
+  // how to create an empty record before decode, generated types just default construct
+  template<class T> struct record_factory {
+    static T create(const avro::ValidSchema&) { return T(); }
+  };
+
+  template<> struct record_factory<avro::GenericDatum> {
+    static avro::GenericDatum create(const avro::ValidSchema& schema) { return avro::GenericDatum(schema); }
+  };
+
+  // decodes the blocks of file on nr_of_threads workers and calls callback for each record in file order
+  // if reader_schema is given the records are resolved from the writer schema, otherwise T must match the writer schema
+  // exceptions from workers and callback are rethrown in the calling thread
+  template<class T>
+  void read_data_file(const mmap_data_file& file, size_t nr_of_threads, const std::function<void(T&)>& callback, const avro::ValidSchema* reader_schema = nullptr) {
+    const std::vector<mmap_data_file::block>& blocks = file.blocks();
+    const avro::ValidSchema& schema = reader_schema ? *reader_schema : file.writer_schema();
+    if (nr_of_threads < 1)
+      nr_of_threads = 1;
+    const size_t window = 2 * nr_of_threads; // blocks decoded ahead of the consumer
+
+    struct slot {
+      slot() : block(SIZE_MAX) {}
+      size_t         block; // block index held by this slot, SIZE_MAX if free
+      std::vector<T> records;
+    };
+    std::vector<slot>       slots(window);
+    std::mutex              mutex;
+    std::condition_variable cv;
+    size_t                  delivered = 0; // blocks handed to callback
+    bool                    aborted = false;
+    std::exception_ptr      error;
+    std::atomic<size_t>     next(0);
+
+    auto worker = [&]() {
+      std::vector<uint8_t> scratch;
+      avro::DecoderPtr decoder = reader_schema ? avro::DecoderPtr(avro::resolvingDecoder(file.writer_schema(), *reader_schema, avro::binaryDecoder())) : avro::binaryDecoder();
+      for (size_t i = next++; i < blocks.size(); i = next++) {
+        slot& s = slots[i % window];
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [&]() { return aborted || i < delivered + window; });
+          if (aborted)
+            return;
+        }
+        try {
+          const uint8_t* data = nullptr;
+          size_t size = 0;
+          file.block_data(i, scratch, &data, &size);
+          std::auto_ptr<avro::InputStream> in = avro::memoryInputStream(data, size);
+          decoder->init(*in);
+          s.records.resize(blocks[i].count, record_factory<T>::create(schema));
+          for (auto& r : s.records)
+            avro::decode(*decoder, r);
+          decoder->drain(); // a wrong count or garbage after the records leaves bytes over
+          if (in->byteCount() != size)
+            throw avro::Exception("block size does not match its records in avro data file");
+        } catch (...) {
+          std::unique_lock<std::mutex> lock(mutex);
+          if (!error)
+            error = std::current_exception();
+          aborted = true;
+          cv.notify_all();
+          return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        s.block = i;
+        cv.notify_all();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i != nr_of_threads; ++i)
+      threads.emplace_back(worker);
+
+    for (size_t i = 0; i != blocks.size(); ++i) {
+      slot& s = slots[i % window];
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return aborted || s.block == i; });
+        if (aborted)
+          break;
+      }
+      try {
+        for (auto& r : s.records)
+          callback(r);
+      } catch (...) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!error)
+          error = std::current_exception();
+        aborted = true;
+        cv.notify_all();
+        break;
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      s.block = SIZE_MAX;
+      ++delivered;
+      cv.notify_all();
+    }
+
+    for (auto& t : threads)
+      t.join();
+    if (error)
+      std::rethrow_exception(error);
+  }
+};
@@ -0,0 +1,266 @@
+#include <cstring>
+#include <random>
+#include <zlib.h>
+#ifdef CSI_AVRO_HAS_SNAPPY
+#include <snappy.h>
+#endif
+#include <boost/uuid/uuid_io.hpp>
+#include "data_file_writer.h"
+#include "utils.h"
+
+namespace csi {
+  // growable single buffer so a finished block can be handed to the pool without copying
+  // chunks never reach past limit, so byteCount() > limit means the encoder has filled the block
+  class data_file_writer_base::block_output_stream : public avro::OutputStream {
+    public:
+    block_output_stream(size_t limit) : limit_(limit), used_(0) {}
+
+    bool next(uint8_t** data, size_t* len) {
+      if (used_ == buf_.size())
+        buf_.resize(std::max<size_t>(4096, 2 * buf_.size()));
+      size_t end = (used_ < limit_) ? std::min(buf_.size(), limit_) : buf_.size();
+      *data = &buf_[used_];
+      *len = end - used_;
+      used_ = end;
+      return true;
+    }
+
+    void backup(size_t len) { used_ -= len; }
+    uint64_t byteCount() const { return used_; }
+    void flush() {}
+
+    void take(std::vector<uint8_t>& dst) {
+      buf_.resize(used_);
+      dst.swap(buf_);
+      buf_.clear();
+      used_ = 0;
+    }
+
+    private:
+    const size_t         limit_;
+    std::vector<uint8_t> buf_;
+    size_t               used_;
+  };
+
+  static void put_long(std::vector<uint8_t>& dst, int64_t l) {
+    uint64_t n = (static_cast<uint64_t>(l) << 1) ^ static_cast<uint64_t>(l >> 63);
+    while (n & ~0x7FULL) {
+      dst.push_back(static_cast<uint8_t>((n & 0x7f) | 0x80));
+      n >>= 7;
+    }
+    dst.push_back(static_cast<uint8_t>(n));
+  }
+
+  static void put_bytes(std::vector<uint8_t>& dst, const std::string& s) {
+    put_long(dst, s.size());
+    dst.insert(dst.end(), s.begin(), s.end());
+  }
+
+  data_file_writer_base::data_file_writer_base(const std::string& path, const avro::ValidSchema& schema, const std::string& codec, size_t nr_of_threads, size_t block_size)
+    : out_(path.c_str(), std::ios::binary | std::ios::trunc)
+    , codec_(codec)
+    , block_size_(block_size)
+    , max_in_flight_(2 * std::max<size_t>(1, nr_of_threads))
+    , stream_(new block_output_stream(block_size))
+    , encoder_(avro::binaryEncoder())
+    , block_count_(0)
+    , records_(0)
+    , next_seq_(0)
+    , next_write_(0)
+    , writing_(false)
+    , closing_(false)
+    , closed_(false) {
+    if (codec_ != "null" && codec_ != "deflate"
+#ifdef CSI_AVRO_HAS_SNAPPY
+      && codec_ != "snappy"
+#endif
+      )
+      throw avro::Exception("unsupported avro data file codec: " + codec_);
+    if (!out_)
+      throw avro::Exception("cannot open " + path);
+
+    std::random_device rd;
+    std::mt19937 rng(rd());
+    for (int i = 0; i != 16; ++i)
+      sync_[i] = static_cast<uint8_t>(rng());
+
+    write_header(schema);
+    encoder_->init(*stream_);
+
+    for (size_t i = 0; i != std::max<size_t>(1, nr_of_threads); ++i)
+      threads_.emplace_back(&data_file_writer_base::worker, this);
+  }
+
+  data_file_writer_base::~data_file_writer_base() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  void data_file_writer_base::write_header(const avro::ValidSchema& schema) {
+    std::vector<uint8_t> h = { 'O', 'b', 'j', '\x01' };
+    put_long(h, 3);
+    put_bytes(h, "avro.schema");
+    put_bytes(h, to_string(schema));
+    put_bytes(h, "avro.codec");
+    put_bytes(h, codec_);
+    put_bytes(h, "csi.schema.hash");
+    put_bytes(h, to_string(generate_hash(schema)));
+    put_long(h, 0);
+    h.insert(h.end(), sync_, sync_ + 16);
+    out_.write(reinterpret_cast<const char*>(h.data()), h.size());
+  }
+
+  void data_file_writer_base::record_written() {
+    ++block_count_;
+    ++records_;
+    if (stream_->byteCount() > block_size_) // no flush per record, see block_output_stream
+      ship_block();
+  }
+
+  void data_file_writer_base::ship_block() {
+    encoder_->flush();
+    if (block_count_ == 0)
+      return;
+
+    std::shared_ptr<job> j = std::make_shared<job>();
+    j->count = block_count_;
+    stream_->take(j->data);
+    encoder_->init(*stream_);
+    block_count_ = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return error_ || next_seq_ < next_write_ + max_in_flight_; });
+    if (error_)
+      std::rethrow_exception(error_);
+    j->seq = next_seq_++;
+    queue_.push_back(j);
+    cv_.notify_all();
+  }
+
+  void data_file_writer_base::flush() {
+    ship_block();
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return error_ || next_write_ == next_seq_; });
+    if (error_)
+      std::rethrow_exception(error_);
+    out_.flush();
+  }
+
+  void data_file_writer_base::close() {
+    if (closed_)
+      return;
+    std::exception_ptr error;
+    try {
+      flush();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      closing_ = true;
+      cv_.notify_all();
+    }
+    for (auto& t : threads_)
+      t.join();
+    threads_.clear();
+    out_.close();
+    closed_ = true;
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  void data_file_writer_base::worker() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [this]() { return closing_ || !queue_.empty(); });
+      if (queue_.empty())
+        return;
+      std::shared_ptr<job> j = queue_.front();
+      queue_.pop_front();
+      lock.unlock();
+      try {
+        compress(*j);
+      } catch (...) {
+        lock.lock();
+        if (!error_)
+          error_ = std::current_exception();
+        cv_.notify_all();
+        continue;
+      }
+      lock.lock();
+      done_[j->seq] = j;
+
+      // whoever completes the next block in sequence writes it and anything queued up behind it
+      if (writing_)
+        continue;
+      writing_ = true;
+      for (auto i = done_.find(next_write_); i != done_.end(); i = done_.find(next_write_)) {
+        std::shared_ptr<job> next = i->second;
+        done_.erase(i);
+        lock.unlock();
+        try {
+          write_block(*next);
+        } catch (...) {
+          lock.lock();
+          if (!error_)
+            error_ = std::current_exception();
+          break;
+        }
+        lock.lock();
+        ++next_write_;
+        cv_.notify_all();
+      }
+      writing_ = false;
+      cv_.notify_all();
+    }
+  }
+
+  void data_file_writer_base::compress(job& j) const {
+    if (codec_ == "deflate") {
+      z_stream zs;
+      memset(&zs, 0, sizeof(zs));
+      if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) // raw deflate, no zlib header
+        throw avro::Exception("deflateInit2 failed");
+      j.compressed.resize(deflateBound(&zs, static_cast<uLong>(j.data.size())));
+      zs.next_in = j.data.data();
+      zs.avail_in = static_cast<uInt>(j.data.size());
+      zs.next_out = j.compressed.data();
+      zs.avail_out = static_cast<uInt>(j.compressed.size());
+      int rc = deflate(&zs, Z_FINISH);
+      deflateEnd(&zs);
+      if (rc != Z_STREAM_END)
+        throw avro::Exception("deflate failed");
+      j.compressed.resize(j.compressed.size() - zs.avail_out);
+    }
+#ifdef CSI_AVRO_HAS_SNAPPY
+    else if (codec_ == "snappy") {
+      // snappy blocks carry a trailing 4 byte big endian crc32 of the uncompressed data
+      j.compressed.resize(snappy::MaxCompressedLength(j.data.size()) + 4);
+      size_t len = 0;
+      snappy::RawCompress(reinterpret_cast<const char*>(j.data.data()), j.data.size(), reinterpret_cast<char*>(j.compressed.data()), &len);
+      uint32_t crc = crc32(0, j.data.data(), static_cast<uInt>(j.data.size()));
+      j.compressed[len++] = static_cast<uint8_t>(crc >> 24);
+      j.compressed[len++] = static_cast<uint8_t>(crc >> 16);
+      j.compressed[len++] = static_cast<uint8_t>(crc >> 8);
+      j.compressed[len++] = static_cast<uint8_t>(crc);
+      j.compressed.resize(len);
+    }
+#endif
+    else {
+      j.compressed.swap(j.data);
+    }
+  }
+
+  void data_file_writer_base::write_block(const job& j) {
+    std::vector<uint8_t> prefix;
+    put_long(prefix, j.count);
+    put_long(prefix, j.compressed.size());
+    out_.write(reinterpret_cast<const char*>(prefix.data()), prefix.size());
+    out_.write(reinterpret_cast<const char*>(j.compressed.data()), j.compressed.size());
+    out_.write(reinterpret_cast<const char*>(sync_), 16);
+    if (!out_)
+      throw avro::Exception("write to avro data file failed");
+  }
+};
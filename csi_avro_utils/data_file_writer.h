@@ -0,0 +1,85 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <avro/ValidSchema.hh>
+#include <avro/Encoder.hh>
+#include <avro/Specific.hh>
+#include <avro/Generic.hh>
+
+#pragma once
+
+namespace csi {
+  // writes avro object container files
+  // records are encoded by the caller into the current block, full blocks are compressed on a pool of
+  // threads and written in order while the caller continues with the next block
+  // the header carries the schema and its generate_hash fingerprint (metadata key csi.schema.hash)
+  class data_file_writer_base {
+    public:
+    // codec is "null", "deflate" or "snappy" (if built with ENABLE_SNAPPY)
+    data_file_writer_base(const std::string& path, const avro::ValidSchema& schema, const std::string& codec, size_t nr_of_threads, size_t block_size);
+    ~data_file_writer_base();
+
+    avro::Encoder& encoder() { return *encoder_; }
+    void           record_written(); // call after each encoded record, ships the block when full
+    void           flush();          // ships the current block and waits until everything is on disk
+    void           close();          // throws if a block failed to compress or write
+    int64_t        records() const { return records_; }
+
+    private:
+    struct job {
+      size_t               seq;
+      int64_t              count;
+      std::vector<uint8_t> data;
+      std::vector<uint8_t> compressed;
+    };
+
+    class block_output_stream;
+
+    void write_header(const avro::ValidSchema& schema);
+    void ship_block();
+    void worker();
+    void compress(job& j) const;
+    void write_block(const job& j);
+
+    std::ofstream                        out_;
+    const std::string                    codec_;
+    const size_t                         block_size_;
+    const size_t                         max_in_flight_;
+    uint8_t                              sync_[16];
+    std::unique_ptr<block_output_stream> stream_;
+    avro::EncoderPtr                     encoder_;
+    int64_t                              block_count_; // records in current block
+    int64_t                              records_;
+
+    std::mutex                           mutex_;
+    std::condition_variable              cv_;
+    std::deque<std::shared_ptr<job>>     queue_;       // waiting for compression
+    std::map<size_t, std::shared_ptr<job>> done_;      // compressed, waiting for their turn to be written
+    size_t                               next_seq_;
+    size_t                               next_write_;
+    bool                                 writing_;
+    bool                                 closing_;
+    bool                                 closed_;
+    std::exception_ptr                   error_;
+    std::vector<std::thread>             threads_;
+  };
+
+  template<class T>
+  class data_file_writer : public data_file_writer_base {
+    public:
+    data_file_writer(const std::string& path, const avro::ValidSchema& schema, const std::string& codec = "deflate", size_t nr_of_threads = std::thread::hardware_concurrency(), size_t block_size = 64 * 1024)
+      : data_file_writer_base(path, schema, codec, nr_of_threads, block_size) {}
+
+    void write(const T& v) {
+      avro::encode(encoder(), v);
+      record_written();
+    }
+  };
+};
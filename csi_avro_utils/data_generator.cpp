@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <avro/Schema.hh>
+#include "data_generator.h"
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_X64) || defined(_M_IX86)
+#define CSI_DATA_GENERATOR_LITTLE_ENDIAN 1
+#endif
+
+namespace csi {
+  static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-";
+
+  size_distribution size_distribution::fixed(uint32_t n) {
+    size_distribution d = { FIXED, n, n, (double) n };
+    return d;
+  }
+
+  size_distribution size_distribution::uniform(uint32_t min, uint32_t max) {
+    size_distribution d = { UNIFORM, min, std::max(min, max), (min + std::max(min, max)) / 2.0 };
+    return d;
+  }
+
+  size_distribution size_distribution::geometric(uint32_t min, double mean, uint32_t max) {
+    size_distribution d = { GEOMETRIC, min, std::max(min, max), mean };
+    return d;
+  }
+
+  generator_config::generator_config()
+    : seed(1)
+    , string_length(size_distribution::uniform(4, 32))
+    , bytes_length(size_distribution::uniform(0, 64))
+    , array_size(size_distribution::geometric(0, 4, 64))
+    , map_size(size_distribution::geometric(0, 4, 64))
+    , min_number(0)
+    , max_number(1000000)
+    , null_probability(-1)
+    , max_depth(8) {}
+
+  static std::vector<uint64_t> cumulative(const std::vector<double>& weights) {
+    double total = 0;
+    for (double w : weights) {
+      if (w < 0)
+        throw std::domain_error("data_generator: negative union branch weight");
+      total += w;
+    }
+    if (total <= 0)
+      throw std::domain_error("data_generator: union branch weights add up to 0");
+    std::vector<uint64_t> c;
+    double sum = 0;
+    for (double w : weights) {
+      sum += w;
+      c.push_back(static_cast<uint64_t>(sum / total * 4294967296.0));
+    }
+    c.back() = 4294967296ULL; // no rounding gap at the end
+    return c;
+  }
+
+  data_generator::data_generator(const avro::ValidSchema& schema, const generator_config& config)
+    : program_(schema)
+    , config_(config)
+    , thresholds_(program_.size())
+    , shortest_(program_.size(), 0)
+    , state_(config.seed)
+    , out_(0)
+    , p_(0)
+    , end_(0)
+    , last_(0) {
+    if (config_.min_number > config_.max_number)
+      throw std::domain_error("data_generator: min_number above max_number");
+
+    for (uint32_t i = 0; i != program_.size(); ++i) {
+      const schema_program::op& o = program_.at(i);
+      if (o.code != schema_program::UNION)
+        continue;
+      std::vector<double> weights(o.size, 1.0);
+      size_t nulls = 0;
+      for (size_t b = 0; b != o.size; ++b)
+        nulls += program_.at(program_.child(o, b)).code == schema_program::NUL;
+      if (config_.null_probability >= 0 && nulls == 1 && o.size > 1) {
+        for (size_t b = 0; b != o.size; ++b)
+          weights[b] = program_.at(program_.child(o, b)).code == schema_program::NUL ? config_.null_probability
+                                                                                    : (1 - config_.null_probability) / (o.size - 1);
+      }
+      thresholds_[i] = cumulative(weights);
+      for (size_t b = 1; b != o.size; ++b) {
+        if (program_.at(program_.child(o, b)).min_bytes < program_.at(program_.child(o, shortest_[i])).min_bytes)
+          shortest_[i] = static_cast<uint32_t>(b);
+      }
+    }
+
+    // weights given per field, found through the records holding the unions
+    size_t found = 0;
+    for (uint32_t i = 0; i != program_.size(); ++i) {
+      const schema_program::op& o = program_.at(i);
+      if (o.code != schema_program::RECORD)
+        continue;
+      for (size_t f = 0; f != o.size; ++f) {
+        std::map<std::string, std::vector<double> >::const_iterator w =
+          config_.branch_weights.find(o.node->name().fullname() + "." + o.node->nameAt(f));
+        if (w == config_.branch_weights.end())
+          continue;
+        uint32_t u = program_.child(o, f);
+        if (program_.at(u).code != schema_program::UNION || w->second.size() != program_.at(u).size)
+          throw std::domain_error("data_generator: " + w->first + " is not a union of " + std::to_string(w->second.size()) + " branches");
+        thresholds_[u] = cumulative(w->second);
+        ++found;
+      }
+    }
+    if (found != config_.branch_weights.size())
+      throw std::domain_error("data_generator: branch weights for a field that is not in the schema");
+  }
+
+  void data_generator::reseed(uint64_t seed) {
+    state_ = seed;
+  }
+
+  // r scaled to [0, n), a multiply instead of a division when n fits in 32 bits
+  static uint64_t below(uint64_t r, uint64_t n) {
+    return n <= 0xFFFFFFFFULL ? ((r >> 32) * n) >> 32 : r % n;
+  }
+
+  // splitmix64
+  static inline uint64_t splitmix(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  uint64_t data_generator::next_random() {
+    return splitmix(state_);
+  }
+
+  uint32_t data_generator::next_size(const size_distribution& d) {
+    switch (d.type) {
+    case size_distribution::FIXED:
+      return d.min;
+    case size_distribution::UNIFORM:
+      return d.min + static_cast<uint32_t>(below(next_random(), uint64_t(d.max - d.min) + 1));
+    case size_distribution::GEOMETRIC:
+    {
+      if (d.mean <= 0)
+        return d.min;
+      double u = ((next_random() >> 11) + 1) * (1.0 / 9007199254740992.0); // (0, 1]
+      double n = std::floor(std::log(u) / std::log(d.mean / (d.mean + 1)));
+      return n >= d.max - d.min ? d.max : d.min + static_cast<uint32_t>(n);
+    }
+    };
+    return d.min;
+  }
+
+  // out_ is kept resized ahead of p_, grown by doubling. the writes below go through local copies of p_ and
+  // state_, stores through a uint8_t* would otherwise make the compiler reload them after every byte
+  void data_generator::grow(size_t n) {
+    size_t used = p_ - &(*out_)[0];
+    out_->resize(std::max(used + n, out_->size() * 2));
+    p_ = &(*out_)[0] + used;
+    end_ = &(*out_)[0] + out_->size();
+  }
+
+  inline void data_generator::ensure(size_t n) {
+    if (static_cast<size_t>(end_ - p_) < n)
+      grow(n);
+  }
+
+  void data_generator::write_varint(uint64_t v) {
+    ensure(10);
+    uint8_t* p = p_;
+    while (v >= 0x80) {
+      *p++ = static_cast<uint8_t>(v | 0x80);
+      v >>= 7;
+    }
+    *p++ = static_cast<uint8_t>(v);
+    p_ = p;
+  }
+
+  void data_generator::write_long(int64_t v) {
+    write_varint((static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+  }
+
+  // 10 characters per random number, whole groups written past the end so there is no loop for the rest
+  void data_generator::write_string(const size_distribution& d) {
+    uint32_t len = next_size(d);
+    write_long(len);
+    ensure(len + 10);
+    uint8_t* p = p_;
+    uint8_t* end = p + len;
+    uint64_t state = state_;
+    for (; p < end; p += 10) {
+      uint64_t r = splitmix(state);
+      for (int i = 0; i != 10; ++i, r >>= 6)
+        p[i] = alphabet[r & 63];
+    }
+    state_ = state;
+    p_ = end;
+  }
+
+  void data_generator::write_random_bytes(size_t n) {
+    ensure(n + 8);
+    uint8_t* p = p_;
+    uint8_t* end = p + n;
+    uint64_t state = state_;
+    for (; p < end; p += 8) {
+      uint64_t r = splitmix(state);
+#ifdef CSI_DATA_GENERATOR_LITTLE_ENDIAN
+      memcpy(p, &r, 8);
+#else
+      for (int i = 0; i != 8; ++i, r >>= 8)
+        p[i] = static_cast<uint8_t>(r);
+#endif
+    }
+    state_ = state;
+    p_ = end;
+  }
+
+  void data_generator::write(uint32_t index, size_t depth) {
+    const schema_program::op& o = program_.at(index);
+    switch (o.code) {
+    case schema_program::NUL:
+      break;
+    case schema_program::BOOL:
+      ensure(1);
+      *p_++ = static_cast<uint8_t>(next_random() >> 63);
+      break;
+    case schema_program::INT:
+    case schema_program::LONG:
+    {
+      int64_t min = config_.min_number;
+      int64_t max = config_.max_number;
+      if (o.code == schema_program::INT) {
+        min = std::min<int64_t>(std::max<int64_t>(min, std::numeric_limits<int32_t>::min()), std::numeric_limits<int32_t>::max());
+        max = std::min<int64_t>(std::max<int64_t>(max, std::numeric_limits<int32_t>::min()), std::numeric_limits<int32_t>::max());
+      }
+      uint64_t range = static_cast<uint64_t>(max) - static_cast<uint64_t>(min);
+      uint64_t r = next_random();
+      write_long(static_cast<int64_t>(static_cast<uint64_t>(min) + (range == std::numeric_limits<uint64_t>::max() ? r : below(r, range + 1))));
+    }
+    break;
+    case schema_program::FLOAT:
+    case schema_program::DOUBLE:
+    {
+      double u = (next_random() >> 11) * (1.0 / 9007199254740992.0);
+      double v = config_.min_number + u * (static_cast<double>(config_.max_number) - config_.min_number);
+      // little endian, as avro
+      uint64_t bits;
+      size_t   n;
+      if (o.code == schema_program::FLOAT) {
+        float    f = static_cast<float>(v);
+        uint32_t b;
+        memcpy(&b, &f, 4);
+        bits = b;
+        n = 4;
+      } else {
+        memcpy(&bits, &v, 8);
+        n = 8;
+      }
+      ensure(n);
+      uint8_t* p = p_;
+      for (size_t i = 0; i != n; ++i, bits >>= 8)
+        p[i] = static_cast<uint8_t>(bits);
+      p_ = p + n;
+    }
+    break;
+    case schema_program::STRING:
+      write_string(config_.string_length);
+      break;
+    case schema_program::BYTES:
+    {
+      uint32_t len = next_size(config_.bytes_length);
+      write_long(len);
+      write_random_bytes(len);
+    }
+    break;
+    case schema_program::FIXED:
+      write_random_bytes(o.size);
+      break;
+    case schema_program::ENUM:
+      write_long(static_cast<int64_t>(below(next_random(), o.size)));
+      break;
+    case schema_program::ARRAY:
+    case schema_program::MAP:
+    {
+      uint32_t n = depth >= config_.max_depth ? 0 : next_size(o.code == schema_program::ARRAY ? config_.array_size : config_.map_size);
+      if (n) {
+        write_long(n);
+        for (uint32_t i = 0; i != n; ++i) {
+          if (o.code == schema_program::MAP)
+            write_string(config_.string_length);
+          write(o.children, depth + 1);
+        }
+      }
+      write_long(0);
+    }
+    break;
+    case schema_program::UNION:
+    {
+      uint32_t branch = shortest_[index];
+      if (depth < config_.max_depth) {
+        const std::vector<uint64_t>& t = thresholds_[index];
+        uint64_t r = next_random() >> 32;
+        branch = 0;
+        while (r >= t[branch])
+          ++branch;
+      }
+      write_long(branch);
+      write(program_.child(o, branch), depth);
+    }
+    break;
+    case schema_program::RECORD:
+      for (size_t i = 0; i != o.size; ++i)
+        write(program_.child(o, i), depth + 1);
+      break;
+    };
+  }
+
+  size_t data_generator::generate(std::vector<uint8_t>& out) {
+    size_t start = out.size();
+    out.resize(start + std::max<size_t>(256, last_ + last_ / 4)); // mostly enough, zero filled once
+    out_ = &out;
+    p_ = &out[0] + start;
+    end_ = &out[0] + out.size();
+    write(program_.root(), 0);
+    size_t size = p_ - &out[0];
+    out.resize(size);
+    out_ = 0;
+    p_ = end_ = 0;
+    last_ = size - start;
+    return last_;
+  }
+
+  void data_generator::generate(avro::OutputStream& os) {
+    buffer_.clear();
+    generate(buffer_);
+    const uint8_t* p = buffer_.empty() ? 0 : &buffer_[0];
+    size_t         left = buffer_.size();
+    while (left) {
+      uint8_t* data;
+      size_t   len;
+      if (!os.next(&data, &len))
+        throw std::runtime_error("data_generator: output stream full");
+      size_t n = std::min(len, left);
+      memcpy(data, p, n);
+      p += n;
+      left -= n;
+      if (n < len)
+        os.backup(len - n);
+    }
+  }
+};
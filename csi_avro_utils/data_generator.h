@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <avro/Stream.hh>
+#include <avro/ValidSchema.hh>
+#include "schema_program.h"
+
+#pragma once
+
+namespace csi {
+  // string and bytes lengths, array and map item counts
+  struct size_distribution {
+    enum kind { FIXED, UNIFORM, GEOMETRIC };
+
+    kind     type;
+    uint32_t min;
+    uint32_t max;
+    double   mean; // GEOMETRIC: min plus a geometric count with this mean, capped at max
+
+    static size_distribution fixed(uint32_t n);
+    static size_distribution uniform(uint32_t min, uint32_t max);
+    static size_distribution geometric(uint32_t min, double mean, uint32_t max);
+  };
+
+  struct generator_config {
+    generator_config(); // the defaults below
+
+    uint64_t          seed;             // 1
+    size_distribution string_length;    // uniform 4..32, also map keys
+    size_distribution bytes_length;     // uniform 0..64
+    size_distribution array_size;       // geometric 0, mean 4, at most 64
+    size_distribution map_size;         // geometric 0, mean 4, at most 64
+    int64_t           min_number;       // int, long, float and double uniform in [min_number, max_number], 0
+    int64_t           max_number;       // 1000000, int clamped to its range
+    double            null_probability; // of the null branch of a union, the other branches share the rest. < 0: all
+                                        // branches equally likely, the default
+    size_t            max_depth;        // nested records, arrays and maps deeper than this are cut short: arrays and
+                                        // maps empty, unions the branch with the shortest encoding. 8
+
+    // "namespace.record.field" to the weight of each branch of the union in that field, overrides null_probability
+    std::map<std::string, std::vector<double> > branch_weights;
+  };
+
+  // deterministic random messages for a schema, avro binary encoded without going through an avro::Encoder.
+  // the same schema, config and seed give the same bytes. geometric sizes go through std::log, so other C libraries
+  // may give other bytes for them. not thread safe, use one per thread, ie seeded with the index of the chunk of
+  // messages it makes
+  class data_generator {
+    public:
+    explicit data_generator(const avro::ValidSchema& schema, const generator_config& config = generator_config());
+
+    void   reseed(uint64_t seed);
+    size_t generate(std::vector<uint8_t>& out); // appends one message, returns its size
+    void   generate(avro::OutputStream& os);    // one message, ie into a csi::pooled_output_stream after a header
+
+    const schema_program& program() const { return program_; }
+
+    private:
+    uint64_t next_random();
+    uint32_t next_size(const size_distribution& d);
+    void     write(uint32_t op, size_t depth);
+    void     write_varint(uint64_t v);
+    void     write_long(int64_t v);
+    void     write_string(const size_distribution& d);
+    void     write_random_bytes(size_t n);
+    void     ensure(size_t n);
+    void     grow(size_t n);
+
+    const schema_program               program_;
+    const generator_config             config_;
+    std::vector<std::vector<uint64_t> > thresholds_; // per op, UNION: cumulative branch probability scaled to 2^32
+    std::vector<uint32_t>               shortest_;   // per op, UNION: the branch with the fewest min_bytes
+    uint64_t                            state_;
+    std::vector<uint8_t>*               out_;
+    uint8_t*                            p_;          // next byte in out_, which is resized ahead
+    uint8_t*                            end_;
+    size_t                              last_;       // size of the previous message
+    std::vector<uint8_t>                buffer_;     // for generate(avro::OutputStream&)
+  };
+};
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cstring>
+#include <avro/Exception.hh>
+#include "envelope.h"
+#include "schema_store.h"
+#include "utils.h"
+
+namespace csi {
+  static int32_t read_id(const uint8_t* p) {
+    return (int32_t) (((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3]);
+  }
+
+  envelope_codec::envelope_codec(envelope_format format, const schema_store* store)
+    : format_(format)
+    , store_(store) {}
+
+  void envelope_codec::add(const schema_ptr& schema) {
+    if (format_ != HASH_ENVELOPE)
+      throw avro::Exception("envelope_codec: confluent envelopes need the schema id");
+    entry e = { schema, generate_hash(*schema), -1 };
+    std::lock_guard<std::mutex> lock(mutex_);
+    by_hash_.insert(std::make_pair(e.hash, e));
+  }
+
+  void envelope_codec::add(int32_t schema_id, const schema_ptr& schema) {
+    if (format_ != CONFLUENT_ENVELOPE)
+      throw avro::Exception("envelope_codec: hash envelopes carry no schema id");
+    entry e = { schema, generate_hash(*schema), schema_id };
+    std::lock_guard<std::mutex> lock(mutex_);
+    by_id_.insert(std::make_pair(schema_id, e)); // registry ids never change, parsers may hold on to the entry
+    by_hash_[e.hash] = e; // for write_header, the last id added wins
+  }
+
+  size_t envelope_codec::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return format_ == HASH_ENVELOPE ? by_hash_.size() : by_id_.size();
+  }
+
+  // appended where the stream is, the bytes may span the end of one chunk and the start of the next
+  static void write_bytes(pooled_output_stream& os, const uint8_t* data, size_t size) {
+    while (size) {
+      uint8_t* p;
+      size_t   len;
+      os.next(&p, &len);
+      size_t n = std::min(len, size);
+      memcpy(p, data, n);
+      os.backup(len - n);
+      data += n;
+      size -= n;
+    }
+  }
+
+  void envelope_codec::write_header(pooled_output_stream& os, const boost::uuids::uuid& hash) const {
+    if (format_ == HASH_ENVELOPE) {
+      write_bytes(os, hash.data, hash_header_size);
+      return;
+    }
+    int32_t id;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = by_hash_.find(hash);
+      if (it == by_hash_.end())
+        throw avro::Exception("envelope_codec: no schema id for " + to_string(hash));
+      id = it->second.schema_id;
+    }
+    uint8_t header[confluent_header_size];
+    header[0] = 0;
+    header[1] = (uint8_t) ((uint32_t) id >> 24);
+    header[2] = (uint8_t) ((uint32_t) id >> 16);
+    header[3] = (uint8_t) ((uint32_t) id >> 8);
+    header[4] = (uint8_t) id;
+    write_bytes(os, header, confluent_header_size);
+  }
+
+  const envelope_codec::entry* envelope_codec::lookup(const uint8_t* header) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (format_ == CONFLUENT_ENVELOPE) {
+      auto it = by_id_.find(read_id(header + 1));
+      return it == by_id_.end() ? 0 : &it->second;
+    }
+    boost::uuids::uuid hash;
+    memcpy(hash.data, header, hash_header_size);
+    auto it = by_hash_.find(hash);
+    if (it != by_hash_.end())
+      return &it->second;
+    if (!store_)
+      return 0;
+    schema_store::schema_ptr schema = store_->find(hash);
+    if (!schema)
+      return 0;
+    entry e = { schema, hash, -1 };
+    return &by_hash_.insert(std::make_pair(hash, e)).first->second;
+  }
+
+  // last is the entry of the previous message, ie of a batch, only looked up again when the header differs
+  const char* envelope_codec::parse(const uint8_t* data, size_t size, const entry*& last, envelope& out) const {
+    out.schema = 0;
+    out.error = 0;
+    if (size < header_size())
+      return out.error = "message shorter than the envelope header";
+    if (format_ == CONFLUENT_ENVELOPE) {
+      if (data[0] != 0)
+        return out.error = "no confluent magic byte";
+      if (!last || last->schema_id != read_id(data + 1))
+        last = lookup(data);
+    } else if (!last || memcmp(last->hash.data, data, hash_header_size) != 0) {
+      last = lookup(data);
+    }
+    if (!last)
+      return out.error = "unknown writer schema";
+    out.hash = last->hash;
+    out.schema_id = last->schema_id;
+    out.schema = last->schema.get();
+    out.body = data + header_size();
+    out.body_size = size - header_size();
+    return 0;
+  }
+
+  envelope envelope_codec::parse(const uint8_t* data, size_t size) const {
+    envelope     env;
+    const entry* last = 0;
+    if (parse(data, size, last, env)) {
+      if (size >= header_size() && (format_ == HASH_ENVELOPE || data[0] == 0)) {
+        std::string key;
+        if (format_ == HASH_ENVELOPE) {
+          boost::uuids::uuid hash;
+          memcpy(hash.data, data, hash_header_size);
+          key = to_string(hash);
+        } else {
+          key = std::to_string(read_id(data + 1));
+        }
+        throw avro::Exception(std::string("envelope_codec: ") + env.error + " " + key);
+      }
+      throw avro::Exception(std::string("envelope_codec: ") + env.error);
+    }
+    return env;
+  }
+
+  size_t envelope_codec::parse_batch(const std::vector<std::pair<const uint8_t*, size_t> >& messages,
+                                     std::vector<envelope>& out) const {
+    out.resize(messages.size());
+    const entry* last = 0;
+    size_t       parsed = 0;
+    for (size_t i = 0; i != messages.size(); ++i) {
+      if (!parse(messages[i].first, messages[i].second, last, out[i]))
+        ++parsed;
+    }
+    return parsed;
+  }
+};
@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <boost/shared_ptr.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/functional/hash.hpp>
+#include <avro/Encoder.hh>
+#include <avro/Specific.hh>
+#include <avro/ValidSchema.hh>
+#include "binary_codec.h"
+#include "pooled_output_stream.h"
+
+#pragma once
+
+namespace csi {
+  class schema_store;
+
+  // the header in front of the avro binary body on the wire
+  enum envelope_format {
+    HASH_ENVELOPE,     // the 16 byte generate_hash of the writer schema
+    CONFLUENT_ENVELOPE // magic byte 0 and the 4 byte big endian schema registry id
+  };
+
+  enum { hash_header_size = 16, confluent_header_size = 5 };
+
+  // a message parsed in place, body points into the parsed buffer
+  struct envelope {
+    boost::uuids::uuid       hash;      // generate_hash of the writer schema, for both formats
+    int32_t                  schema_id; // CONFLUENT_ENVELOPE, -1 otherwise
+    const avro::ValidSchema* schema;    // writer schema, null if the batch parse failed
+    const uint8_t*           body;
+    size_t                   body_size;
+    const char*              error;     // why the batch parse failed, null if it did not
+  };
+
+  // header plus body written into one pooled_output_stream, headers parsed in place with the writer schema looked up
+  // by hash or schema id. schemas are added up front; with a schema_store given, hashes not added are looked up there.
+  // parse may be called from several threads, also while schemas are added
+  class envelope_codec {
+    public:
+    typedef boost::shared_ptr<const avro::ValidSchema> schema_ptr;
+
+    explicit envelope_codec(envelope_format format, const schema_store* store = 0);
+
+    envelope_format format() const { return format_; }
+    size_t          header_size() const { return format_ == HASH_ENVELOPE ? hash_header_size : confluent_header_size; }
+
+    void add(const schema_ptr& schema);                  // HASH_ENVELOPE, keyed on generate_hash
+    void add(int32_t schema_id, const schema_ptr& schema); // CONFLUENT_ENVELOPE, the schema registry id
+
+    // os.reset(), the header for T::schema_hash() then v. CONFLUENT_ENVELOPE needs T's schema added with its id
+    template<class T> void encode(pooled_output_stream& os, avro::Encoder& e, const T& v) const {
+      os.reset();
+      write_header(os, T::schema_hash());
+      e.init(os);
+      avro::encode(e, v);
+      e.flush();
+    }
+
+    // appends the header to what os already holds. throws if the id is unknown, os is left as it was
+    void write_header(pooled_output_stream& os, const boost::uuids::uuid& hash) const;
+
+    // throws avro::Exception if data is too short, the magic byte is wrong or the schema is unknown
+    envelope parse(const uint8_t* data, size_t size) const;
+
+    // one lookup per run of messages with the same writer schema. failed messages get schema 0 and an error,
+    // returns the number parsed
+    size_t parse_batch(const std::vector<std::pair<const uint8_t*, size_t> >& messages, std::vector<envelope>& out) const;
+
+    // decodes the body into v without copying it, the writer schema must be T's. use the envelope's schema with an
+    // avro::resolvingDecoder for other writers
+    template<class T> void decode(const envelope& env, binary_decoder& d, T& v) const {
+      if (env.hash != T::schema_hash())
+        throw avro::Exception("envelope_codec: message written with another schema than the one decoded into");
+      d.init(env.body, env.body_size);
+      avro::decode(d, v);
+    }
+
+    size_t size() const; // schemas added
+
+    private:
+    struct entry {
+      schema_ptr         schema;
+      boost::uuids::uuid hash;
+      int32_t            schema_id;
+    };
+
+    typedef boost::hash<boost::uuids::uuid> uuid_hash;
+
+    const entry* lookup(const uint8_t* header) const; // locked, 0 if unknown
+    const char*  parse(const uint8_t* data, size_t size, const entry*& last, envelope& out) const;
+
+    const envelope_format                                     format_;
+    const schema_store*                                       store_;
+    mutable std::mutex                                        mutex_;
+    mutable std::unordered_map<boost::uuids::uuid, entry, uuid_hash> by_hash_;
+    std::unordered_map<int32_t, entry>                        by_id_;
+  };
+};
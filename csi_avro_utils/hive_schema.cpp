@@ -1,80 +1,97 @@
+#include <stdexcept>
 #include <boost/make_shared.hpp>
 #include "hive_schema.h"
+#include "arena_decoder.h"
 #include <avro/Generic.hh>
 #include <avro/Schema.hh>
 
 namespace csi {
   namespace avro_hive {
-    boost::shared_ptr<avro::Schema> create_hive_column_schema(avro::Type t) {
-      //AVRO_STRING,    /*!< String */
-      //    AVRO_BYTES,     /*!< Sequence of variable length bytes data */
-      //    AVRO_INT,       /*!< 32-bit integer */
-      //    
-      //    ,     /*!< Floating point number */
-      //    AVRO_DOUBLE,    /*!< Double precision floating point number */
-      //    AVRO_BOOL,      /*!< Boolean value */
-      //    AVRO_NULL,      /*!< Null */
-
-      //    AVRO_RECORD,    /*!< Record, a sequence of fields */
-      //    AVRO_ENUM,      /*!< Enumeration */
-      //    AVRO_ARRAY,     /*!< Homogeneous array of some specific type */
-      //    AVRO_MAP,       /*!< Homogeneous map from string to some specific type */
-      //    AVRO_UNION,     /*!< Union of one or more types */
-      //    AVRO_FIXED,     /*!< Fixed number of bytes */
-
-      boost::shared_ptr<avro::Schema>  value_schema;
-      switch(t) {
+    // lets us put existing nodes (records, arrays, maps...) into the schema builders
+    class node_schema : public avro::Schema {
+      public:
+      explicit node_schema(const avro::NodePtr& node) : avro::Schema(node) {}
+    };
+
+    static avro::NodePtr resolve(const avro::NodePtr& n) {
+      return (n->type() == avro::AVRO_SYMBOLIC) ? avro::resolveSymbol(n) : n;
+    }
+
+    static int null_branch(const avro::NodePtr& u) {
+      for (size_t i = 0; i != u->leaves(); ++i)
+        if (u->leafAt(i)->type() == avro::AVRO_NULL)
+          return static_cast<int>(i);
+      return -1;
+    }
+
+    // [null, T] or [T, null] -> T
+    static avro::NodePtr unwrap_nullable(const avro::NodePtr& src) {
+      avro::NodePtr n = resolve(src);
+      if (n->type() == avro::AVRO_UNION && n->leaves() == 2 && null_branch(n) >= 0)
+        return resolve(n->leafAt(1 - null_branch(n)));
+      return n;
+    }
+
+    // the native hive type of a column without null
+    boost::shared_ptr<avro::Schema> create_hive_strict_key_schema(const avro::NodePtr& src) {
+      avro::NodePtr n = unwrap_nullable(src);
+      switch(n->type()) {
       case avro::AVRO_INT:
-      value_schema = boost::make_shared<avro::IntSchema>();
-      break;
+      return boost::make_shared<avro::IntSchema>();
       case avro::AVRO_LONG:
-      value_schema = boost::make_shared<avro::LongSchema>();
-      break;
+      return boost::make_shared<avro::LongSchema>();
+      case avro::AVRO_FLOAT:
+      return boost::make_shared<avro::FloatSchema>();
+      case avro::AVRO_DOUBLE:
+      return boost::make_shared<avro::DoubleSchema>();
+      case avro::AVRO_BOOL:
+      return boost::make_shared<avro::BoolSchema>();
+      case avro::AVRO_BYTES:
+      case avro::AVRO_FIXED: // hive binary
+      return boost::make_shared<avro::BytesSchema>();
+      case avro::AVRO_STRING:
+      case avro::AVRO_ENUM:  // hive has no enums
+      return boost::make_shared<avro::StringSchema>();
       default:
-      value_schema = boost::make_shared<avro::StringSchema>();
-      break;
+      return boost::make_shared<node_schema>(n);
       };
+    }
+
+    boost::shared_ptr<avro::Schema> create_hive_column_schema(const avro::NodePtr& src) {
+      avro::NodePtr n = resolve(src);
 
       /* Make a union of value_schema with null. Some types are already a union,
       * in which case they must include null as the first branch of the union,
       * and return directly from the function without getting here (otherwise
       * we'd get a union inside a union, which is not valid Avro). */
-      boost::shared_ptr<avro::Schema> null_schema = boost::make_shared<avro::NullSchema>();
+      if (n->type() == avro::AVRO_NULL)
+        return boost::make_shared<avro::NullSchema>();
+
       boost::shared_ptr<avro::UnionSchema> union_schema = boost::make_shared<avro::UnionSchema>();
-      union_schema->addType(*null_schema);
-      union_schema->addType(*value_schema);
+      union_schema->addType(avro::NullSchema());
+      if (n->type() == avro::AVRO_UNION && !(n->leaves() == 2 && null_branch(n) >= 0)) {
+        if (null_branch(n) >= 0)
+          return boost::make_shared<node_schema>(n);
+        for (size_t i = 0; i != n->leaves(); ++i)
+          union_schema->addType(node_schema(n->leafAt(i)));
+        return union_schema;
+      }
+      union_schema->addType(*create_hive_strict_key_schema(n));
       return union_schema;
     }
 
-
-    boost::shared_ptr<avro::Schema> create_hive_strict_key_schema(avro::Type t) {
-      //AVRO_STRING,    /*!< String */
-      //    AVRO_BYTES,     /*!< Sequence of variable length bytes data */
-      //    AVRO_INT,       /*!< 32-bit integer */
-      //    
-      //    ,     /*!< Floating point number */
-      //    AVRO_DOUBLE,    /*!< Double precision floating point number */
-      //    AVRO_BOOL,      /*!< Boolean value */
-      //    AVRO_NULL,      /*!< Null */
-
-      //    AVRO_RECORD,    /*!< Record, a sequence of fields */
-      //    AVRO_ENUM,      /*!< Enumeration */
-      //    AVRO_ARRAY,     /*!< Homogeneous array of some specific type */
-      //    AVRO_MAP,       /*!< Homogeneous map from string to some specific type */
-      //    AVRO_UNION,     /*!< Union of one or more types */
-      //    AVRO_FIXED,     /*!< Fixed number of bytes */
-
-      boost::shared_ptr<avro::Schema>  value_schema;
+    static bool is_key_type(avro::Type t) {
       switch(t) {
       case avro::AVRO_INT:
-      return boost::make_shared<avro::IntSchema>();
-      break;
       case avro::AVRO_LONG:
-      return boost::make_shared<avro::LongSchema>();
-      break;
+      case avro::AVRO_FLOAT:
+      case avro::AVRO_DOUBLE:
+      case avro::AVRO_BOOL:
+      case avro::AVRO_BYTES:
+      case avro::AVRO_STRING:
+      return true;
       default:
-      return boost::make_shared<avro::StringSchema>();
-      break;
+      return false;
       };
     }
 
@@ -89,10 +106,13 @@ namespace csi {
           auto name = r->nameAt(j);
           if(name == *i) {
             auto l = r->leafAt(j);
+            boost::shared_ptr<avro::Schema> strict = create_hive_strict_key_schema(l);
+            if(!is_key_type(strict->type()))
+              throw std::domain_error(std::string("unsupported key column type: ") + *i + " " + avro::toString(strict->type()));
             if(allow_null)
-              key_schema->addField(*i, *create_hive_column_schema(l->type()));
+              key_schema->addField(*i, *create_hive_column_schema(l));
             else
-              key_schema->addField(*i, *create_hive_strict_key_schema(l->type()));
+              key_schema->addField(*i, *strict);
             break;
           }
         }
@@ -100,13 +120,108 @@ namespace csi {
       return boost::make_shared<avro::ValidSchema>(*key_schema);
     }
 
-    boost::shared_ptr<avro::ValidSchema> get_value_schema(const std::string& schema_name, const avro::ValidSchema& src_schema, const avro::ValidSchema& key_schema) {
+    boost::shared_ptr<avro::ValidSchema> get_value_schema(const avro::Name& schema_name, const avro::ValidSchema& src_schema, const avro::ValidSchema& key_schema) {
       auto r = src_schema.root();
       assert(r->type() == avro::AVRO_RECORD);
-      boost::shared_ptr<avro::RecordSchema> value_schema = boost::make_shared<avro::RecordSchema>(schema_name);
+      boost::shared_ptr<avro::RecordSchema> value_schema = boost::make_shared<avro::RecordSchema>(schema_name.fullname());
+      for(size_t j = 0; j != r->leaves(); ++j) {
+        size_t index;
+        if(key_schema.root()->nameIndex(r->nameAt(j), index))
+          continue;
+        value_schema->addField(r->nameAt(j), *create_hive_column_schema(r->leafAt(j)));
+      }
       return boost::make_shared<avro::ValidSchema>(*value_schema);
     }
 
+    // how the branch of a hive column is selected from the source column
+    enum branch_mode {
+      PLAIN,    // not a union - strict keys
+      NULLABLE, // [null, T] from T, [null, T] or [T, null] - branch 0 if the source is null, otherwise 1
+      SAME,     // the source union as is, null may be any branch
+      SHIFT     // null added in front of the source union
+    };
+
+    static branch_mode column_mode(const avro::NodePtr& src, const avro::NodePtr& dst) {
+      avro::NodePtr s = resolve(src);
+      if(dst->type() != avro::AVRO_UNION)
+        return PLAIN;
+      if(s->type() != avro::AVRO_UNION || dst->leaves() == 2)
+        return NULLABLE;
+      return (dst->leaves() == s->leaves()) ? SAME : SHIFT;
+    }
+
+    // src and dst are looked through, dst is on the right branch
+    static void assign_value(const avro::GenericDatum& src, avro::GenericDatum& dst) {
+      switch(dst.type()) {
+      case avro::AVRO_NULL:
+      break;
+      case avro::AVRO_BOOL:
+      dst.value<bool>() = src.value<bool>();
+      break;
+      case avro::AVRO_INT:
+      dst.value<int32_t>() = src.value<int32_t>();
+      break;
+      case avro::AVRO_LONG:
+      dst.value<int64_t>() = src.value<int64_t>();
+      break;
+      case avro::AVRO_FLOAT:
+      dst.value<float>() = src.value<float>();
+      break;
+      case avro::AVRO_DOUBLE:
+      dst.value<double>() = src.value<double>();
+      break;
+      case avro::AVRO_STRING:
+      if(src.type() == avro::AVRO_ENUM)
+        dst.value<std::string>() = src.value<avro::GenericEnum>().symbol();
+      else
+        dst.value<std::string>() = src.value<std::string>();
+      break;
+      case avro::AVRO_BYTES:
+      if(src.type() == avro::AVRO_FIXED)
+        dst.value<std::vector<uint8_t>>() = src.value<avro::GenericFixed>().value();
+      else
+        dst.value<std::vector<uint8_t>>() = src.value<std::vector<uint8_t>>();
+      break;
+      case avro::AVRO_RECORD:
+      dst.value<avro::GenericRecord>() = src.value<avro::GenericRecord>();
+      break;
+      case avro::AVRO_ARRAY:
+      dst.value<avro::GenericArray>() = src.value<avro::GenericArray>();
+      break;
+      case avro::AVRO_MAP:
+      dst.value<avro::GenericMap>() = src.value<avro::GenericMap>();
+      break;
+      case avro::AVRO_ENUM:
+      dst.value<avro::GenericEnum>() = src.value<avro::GenericEnum>();
+      break;
+      case avro::AVRO_FIXED:
+      dst.value<avro::GenericFixed>() = src.value<avro::GenericFixed>();
+      break;
+      default:
+      throw std::domain_error(std::string("unsupported hive column type: ") + avro::toString(dst.type()));
+      };
+    }
+
+    // type() and value<T>() look through unions so we must ask isUnion()
+    static void copy_column(const avro::GenericDatum& src, avro::GenericDatum& dst, int mode) {
+      switch(mode) {
+      case PLAIN:
+      if(src.type() == avro::AVRO_NULL && dst.type() != avro::AVRO_NULL)
+        throw std::domain_error("null value in strict key column");
+      break;
+      case NULLABLE:
+      dst.selectBranch(src.type() == avro::AVRO_NULL ? 0 : 1);
+      break;
+      case SAME:
+      dst.selectBranch(src.unionBranch());
+      break;
+      case SHIFT:
+      dst.selectBranch(src.unionBranch() + 1);
+      break;
+      };
+      assign_value(src, dst);
+    }
+
     boost::shared_ptr<avro::GenericDatum> get_key(avro::GenericDatum& value_datum, const avro::ValidSchema& key_schema) {
       boost::shared_ptr<avro::GenericDatum> key = boost::make_shared<avro::GenericDatum>(key_schema);
       assert(key_schema.root()->type() == avro::AVRO_RECORD);
@@ -116,22 +231,105 @@ namespace csi {
       avro::GenericRecord& key_record(key->value<avro::GenericRecord>());
       avro::GenericRecord& value_record(value_datum.value<avro::GenericRecord>());
 
-      //size_t nValueFields = value_record.fieldCount();
-
-      for(int i = 0; i < nKeyFields; i++) {
+      for(size_t i = 0; i < nKeyFields; i++) {
         std::string column_name = key_schema.root()->nameAt(i);
         assert(value_record.hasField(column_name));
-        assert(key_record.hasField(column_name));
-        // we need to handle keys with or without nulls ie union or value
-        if(key_record.field(column_name).type() == avro::AVRO_UNION) {
-          key_record.field(column_name) = value_record.field(column_name);
-        } else {
-          avro::GenericUnion& au(value_record.field(column_name).value<avro::GenericUnion>());
-          avro::GenericDatum& actual_column_value = au.datum();
-          key_record.field(column_name) = actual_column_value;
-        }
+        size_t src_index = value_record.fieldIndex(column_name);
+        int mode = column_mode(value_record.schema()->leafAt(src_index), key_schema.root()->leafAt(i));
+        copy_column(value_record.fieldAt(src_index), key_record.fieldAt(i), mode);
+      }
+      return key;
+    }
+
+    // key columns are primitives or [null, primitive], see get_key_schema
+    static void assign_value(const csi::arena_datum& src, avro::GenericDatum& dst) {
+      switch(dst.type()) {
+      case avro::AVRO_NULL:
+      break;
+      case avro::AVRO_BOOL:
+      dst.value<bool>() = src.value<bool>();
+      break;
+      case avro::AVRO_INT:
+      dst.value<int32_t>() = src.value<int32_t>();
+      break;
+      case avro::AVRO_LONG:
+      dst.value<int64_t>() = src.value<int64_t>();
+      break;
+      case avro::AVRO_FLOAT:
+      dst.value<float>() = src.value<float>();
+      break;
+      case avro::AVRO_DOUBLE:
+      dst.value<double>() = src.value<double>();
+      break;
+      case avro::AVRO_STRING:
+      if(src.type() == avro::AVRO_ENUM)
+        dst.value<std::string>() = src.symbol();
+      else if(src.type() == avro::AVRO_STRING)
+        dst.value<std::string>().assign(reinterpret_cast<const char*>(src.data()), src.size());
+      else
+        throw std::bad_cast();
+      break;
+      case avro::AVRO_BYTES:
+      if(src.type() != avro::AVRO_BYTES && src.type() != avro::AVRO_FIXED)
+        throw std::bad_cast();
+      dst.value<std::vector<uint8_t>>().assign(src.data(), src.data() + src.size());
+      break;
+      default:
+      throw std::domain_error(std::string("unsupported key column type: ") + avro::toString(dst.type()));
+      };
+    }
+
+    boost::shared_ptr<avro::GenericDatum> get_key(const csi::arena_datum& value_datum, const avro::ValidSchema& key_schema) {
+      boost::shared_ptr<avro::GenericDatum> key = boost::make_shared<avro::GenericDatum>(key_schema);
+      assert(key_schema.root()->type() == avro::AVRO_RECORD);
+      avro::GenericRecord& key_record(key->value<avro::GenericRecord>());
+      for(size_t i = 0; i != key_record.fieldCount(); i++) {
+        csi::arena_datum src = value_datum.field(key_schema.root()->nameAt(i));
+        avro::GenericDatum& dst = key_record.fieldAt(i);
+        if(dst.isUnion())
+          dst.selectBranch(src.type() == avro::AVRO_NULL ? 0 : 1);
+        else if(src.type() == avro::AVRO_NULL)
+          throw std::domain_error("null value in strict key column");
+        assign_value(src, dst);
       }
       return key;
     }
+
+    hive_row_converter::hive_row_converter(const avro::ValidSchema& src_schema, const std::vector<std::string>& keys, bool allow_null,
+                                           const avro::Name& key_schema_name, const avro::Name& value_schema_name)
+      : src_schema_(boost::make_shared<avro::ValidSchema>(src_schema))
+      , key_schema_(get_key_schema(key_schema_name, keys, allow_null, src_schema))
+      , value_schema_(get_value_schema(value_schema_name, src_schema, *key_schema_)) {
+      auto r = src_schema.root();
+      for(size_t j = 0; j != r->leaves(); ++j) {
+        column_op op;
+        op.src_index = j;
+        op.to_key = key_schema_->root()->nameIndex(r->nameAt(j), op.dst_index);
+        if(!op.to_key && !value_schema_->root()->nameIndex(r->nameAt(j), op.dst_index))
+          continue;
+        const avro::ValidSchema& dst = op.to_key ? *key_schema_ : *value_schema_;
+        op.mode = column_mode(r->leafAt(j), dst.root()->leafAt(op.dst_index));
+        ops_.push_back(op);
+      }
+    }
+
+    void hive_row_converter::convert(const avro::GenericDatum& row, avro::GenericDatum& key, avro::GenericDatum& value) const {
+      const avro::GenericRecord& src = row.value<avro::GenericRecord>();
+      avro::GenericRecord& key_record = key.value<avro::GenericRecord>();
+      avro::GenericRecord& value_record = value.value<avro::GenericRecord>();
+      for(std::vector<column_op>::const_iterator i = ops_.begin(); i != ops_.end(); ++i)
+        copy_column(src.fieldAt(i->src_index), (i->to_key ? key_record : value_record).fieldAt(i->dst_index), i->mode);
+    }
+
+    void hive_row_converter::convert(const std::vector<avro::GenericDatum>& rows, std::vector<avro::GenericDatum>& keys, std::vector<avro::GenericDatum>& values) const {
+      keys.reserve(rows.size());
+      values.reserve(rows.size());
+      while(keys.size() < rows.size())
+        keys.push_back(avro::GenericDatum(*key_schema_));
+      while(values.size() < rows.size())
+        values.push_back(avro::GenericDatum(*value_schema_));
+      for(size_t i = 0; i != rows.size(); ++i)
+        convert(rows[i], keys[i], values[i]);
+    }
   };
-};
\ No newline at end of file
+};
@@ -1,10 +1,51 @@
 #pragma once
+#include <vector>
+#include <string>
 #include <avro/ValidSchema.hh>
+#include <avro/Generic.hh>
 
 namespace csi {
+  class arena_datum; // csi_avro_utils/arena_decoder.h
+
   namespace avro_hive {
+    // hive columns keep their native types: int, long, float, double, boolean, string and bytes as is,
+    // enum becomes string, fixed becomes bytes, nullable unions are unwrapped, records, arrays, maps and
+    // other unions are kept as they are. value columns (and keys if allow_null) are nullable: [null, T] for
+    // plain and two branch nullable columns, null added in front of other unions unless they already have
+    // null, those are kept with null where it is.
     boost::shared_ptr<avro::ValidSchema>  get_key_schema(const avro::Name& key_schema_name, const std::vector<std::string>& keys, bool allow_null, const avro::ValidSchema& value_schema);
+    boost::shared_ptr<avro::ValidSchema>  get_value_schema(const avro::Name& value_schema_name, const avro::ValidSchema& src_schema, const avro::ValidSchema& key_schema); // all columns not in key_schema
     boost::shared_ptr<avro::GenericDatum> get_key(avro::GenericDatum& value_datum, const avro::ValidSchema& key_schema);
+    boost::shared_ptr<avro::GenericDatum> get_key(const csi::arena_datum& value_datum, const avro::ValidSchema& key_schema);
+
+    // source record -> hive key and value records in one pass over the source columns
+    // the column mapping is resolved once, key and value datums are reused between calls
+    class hive_row_converter {
+      public:
+      hive_row_converter(const avro::ValidSchema& src_schema, const std::vector<std::string>& keys, bool allow_null,
+                         const avro::Name& key_schema_name, const avro::Name& value_schema_name);
+
+      const boost::shared_ptr<avro::ValidSchema>& key_schema() const { return key_schema_; }
+      const boost::shared_ptr<avro::ValidSchema>& value_schema() const { return value_schema_; }
+
+      // key and value must be created from key_schema() and value_schema()
+      void convert(const avro::GenericDatum& row, avro::GenericDatum& key, avro::GenericDatum& value) const;
+
+      // keys and values are grown to rows.size(), existing elements are reused
+      void convert(const std::vector<avro::GenericDatum>& rows, std::vector<avro::GenericDatum>& keys, std::vector<avro::GenericDatum>& values) const;
+
+      private:
+      struct column_op {
+        size_t src_index;
+        bool   to_key;
+        size_t dst_index;
+        int    mode;      // how union branches map, see hive_schema.cpp
+      };
+
+      boost::shared_ptr<avro::ValidSchema> src_schema_;
+      boost::shared_ptr<avro::ValidSchema> key_schema_;
+      boost::shared_ptr<avro::ValidSchema> value_schema_;
+      std::vector<column_op>               ops_; // in source column order
+    };
   };
 };
-
@@ -0,0 +1,140 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "json_writer.h"
+
+namespace csi {
+  namespace json {
+    static const char digit_pairs[] =
+      "00010203040506070809"
+      "10111213141516171819"
+      "20212223242526272829"
+      "30313233343536373839"
+      "40414243444546474849"
+      "50515253545556575859"
+      "60616263646566676869"
+      "70717273747576777879"
+      "80818283848586878889"
+      "90919293949596979899";
+
+    void write_int(int64_t v, json_buffer& out) {
+      char buf[24];
+      char* end = buf + sizeof(buf);
+      char* p = end;
+      uint64_t n = v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v);
+      while (n >= 100) {
+        size_t i = (n % 100) * 2;
+        n /= 100;
+        *--p = digit_pairs[i + 1];
+        *--p = digit_pairs[i];
+      }
+      if (n >= 10) {
+        *--p = digit_pairs[n * 2 + 1];
+        *--p = digit_pairs[n * 2];
+      } else {
+        *--p = static_cast<char>('0' + n);
+      }
+      if (v < 0)
+        *--p = '-';
+      out.append(p, end - p);
+    }
+
+    // snprintf follows LC_NUMERIC, whatever the locale uses as decimal point becomes '.'
+    static void append_number(const char* buf, int len, json_buffer& out) {
+      for (int i = 0; i != len; ++i) {
+        char c = buf[i];
+        out.put((c >= '0' && c <= '9') || c == '-' || c == '+' || c == 'e' ? c : '.');
+      }
+    }
+
+    static bool write_special(double v, json_buffer& out) {
+      if (std::isnan(v)) {
+        out.append("\"NaN\"", 5);
+        return true;
+      }
+      if (std::isinf(v)) {
+        v > 0 ? out.append("\"Infinity\"", 10) : out.append("\"-Infinity\"", 11);
+        return true;
+      }
+      // integral values, the common case for counters and ids, without printf
+      if (v == std::floor(v) && std::fabs(v) < 1e15) {
+        if (v == 0 && std::signbit(v))
+          out.put('-');
+        write_int(static_cast<int64_t>(v), out);
+        out.append(".0", 2);
+        return true;
+      }
+      return false;
+    }
+
+    // shortest of 15 and 17 significant digits that reads back as the same value
+    void write_double(double v, json_buffer& out) {
+      if (write_special(v, out))
+        return;
+      char buf[32];
+      int len = snprintf(buf, sizeof(buf), "%.15g", v);
+      if (strtod(buf, 0) != v)
+        len = snprintf(buf, sizeof(buf), "%.17g", v);
+      append_number(buf, len, out);
+    }
+
+    void write_float(float v, json_buffer& out) {
+      if (write_special(v, out))
+        return;
+      char buf[32];
+      int len = snprintf(buf, sizeof(buf), "%.7g", v);
+      if (static_cast<float>(strtod(buf, 0)) != v)
+        len = snprintf(buf, sizeof(buf), "%.9g", v);
+      append_number(buf, len, out);
+    }
+
+    static const char hex_digits[] = "0123456789abcdef";
+
+    static void write_escaped(unsigned char c, json_buffer& out) {
+      switch (c) {
+      case '"':  out.append("\\\"", 2); break;
+      case '\\': out.append("\\\\", 2); break;
+      case '\b': out.append("\\b", 2); break;
+      case '\f': out.append("\\f", 2); break;
+      case '\n': out.append("\\n", 2); break;
+      case '\r': out.append("\\r", 2); break;
+      case '\t': out.append("\\t", 2); break;
+      default:
+        {
+          char u[6] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xf] };
+          out.append(u, 6);
+        }
+      };
+    }
+
+    // utf-8 passes through, only quotes, backslashes and control characters are escaped
+    void write_string(const char* s, size_t len, json_buffer& out) {
+      out.put('"');
+      const char* run = s;
+      const char* end = s + len;
+      for (const char* p = s; p != end; ++p) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c >= 0x20 && c != '"' && c != '\\')
+          continue;
+        out.append(run, p - run);
+        write_escaped(c, out);
+        run = p + 1;
+      }
+      out.append(run, end - run);
+      out.put('"');
+    }
+
+    // one character per byte, as avro does
+    void write_bytes(const uint8_t* p, size_t len, json_buffer& out) {
+      out.put('"');
+      for (size_t i = 0; i != len; ++i) {
+        uint8_t c = p[i];
+        if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\')
+          out.put(static_cast<char>(c));
+        else
+          write_escaped(c, out);
+      }
+      out.put('"');
+    }
+  };
+};
@@ -0,0 +1,115 @@
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <boost/array.hpp>
+#include "logical_types.h"
+
+#pragma once
+
+// avro json encoding of csi_avrogencpp --json generated types, the generator emits a to_json() per record,
+// union and enum and this file has the primitives and containers. no iostreams and no locale:
+// numbers are formatted by hand or normalized to '.' as decimal point.
+//
+// the output follows the avro json encoding: unions are {"branch type": value} or null, bytes and fixed
+// are strings with one \u00XX character per byte above 0x7f. NaN and infinities, which json cannot
+// express, are written as the strings "NaN", "Infinity" and "-Infinity"
+
+namespace csi {
+  class json_buffer {
+    public:
+    json_buffer() {}
+
+    void append(const char* s, size_t len) { buf_.append(s, len); }
+    void append(const char* s) { buf_.append(s); }
+    void put(char c) { buf_.push_back(c); }
+
+    void               clear() { buf_.clear(); }
+    void               reserve(size_t n) { buf_.reserve(n); }
+    const char*        data() const { return buf_.data(); }
+    size_t             size() const { return buf_.size(); }
+    const std::string& str() const { return buf_; }
+
+    private:
+    std::string buf_;
+  };
+
+  namespace json {
+    void write_int(int64_t v, json_buffer& out);
+    void write_double(double v, json_buffer& out);
+    void write_float(float v, json_buffer& out);
+    void write_string(const char* s, size_t len, json_buffer& out);
+    void write_bytes(const uint8_t* p, size_t len, json_buffer& out);
+
+    inline void to_json(bool v, json_buffer& out) { v ? out.append("true", 4) : out.append("false", 5); }
+    inline void to_json(int32_t v, json_buffer& out) { write_int(v, out); }
+    inline void to_json(int64_t v, json_buffer& out) { write_int(v, out); }
+    inline void to_json(float v, json_buffer& out) { write_float(v, out); }
+    inline void to_json(double v, json_buffer& out) { write_double(v, out); }
+    inline void to_json(const std::string& v, json_buffer& out) { write_string(v.data(), v.size(), out); }
+    inline void to_json(const std::vector<uint8_t>& v, json_buffer& out) { write_bytes(v.data(), v.size(), out); }
+    template<size_t N> inline void to_json(const boost::array<uint8_t, N>& v, json_buffer& out) { write_bytes(v.data(), N, out); }
+
+    // logical types are written as their underlying avro type, decimals as the two's complement bytes
+    inline void write_decimal(int64_t hi, uint64_t lo, size_t fixed_size, json_buffer& out) {
+      uint8_t buf[16];
+      size_t  first = logical::to_twos_complement(hi, lo, buf);
+      if (fixed_size == 0) {
+        write_bytes(buf + first, 16 - first, out);
+      } else if (fixed_size <= 16) {
+        write_bytes(buf + 16 - fixed_size, fixed_size, out);
+      } else {
+        std::vector<uint8_t> v(fixed_size - 16, hi < 0 ? 0xff : 0x00);
+        v.insert(v.end(), buf, buf + 16);
+        write_bytes(v.data(), v.size(), out);
+      }
+    }
+
+    template<int S, size_t F> inline void to_json(const decimal64<S, F>& v, json_buffer& out) { write_decimal(v.unscaled < 0 ? -1 : 0, static_cast<uint64_t>(v.unscaled), F, out); }
+    template<int S, size_t F> inline void to_json(const decimal128<S, F>& v, json_buffer& out) { write_decimal(v.hi, v.lo, F, out); }
+    template<class C, class D> inline void to_json(const std::chrono::time_point<C, D>& v, json_buffer& out) { write_int(v.time_since_epoch().count(), out); }
+    template<class R, class P> inline void to_json(const std::chrono::duration<R, P>& v, json_buffer& out) { write_int(v.count(), out); }
+
+    inline void to_json(const uuid& v, json_buffer& out) {
+      char buf[36];
+      logical::format_uuid(v, buf);
+      out.put('"');
+      out.append(buf, 36);
+      out.put('"');
+    }
+
+    template<class T> void to_json(const std::vector<T>& v, json_buffer& out);
+    template<class T> void to_json(const std::map<std::string, T>& v, json_buffer& out);
+
+    template<class T> void to_json(const std::vector<T>& v, json_buffer& out) {
+      out.put('[');
+      for (typename std::vector<T>::const_iterator i = v.begin(); i != v.end(); ++i) {
+        if (i != v.begin())
+          out.put(',');
+        to_json(*i, out);
+      }
+      out.put(']');
+    }
+
+    template<class T> void to_json(const std::map<std::string, T>& v, json_buffer& out) {
+      out.put('{');
+      for (typename std::map<std::string, T>::const_iterator i = v.begin(); i != v.end(); ++i) {
+        if (i != v.begin())
+          out.put(',');
+        write_string(i->first.data(), i->first.size(), out);
+        out.put(':');
+        to_json(i->second, out);
+      }
+      out.put('}');
+    }
+  };
+
+  // the json of any generated type, ie csi::to_json_string(record)
+  template<class T> std::string to_json_string(const T& v) {
+    using csi::json::to_json;
+    json_buffer out;
+    to_json(v, out);
+    return out.str();
+  }
+};
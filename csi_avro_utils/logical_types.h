@@ -0,0 +1,290 @@
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <boost/uuid/uuid.hpp>
+#include <avro/Encoder.hh>
+#include <avro/Decoder.hh>
+#include <avro/Specific.hh>
+#include <avro/Exception.hh>
+
+#pragma once
+
+// native c++ types for avro logical types, used by csi_avrogencpp --logical-types generated code
+//
+//   decimal (bytes or fixed)  precision <= 18: csi::decimal64<Scale, FixedSize>, <= 38: csi::decimal128<Scale, FixedSize>
+//   timestamp-millis (long)   csi::timestamp_millis, a std::chrono::system_clock time point
+//   timestamp-micros (long)   csi::timestamp_micros
+//   time-millis (int)         csi::time_millis, a std::chrono duration since midnight
+//   time-micros (long)        csi::time_micros
+//   date (int)                csi::date, a std::chrono::system_clock time point with days resolution
+//   uuid (string)             csi::uuid, a boost::uuids::uuid
+//
+// the avro::codec_traits below convert straight between the wire format and the native value: decimals are
+// read from the two's complement bytes into the scaled integer and uuids are parsed from their 36 characters,
+// there is no intermediate bignum. FixedSize is the size of the underlying fixed, 0 for bytes.
+// the uuid codec is on csi::uuid, not boost::uuids::uuid, so including this header does not change how
+// other code encodes a plain boost::uuids::uuid
+
+namespace csi {
+  typedef std::chrono::duration<int32_t, std::ratio<86400> >                          days;
+  typedef std::chrono::time_point<std::chrono::system_clock, std::chrono::milliseconds> timestamp_millis;
+  typedef std::chrono::time_point<std::chrono::system_clock, std::chrono::microseconds> timestamp_micros;
+  typedef std::chrono::time_point<std::chrono::system_clock, days>                      date;
+  typedef std::chrono::duration<int32_t, std::milli>                                    time_millis;
+  typedef std::chrono::microseconds                                                     time_micros;
+
+  namespace logical {
+    inline double pow10(int n) {
+      double p = 1;
+      for (int i = 0; i < n; ++i)
+        p *= 10;
+      return p;
+    }
+
+    // decimal digits of the 128 bit two's complement value hi:lo with the point scale digits from the right
+    inline std::string format_decimal(int64_t hi, uint64_t lo, int scale) {
+      bool negative = hi < 0;
+      uint64_t mhi = static_cast<uint64_t>(hi);
+      uint64_t mlo = lo;
+      if (negative) {
+        mlo = ~mlo + 1;
+        mhi = ~mhi + (mlo == 0 ? 1 : 0);
+      }
+      char digits[48];
+      char* p = digits + sizeof(digits);
+      uint32_t limb[4] = { static_cast<uint32_t>(mhi >> 32), static_cast<uint32_t>(mhi), static_cast<uint32_t>(mlo >> 32), static_cast<uint32_t>(mlo) };
+      do {
+        uint64_t rem = 0;
+        for (int i = 0; i != 4; ++i) {
+          uint64_t cur = (rem << 32) | limb[i];
+          limb[i] = static_cast<uint32_t>(cur / 10);
+          rem = cur % 10;
+        }
+        *--p = static_cast<char>('0' + rem);
+      } while (limb[0] | limb[1] | limb[2] | limb[3]);
+      std::string s(p, digits + sizeof(digits));
+      if (scale > 0) {
+        if (s.size() <= static_cast<size_t>(scale))
+          s.insert(0, scale + 1 - s.size(), '0');
+        s.insert(s.size() - scale, 1, '.');
+      }
+      return negative ? "-" + s : s;
+    }
+
+    // shortest big endian two's complement of hi:lo, returns the offset of the first byte in buf
+    inline size_t to_twos_complement(int64_t hi, uint64_t lo, uint8_t (&buf)[16]) {
+      for (int i = 0; i != 8; ++i) {
+        buf[7 - i] = static_cast<uint8_t>(static_cast<uint64_t>(hi) >> (8 * i));
+        buf[15 - i] = static_cast<uint8_t>(lo >> (8 * i));
+      }
+      size_t first = 0;
+      while (first != 15 && ((buf[first] == 0x00 && !(buf[first + 1] & 0x80)) || (buf[first] == 0xff && (buf[first + 1] & 0x80))))
+        ++first;
+      return first;
+    }
+
+    // sign extends the big endian two's complement p[0..n) into hi:lo, throws if it does not fit in max_bytes
+    inline void from_twos_complement(const uint8_t* p, size_t n, size_t max_bytes, int64_t& hi, uint64_t& lo) {
+      if (n == 0) {
+        hi = 0;
+        lo = 0;
+        return;
+      }
+      uint8_t sign = (p[0] & 0x80) ? 0xff : 0x00;
+      for (; n > max_bytes; ++p, --n)
+        if (*p != sign || ((p[1] ^ sign) & 0x80))
+          throw avro::Exception("decimal value out of range");
+      uint64_t h = sign ? ~0ULL : 0;
+      uint64_t l = h;
+      for (size_t i = 0; i != n; ++i) {
+        h = (h << 8) | (l >> 56);
+        l = (l << 8) | p[i];
+      }
+      hi = static_cast<int64_t>(h);
+      lo = l;
+    }
+
+    inline std::vector<uint8_t>& scratch() {
+      static thread_local std::vector<uint8_t> buf;
+      return buf;
+    }
+
+    inline void encode_decimal(avro::Encoder& e, int64_t hi, uint64_t lo, size_t fixed_size) {
+      uint8_t buf[16];
+      size_t first = to_twos_complement(hi, lo, buf);
+      if (fixed_size == 0) {
+        e.encodeBytes(buf + first, 16 - first);
+        return;
+      }
+      if (16 - first > fixed_size)
+        throw avro::Exception("decimal value does not fit in fixed");
+      if (fixed_size <= 16) {
+        e.encodeFixed(buf + 16 - fixed_size, fixed_size);
+        return;
+      }
+      std::vector<uint8_t>& v = scratch();
+      v.assign(fixed_size - 16, hi < 0 ? 0xff : 0x00);
+      v.insert(v.end(), buf, buf + 16);
+      e.encodeFixed(v.data(), v.size());
+    }
+
+    inline void decode_decimal(avro::Decoder& d, size_t fixed_size, size_t max_bytes, int64_t& hi, uint64_t& lo) {
+      std::vector<uint8_t>& v = scratch();
+      if (fixed_size == 0)
+        d.decodeBytes(v);
+      else
+        d.decodeFixed(fixed_size, v);
+      from_twos_complement(v.data(), v.size(), max_bytes, hi, lo);
+    }
+
+    inline void format_uuid(const boost::uuids::uuid& u, char (&out)[36]) {
+      static const char hex[] = "0123456789abcdef";
+      char* p = out;
+      for (size_t i = 0; i != 16; ++i) {
+        if (i == 4 || i == 6 || i == 8 || i == 10)
+          *p++ = '-';
+        *p++ = hex[u.data[i] >> 4];
+        *p++ = hex[u.data[i] & 0xf];
+      }
+    }
+
+    inline int hex_value(char c) {
+      if (c >= '0' && c <= '9')
+        return c - '0';
+      if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+      if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+      return -1;
+    }
+
+    inline bool parse_uuid(const char* s, size_t len, boost::uuids::uuid& u) {
+      if (len != 36)
+        return false;
+      size_t j = 0;
+      for (size_t i = 0; i != 16; ++i) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+          if (s[j++] != '-')
+            return false;
+        }
+        int h = hex_value(s[j++]);
+        int l = hex_value(s[j++]);
+        if (h < 0 || l < 0)
+          return false;
+        u.data[i] = static_cast<uint8_t>((h << 4) | l);
+      }
+      return true;
+    }
+  };
+
+  // a boost::uuids::uuid encoded as its 36 character string, nil by default
+  struct uuid : boost::uuids::uuid {
+    uuid() { std::memset(data, 0, sizeof(data)); }
+    uuid(const boost::uuids::uuid& u) : boost::uuids::uuid(u) {}
+  };
+
+  // value = unscaled / 10^Scale, precision up to 18 digits
+  template<int Scale, size_t FixedSize = 0> struct decimal64 {
+    int64_t unscaled;
+
+    decimal64() : unscaled(0) {}
+    explicit decimal64(int64_t u) : unscaled(u) {}
+
+    static const int    scale = Scale;
+    static const size_t fixed_size = FixedSize;
+
+    double      to_double() const { return static_cast<double>(unscaled) / logical::pow10(Scale); }
+    std::string to_string() const { return logical::format_decimal(unscaled < 0 ? -1 : 0, static_cast<uint64_t>(unscaled), Scale); }
+
+    bool operator==(const decimal64& o) const { return unscaled == o.unscaled; }
+    bool operator!=(const decimal64& o) const { return unscaled != o.unscaled; }
+    bool operator<(const decimal64& o) const { return unscaled < o.unscaled; }
+  };
+
+  // value = (hi * 2^64 + lo) / 10^Scale, precision up to 38 digits
+  template<int Scale, size_t FixedSize = 0> struct decimal128 {
+    int64_t  hi;
+    uint64_t lo;
+
+    decimal128() : hi(0), lo(0) {}
+    decimal128(int64_t h, uint64_t l) : hi(h), lo(l) {}
+    explicit decimal128(int64_t v) : hi(v < 0 ? -1 : 0), lo(static_cast<uint64_t>(v)) {}
+
+    static const int    scale = Scale;
+    static const size_t fixed_size = FixedSize;
+
+    double to_double() const {
+      return (static_cast<double>(hi) * 18446744073709551616.0 + static_cast<double>(lo)) / logical::pow10(Scale);
+    }
+
+    std::string to_string() const { return logical::format_decimal(hi, lo, Scale); }
+
+    bool operator==(const decimal128& o) const { return hi == o.hi && lo == o.lo; }
+    bool operator!=(const decimal128& o) const { return !(*this == o); }
+    bool operator<(const decimal128& o) const { return hi < o.hi || (hi == o.hi && lo < o.lo); }
+  };
+};
+
+namespace avro {
+  template<int S, size_t F> struct codec_traits<csi::decimal64<S, F> > {
+    static void encode(Encoder& e, const csi::decimal64<S, F>& v) {
+      csi::logical::encode_decimal(e, v.unscaled < 0 ? -1 : 0, static_cast<uint64_t>(v.unscaled), F);
+    }
+
+    static void decode(Decoder& d, csi::decimal64<S, F>& v) {
+      int64_t  hi;
+      uint64_t lo;
+      csi::logical::decode_decimal(d, F, 8, hi, lo);
+      v.unscaled = static_cast<int64_t>(lo);
+    }
+  };
+
+  template<int S, size_t F> struct codec_traits<csi::decimal128<S, F> > {
+    static void encode(Encoder& e, const csi::decimal128<S, F>& v) { csi::logical::encode_decimal(e, v.hi, v.lo, F); }
+    static void decode(Decoder& d, csi::decimal128<S, F>& v) { csi::logical::decode_decimal(d, F, 16, v.hi, v.lo); }
+  };
+
+  template<> struct codec_traits<csi::timestamp_millis> {
+    static void encode(Encoder& e, const csi::timestamp_millis& v) { e.encodeLong(v.time_since_epoch().count()); }
+    static void decode(Decoder& d, csi::timestamp_millis& v) { v = csi::timestamp_millis(std::chrono::milliseconds(d.decodeLong())); }
+  };
+
+  template<> struct codec_traits<csi::timestamp_micros> {
+    static void encode(Encoder& e, const csi::timestamp_micros& v) { e.encodeLong(v.time_since_epoch().count()); }
+    static void decode(Decoder& d, csi::timestamp_micros& v) { v = csi::timestamp_micros(std::chrono::microseconds(d.decodeLong())); }
+  };
+
+  template<> struct codec_traits<csi::date> {
+    static void encode(Encoder& e, const csi::date& v) { e.encodeInt(v.time_since_epoch().count()); }
+    static void decode(Decoder& d, csi::date& v) { v = csi::date(csi::days(d.decodeInt())); }
+  };
+
+  template<> struct codec_traits<csi::time_millis> {
+    static void encode(Encoder& e, const csi::time_millis& v) { e.encodeInt(v.count()); }
+    static void decode(Decoder& d, csi::time_millis& v) { v = csi::time_millis(d.decodeInt()); }
+  };
+
+  template<> struct codec_traits<csi::time_micros> {
+    static void encode(Encoder& e, const csi::time_micros& v) { e.encodeLong(v.count()); }
+    static void decode(Decoder& d, csi::time_micros& v) { v = csi::time_micros(d.decodeLong()); }
+  };
+
+  template<> struct codec_traits<csi::uuid> {
+    static void encode(Encoder& e, const csi::uuid& v) {
+      static thread_local std::string s(36, '0');
+      char buf[36];
+      csi::logical::format_uuid(v, buf);
+      s.assign(buf, 36);
+      e.encodeString(s);
+    }
+
+    static void decode(Decoder& d, csi::uuid& v) {
+      static thread_local std::string s;
+      d.decodeString(s);
+      if (!csi::logical::parse_uuid(s.data(), s.size(), v))
+        throw avro::Exception("invalid uuid: " + s);
+    }
+  };
+};
@@ -0,0 +1,173 @@
+#include "parallel_decoder.h"
+
+namespace csi {
+  parallel_decoder_base::parallel_decoder_base(size_t nr_of_threads, size_t window)
+    : nr_of_threads_(nr_of_threads ? nr_of_threads : 1)
+    , window_(window ? window : 16 * nr_of_threads_)
+    , slots_(new slot[window_])
+    , queues_(new work_queue[nr_of_threads_])
+    , pushed_(0)
+    , delivered_(0)
+    , queued_(0)
+    , sleeping_(0)
+    , spinning_(0)
+    , delivering_(false)
+    , aborted_(false)
+    , stopping_(false) {}
+
+  parallel_decoder_base::~parallel_decoder_base() {
+    stop();
+  }
+
+  void parallel_decoder_base::start() {
+    for (size_t i = 0; i != nr_of_threads_; ++i)
+      threads_.emplace_back(&parallel_decoder_base::worker, this, i);
+  }
+
+  void parallel_decoder_base::stop() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& t : threads_)
+      t.join();
+    threads_.clear();
+  }
+
+  void parallel_decoder_base::push(const uint8_t* data, size_t size) {
+    const uint64_t seq = pushed_;
+    if (aborted_ || seq >= delivered_ + window_) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      space_cv_.wait(lock, [&]() { return aborted_ || seq < delivered_ + window_; });
+    }
+    if (aborted_)
+      rethrow_error();
+
+    slots_[seq % window_].data.assign(data, data + size);
+    {
+      work_queue& q = queues_[seq % nr_of_threads_];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      q.seqs.push_back(seq);
+    }
+    pushed_ = seq + 1;
+    ++queued_;
+    if (sleeping_ && !spinning_) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      work_cv_.notify_one();
+    }
+  }
+
+  void parallel_decoder_base::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_cv_.wait(lock, [&]() { return aborted_ || delivered_ == pushed_; });
+    lock.unlock();
+    if (aborted_)
+      rethrow_error();
+  }
+
+  void parallel_decoder_base::rethrow_error() {
+    std::exception_ptr e;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      e = error_;
+    }
+    std::rethrow_exception(e);
+  }
+
+  void parallel_decoder_base::fail(std::exception_ptr e) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_)
+      error_ = e;
+    aborted_ = true;
+    space_cv_.notify_all();
+  }
+
+  // own queue first, then the others. both take the oldest message since the window only moves with the oldest
+  bool parallel_decoder_base::take(size_t id, uint64_t& seq) {
+    if (queued_ == 0)
+      return false;
+    for (size_t i = 0; i != nr_of_threads_; ++i) {
+      work_queue& q = queues_[(id + i) % nr_of_threads_];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (q.seqs.empty())
+        continue;
+      seq = q.seqs.front();
+      q.seqs.pop_front();
+      --queued_;
+      return true;
+    }
+    return false;
+  }
+
+  // a worker out of work looks for a while before it sleeps, push() only wakes a sleeper if nobody is looking.
+  // saves a wakeup per message when the producer is slower than the workers
+  bool parallel_decoder_base::spin(size_t id, uint64_t& seq) {
+    ++spinning_;
+    bool found = false;
+    for (int i = 0; i != 64 && !found; ++i) {
+      std::this_thread::yield();
+      found = take(id, seq);
+    }
+    --spinning_;
+    return found;
+  }
+
+  void parallel_decoder_base::worker(size_t id) {
+    for (;;) {
+      uint64_t seq;
+      if (!take(id, seq) && !spin(id, seq)) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++sleeping_;
+        work_cv_.wait(lock, [&]() { return stopping_ || queued_ > 0; });
+        --sleeping_;
+        if (stopping_ && queued_ == 0)
+          return;
+        continue;
+      }
+      const size_t s = seq % window_;
+      if (!aborted_) {
+        try {
+          decode(id, s);
+        } catch (...) {
+          slots_[s].error = std::current_exception();
+        }
+      }
+      slots_[s].ready = true;
+      try_deliver();
+    }
+  }
+
+  // one deliverer at a time. a worker that finds another one delivering leaves its message to it, the deliverer
+  // checks the head again after giving up the role so a message completed meanwhile is not left behind
+  void parallel_decoder_base::try_deliver() {
+    for (;;) {
+      if (delivering_.exchange(true))
+        return;
+      const uint64_t first = delivered_;
+      uint64_t       d = first;
+      while (slots_[d % window_].ready) {
+        slot& s = slots_[d % window_];
+        if (s.error) {
+          fail(s.error);
+          s.error = nullptr;
+        } else if (!aborted_) {
+          try {
+            deliver(d % window_);
+          } catch (...) {
+            fail(std::current_exception());
+          }
+        }
+        s.ready = false;
+        delivered_ = ++d;
+      }
+      delivering_ = false;
+      if (d != first) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        space_cv_.notify_all();
+      }
+      if (!slots_[d % window_].ready)
+        return;
+    }
+  }
+};
@@ -0,0 +1,160 @@
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <avro/ValidSchema.hh>
+#include <avro/Decoder.hh>
+#include <avro/Specific.hh>
+#include <avro/Stream.hh>
+#include "binary_codec.h"
+#include "data_file_reader.h"
+
+#pragma once
+
+namespace csi {
+  // decodes a stream of encoded messages (ie one kafka partition) on a pool of threads and delivers them in push order
+  // every worker has its own queue and steals from the others when it runs dry, so a few large messages do not leave
+  // the other threads idle. at most window messages are in flight: push() blocks while the oldest undelivered message
+  // is window messages behind. the callback is called for one message at a time, in order, from the worker that
+  // completes the head of the window
+  // a decode or callback error stops delivery after the messages before it and is rethrown by the next push() or flush()
+  class parallel_decoder_base {
+    public:
+    parallel_decoder_base(size_t nr_of_threads, size_t window);
+    virtual ~parallel_decoder_base();
+
+    void     push(const uint8_t* data, size_t size); // copies the message
+    void     push(const std::vector<uint8_t>& message) { push(message.data(), message.size()); }
+    void     flush();                                // waits until every pushed message is delivered
+    uint64_t pushed() const { return pushed_; }
+    uint64_t delivered() const { return delivered_; }
+    size_t   threads() const { return nr_of_threads_; }
+    size_t   window() const { return window_; }
+
+    protected:
+    void start(); // from the derived constructor, when decode() and deliver() can be called
+    void stop();  // from the derived destructor, decodes and delivers what is queued
+
+    const std::vector<uint8_t>& message(size_t slot) const { return slots_[slot].data; }
+    virtual void decode(size_t worker, size_t slot) = 0;
+    virtual void deliver(size_t slot) = 0;
+
+    private:
+    struct work_queue {
+      std::mutex           mutex;
+      std::deque<uint64_t> seqs;
+    };
+
+    struct slot {
+      slot() : ready(false) {}
+      std::vector<uint8_t> data;
+      std::exception_ptr   error; // decode failed
+      std::atomic<bool>    ready; // decoded, waiting for delivery
+    };
+
+    void worker(size_t id);
+    bool take(size_t id, uint64_t& seq);
+    bool spin(size_t id, uint64_t& seq);
+    void try_deliver();
+    void fail(std::exception_ptr e);
+    void rethrow_error();
+
+    const size_t                  nr_of_threads_;
+    const size_t                  window_;
+    std::unique_ptr<slot[]>       slots_;   // message seq lives in slot seq % window
+    std::unique_ptr<work_queue[]> queues_;  // one per worker
+    std::atomic<uint64_t>         pushed_;
+    std::atomic<uint64_t>         delivered_;
+    std::atomic<size_t>           queued_;  // in some queue, not yet taken
+    std::atomic<size_t>           sleeping_;
+    std::atomic<size_t>           spinning_;
+    std::atomic<bool>             delivering_;
+    std::atomic<bool>             aborted_;
+
+    std::mutex                    mutex_;
+    std::condition_variable       work_cv_;  // idle workers
+    std::condition_variable       space_cv_; // push() and flush()
+    bool                          stopping_;
+    std::exception_ptr            error_;
+    std::vector<std::thread>      threads_;
+  };
+
+  // InputStream over one message, reused between messages instead of a memoryInputStream per message
+  class message_input_stream : public avro::InputStream {
+    public:
+    message_input_stream() : data_(nullptr), size_(0), pos_(0) {}
+
+    void reset(const uint8_t* data, size_t size) {
+      data_ = data;
+      size_ = size;
+      pos_ = 0;
+    }
+
+    bool next(const uint8_t** data, size_t* len) {
+      if (pos_ == size_)
+        return false;
+      *data = data_ + pos_;
+      *len = size_ - pos_;
+      pos_ = size_;
+      return true;
+    }
+
+    void   backup(size_t len) { pos_ -= len; }
+    void   skip(size_t len) { pos_ = (len < size_ - pos_) ? pos_ + len : size_; }
+    size_t byteCount() const { return pos_; }
+
+    private:
+    const uint8_t* data_;
+    size_t         size_;
+    size_t         pos_;
+  };
+
+  // T is a csi_avrogencpp generated type or avro::GenericDatum, decoded values are reused between messages
+  // if reader_schema is given the messages are resolved from schema, otherwise T must match schema
+  template<class T>
+  class parallel_decoder : public parallel_decoder_base {
+    public:
+    parallel_decoder(const avro::ValidSchema& schema, size_t nr_of_threads, const std::function<void(T&)>& callback,
+                     size_t window = 0, const avro::ValidSchema* reader_schema = nullptr)
+      : parallel_decoder_base(nr_of_threads, window)
+      , callback_(callback) {
+      const avro::ValidSchema& value_schema = reader_schema ? *reader_schema : schema;
+      values_.resize(this->window(), record_factory<T>::create(value_schema));
+      workers_.resize(threads());
+      for (auto& w : workers_) {
+        w.reset(new worker_state);
+        w->decoder = reader_schema ? avro::DecoderPtr(avro::resolvingDecoder(schema, *reader_schema, avro::binaryDecoder())) : avro::DecoderPtr(new binary_decoder);
+      }
+      start();
+    }
+
+    ~parallel_decoder() { stop(); }
+
+    protected:
+    void decode(size_t worker, size_t slot) {
+      worker_state& w = *workers_[worker];
+      const std::vector<uint8_t>& m = message(slot);
+      w.in.reset(m.data(), m.size());
+      w.decoder->init(w.in);
+      avro::decode(*w.decoder, values_[slot]);
+    }
+
+    void deliver(size_t slot) { callback_(values_[slot]); }
+
+    private:
+    struct worker_state {
+      message_input_stream in;
+      avro::DecoderPtr     decoder;
+    };
+
+    std::function<void(T&)>                    callback_;
+    std::vector<T>                             values_;  // per slot
+    std::vector<std::unique_ptr<worker_state>> workers_;
+  };
+};
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "partitioner.h"
+#include <avro/Schema.hh>
+
+namespace csi {
+  int32_t kafka_murmur2(const uint8_t* data, size_t size) {
+    const uint32_t m = 0x5bd1e995;
+    const int r = 24;
+    uint32_t h = 0x9747b28c ^ static_cast<uint32_t>(size);
+    const uint8_t* end = data + (size & ~static_cast<size_t>(3));
+    for (const uint8_t* p = data; p != end; p += 4) {
+      uint32_t k = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+      h *= m;
+      h ^= k;
+    }
+    switch (size & 3) {
+    case 3: h ^= uint32_t(end[2]) << 16; // fall through
+    case 2: h ^= uint32_t(end[1]) << 8; // fall through
+    case 1: h ^= uint32_t(end[0]);
+      h *= m;
+    };
+    h ^= h >> 13;
+    h *= m;
+    h ^= h >> 15;
+    return static_cast<int32_t>(h);
+  }
+
+  static avro::NodePtr resolve(const avro::NodePtr& n) {
+    return (n->type() == avro::AVRO_SYMBOLIC) ? avro::resolveSymbol(n) : n;
+  }
+
+  key_partitioner::key_partitioner(const avro::ValidSchema& src_schema, const avro::ValidSchema& key_schema) {
+    avro::NodePtr src = src_schema.root();
+    avro::NodePtr key = key_schema.root();
+    if (src->type() != avro::AVRO_RECORD || key->type() != avro::AVRO_RECORD)
+      throw std::domain_error("key_partitioner: source and key schemas must be records");
+    for (size_t i = 0; i != key->leaves(); ++i) {
+      key_column c;
+      if (!src->nameIndex(key->nameAt(i), c.src_index))
+        throw std::domain_error("key_partitioner: no source column " + key->nameAt(i));
+      avro::NodePtr t = resolve(key->leafAt(i));
+      c.nullable = (t->type() == avro::AVRO_UNION);
+      if (c.nullable) {
+        if (t->leaves() != 2 || t->leafAt(0)->type() != avro::AVRO_NULL)
+          throw std::domain_error("key_partitioner: unsupported key column " + key->nameAt(i));
+        t = resolve(t->leafAt(1));
+      }
+      c.type = t->type();
+      switch (c.type) {
+      case avro::AVRO_INT:
+      case avro::AVRO_LONG:
+      case avro::AVRO_FLOAT:
+      case avro::AVRO_DOUBLE:
+      case avro::AVRO_BOOL:
+      case avro::AVRO_STRING:
+      case avro::AVRO_BYTES:
+      break;
+      default:
+      throw std::domain_error("key_partitioner: unsupported key column " + key->nameAt(i));
+      };
+      columns_.push_back(c);
+    }
+  }
+
+  static inline void put_long(std::vector<uint8_t>& dst, int64_t l) {
+    uint64_t n = (static_cast<uint64_t>(l) << 1) ^ static_cast<uint64_t>(l >> 63);
+    while (n & ~0x7FULL) {
+      dst.push_back(static_cast<uint8_t>((n & 0x7f) | 0x80));
+      n >>= 7;
+    }
+    dst.push_back(static_cast<uint8_t>(n));
+  }
+
+  static inline void put_raw(std::vector<uint8_t>& dst, const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    dst.insert(dst.end(), p, p + size);
+  }
+
+  // avro writes float and double little endian
+  template<class T> static inline void put_ieee(std::vector<uint8_t>& dst, T v) {
+    uint8_t b[sizeof(T)];
+    memcpy(b, &v, sizeof(T));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    std::reverse(b, b + sizeof(T));
+#endif
+    put_raw(dst, b, sizeof(T));
+  }
+
+  // appends the avro binary encoded key of row to buffer_
+  void key_partitioner::encode(const avro::GenericDatum& row) {
+    const avro::GenericRecord& r = row.value<avro::GenericRecord>();
+    for (std::vector<key_column>::const_iterator i = columns_.begin(); i != columns_.end(); ++i) {
+      const avro::GenericDatum& f = r.fieldAt(i->src_index);
+      bool is_null = (f.type() == avro::AVRO_NULL); // looks through unions
+      if (i->nullable) {
+        put_long(buffer_, is_null ? 0 : 1);
+        if (is_null)
+          continue;
+      } else if (is_null) {
+        throw std::domain_error("null value in strict key column");
+      }
+
+      switch (i->type) {
+      case avro::AVRO_INT:
+      put_long(buffer_, f.value<int32_t>());
+      break;
+      case avro::AVRO_LONG:
+      put_long(buffer_, f.value<int64_t>());
+      break;
+      case avro::AVRO_FLOAT:
+      put_ieee(buffer_, f.value<float>());
+      break;
+      case avro::AVRO_DOUBLE:
+      put_ieee(buffer_, f.value<double>());
+      break;
+      case avro::AVRO_BOOL:
+      buffer_.push_back(f.value<bool>() ? 1 : 0);
+      break;
+      case avro::AVRO_STRING:
+      if (f.type() == avro::AVRO_ENUM) {
+        const std::string& s = f.value<avro::GenericEnum>().symbol();
+        put_long(buffer_, s.size());
+        put_raw(buffer_, s.data(), s.size());
+      } else {
+        const std::string& s = f.value<std::string>();
+        put_long(buffer_, s.size());
+        put_raw(buffer_, s.data(), s.size());
+      }
+      break;
+      case avro::AVRO_BYTES:
+      {
+        const std::vector<uint8_t>& v = (f.type() == avro::AVRO_FIXED) ? f.value<avro::GenericFixed>().value() : f.value<std::vector<uint8_t>>();
+        put_long(buffer_, v.size());
+        put_raw(buffer_, v.data(), v.size());
+      }
+      break;
+      default:
+      break;
+      };
+    }
+  }
+
+  const std::vector<uint8_t>& key_partitioner::encode_key(const avro::GenericDatum& row) {
+    buffer_.clear();
+    encode(row);
+    return buffer_;
+  }
+
+  int32_t key_partitioner::partition(const avro::GenericDatum& row, int32_t nr_of_partitions) {
+    encode_key(row);
+    return kafka_partition(buffer_.data(), buffer_.size(), nr_of_partitions);
+  }
+
+  void key_partitioner::partition(const avro::GenericDatum* rows, size_t count, int32_t nr_of_partitions, int32_t* partitions) {
+    if (nr_of_partitions <= 0)
+      throw std::domain_error("key_partitioner: nr_of_partitions must be positive");
+    buffer_.clear();
+    offsets_.resize(count + 1);
+    for (size_t i = 0; i != count; ++i) {
+      offsets_[i] = buffer_.size();
+      encode(rows[i]);
+    }
+    offsets_[count] = buffer_.size();
+
+    const uint8_t* base = buffer_.data();
+    const size_t* offsets = offsets_.data();
+    for (size_t i = 0; i != count; ++i)
+      partitions[i] = kafka_partition(base + offsets[i], offsets[i + 1] - offsets[i], nr_of_partitions);
+  }
+
+  void key_partitioner::partition(const std::vector<avro::GenericDatum>& rows, int32_t nr_of_partitions, std::vector<int32_t>& partitions) {
+    partitions.resize(rows.size());
+    partition(rows.data(), rows.size(), nr_of_partitions, partitions.data());
+  }
+};
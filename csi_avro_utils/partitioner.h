@@ -0,0 +1,52 @@
+#include <stdint.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <avro/ValidSchema.hh>
+#include <avro/Generic.hh>
+
+#pragma once
+
+namespace csi {
+  // murmur2 as used by the kafka java client default partitioner
+  int32_t kafka_murmur2(const uint8_t* data, size_t size);
+
+  // kafka partition of an encoded key: toPositive(murmur2(key)) % nr_of_partitions
+  // throws std::domain_error unless nr_of_partitions > 0
+  inline int32_t kafka_partition(const uint8_t* data, size_t size, int32_t nr_of_partitions) {
+    if (nr_of_partitions <= 0)
+      throw std::domain_error("kafka_partition: nr_of_partitions must be positive");
+    return (kafka_murmur2(data, size) & 0x7fffffff) % nr_of_partitions;
+  }
+
+  // computes kafka partitions straight from source rows, without building key datums
+  // the key is encoded as get_key() + avro binary encoding would, so partitions match producers
+  // that hash the serialized key. key_schema comes from avro_hive::get_key_schema
+  //
+  // a batch is encoded into one reused buffer and then hashed in a separate tight loop
+  // not thread safe - use one partitioner per thread. nr_of_partitions must be positive, see kafka_partition
+  class key_partitioner {
+    public:
+    key_partitioner(const avro::ValidSchema& src_schema, const avro::ValidSchema& key_schema); // throws std::domain_error for unsupported key columns
+
+    int32_t partition(const avro::GenericDatum& row, int32_t nr_of_partitions);
+    void    partition(const avro::GenericDatum* rows, size_t count, int32_t nr_of_partitions, int32_t* partitions);
+    void    partition(const std::vector<avro::GenericDatum>& rows, int32_t nr_of_partitions, std::vector<int32_t>& partitions); // resizes partitions
+
+    // the avro binary encoded key of row, valid until the next call
+    const std::vector<uint8_t>& encode_key(const avro::GenericDatum& row);
+
+    private:
+    struct key_column {
+      size_t     src_index;
+      bool       nullable; // [null, T] in the key schema
+      avro::Type type;     // T
+    };
+
+    void encode(const avro::GenericDatum& row);
+
+    std::vector<key_column> columns_;
+    std::vector<uint8_t>    buffer_;
+    std::vector<size_t>     offsets_;
+  };
+};
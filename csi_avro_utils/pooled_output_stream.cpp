@@ -0,0 +1,120 @@
+#include <cstring>
+#include "pooled_output_stream.h"
+
+namespace csi {
+  // free chunks as a list linked through their first bytes. a stream destroyed after the pool of its thread
+  // (ie a thread_local stream) frees its chunks directly
+  static thread_local bool pool_gone = false;
+
+  struct chunk_pool {
+    uint8_t* head;
+    size_t   count;
+
+    chunk_pool() : head(0), count(0) {}
+
+    ~chunk_pool() {
+      while (head) {
+        uint8_t* c = head;
+        memcpy(&head, c, sizeof(head));
+        delete[] c;
+      }
+      pool_gone = true;
+    }
+  };
+
+  static chunk_pool& local_pool() {
+    static thread_local chunk_pool pool;
+    return pool;
+  }
+
+  static uint8_t* acquire_chunk() {
+    if (!pool_gone) {
+      chunk_pool& pool = local_pool();
+      if (pool.head) {
+        uint8_t* c = pool.head;
+        memcpy(&pool.head, c, sizeof(pool.head));
+        --pool.count;
+        return c;
+      }
+    }
+    return new uint8_t[pooled_output_stream::chunk_size];
+  }
+
+  static void release_chunk(uint8_t* c) {
+    if (!pool_gone) {
+      chunk_pool& pool = local_pool();
+      if (pool.count < pooled_output_stream::max_pooled_chunks) {
+        memcpy(c, &pool.head, sizeof(pool.head));
+        pool.head = c;
+        ++pool.count;
+        return;
+      }
+    }
+    delete[] c;
+  }
+
+  pooled_output_stream::pooled_output_stream()
+    : first_(0)
+    , used_(0) {}
+
+  pooled_output_stream::~pooled_output_stream() {
+    reset();
+  }
+
+  bool pooled_output_stream::next(uint8_t** data, size_t* len) {
+    if (!first_) {
+      first_ = acquire_chunk();
+    } else if (used_ == chunk_size) {
+      more_.push_back(acquire_chunk());
+      used_ = 0;
+    }
+    uint8_t* last = more_.empty() ? first_ : more_.back();
+    *data = last + used_;
+    *len = chunk_size - used_;
+    used_ = chunk_size;
+    return true;
+  }
+
+  // the encoders only give back part of the last next()
+  void pooled_output_stream::backup(size_t len) {
+    used_ -= len;
+  }
+
+  void pooled_output_stream::reset() {
+    for (uint8_t* c : more_)
+      release_chunk(c);
+    more_.clear();
+    if (first_)
+      release_chunk(first_);
+    first_ = 0;
+    used_ = 0;
+  }
+
+  void pooled_output_stream::copy_to(uint8_t* dst) const {
+    if (!first_)
+      return;
+    if (more_.empty()) {
+      memcpy(dst, first_, used_);
+      return;
+    }
+    memcpy(dst, first_, chunk_size);
+    dst += chunk_size;
+    for (size_t i = 0; i + 1 < more_.size(); ++i, dst += chunk_size)
+      memcpy(dst, more_[i], chunk_size);
+    memcpy(dst, more_.back(), used_);
+  }
+
+  void pooled_output_stream::append_to(std::vector<uint8_t>& dst) const {
+    size_t offset = dst.size();
+    dst.resize(offset + size());
+    if (size())
+      copy_to(&dst[offset]);
+  }
+
+  std::string pooled_output_stream::str() const {
+    std::string s(size(), '\0');
+    if (!s.empty())
+      copy_to(reinterpret_cast<uint8_t*>(&s[0]));
+    return s;
+  }
+};
@@ -0,0 +1,50 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <avro/Encoder.hh>
+#include <avro/Specific.hh>
+#include <avro/Stream.hh>
+
+#pragma once
+
+namespace csi {
+  // avro::OutputStream for encoding messages, instead of a fresh avro::memoryOutputStream() per message.
+  // the bytes go into fixed size chunks taken from a pool per thread and given back by reset() and the
+  // destructor, so once the pool is warm encoding does not allocate. a message that fits in one chunk is
+  // contiguous and can be handed on from data() / size() without copying it out.
+  // chunks go back to the pool of the thread that calls reset(), a stream may be passed between threads
+  class pooled_output_stream : public avro::OutputStream {
+    public:
+    enum { chunk_size = 4096, max_pooled_chunks = 256 }; // at most 1 MB kept per thread
+
+    pooled_output_stream();
+    ~pooled_output_stream();
+
+    bool     next(uint8_t** data, size_t* len);
+    void     backup(size_t len);
+    uint64_t byteCount() const { return size(); }
+    void     flush() {}
+
+    void reset(); // empty again, re-init the encoder before the next message
+
+    bool           contiguous() const { return more_.empty(); }
+    const uint8_t* data() const { return first_; } // all of it if contiguous(), else the first chunk
+    size_t         size() const { return (first_ ? more_.size() * chunk_size : 0) + used_; }
+    void           copy_to(uint8_t* dst) const;  // size() bytes
+    void           append_to(std::vector<uint8_t>& dst) const;
+    std::string    str() const;
+
+    private:
+    uint8_t*              first_;
+    std::vector<uint8_t*> more_; // after first_, all but the last one full
+    size_t                used_; // in the last chunk
+  };
+
+  // os.reset(), then v encoded into it with e (avro::binaryEncoder(), csi::binary_encoder) through its codec_traits
+  template<class T> inline void encode_to(pooled_output_stream& os, avro::Encoder& e, const T& v) {
+    os.reset();
+    e.init(os);
+    avro::encode(e, v);
+    e.flush();
+  }
+};
@@ -0,0 +1,43 @@
+#include <cstring>
+#include <avro/Exception.hh>
+#include "record_patch.h"
+
+namespace csi {
+  patch_writer::patch_writer(std::vector<uint8_t>& patch, const boost::uuids::uuid& hash, size_t fields)
+    : patch_(patch)
+    , mask_(hash.size())
+    , changed_(false) {
+    patch_.assign(hash.size() + (fields + 7) / 8, 0);
+    memcpy(&patch_[0], hash.data, hash.size());
+    encoder_.init(os_);
+  }
+
+  avro::Encoder& patch_writer::field(size_t i) {
+    patch_[mask_ + i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+    changed_ = true;
+    return encoder_;
+  }
+
+  bool patch_writer::finish() {
+    encoder_.flush();
+    os_.append_to(patch_);
+    return changed_;
+  }
+
+  patch_reader::patch_reader(const uint8_t* data, size_t size, const boost::uuids::uuid& hash, size_t fields)
+    : mask_(data + hash.size()) {
+    size_t mask_size = (fields + 7) / 8;
+    if (size < hash.size() + mask_size)
+      throw avro::Exception("patch_reader: patch shorter than its header");
+    if (memcmp(data, hash.data, hash.size()) != 0)
+      throw avro::Exception("patch_reader: patch for another schema");
+    if (fields % 8 && (mask_[mask_size - 1] >> (fields % 8)) != 0)
+      throw avro::Exception("patch_reader: patch marks fields the record does not have");
+    decoder_.init(mask_ + mask_size, size - hash.size() - mask_size);
+  }
+
+  void patch_reader::finish() const {
+    if (decoder_.remaining())
+      throw avro::Exception("patch_reader: bytes left over after the changed fields");
+  }
+};
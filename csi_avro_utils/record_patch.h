@@ -0,0 +1,43 @@
+#include <stdint.h>
+#include <vector>
+#include <boost/uuid/uuid.hpp>
+#include <avro/Encoder.hh>
+#include <avro/Decoder.hh>
+#include "binary_codec.h"
+#include "pooled_output_stream.h"
+
+#pragma once
+
+namespace csi {
+  // sparse record updates, written by the diff() and read by the apply_patch() that csi_avrogencpp --patch generates:
+  // the 16 byte patch_hash() of the record, a bitmask of the changed fields (field i is bit i % 8 of byte i / 8) and
+  // the avro binary encoding of the new value of each changed field, in field order
+  class patch_writer {
+    public:
+    patch_writer(std::vector<uint8_t>& patch, const boost::uuids::uuid& hash, size_t fields); // patch is overwritten
+
+    avro::Encoder& field(size_t i); // marks field i changed, its value goes into the returned encoder. in field order
+    bool           finish();        // false if no field changed
+
+    private:
+    std::vector<uint8_t>& patch_;
+    size_t                mask_; // offset of the bitmask in patch_
+    bool                  changed_;
+    pooled_output_stream  os_;
+    binary_encoder        encoder_;
+  };
+
+  class patch_reader {
+    public:
+    // throws avro::Exception if the patch is for another schema, is too short or marks fields the record does not have
+    patch_reader(const uint8_t* data, size_t size, const boost::uuids::uuid& hash, size_t fields);
+
+    bool           changed(size_t i) const { return (mask_[i / 8] >> (i % 8)) & 1; }
+    avro::Decoder& decoder() { return decoder_; } // the changed fields in field order, the body points into the patch
+    void           finish() const;                // throws if bytes are left over
+
+    private:
+    const uint8_t* mask_;
+    binary_decoder decoder_;
+  };
+};
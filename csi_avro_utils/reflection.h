@@ -0,0 +1,253 @@
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <type_traits>
+#include <boost/array.hpp>
+#include <avro/Types.hh>
+#include "logical_types.h"
+
+#pragma once
+
+// field level access to csi_avrogencpp --reflection generated types without going through GenericDatum
+// the generator specializes record_info, union_info and enum_info for every record, union and enum:
+//
+//   record_info<T>::size, fields(), visit(v, f) and visit_field(v, i, f)
+//   union_info<T>::size, visit(v, f)
+//   enum_info<T>::size, names()
+//
+// visitors are functors with a templated operator(), called with the member itself so there is no copy
+
+namespace csi {
+  struct field_info {
+    const char* name;     // as in the schema
+    avro::Type  type;     // AVRO_UNION for unions, never AVRO_SYMBOLIC
+    bool        nullable; // union with a null branch
+  };
+
+  struct null_value {}; // what union_info<T>::visit passes for a null branch
+
+  template<class T> struct record_info {};
+  template<class T> struct union_info {};
+  template<class T> struct enum_info {};
+
+  template<class T> struct is_reflected_record {
+    private:
+    template<class U> static char test(decltype(&record_info<U>::fields));
+    template<class U> static long test(...);
+    public:
+    static const bool value = sizeof(test<T>(0)) == 1;
+  };
+
+  template<class T> struct is_reflected_union {
+    private:
+    template<class U> static char test(decltype(&union_info<U>::size));
+    template<class U> static long test(...);
+    public:
+    static const bool value = sizeof(test<T>(0)) == 1;
+  };
+
+  // f(const field_info&, member) for every field in schema order, T may be const
+  template<class T, class F> inline void for_each_field(T& v, F& f) {
+    record_info<typename std::remove_const<T>::type>::visit(v, f);
+  }
+
+  // f(const field_info&, member) for field i
+  template<class T, class F> inline void visit_field(T& v, size_t i, F& f) {
+    record_info<typename std::remove_const<T>::type>::visit_field(v, i, f);
+  }
+
+  // field index or -1
+  template<class T> inline int find_field(const std::string& name) {
+    const field_info* fields = record_info<T>::fields();
+    for (size_t i = 0; i != record_info<T>::size; ++i)
+      if (name == fields[i].name)
+        return static_cast<int>(i);
+    return -1;
+  }
+
+  template<class T> inline const char* symbol(T v) {
+    return enum_info<T>::names()[static_cast<size_t>(v)];
+  }
+
+  // csv export. nested records are flattened into parent.child columns, null is an empty cell,
+  // array items are separated by '|', map entries are key=value and records inside arrays, maps or unions
+  // have their fields separated by ';'. cells are quoted when needed
+  namespace csv {
+    inline void append(std::string&, const null_value&) {}
+    inline void append(std::string& out, bool v) { out += v ? "true" : "false"; }
+
+    inline void append(std::string& out, int32_t v) {
+      char buf[16];
+      out.append(buf, snprintf(buf, sizeof(buf), "%d", v));
+    }
+
+    inline void append(std::string& out, int64_t v) {
+      char buf[32];
+      out.append(buf, snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(v)));
+    }
+
+    inline void append(std::string& out, float v) {
+      char buf[32];
+      out.append(buf, snprintf(buf, sizeof(buf), "%.9g", v));
+    }
+
+    inline void append(std::string& out, double v) {
+      char buf[32];
+      out.append(buf, snprintf(buf, sizeof(buf), "%.17g", v));
+    }
+
+    inline void append(std::string& out, const std::string& v) { out += v; }
+
+    inline void append_hex(std::string& out, const uint8_t* p, size_t size) {
+      static const char hex[] = "0123456789abcdef";
+      for (size_t i = 0; i != size; ++i) {
+        out += hex[p[i] >> 4];
+        out += hex[p[i] & 0xf];
+      }
+    }
+
+    inline void append(std::string& out, const std::vector<uint8_t>& v) { append_hex(out, v.data(), v.size()); }
+    template<size_t N> inline void append(std::string& out, const boost::array<uint8_t, N>& v) { append_hex(out, v.data(), N); }
+
+    // decimals as text, dates and times as the avro value (days, millis or micros)
+    template<int S, size_t F> inline void append(std::string& out, const decimal64<S, F>& v) { out += v.to_string(); }
+    template<int S, size_t F> inline void append(std::string& out, const decimal128<S, F>& v) { out += v.to_string(); }
+    template<class C, class D> inline void append(std::string& out, const std::chrono::time_point<C, D>& v) { append(out, static_cast<int64_t>(v.time_since_epoch().count())); }
+    template<class R, class P> inline void append(std::string& out, const std::chrono::duration<R, P>& v) { append(out, static_cast<int64_t>(v.count())); }
+
+    inline void append(std::string& out, const uuid& v) {
+      char buf[36];
+      logical::format_uuid(v, buf);
+      out.append(buf, 36);
+    }
+
+    template<class T> inline typename std::enable_if<std::is_enum<T>::value>::type append(std::string& out, T v) { out += symbol(v); }
+
+    template<class T> typename std::enable_if<is_reflected_record<T>::value>::type append(std::string& out, const T& v);
+    template<class T> typename std::enable_if<is_reflected_union<T>::value>::type append(std::string& out, const T& v);
+    template<class T> void append(std::string& out, const std::vector<T>& v);
+    template<class T> void append(std::string& out, const std::map<std::string, T>& v);
+
+    struct value_appender {
+      std::string& out;
+      template<class M> void operator()(const M& m) { append(out, m); }
+    };
+
+    struct field_appender {
+      std::string& out;
+      bool         first;
+      template<class M> void operator()(const field_info&, const M& m) {
+        if (!first)
+          out += ';';
+        first = false;
+        append(out, m);
+      }
+    };
+
+    template<class T> typename std::enable_if<is_reflected_record<T>::value>::type append(std::string& out, const T& v) {
+      field_appender f = { out, true };
+      for_each_field(v, f);
+    }
+
+    template<class T> typename std::enable_if<is_reflected_union<T>::value>::type append(std::string& out, const T& v) {
+      value_appender f = { out };
+      union_info<T>::visit(v, f);
+    }
+
+    template<class T> void append(std::string& out, const std::vector<T>& v) {
+      for (size_t i = 0; i != v.size(); ++i) {
+        if (i)
+          out += '|';
+        append(out, v[i]);
+      }
+    }
+
+    template<class T> void append(std::string& out, const std::map<std::string, T>& v) {
+      for (typename std::map<std::string, T>::const_iterator i = v.begin(); i != v.end(); ++i) {
+        if (i != v.begin())
+          out += '|';
+        out += i->first;
+        out += '=';
+        append(out, i->second);
+      }
+    }
+
+    inline void append_cell(std::string& out, const std::string& raw) {
+      if (raw.find_first_of(",\"\r\n") == std::string::npos) {
+        out += raw;
+        return;
+      }
+      out += '"';
+      for (std::string::const_iterator i = raw.begin(); i != raw.end(); ++i) {
+        if (*i == '"')
+          out += '"';
+        out += *i;
+      }
+      out += '"';
+    }
+
+    struct header_writer {
+      std::string& out;
+      std::string  prefix;
+
+      template<class M> typename std::enable_if<is_reflected_record<M>::value>::type operator()(const field_info& fi, const M& m) {
+        header_writer nested = { out, prefix + fi.name + "." };
+        for_each_field(m, nested);
+      }
+
+      template<class M> typename std::enable_if<!is_reflected_record<M>::value>::type operator()(const field_info& fi, const M&) {
+        if (!out.empty())
+          out += ',';
+        append_cell(out, prefix + fi.name);
+      }
+    };
+
+    struct row_writer {
+      std::string& out;
+      std::string& scratch;
+      bool         first;
+
+      void separator() {
+        if (!first)
+          out += ',';
+        first = false;
+      }
+
+      template<class M> typename std::enable_if<is_reflected_record<M>::value>::type operator()(const field_info&, const M& m) {
+        for_each_field(m, *this);
+      }
+
+      // numbers never need quoting
+      template<class M> typename std::enable_if<std::is_arithmetic<M>::value>::type operator()(const field_info&, M m) {
+        separator();
+        append(out, m);
+      }
+
+      template<class M> typename std::enable_if<!is_reflected_record<M>::value && !std::is_arithmetic<M>::value>::type operator()(const field_info&, const M& m) {
+        separator();
+        scratch.clear();
+        append(scratch, m);
+        append_cell(out, scratch);
+      }
+    };
+  };
+
+  // csv header line for T, without the line break
+  template<class T> std::string csv_header() {
+    std::string out;
+    T v;
+    csv::header_writer w = { out, std::string() };
+    for_each_field(v, w);
+    return out;
+  }
+
+  // appends v as one csv line including the line break
+  template<class T> void to_csv(const T& v, std::string& out) {
+    std::string scratch;
+    csv::row_writer w = { out, scratch, true };
+    for_each_field(v, w);
+    out += '\n';
+  }
+};
@@ -0,0 +1,357 @@
+#include "schema_compatibility.h"
+#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <avro/GenericDatum.hh>
+#include <avro/NodeImpl.hh>
+#include "schema_store.h"
+#include "utils.h"
+
+namespace csi {
+  static avro::NodePtr resolved(const avro::NodePtr& n) {
+    return (n->type() == avro::AVRO_SYMBOLIC) ? avro::resolveSymbol(n) : n;
+  }
+
+  static std::string type_name(const avro::NodePtr& n) {
+    return n->hasName() ? n->name().fullname() : avro::toString(n->type());
+  }
+
+  static bool promotable(avro::Type writer, avro::Type reader) {
+    switch (writer) {
+      case avro::AVRO_INT:
+        return reader == avro::AVRO_LONG || reader == avro::AVRO_FLOAT || reader == avro::AVRO_DOUBLE;
+      case avro::AVRO_LONG:
+        return reader == avro::AVRO_FLOAT || reader == avro::AVRO_DOUBLE;
+      case avro::AVRO_FLOAT:
+        return reader == avro::AVRO_DOUBLE;
+      default:
+        return false;
+    }
+  }
+
+  static bool same_type(const avro::NodePtr& writer, const avro::NodePtr& reader) {
+    if (writer->type() != reader->type())
+      return false;
+    return !writer->hasName() || writer->name() == reader->name();
+  }
+
+  // the branch avro picks: the first of the same type (and name), otherwise the first the writer promotes to
+  static int best_branch(const avro::NodePtr& writer, const avro::NodePtr& reader_union) {
+    for (size_t i = 0; i != reader_union->leaves(); ++i)
+      if (same_type(writer, resolved(reader_union->leafAt(i))))
+        return static_cast<int>(i);
+    for (size_t i = 0; i != reader_union->leaves(); ++i)
+      if (promotable(writer->type(), resolved(reader_union->leafAt(i))->type()))
+        return static_cast<int>(i);
+    return -1;
+  }
+
+  // the compiler leaves a plain null datum for a field without a default, a null default of a union is a union
+  static bool has_default(const avro::NodePtr& record, size_t field) {
+    const avro::GenericDatum& d = record->defaultValueAt(static_cast<int>(field));
+    return d.isUnion() || d.type() != avro::AVRO_NULL || resolved(record->leafAt(field))->type() == avro::AVRO_NULL;
+  }
+
+  static std::string rebase(const std::string& prefix, const std::string& path) {
+    if (path.empty())
+      return prefix;
+    if (prefix.empty() || path[0] == '[' || path[0] == '{')
+      return prefix + path;
+    return prefix + "." + path;
+  }
+
+  static void append(const compatibility_verdict& from, const std::string& prefix, compatibility_verdict& to) {
+    for (auto& i : from.issues) {
+      compatibility_verdict::issue x = i;
+      x.path = rebase(prefix, i.path);
+      to.issues.push_back(x);
+    }
+    for (auto& p : from.promotions) {
+      compatibility_verdict::promotion x = p;
+      x.path = rebase(prefix, p.path);
+      to.promotions.push_back(x);
+    }
+    for (auto& d : from.defaults)
+      to.defaults.push_back(rebase(prefix, d));
+    for (auto& s : from.skipped)
+      to.skipped.push_back(rebase(prefix, s));
+    for (auto& b : from.branches) {
+      compatibility_verdict::branch_mapping x = b;
+      x.path = rebase(prefix, b.path);
+      to.branches.push_back(x);
+    }
+  }
+
+  static void add_issue(compatibility_verdict& v, compatibility_verdict::issue_kind kind, const std::string& path, const std::string& detail) {
+    compatibility_verdict::issue i;
+    i.kind = kind;
+    i.path = path;
+    i.detail = detail;
+    v.issues.push_back(i);
+  }
+
+  // walks writer and reader side by side. the verdicts for record pairs are kept with paths relative to the record
+  // and reused for every other place, or schema, the same two record nodes meet again
+  class compatibility_walker {
+    public:
+    compatibility_walker() : cut_(std::numeric_limits<size_t>::max()) {}
+
+    void resolve(const avro::NodePtr& writer, const avro::NodePtr& reader, const std::string& path, compatibility_verdict& v) {
+      const avro::NodePtr w = resolved(writer);
+      const avro::NodePtr r = resolved(reader);
+
+      if (w->type() == avro::AVRO_UNION) {
+        compatibility_verdict::branch_mapping m;
+        m.path = path;
+        m.writer_union = true;
+        for (size_t i = 0; i != w->leaves(); ++i) {
+          const avro::NodePtr wb = resolved(w->leafAt(i));
+          int b = -1;
+          if (r->type() == avro::AVRO_UNION)
+            b = best_branch(wb, r);
+          else if (same_type(wb, r) || promotable(wb->type(), r->type()))
+            b = 0;
+          m.reader_branch.push_back(b);
+          if (b < 0)
+            add_issue(v, compatibility_verdict::MISSING_UNION_BRANCH, path, "writer branch " + type_name(wb) + " has no reader branch");
+          else
+            resolve(wb, r->type() == avro::AVRO_UNION ? r->leafAt(b) : r, path, v);
+        }
+        v.branches.push_back(m);
+        return;
+      }
+
+      if (r->type() == avro::AVRO_UNION) {
+        int b = best_branch(w, r);
+        compatibility_verdict::branch_mapping m;
+        m.path = path;
+        m.writer_union = false;
+        m.reader_branch.push_back(b);
+        v.branches.push_back(m);
+        if (b < 0)
+          add_issue(v, compatibility_verdict::MISSING_UNION_BRANCH, path, "writer " + type_name(w) + " is not in the reader union");
+        else
+          resolve(w, r->leafAt(b), path, v);
+        return;
+      }
+
+      if (w->type() != r->type()) {
+        if (promotable(w->type(), r->type())) {
+          compatibility_verdict::promotion p;
+          p.path = path;
+          p.writer = w->type();
+          p.reader = r->type();
+          v.promotions.push_back(p);
+        } else {
+          add_issue(v, compatibility_verdict::TYPE_MISMATCH, path, "writer " + type_name(w) + ", reader " + type_name(r));
+        }
+        return;
+      }
+
+      if (w->hasName() && w->name() != r->name()) {
+        add_issue(v, compatibility_verdict::NAME_MISMATCH, path, "writer " + type_name(w) + ", reader " + type_name(r));
+        return;
+      }
+
+      switch (w->type()) {
+        case avro::AVRO_RECORD:
+          resolve_record(w, r, path, v);
+          break;
+        case avro::AVRO_ENUM:
+          for (size_t i = 0; i != w->names(); ++i) {
+            size_t index;
+            if (!r->nameIndex(w->nameAt(i), index))
+              add_issue(v, compatibility_verdict::MISSING_ENUM_SYMBOL, path, w->nameAt(i));
+          }
+          break;
+        case avro::AVRO_FIXED:
+          if (w->fixedSize() != r->fixedSize()) {
+            std::ostringstream s;
+            s << "writer " << w->fixedSize() << " bytes, reader " << r->fixedSize();
+            add_issue(v, compatibility_verdict::FIXED_SIZE_MISMATCH, path, s.str());
+          }
+          break;
+        case avro::AVRO_ARRAY:
+          resolve(w->leafAt(0), r->leafAt(0), path + "[]", v);
+          break;
+        case avro::AVRO_MAP:
+          resolve(w->leafAt(1), r->leafAt(1), path + "{}", v);
+          break;
+        default:
+          break;
+      }
+    }
+
+    private:
+    typedef std::pair<const avro::Node*, const avro::Node*> node_pair;
+
+    // a pair met again while it is being walked (a recursive type) adds nothing. a verdict that stopped at a record
+    // further up is incomplete on its own and is not kept
+    void resolve_record(const avro::NodePtr& w, const avro::NodePtr& r, const std::string& path, compatibility_verdict& v) {
+      const node_pair key(w.get(), r.get());
+      auto done = records_.find(key);
+      if (done != records_.end()) {
+        append(*done->second, path, v);
+        return;
+      }
+      auto walking = in_progress_.find(key);
+      if (walking != in_progress_.end()) {
+        cut_ = std::min(cut_, walking->second);
+        return;
+      }
+
+      const size_t depth = in_progress_.size();
+      const size_t outer_cut = cut_;
+      cut_ = std::numeric_limits<size_t>::max();
+      in_progress_[key] = depth;
+
+      boost::shared_ptr<compatibility_verdict> rel = boost::make_shared<compatibility_verdict>();
+      for (size_t j = 0; j != r->leaves(); ++j) {
+        const std::string& name = r->nameAt(j);
+        size_t             i;
+        if (w->nameIndex(name, i))
+          resolve(w->leafAt(i), r->leafAt(j), name, *rel);
+        else if (has_default(r, j))
+          rel->defaults.push_back(name);
+        else
+          add_issue(*rel, compatibility_verdict::MISSING_DEFAULT, name, "not written and no default");
+      }
+      for (size_t i = 0; i != w->leaves(); ++i) {
+        size_t j;
+        if (!r->nameIndex(w->nameAt(i), j))
+          rel->skipped.push_back(w->nameAt(i));
+      }
+
+      in_progress_.erase(key);
+      if (cut_ >= depth) {
+        records_[key] = rel;
+        cut_ = outer_cut;
+      } else {
+        cut_ = std::min(outer_cut, cut_);
+      }
+      append(*rel, path, v);
+    }
+
+    std::map<node_pair, boost::shared_ptr<const compatibility_verdict> > records_;
+    std::map<node_pair, size_t>                                          in_progress_; // to the walk depth
+    size_t                                                               cut_;         // shallowest in progress record met
+  };
+
+  static const char* kind_name(compatibility_verdict::issue_kind kind) {
+    switch (kind) {
+      case compatibility_verdict::TYPE_MISMATCH:        return "type mismatch";
+      case compatibility_verdict::NAME_MISMATCH:        return "name mismatch";
+      case compatibility_verdict::FIXED_SIZE_MISMATCH:  return "fixed size mismatch";
+      case compatibility_verdict::MISSING_DEFAULT:      return "missing default";
+      case compatibility_verdict::MISSING_ENUM_SYMBOL:  return "missing enum symbol";
+      case compatibility_verdict::MISSING_UNION_BRANCH: return "missing union branch";
+    }
+    return "";
+  }
+
+  static std::string display(const std::string& path) {
+    return path.empty() ? "<top>" : path;
+  }
+
+  std::string compatibility_verdict::to_string() const {
+    std::ostringstream s;
+    for (auto& i : issues)
+      s << kind_name(i.kind) << " " << display(i.path) << ": " << i.detail << "\n";
+    for (auto& p : promotions)
+      s << "promoted " << display(p.path) << ": " << avro::toString(p.writer) << " -> " << avro::toString(p.reader) << "\n";
+    for (auto& d : defaults)
+      s << "default " << display(d) << "\n";
+    for (auto& k : skipped)
+      s << "skipped " << display(k) << "\n";
+    for (auto& b : branches) {
+      s << "union " << display(b.path) << ":";
+      for (size_t i = 0; i != b.reader_branch.size(); ++i) {
+        s << " ";
+        if (b.writer_union)
+          s << i << "->";
+        s << b.reader_branch[i];
+      }
+      s << "\n";
+    }
+    return s.str();
+  }
+
+  compatibility_verdict check_compatibility(const avro::ValidSchema& writer, const avro::ValidSchema& reader) {
+    compatibility_verdict v;
+    compatibility_walker().resolve(writer.root(), reader.root(), "", v);
+    return v;
+  }
+
+  compatibility_checker::compatibility_checker()
+    : hits_(0) {}
+
+  compatibility_checker::verdict_ptr compatibility_checker::check(const avro::ValidSchema& writer, const avro::ValidSchema& reader) {
+    return check(schema_fingerprint(writer), writer, schema_fingerprint(reader), reader);
+  }
+
+  compatibility_checker::verdict_ptr compatibility_checker::check(const boost::uuids::uuid& writer_hash, const avro::ValidSchema& writer,
+                                                                  const boost::uuids::uuid& reader_hash, const avro::ValidSchema& reader) {
+    const key_type key(writer_hash, reader_hash);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = verdicts_.find(key);
+      if (it != verdicts_.end()) {
+        ++hits_;
+        return it->second;
+      }
+    }
+    boost::shared_ptr<compatibility_verdict> v = boost::make_shared<compatibility_verdict>();
+    compatibility_walker().resolve(writer.root(), reader.root(), "", *v);
+    std::lock_guard<std::mutex> lock(mutex_);
+    return verdicts_.insert(std::make_pair(key, v)).first->second;
+  }
+
+  compatibility_checker::verdict_ptr compatibility_checker::find(const boost::uuids::uuid& writer_hash, const boost::uuids::uuid& reader_hash) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = verdicts_.find(key_type(writer_hash, reader_hash));
+    return it != verdicts_.end() ? it->second : verdict_ptr();
+  }
+
+  std::vector<compatibility_checker::verdict_ptr> compatibility_checker::check_all(const std::vector<const avro::ValidSchema*>& writers, const avro::ValidSchema& reader) {
+    std::vector<std::pair<boost::uuids::uuid, const avro::ValidSchema*> > hashed;
+    hashed.reserve(writers.size());
+    for (const avro::ValidSchema* writer : writers)
+      hashed.push_back(std::make_pair(schema_fingerprint(*writer), writer));
+    return check_all(hashed, reader);
+  }
+
+  std::vector<compatibility_checker::verdict_ptr> compatibility_checker::check_all(const std::vector<std::pair<boost::uuids::uuid, const avro::ValidSchema*> >& writers,
+                                                                                   const avro::ValidSchema& reader) {
+    const boost::uuids::uuid reader_hash = schema_fingerprint(reader);
+    compatibility_walker     walker; // the writers outlive the batch, so their node addresses can key it
+    std::vector<verdict_ptr> result;
+    result.reserve(writers.size());
+    for (auto& entry : writers) {
+      const avro::ValidSchema* writer = entry.second;
+      const key_type           key(entry.first, reader_hash);
+      verdict_ptr              found = find(key.first, key.second);
+      if (found) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++hits_;
+        result.push_back(found);
+        continue;
+      }
+      boost::shared_ptr<compatibility_verdict> v = boost::make_shared<compatibility_verdict>();
+      walker.resolve(writer->root(), reader.root(), "", *v);
+      std::lock_guard<std::mutex> lock(mutex_);
+      result.push_back(verdicts_.insert(std::make_pair(key, v)).first->second);
+    }
+    return result;
+  }
+
+  size_t compatibility_checker::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return verdicts_.size();
+  }
+
+  uint64_t compatibility_checker::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+  }
+};
@@ -0,0 +1,90 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <boost/shared_ptr.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <avro/ValidSchema.hh>
+
+#pragma once
+
+namespace csi {
+  // what reading data written with one schema through another does, worked out from the two schemas instead of by
+  // building an avro::ResolvingDecoder. paths name the reader field: "order.price", "tags[]" for array items,
+  // "attributes{}" for map values, "" for the top level
+  struct compatibility_verdict {
+    enum issue_kind {
+      TYPE_MISMATCH,        // no promotion from the writer type
+      NAME_MISMATCH,        // records, enums and fixed must have the same full name
+      FIXED_SIZE_MISMATCH,
+      MISSING_DEFAULT,      // reader field the writer does not have, without a default
+      MISSING_ENUM_SYMBOL,  // writer symbol the reader does not have
+      MISSING_UNION_BRANCH  // writer type or union branch with no reader branch to go to
+    };
+
+    struct issue {
+      issue_kind  kind;
+      std::string path;
+      std::string detail;
+    };
+
+    struct promotion {
+      std::string path;
+      avro::Type  writer;
+      avro::Type  reader; // long, float or double
+    };
+
+    // writer union branch, or a writer that is not a union (one entry), to reader branch
+    struct branch_mapping {
+      std::string      path;
+      bool             writer_union;
+      std::vector<int> reader_branch; // per writer branch, -1 if it has none, the reader is not a union: 0
+    };
+
+    std::vector<issue>          issues;     // empty if the data can be read
+    std::vector<promotion>      promotions;
+    std::vector<std::string>    defaults;   // reader fields filled in from their default
+    std::vector<std::string>    skipped;    // writer fields the reader drops
+    std::vector<branch_mapping> branches;
+
+    bool        compatible() const { return issues.empty(); }
+    std::string to_string() const; // one line per entry, for logs
+  };
+
+  // enum symbols and union branches the reader lacks are issues even though avro only fails when such a value is
+  // decoded, as in the java SchemaCompatibility. the reader must come from the compiler (compileJsonSchema, generated
+  // valid_schema()), records put together with avro::RecordSchema carry no field defaults
+  compatibility_verdict check_compatibility(const avro::ValidSchema& writer, const avro::ValidSchema& reader);
+
+  // memoizes verdicts by the schema_fingerprint of writer and reader, ie a consumer checking every writer schema it
+  // sees against its reader again on every rebalance. not generate_hash, which leaves out the field defaults a
+  // verdict depends on. thread safe
+  class compatibility_checker {
+    public:
+    typedef boost::shared_ptr<const compatibility_verdict> verdict_ptr;
+
+    compatibility_checker();
+
+    verdict_ptr check(const avro::ValidSchema& writer, const avro::ValidSchema& reader);
+    verdict_ptr check(const boost::uuids::uuid& writer_hash, const avro::ValidSchema& writer,
+                      const boost::uuids::uuid& reader_hash, const avro::ValidSchema& reader); // fingerprints already known
+    verdict_ptr find(const boost::uuids::uuid& writer_hash, const boost::uuids::uuid& reader_hash) const; // null if not checked
+
+    // one reader against many writers, ie a whole registry. records met before in the batch are not walked again,
+    // so writers from a csi::schema_store, which share their sub-records, are checked about once per distinct record
+    std::vector<verdict_ptr> check_all(const std::vector<const avro::ValidSchema*>& writers, const avro::ValidSchema& reader);
+    std::vector<verdict_ptr> check_all(const std::vector<std::pair<boost::uuids::uuid, const avro::ValidSchema*> >& writers,
+                                       const avro::ValidSchema& reader); // writer fingerprints already known
+
+    size_t   size() const; // memoized verdicts
+    uint64_t hits() const;
+
+    private:
+    typedef std::pair<boost::uuids::uuid, boost::uuids::uuid> key_type;
+
+    mutable std::mutex              mutex_;
+    std::map<key_type, verdict_ptr> verdicts_;
+    uint64_t                        hits_;
+  };
+};
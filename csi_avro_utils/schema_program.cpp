@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <stdexcept>
+#include "schema_program.h"
+#include <avro/Schema.hh>
+
+namespace csi {
+  schema_program::schema_program(const avro::ValidSchema& schema) {
+    compile(schema.root());
+  }
+
+  uint32_t schema_program::compile(const avro::NodePtr& n) {
+    avro::NodePtr node = n;
+    if (node->type() == avro::AVRO_SYMBOLIC) {
+      std::map<std::string, uint32_t>::const_iterator i = named_.find(node->name().fullname());
+      if (i != named_.end())
+        return i->second;
+      node = avro::resolveSymbol(node);
+    }
+    if (node->hasName()) {
+      std::map<std::string, uint32_t>::const_iterator i = named_.find(node->name().fullname());
+      if (i != named_.end())
+        return i->second;
+    }
+
+    uint32_t index = static_cast<uint32_t>(ops_.size());
+    op o;
+    o.size = 0;
+    o.children = 0;
+    o.min_bytes = 1;
+    o.empty = false;
+    o.node = node;
+    switch (node->type()) {
+    case avro::AVRO_NULL:   o.code = NUL; o.min_bytes = 0; o.empty = true; break;
+    case avro::AVRO_BOOL:   o.code = BOOL; break;
+    case avro::AVRO_INT:    o.code = INT; break;
+    case avro::AVRO_LONG:   o.code = LONG; break;
+    case avro::AVRO_FLOAT:  o.code = FLOAT; o.min_bytes = 4; break;
+    case avro::AVRO_DOUBLE: o.code = DOUBLE; o.min_bytes = 8; break;
+    case avro::AVRO_STRING: o.code = STRING; break;
+    case avro::AVRO_BYTES:  o.code = BYTES; break;
+    case avro::AVRO_FIXED:  o.code = FIXED; o.size = o.min_bytes = static_cast<uint32_t>(node->fixedSize()); o.empty = (o.size == 0); break;
+    case avro::AVRO_ENUM:   o.code = ENUM; o.size = static_cast<uint32_t>(node->names()); break;
+    case avro::AVRO_ARRAY:  o.code = ARRAY; break;
+    case avro::AVRO_MAP:    o.code = MAP; break;
+    case avro::AVRO_UNION:  o.code = UNION; o.size = static_cast<uint32_t>(node->leaves()); break;
+    case avro::AVRO_RECORD: o.code = RECORD; o.size = static_cast<uint32_t>(node->leaves()); o.min_bytes = 0; break;
+    default:
+      throw std::domain_error(std::string("schema_program: unsupported type: ") + avro::toString(node->type()));
+    };
+    ops_.push_back(o);
+    if (node->hasName())
+      named_[node->name().fullname()] = index; // before the children so recursive references find it
+
+    // ops_ may grow below so only touch ops_[index] after compiling the children
+    switch (node->type()) {
+    case avro::AVRO_ARRAY:
+    {
+      uint32_t item = compile(node->leafAt(0));
+      ops_[index].children = item;
+    }
+    break;
+    case avro::AVRO_MAP:
+    {
+      uint32_t key = compile(avro::StringSchema().root());
+      uint32_t item = compile(node->leafAt(1));
+      ops_[index].size = key;
+      ops_[index].children = item;
+    }
+    break;
+    case avro::AVRO_UNION:
+    case avro::AVRO_RECORD:
+    {
+      std::vector<uint32_t> c;
+      for (size_t i = 0; i != node->leaves(); ++i)
+        c.push_back(compile(node->leafAt(i)));
+      uint32_t min_bytes = 0;
+      bool empty = false;
+      if (node->type() == avro::AVRO_UNION) {
+        for (size_t i = 0; i != c.size(); ++i)
+          min_bytes = (i == 0) ? ops_[c[i]].min_bytes : std::min(min_bytes, ops_[c[i]].min_bytes);
+        min_bytes += 1; // branch index
+      } else {
+        // a field referring back to a record still being compiled counts as 0 and not empty: a record that
+        // only reaches itself through records has no finite encoding, any other way back takes at least a byte
+        empty = true;
+        for (size_t i = 0; i != c.size(); ++i) {
+          min_bytes += ops_[c[i]].min_bytes;
+          empty = empty && ops_[c[i]].empty;
+        }
+      }
+      ops_[index].children = static_cast<uint32_t>(children_.size());
+      ops_[index].min_bytes = min_bytes;
+      ops_[index].empty = empty;
+      children_.insert(children_.end(), c.begin(), c.end());
+    }
+    break;
+    default:
+    break;
+    };
+    return index;
+  }
+};
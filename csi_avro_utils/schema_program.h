@@ -0,0 +1,40 @@
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <avro/ValidSchema.hh>
+
+#pragma once
+
+namespace csi {
+  // a schema flattened into an array of ops that can be walked by index, no shared_ptr chasing or
+  // symbol resolving at runtime. named types are compiled once so recursive schemas become loops in the graph.
+  // used by binary_validator
+  class schema_program {
+    public:
+    enum opcode : uint8_t { NUL, BOOL, INT, LONG, FLOAT, DOUBLE, STRING, BYTES, FIXED, ENUM, ARRAY, MAP, UNION, RECORD };
+
+    struct op {
+      opcode        code;
+      uint32_t      size;      // FIXED bytes, ENUM symbols, UNION branches, RECORD fields, MAP the key op
+      uint32_t      children;  // ARRAY, MAP: the item op, UNION, RECORD: first index in the child list
+      uint32_t      min_bytes; // lower bound of the encoded size, fields referring back to a record still being compiled count as 0
+      bool          empty;     // always encodes to nothing: null, fixed of size 0 and records of only empty fields
+      avro::NodePtr node;
+    };
+
+    explicit schema_program(const avro::ValidSchema& schema);
+
+    uint32_t  root() const { return 0; }
+    const op& at(uint32_t i) const { return ops_[i]; }
+    uint32_t  child(const op& o, size_t i) const { return children_[o.children + i]; } // UNION branch / RECORD field
+    size_t    size() const { return ops_.size(); }
+
+    private:
+    uint32_t compile(const avro::NodePtr& node);
+
+    std::vector<op>                 ops_;
+    std::vector<uint32_t>           children_;
+    std::map<std::string, uint32_t> named_;
+  };
+};
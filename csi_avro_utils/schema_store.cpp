@@ -0,0 +1,272 @@
+#include "schema_store.h"
+#include <sstream>
+#include <limits>
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <avro/Compiler.hh>
+#include <avro/Encoder.hh>
+#include <avro/Generic.hh>
+#include <avro/GenericDatum.hh>
+#include <avro/NodeImpl.hh>
+#include "utils.h"
+
+namespace csi {
+  static void encode_defaults(const avro::NodePtr& n, avro::Encoder& e) {
+    if (n->type() == avro::AVRO_SYMBOLIC)
+      return;
+    if (n->type() == avro::AVRO_RECORD) {
+      for (size_t i = 0; i != n->leaves(); ++i)
+        avro::encode(e, n->defaultValueAt(i));
+    }
+    for (size_t i = 0; i != n->leaves(); ++i)
+      encode_defaults(n->leafAt(i), e);
+  }
+
+  // md5 of the json as printed, whitespace and all, followed by the encoded field defaults of every record
+  // defined in n. printJson leaves the defaults out in some avro-cpp versions, generate_hash always does
+  static boost::uuids::uuid fingerprint(const avro::NodePtr& n) {
+    std::ostringstream os;
+    n->printJson(os, 0);
+    std::auto_ptr<avro::OutputStream> defaults = avro::memoryOutputStream();
+    avro::EncoderPtr                  e = avro::binaryEncoder();
+    e->init(*defaults);
+    encode_defaults(n, *e);
+    e->flush();
+    return hash_normalized(os.str() + to_string(*defaults));
+  }
+
+  static void copy_value(const avro::GenericDatum& from, avro::GenericDatum& to) {
+    if (from.isUnion())
+      to.selectBranch(from.unionBranch());
+    switch (from.type()) {
+      case avro::AVRO_NULL:
+        break;
+      case avro::AVRO_BOOL:
+        to.value<bool>() = from.value<bool>();
+        break;
+      case avro::AVRO_INT:
+        to.value<int32_t>() = from.value<int32_t>();
+        break;
+      case avro::AVRO_LONG:
+        to.value<int64_t>() = from.value<int64_t>();
+        break;
+      case avro::AVRO_FLOAT:
+        to.value<float>() = from.value<float>();
+        break;
+      case avro::AVRO_DOUBLE:
+        to.value<double>() = from.value<double>();
+        break;
+      case avro::AVRO_STRING:
+        to.value<std::string>() = from.value<std::string>();
+        break;
+      case avro::AVRO_BYTES:
+        to.value<std::vector<uint8_t> >() = from.value<std::vector<uint8_t> >();
+        break;
+      case avro::AVRO_FIXED:
+        to.value<avro::GenericFixed>().value() = from.value<avro::GenericFixed>().value();
+        break;
+      case avro::AVRO_ENUM:
+        to.value<avro::GenericEnum>().set(from.value<avro::GenericEnum>().value());
+        break;
+      case avro::AVRO_RECORD:
+      {
+        const avro::GenericRecord& f = from.value<avro::GenericRecord>();
+        avro::GenericRecord&       t = to.value<avro::GenericRecord>();
+        for (size_t i = 0; i != f.fieldCount(); ++i)
+          copy_value(f.fieldAt(i), t.fieldAt(i));
+        break;
+      }
+      case avro::AVRO_ARRAY:
+      {
+        avro::GenericArray& t = to.value<avro::GenericArray>();
+        t.value().clear();
+        for (auto& item : from.value<avro::GenericArray>().value()) {
+          t.value().push_back(avro::GenericDatum(t.schema()->leafAt(0)));
+          copy_value(item, t.value().back());
+        }
+        break;
+      }
+      case avro::AVRO_MAP:
+      {
+        avro::GenericMap& t = to.value<avro::GenericMap>();
+        t.value().clear();
+        for (auto& item : from.value<avro::GenericMap>().value()) {
+          t.value().push_back(std::make_pair(item.first, avro::GenericDatum(t.schema()->leafAt(1))));
+          copy_value(item.second, t.value().back().second);
+        }
+        break;
+      }
+      default:
+        throw avro::Exception("schema_store: unexpected default value type");
+    }
+  }
+
+  // a union, record, enum, fixed, array or map default refers to its schema node, it is rebuilt on the copy so the
+  // compiled tree is not kept alive by it. values that reach a recursive type can not be, the symbolic nodes of the
+  // copy are only linked when it is validated. those keep the compiled nodes
+  static avro::GenericDatum copy_default(const avro::GenericDatum& d, const avro::NodePtr& node) {
+    if (!d.isUnion()) {
+      switch (d.type()) {
+        case avro::AVRO_RECORD:
+        case avro::AVRO_ENUM:
+        case avro::AVRO_FIXED:
+        case avro::AVRO_ARRAY:
+        case avro::AVRO_MAP:
+          break;
+        default:
+          return d;
+      }
+    }
+    try {
+      avro::GenericDatum r(node);
+      copy_value(d, r);
+      return r;
+    } catch (avro::Exception&) {
+      return d;
+    }
+  }
+
+  schema_store::schema_store()
+    : reused_(0) {}
+
+  schema_store::schema_ptr schema_store::intern(const avro::ValidSchema& schema) {
+    return add(schema, fingerprint(schema.root()));
+  }
+
+  boost::uuids::uuid schema_fingerprint(const avro::ValidSchema& schema) {
+    return fingerprint(schema.root());
+  }
+
+  schema_store::schema_ptr schema_store::intern(const std::string& schema_json) {
+    return intern(avro::compileJsonSchemaFromString(schema_json));
+  }
+
+  schema_store::schema_ptr schema_store::find(const boost::uuids::uuid& hash) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = by_hash_.find(hash);
+    return it != by_hash_.end() ? it->second : schema_ptr();
+  }
+
+  size_t schema_store::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return schemas_.size();
+  }
+
+  size_t schema_store::subtrees() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return subtrees_.size();
+  }
+
+  uint64_t schema_store::reused() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reused_;
+  }
+
+  // the ValidSchema constructor links the symbolic nodes and locks every node again, shared ones included,
+  // with the values they already have. done under the lock so two schemas are never validated at once, but
+  // threads using earlier schemas read those nodes without it, see schema_store.h
+  schema_store::schema_ptr schema_store::add(const avro::ValidSchema& compiled, const boost::uuids::uuid& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = schemas_.find(key);
+    if (it != schemas_.end())
+      return it->second;
+    walk_state st;
+    st.next = 0;
+    size_t first_ref = std::numeric_limits<size_t>::max();
+    schema_ptr p = boost::make_shared<const avro::ValidSchema>(rebuild(compiled.root(), st, first_ref));
+    schemas_[key] = p;
+    by_hash_.insert(std::make_pair(generate_hash(*p), p)); // the first one if they differ only in defaults
+    return p;
+  }
+
+  // a subtree from the store defines the same names as the one it replaces
+  static void define_names(const avro::NodePtr& n, std::map<avro::Name, size_t>& defined, size_t& next) {
+    if (n->type() == avro::AVRO_SYMBOLIC)
+      return;
+    if (n->hasName())
+      defined[n->name()] = next++;
+    for (size_t i = 0; i != n->leaves(); ++i)
+      define_names(n->leafAt(i), defined, next);
+  }
+
+  // walks the compiled schema in the order ValidSchema validates it, so named types are defined and referenced
+  // at the same places in the copy. first_ref is lowered to the first definition referenced from inside n, n is
+  // self contained if that is not before n itself
+  avro::NodePtr schema_store::rebuild(const avro::NodePtr& n, walk_state& st, size_t& first_ref) {
+    if (n->type() == avro::AVRO_SYMBOLIC) {
+      auto it = st.defined.find(n->name());
+      if (it == st.defined.end())
+        throw avro::Exception("Symbol not found: " + n->name().fullname());
+      first_ref = std::min(first_ref, it->second);
+      return boost::make_shared<avro::NodeSymbolic>(avro::HasName(n->name()));
+    }
+
+    const boost::uuids::uuid key = fingerprint(n);
+    auto hit = subtrees_.find(key);
+    if (hit != subtrees_.end()) {
+      define_names(n, st.defined, st.next);
+      ++reused_;
+      return hit->second;
+    }
+
+    const size_t first = st.next;
+    if (n->hasName())
+      st.defined[n->name()] = st.next++;
+    size_t            refs = std::numeric_limits<size_t>::max();
+    avro::MultiLeaves leaves;
+    for (size_t i = 0; i != n->leaves(); ++i)
+      leaves.add(rebuild(n->leafAt(i), st, refs));
+    first_ref = std::min(first_ref, refs);
+
+    avro::NodePtr r;
+    switch (n->type()) {
+      case avro::AVRO_RECORD:
+      {
+        avro::LeafNames                names;
+        std::vector<avro::GenericDatum> defaults;
+        for (size_t i = 0; i != n->leaves(); ++i) {
+          names.add(n->nameAt(i));
+          defaults.push_back(copy_default(n->defaultValueAt(i), leaves.get(i)));
+        }
+        r = boost::make_shared<avro::NodeRecord>(avro::HasName(n->name()), leaves, names, defaults);
+        break;
+      }
+      case avro::AVRO_ENUM:
+      {
+        avro::LeafNames symbols;
+        for (size_t i = 0; i != n->names(); ++i)
+          symbols.add(n->nameAt(i));
+        r = boost::make_shared<avro::NodeEnum>(avro::HasName(n->name()), symbols);
+        break;
+      }
+      case avro::AVRO_FIXED:
+        r = boost::make_shared<avro::NodeFixed>(avro::HasName(n->name()), avro::HasSize(n->fixedSize()));
+        break;
+      case avro::AVRO_ARRAY:
+        r = boost::make_shared<avro::NodeArray>(avro::SingleLeaf(leaves.get(0)));
+        break;
+      case avro::AVRO_MAP:
+        r = boost::make_shared<avro::NodeMap>(avro::SingleLeaf(leaves.get(1)));
+        break;
+      case avro::AVRO_UNION:
+        r = boost::make_shared<avro::NodeUnion>(leaves);
+        break;
+      case avro::AVRO_STRING:
+      case avro::AVRO_BYTES:
+      case avro::AVRO_INT:
+      case avro::AVRO_LONG:
+      case avro::AVRO_FLOAT:
+      case avro::AVRO_DOUBLE:
+      case avro::AVRO_BOOL:
+      case avro::AVRO_NULL:
+        r = boost::make_shared<avro::NodePrimitive>(n->type());
+        break;
+      default:
+        throw avro::Exception("schema_store: unexpected node type");
+    }
+
+    if (refs >= first)
+      subtrees_[key] = r;
+    return r;
+  }
+};
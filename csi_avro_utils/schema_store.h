@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <boost/shared_ptr.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/functional/hash.hpp>
+#include <avro/ValidSchema.hh>
+
+#pragma once
+
+namespace csi {
+  // keeps many schemas, ie every version in a schema registry, with identical subtrees stored once.
+  // a subtree is shared when it is self contained (every named type it refers to is defined inside it) and is
+  // keyed on the md5 of its json and field defaults. schemas that reuse the same named records and enums then share
+  // those nodes, including their name and field name strings, and every "int" or "string" node is the same one.
+  // schemas are keyed the same way, interning a schema that is already there returns the stored one.
+  // the returned schemas are ordinary avro::ValidSchemas. interning is serialized, but building the new ValidSchema
+  // links and locks the shared nodes again, nodes that schemas returned earlier use. so intern() must not run while
+  // other threads use stored schemas: intern up front (ie the registry dump at startup), or stop the readers.
+  // find() and using the schemas from any number of threads is fine once interning is done. nothing is ever removed
+  class schema_store {
+    public:
+    typedef boost::shared_ptr<const avro::ValidSchema> schema_ptr;
+
+    schema_store();
+
+    // schema must come from the compiler, records put together with avro::RecordSchema carry no field defaults
+    schema_ptr intern(const avro::ValidSchema& schema);
+    schema_ptr intern(const std::string& schema_json);
+    schema_ptr find(const boost::uuids::uuid& hash) const; // by generate_hash, which leaves defaults out. null if not interned
+
+    size_t   size() const;     // schemas
+    size_t   subtrees() const; // distinct shared subtrees
+    uint64_t reused() const;   // subtrees taken from the store instead of copied
+
+    private:
+    struct walk_state {
+      std::map<avro::Name, size_t> defined; // named types in definition order
+      size_t                       next;
+    };
+
+    schema_ptr    add(const avro::ValidSchema& compiled, const boost::uuids::uuid& key);
+    avro::NodePtr rebuild(const avro::NodePtr& n, walk_state& st, size_t& first_ref);
+
+    typedef boost::hash<boost::uuids::uuid> uuid_hash;
+
+    mutable std::mutex                                               mutex_;
+    std::unordered_map<boost::uuids::uuid, schema_ptr, uuid_hash>    schemas_;
+    std::unordered_map<boost::uuids::uuid, schema_ptr, uuid_hash>    by_hash_;
+    std::unordered_map<boost::uuids::uuid, avro::NodePtr, uuid_hash> subtrees_;
+    uint64_t                                                         reused_;
+  };
+
+  // the key schemas are interned on: md5 of the json and the encoded field defaults. unlike generate_hash it tells
+  // apart schemas that only differ in a default
+  boost::uuids::uuid schema_fingerprint(const avro::ValidSchema& schema);
+};
@@ -0,0 +1,272 @@
+#include <cstring>
+#include <stdexcept>
+#include "sortable_key.h"
+
+namespace csi {
+  namespace avro_hive {
+    static void check_column_type(avro::Type t) {
+      switch (t) {
+      case avro::AVRO_NULL:
+      case avro::AVRO_BOOL:
+      case avro::AVRO_INT:
+      case avro::AVRO_LONG:
+      case avro::AVRO_FLOAT:
+      case avro::AVRO_DOUBLE:
+      case avro::AVRO_STRING:
+      case avro::AVRO_BYTES:
+      case avro::AVRO_ENUM:
+      case avro::AVRO_FIXED:
+      return;
+      default:
+      throw std::domain_error(std::string("sortable_key_codec: unsupported key column type: ") + avro::toString(t));
+      };
+    }
+
+    sortable_key_codec::sortable_key_codec(const avro::ValidSchema& key_schema) {
+      const avro::NodePtr& r = key_schema.root();
+      if (r->type() != avro::AVRO_RECORD)
+        throw std::domain_error(std::string("sortable_key_codec: expected: AVRO_RECORD, actual: ") + avro::toString(r->type()));
+
+      for (size_t i = 0; i != r->leaves(); ++i) {
+        const avro::NodePtr& l = r->leafAt(i);
+        column c;
+        c.type = l->type();
+        c.fixed_size = 0;
+        if (c.type == avro::AVRO_UNION) {
+          if (l->leaves() > 255)
+            throw std::domain_error("sortable_key_codec: too many union branches");
+          for (size_t j = 0; j != l->leaves(); ++j) {
+            c.branches.push_back(l->leafAt(j)->type());
+            check_column_type(c.branches.back());
+            c.branch_sizes.push_back(c.branches.back() == avro::AVRO_FIXED ? l->leafAt(j)->fixedSize() : 0);
+          }
+        } else {
+          check_column_type(c.type);
+          if (c.type == avro::AVRO_FIXED)
+            c.fixed_size = l->fixedSize();
+        }
+        columns_.push_back(c);
+      }
+    }
+
+    static inline void put_be32(std::string& dst, uint32_t v) {
+      char b[4] = { char(v >> 24), char(v >> 16), char(v >> 8), char(v) };
+      dst.append(b, 4);
+    }
+
+    static inline void put_be64(std::string& dst, uint64_t v) {
+      put_be32(dst, static_cast<uint32_t>(v >> 32));
+      put_be32(dst, static_cast<uint32_t>(v));
+    }
+
+    static void put_escaped(std::string& dst, const uint8_t* p, size_t len) {
+      const uint8_t* end = p + len;
+      while (p != end) {
+        const uint8_t* z = static_cast<const uint8_t*>(memchr(p, 0, end - p));
+        if (!z) {
+          dst.append(reinterpret_cast<const char*>(p), end - p);
+          break;
+        }
+        dst.append(reinterpret_cast<const char*>(p), z - p);
+        dst.append("\x00\xff", 2);
+        p = z + 1;
+      }
+      dst.append("\x00\x01", 2);
+    }
+
+    static void encode_value(avro::Type t, const avro::GenericDatum& d, std::string& dst) {
+      switch (t) {
+      case avro::AVRO_NULL:
+      break;
+      case avro::AVRO_BOOL:
+      dst.push_back(d.value<bool>() ? 1 : 0);
+      break;
+      case avro::AVRO_INT:
+      put_be32(dst, static_cast<uint32_t>(d.value<int32_t>()) ^ 0x80000000u);
+      break;
+      case avro::AVRO_LONG:
+      put_be64(dst, static_cast<uint64_t>(d.value<int64_t>()) ^ 0x8000000000000000ull);
+      break;
+      case avro::AVRO_FLOAT:
+      {
+        uint32_t bits;
+        float v = d.value<float>();
+        memcpy(&bits, &v, 4);
+        put_be32(dst, (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u));
+      }
+      break;
+      case avro::AVRO_DOUBLE:
+      {
+        uint64_t bits;
+        double v = d.value<double>();
+        memcpy(&bits, &v, 8);
+        put_be64(dst, (bits & 0x8000000000000000ull) ? ~bits : (bits | 0x8000000000000000ull));
+      }
+      break;
+      case avro::AVRO_STRING:
+      {
+        const std::string& s = d.value<std::string>();
+        put_escaped(dst, reinterpret_cast<const uint8_t*>(s.data()), s.size());
+      }
+      break;
+      case avro::AVRO_BYTES:
+      {
+        const std::vector<uint8_t>& b = d.value<std::vector<uint8_t>>();
+        put_escaped(dst, b.data(), b.size());
+      }
+      break;
+      case avro::AVRO_ENUM:
+      put_be32(dst, static_cast<uint32_t>(d.value<avro::GenericEnum>().value()));
+      break;
+      case avro::AVRO_FIXED:
+      {
+        const std::vector<uint8_t>& b = d.value<avro::GenericFixed>().value();
+        dst.append(reinterpret_cast<const char*>(b.data()), b.size());
+      }
+      break;
+      default:
+      break;
+      };
+    }
+
+    void sortable_key_codec::encode(const avro::GenericDatum& key, std::string& dst) const {
+      if (key.type() != avro::AVRO_RECORD)
+        throw std::domain_error(std::string("sortable_key_codec: expected: AVRO_RECORD, actual: ") + avro::toString(key.type()));
+      const avro::GenericRecord& record = key.value<avro::GenericRecord>();
+      if (record.fieldCount() != columns_.size())
+        throw std::domain_error("sortable_key_codec: key does not match key schema");
+
+      for (size_t i = 0; i != columns_.size(); ++i) {
+        const column& c = columns_[i];
+        const avro::GenericDatum& f = record.fieldAt(i);
+        if (c.type == avro::AVRO_UNION) {
+          size_t branch = f.unionBranch();
+          dst.push_back(static_cast<char>(branch));
+          encode_value(c.branches[branch], f, dst);
+        } else {
+          encode_value(c.type, f, dst);
+        }
+      }
+    }
+
+    std::string sortable_key_codec::encode(const avro::GenericDatum& key) const {
+      std::string s;
+      encode(key, s);
+      return s;
+    }
+
+    static void need(const uint8_t* p, const uint8_t* end, size_t n) {
+      if (static_cast<size_t>(end - p) < n)
+        throw std::domain_error("sortable_key_codec: truncated key");
+    }
+
+    static inline uint32_t get_be32(const uint8_t*& p, const uint8_t* end) {
+      need(p, end, 4);
+      uint32_t v = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+      p += 4;
+      return v;
+    }
+
+    static inline uint64_t get_be64(const uint8_t*& p, const uint8_t* end) {
+      uint64_t hi = get_be32(p, end);
+      return (hi << 32) | get_be32(p, end);
+    }
+
+    template<class C> static void get_escaped(const uint8_t*& p, const uint8_t* end, C& dst) {
+      dst.clear();
+      while (true) {
+        const uint8_t* z = static_cast<const uint8_t*>(memchr(p, 0, end - p));
+        if (!z || z + 1 == end)
+          throw std::domain_error("sortable_key_codec: unterminated string");
+        dst.insert(dst.end(), p, z);
+        p = z + 2;
+        if (z[1] == 0x01)
+          return;
+        if (z[1] != 0xff)
+          throw std::domain_error("sortable_key_codec: invalid escape");
+        dst.push_back(0);
+      }
+    }
+
+    static void decode_value(avro::Type t, size_t fixed_size, const uint8_t*& p, const uint8_t* end, avro::GenericDatum& d) {
+      switch (t) {
+      case avro::AVRO_NULL:
+      break;
+      case avro::AVRO_BOOL:
+      need(p, end, 1);
+      d.value<bool>() = (*p++ != 0);
+      break;
+      case avro::AVRO_INT:
+      d.value<int32_t>() = static_cast<int32_t>(get_be32(p, end) ^ 0x80000000u);
+      break;
+      case avro::AVRO_LONG:
+      d.value<int64_t>() = static_cast<int64_t>(get_be64(p, end) ^ 0x8000000000000000ull);
+      break;
+      case avro::AVRO_FLOAT:
+      {
+        uint32_t bits = get_be32(p, end);
+        bits = (bits & 0x80000000u) ? (bits & ~0x80000000u) : ~bits;
+        memcpy(&d.value<float>(), &bits, 4);
+      }
+      break;
+      case avro::AVRO_DOUBLE:
+      {
+        uint64_t bits = get_be64(p, end);
+        bits = (bits & 0x8000000000000000ull) ? (bits & ~0x8000000000000000ull) : ~bits;
+        memcpy(&d.value<double>(), &bits, 8);
+      }
+      break;
+      case avro::AVRO_STRING:
+      get_escaped(p, end, d.value<std::string>());
+      break;
+      case avro::AVRO_BYTES:
+      get_escaped(p, end, d.value<std::vector<uint8_t>>());
+      break;
+      case avro::AVRO_ENUM:
+      d.value<avro::GenericEnum>().set(get_be32(p, end));
+      break;
+      case avro::AVRO_FIXED:
+      {
+        need(p, end, fixed_size);
+        std::vector<uint8_t>& v = d.value<avro::GenericFixed>().value();
+        v.assign(p, p + fixed_size);
+        p += fixed_size;
+      }
+      break;
+      default:
+      break;
+      };
+    }
+
+    void sortable_key_codec::decode(const uint8_t* data, size_t size, avro::GenericDatum& key) const {
+      if (key.type() != avro::AVRO_RECORD)
+        throw std::domain_error(std::string("sortable_key_codec: expected: AVRO_RECORD, actual: ") + avro::toString(key.type()));
+      avro::GenericRecord& record = key.value<avro::GenericRecord>();
+      if (record.fieldCount() != columns_.size())
+        throw std::domain_error("sortable_key_codec: key does not match key schema");
+
+      const uint8_t* p = data;
+      const uint8_t* end = data + size;
+      for (size_t i = 0; i != columns_.size(); ++i) {
+        const column& c = columns_[i];
+        avro::GenericDatum& f = record.fieldAt(i);
+        if (c.type == avro::AVRO_UNION) {
+          need(p, end, 1);
+          size_t branch = *p++;
+          if (branch >= c.branches.size())
+            throw std::domain_error("sortable_key_codec: invalid union branch");
+          f.selectBranch(branch);
+          decode_value(c.branches[branch], c.branch_sizes[branch], p, end, f);
+        } else {
+          decode_value(c.type, c.fixed_size, p, end, f);
+        }
+      }
+      if (p != end)
+        throw std::domain_error("sortable_key_codec: trailing bytes after key");
+    }
+
+    void sortable_key_codec::decode(const std::string& encoded, avro::GenericDatum& key) const {
+      decode(reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size(), key);
+    }
+  };
+};
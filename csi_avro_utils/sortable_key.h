@@ -0,0 +1,43 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <avro/ValidSchema.hh>
+#include <avro/Generic.hh>
+
+#pragma once
+
+namespace csi {
+  namespace avro_hive {
+    // order preserving binary encoding of key records as produced by get_key / get_key_schema
+    // memcmp (or a radix sort) on the encoded keys gives the avro sort order of the records
+    //
+    // columns are concatenated in schema order:
+    //   int, long, enum - big endian with the sign bit flipped
+    //   float, double   - big endian, sign bit flipped for positive values, all bits flipped for negative
+    //   boolean         - one byte
+    //   string, bytes   - 0x00 escaped as 0x00 0xff, terminated by 0x00 0x01
+    //   fixed           - raw bytes
+    //   union           - one byte branch index followed by the value (nothing for null)
+    // the only differences from the avro order: -0.0 sorts before 0.0 and NaNs sort by their bits
+    class sortable_key_codec {
+      public:
+      explicit sortable_key_codec(const avro::ValidSchema& key_schema); // throws std::domain_error for unsupported column types
+
+      void        encode(const avro::GenericDatum& key, std::string& dst) const; // appends to dst
+      std::string encode(const avro::GenericDatum& key) const;
+
+      // key must be created from the key schema
+      void        decode(const uint8_t* data, size_t size, avro::GenericDatum& key) const;
+      void        decode(const std::string& encoded, avro::GenericDatum& key) const;
+
+      private:
+      struct column {
+        avro::Type              type;
+        size_t                  fixed_size;
+        std::vector<avro::Type> branches;     // union only
+        std::vector<size_t>     branch_sizes; // union only, the fixed_size of each branch
+      };
+      std::vector<column> columns_;
+    };
+  };
+};
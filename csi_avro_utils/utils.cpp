@@ -1,9 +1,14 @@
 #include <iostream>
 #include <sstream>
 #include <openssl/md5.h>
+#include "pooled_output_stream.h"
 #include "utils.h"
 
 std::string to_string(const avro::OutputStream& os) {
+  // copied straight out of the chunks, no memoryInputStream
+  const csi::pooled_output_stream* pooled = dynamic_cast<const csi::pooled_output_stream*>(&os);
+  if (pooled)
+    return pooled->str();
   std::string res;
   size_t sz = os.byteCount();
   res.reserve(sz);
@@ -35,7 +40,10 @@ std::string normalize(const avro::ValidSchema& vs) {
 }
 
 boost::uuids::uuid generate_hash(const avro::ValidSchema& vs) {
-  std::string s = normalize(vs);
+  return hash_normalized(normalize(vs));
+}
+
+boost::uuids::uuid hash_normalized(const std::string& s) {
   MD5_CTX ctx;
   MD5_Init(&ctx);
   MD5_Update(&ctx, s.data(), s.size());
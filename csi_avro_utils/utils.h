@@ -42,6 +42,7 @@ return s;
 
 std::string        to_string(const avro::OutputStream& os);
 boost::uuids::uuid generate_hash(const avro::ValidSchema&);
+boost::uuids::uuid hash_normalized(const std::string& normalized_schema); // same as generate_hash if you already have normalize()
 std::string        to_string(const avro::ValidSchema& vs);
 std::string        normalize(const avro::ValidSchema&);
 
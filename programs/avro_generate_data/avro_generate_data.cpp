@@ -0,0 +1,313 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <avro/Compiler.hh>
+#include <avro/ValidSchema.hh>
+#include <boost/make_shared.hpp>
+#include <boost/program_options.hpp>
+#include <csi_avro_utils/utils.h>
+#include <csi_avro_utils/data_generator.h>
+#include <csi_avro_utils/data_file_writer.h>
+#include <csi_avro_utils/envelope.h>
+#include <csi_avro_utils/pooled_output_stream.h>
+
+// messages are made in chunks, each by its own generator seeded from the seed and the chunk number,
+// so the output only depends on the seed and not on the number of threads
+static const size_t chunk_messages = 1024;
+
+struct chunk
+{
+    size_t               index;
+    size_t               count;
+    std::vector<uint8_t> data;    // framed messages
+    std::vector<size_t>  offsets; // message ends in data, for container files
+};
+
+static uint64_t chunk_seed(uint64_t seed, size_t index)
+{
+    return seed ^ (index * 0xD1B54A32D192ED03ULL);
+}
+
+static void write_length(std::vector<uint8_t>& out, size_t at, uint32_t len)
+{
+    out[at] = (uint8_t) (len >> 24);
+    out[at + 1] = (uint8_t) (len >> 16);
+    out[at + 2] = (uint8_t) (len >> 8);
+    out[at + 3] = (uint8_t) len;
+}
+
+static void make_chunk(csi::data_generator& generator, uint64_t seed, bool length_prefix, const std::string& header, chunk& c)
+{
+    generator.reseed(chunk_seed(seed, c.index));
+    c.data.clear();
+    c.offsets.clear();
+    for (size_t i = 0; i != c.count; ++i)
+    {
+        size_t at = c.data.size();
+        if (length_prefix)
+            c.data.resize(at + 4);
+        c.data.insert(c.data.end(), header.begin(), header.end());
+        size_t len = generator.generate(c.data);
+        if (length_prefix)
+            write_length(c.data, at, (uint32_t) (header.size() + len));
+        c.offsets.push_back(c.data.size());
+    }
+}
+
+// each worker pulls the next chunk of the round, the chunks are written in order
+static void make_chunks(std::vector<csi::data_generator>& generators, uint64_t seed, bool length_prefix, const std::string& header, std::vector<chunk>& chunks)
+{
+    std::atomic<size_t> next(0);
+    auto worker = [&](csi::data_generator& generator)
+    {
+        for (size_t i = next++; i < chunks.size(); i = next++)
+            make_chunk(generator, seed, length_prefix, header, chunks[i]);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < generators.size(); ++i)
+        threads.emplace_back(worker, std::ref(generators[i]));
+    worker(generators[0]);
+    for (auto& t : threads)
+        t.join();
+}
+
+// fixed:N, uniform:MIN:MAX or geometric:MIN:MEAN:MAX
+static csi::size_distribution parse_distribution(const std::string& spec)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    for (size_t i = spec.find(':'); ; i = spec.find(':', start))
+    {
+        parts.push_back(spec.substr(start, i == std::string::npos ? std::string::npos : i - start));
+        if (i == std::string::npos)
+            break;
+        start = i + 1;
+    }
+    if (parts[0] == "fixed" && parts.size() == 2)
+        return csi::size_distribution::fixed((uint32_t) std::stoul(parts[1]));
+    if (parts[0] == "uniform" && parts.size() == 3)
+        return csi::size_distribution::uniform((uint32_t) std::stoul(parts[1]), (uint32_t) std::stoul(parts[2]));
+    if (parts[0] == "geometric" && parts.size() == 4)
+        return csi::size_distribution::geometric((uint32_t) std::stoul(parts[1]), std::stod(parts[2]), (uint32_t) std::stoul(parts[3]));
+    throw std::invalid_argument("bad distribution: " + spec + ", expected fixed:N, uniform:MIN:MAX or geometric:MIN:MEAN:MAX");
+}
+
+// namespace.record.field=W0,W1,...
+static void parse_weights(const std::string& spec, csi::generator_config& config)
+{
+    size_t eq = spec.find('=');
+    if (eq == std::string::npos)
+        throw std::invalid_argument("bad weights: " + spec + ", expected namespace.record.field=W0,W1,...");
+    std::vector<double>& weights = config.branch_weights[spec.substr(0, eq)];
+    for (size_t start = eq + 1; start <= spec.size(); )
+    {
+        size_t comma = std::min(spec.find(',', start), spec.size());
+        weights.push_back(std::stod(spec.substr(start, comma - start)));
+        start = comma + 1;
+    }
+}
+
+namespace po = boost::program_options;
+
+int main(int argc, char** argv)
+{
+    po::options_description desc("Usage: avro_generate_data [options] [schema] [output]\nAllowed options");
+    desc.add_options()
+        ("help,h", "produce help message")
+        ("count,n", po::value<size_t>()->default_value(1000), "number of messages")
+        ("seed,s", po::value<uint64_t>()->default_value(1), "random seed, the same seed gives the same output")
+        ("frame,f", po::value<std::string>()->default_value("length"), "length: 4 byte big endian length before each message, none, or container: avro object container file")
+        ("envelope,e", po::value<std::string>()->default_value("none"), "header in front of each message: none, hash (generate_hash) or confluent")
+        ("schema-id", po::value<int32_t>()->default_value(1), "schema registry id for --envelope confluent")
+        ("codec", po::value<std::string>()->default_value("deflate"), "container file codec")
+        ("string-length", po::value<std::string>(), "string lengths, default uniform:4:32")
+        ("bytes-length", po::value<std::string>(), "bytes lengths, default uniform:0:64")
+        ("array-size", po::value<std::string>(), "array items, default geometric:0:4:64")
+        ("map-size", po::value<std::string>(), "map entries, default geometric:0:4:64")
+        ("min-number", po::value<int64_t>(), "smallest int, long, float and double, default 0")
+        ("max-number", po::value<int64_t>(), "largest int, long, float and double, default 1000000")
+        ("null-probability", po::value<double>(), "probability of the null branch of nullable unions, default all branches equally likely")
+        ("weights,w", po::value<std::vector<std::string> >()->composing(), "union branch weights, namespace.record.field=W0,W1,...")
+        ("max-depth", po::value<size_t>(), "cut nesting short below this depth, default 8")
+        ("threads,j", po::value<size_t>()->default_value(std::max<size_t>(1, std::thread::hardware_concurrency())), "generating threads")
+        ("input", po::value<std::string>(), "schema file, default stdin")
+        ("output", po::value<std::string>(), "output file, default stdout");
+
+    po::positional_options_description positional;
+    positional.add("input", 1);
+    positional.add("output", 1);
+
+    po::variables_map vm;
+    csi::generator_config config;
+    try
+    {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+        po::notify(vm);
+        config.seed = vm["seed"].as<uint64_t>();
+        if (vm.count("string-length"))
+            config.string_length = parse_distribution(vm["string-length"].as<std::string>());
+        if (vm.count("bytes-length"))
+            config.bytes_length = parse_distribution(vm["bytes-length"].as<std::string>());
+        if (vm.count("array-size"))
+            config.array_size = parse_distribution(vm["array-size"].as<std::string>());
+        if (vm.count("map-size"))
+            config.map_size = parse_distribution(vm["map-size"].as<std::string>());
+        if (vm.count("min-number"))
+            config.min_number = vm["min-number"].as<int64_t>();
+        if (vm.count("max-number"))
+            config.max_number = vm["max-number"].as<int64_t>();
+        if (vm.count("null-probability"))
+            config.null_probability = vm["null-probability"].as<double>();
+        if (vm.count("max-depth"))
+            config.max_depth = vm["max-depth"].as<size_t>();
+        if (vm.count("weights"))
+        {
+            for (auto& w : vm["weights"].as<std::vector<std::string> >())
+                parse_weights(w, config);
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl << desc << std::endl;
+        return 1;
+    }
+
+    if (vm.count("help"))
+    {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    const std::string frame = vm["frame"].as<std::string>();
+    const std::string envelope = vm["envelope"].as<std::string>();
+    if (frame != "length" && frame != "none" && frame != "container")
+    {
+        std::cerr << "Unknown frame: " << frame << std::endl;
+        return 1;
+    }
+    if (envelope != "none" && envelope != "hash" && envelope != "confluent")
+    {
+        std::cerr << "Unknown envelope: " << envelope << std::endl;
+        return 1;
+    }
+    if (frame == "container" && envelope != "none")
+    {
+        std::cerr << "Container files hold the plain records, no envelope" << std::endl;
+        return 1;
+    }
+
+    std::string infile = vm.count("input") ? vm["input"].as<std::string>() : std::string();
+    std::string outfile = vm.count("output") ? vm["output"].as<std::string>() : std::string();
+
+    boost::shared_ptr<avro::ValidSchema> schema = boost::make_shared<avro::ValidSchema>();
+    try
+    {
+        if (!infile.empty())
+        {
+            std::ifstream in(infile.c_str());
+            avro::compileJsonSchema(in, *schema);
+        }
+        else
+        {
+            avro::compileJsonSchema(std::cin, *schema);
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "Failed to parse or compile schema: " << e.what() << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        // the same header goes in front of every message
+        std::string header;
+        if (envelope != "none")
+        {
+            csi::envelope_codec codec(envelope == "hash" ? csi::HASH_ENVELOPE : csi::CONFLUENT_ENVELOPE);
+            if (envelope == "hash")
+                codec.add(schema);
+            else
+                codec.add(vm["schema-id"].as<int32_t>(), schema);
+            csi::pooled_output_stream os;
+            codec.write_header(os, generate_hash(*schema));
+            header = os.str();
+        }
+
+        size_t nr_of_threads = std::max<size_t>(1, vm["threads"].as<size_t>());
+        std::vector<csi::data_generator> generators(nr_of_threads, csi::data_generator(*schema, config));
+
+        std::unique_ptr<csi::data_file_writer_base> container;
+        std::ofstream fout;
+        if (frame == "container")
+        {
+            if (outfile.empty())
+            {
+                std::cerr << "Container files need an output file" << std::endl;
+                return 1;
+            }
+            container.reset(new csi::data_file_writer_base(outfile, *schema, vm["codec"].as<std::string>(), nr_of_threads, 64 * 1024));
+        }
+        else if (!outfile.empty())
+        {
+            fout.open(outfile.c_str(), std::ios::binary);
+            if (!fout)
+            {
+                std::cerr << "Failed to open output file: " << outfile << std::endl;
+                return 1;
+            }
+        }
+        std::ostream& out = outfile.empty() ? std::cout : fout;
+
+        const size_t count = vm["count"].as<size_t>();
+        std::vector<chunk> round(4 * nr_of_threads);
+        for (size_t done = 0, index = 0; done < count; )
+        {
+            size_t n = 0;
+            for (; n != round.size() && done < count; ++n, ++index)
+            {
+                round[n].index = index;
+                round[n].count = std::min(chunk_messages, count - done);
+                done += round[n].count;
+            }
+            round.resize(n);
+            make_chunks(generators, config.seed, frame == "length", header, round);
+            for (auto& c : round)
+            {
+                if (container)
+                {
+                    // the messages are already encoded, written into the block as they are
+                    for (size_t i = 0, from = 0; i != c.offsets.size(); from = c.offsets[i++])
+                    {
+                        container->encoder().encodeFixed(&c.data[from], c.offsets[i] - from);
+                        container->record_written();
+                    }
+                }
+                else if (!c.data.empty())
+                {
+                    out.write((const char*) &c.data[0], c.data.size());
+                }
+            }
+        }
+
+        if (container)
+            container->close();
+        out.flush();
+        if (!out)
+        {
+            std::cerr << "Failed to write output" << std::endl;
+            return 1;
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "Failed to generate data: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
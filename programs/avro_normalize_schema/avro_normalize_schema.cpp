@@ -3,12 +3,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <thread>
+#include <atomic>
 #include <fstream>
+#include <algorithm>
+#include <stdexcept>
 #include <avro/Compiler.hh>
 #include <avro/Schema.hh>
 #include <avro/ValidSchema.hh>
 #include <sstream>
 #include <boost/uuid/uuid_io.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
 #include <csi_avro_utils/utils.h>
 
 template<class OutIter>
@@ -39,16 +44,227 @@ OutIter escape_string(std::string const& s, OutIter out) {
     return out;
 }
 
+struct batch_item
+{
+    std::string source; // line number or file name, used in error messages
+    std::string schema;
+    std::string result; // fingerprint \t normalized \t escaped
+    std::string error;
+};
+
+static void process(batch_item& item)
+{
+    try
+    {
+        avro::ValidSchema schema = avro::compileJsonSchemaFromString(item.schema);
+        std::string normalized = normalize(schema);
+        item.result = to_string(hash_normalized(normalized));
+        item.result += '\t';
+        item.result += normalized;
+        item.result += '\t';
+        escape_string(normalized, std::back_inserter(item.result));
+    }
+    catch (std::exception &e)
+    {
+        item.error = e.what();
+    }
+}
+
+// each worker pulls the next unprocessed item, results stay in input order
+static void process_parallel(std::vector<batch_item>& items, size_t nr_of_threads)
+{
+    std::atomic<size_t> next(0);
+    auto worker = [&items, &next]()
+    {
+        for (size_t i = next++; i < items.size(); i = next++)
+            process(items[i]);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nr_of_threads; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads)
+        t.join();
+}
+
+// returns number of failed schemas
+static size_t flush_batch(std::vector<batch_item>& items, size_t nr_of_threads, bool with_source, std::ostream& out)
+{
+    size_t failed = 0;
+    process_parallel(items, nr_of_threads);
+    for (auto& i : items)
+    {
+        if (!i.error.empty())
+        {
+            std::cerr << "Failed to parse or compile schema: " << i.source << ": " << i.error << std::endl;
+            ++failed;
+            continue;
+        }
+        if (with_source)
+            out << i.source << '\t';
+        out << i.result << '\n';
+    }
+    items.clear();
+    return failed;
+}
+
+// one schema per line, processed in bounded chunks so the input can be a pipe of any size
+static size_t run_lines(std::istream& in, size_t nr_of_threads, std::ostream& out)
+{
+    const size_t chunk_size = 4096 * nr_of_threads;
+    std::vector<batch_item> items;
+    items.reserve(chunk_size);
+    size_t failed = 0;
+    size_t line_no = 0;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        ++line_no;
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        items.push_back(batch_item());
+        items.back().source = "line " + std::to_string(line_no);
+        items.back().schema.swap(line);
+        if (items.size() == chunk_size)
+            failed += flush_batch(items, nr_of_threads, false, out);
+    }
+    failed += flush_batch(items, nr_of_threads, false, out);
+    return failed;
+}
+
+// one schema per regular file, sorted by path
+static size_t run_directory(const std::string& dir, size_t nr_of_threads, std::ostream& out)
+{
+    std::vector<std::string> files;
+    for (boost::filesystem::directory_iterator i(dir), end; i != end; ++i)
+    {
+        if (boost::filesystem::is_regular_file(i->status()))
+            files.push_back(i->path().string());
+    }
+    std::sort(files.begin(), files.end());
+
+    const size_t chunk_size = 4096 * nr_of_threads;
+    std::vector<batch_item> items;
+    size_t failed = 0;
+    for (auto& f : files)
+    {
+        std::ifstream in(f.c_str());
+        if (!in)
+            throw std::runtime_error("cannot open " + f);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        items.push_back(batch_item());
+        items.back().source = f;
+        items.back().schema = ss.str();
+        if (items.size() == chunk_size)
+            failed += flush_batch(items, nr_of_threads, true, out);
+    }
+    failed += flush_batch(items, nr_of_threads, true, out);
+    return failed;
+}
+
+namespace po = boost::program_options;
+
 int main(int argc, char** argv)
 {
-    std::string infine;
-    std::string outfile;
+    po::options_description desc("Usage: avro_normalize_schema [options] [input] [output]\n       avro_normalize_schema --dir dir [options] [output]\nAllowed options");
+    desc.add_options()
+        ("help,h", "produce help message")
+        ("batch,b", "input is newline delimited, one schema per line")
+        ("dir,d", po::value<std::string>(), "normalize every file in directory")
+        ("threads,j", po::value<size_t>()->default_value(std::max<size_t>(1, std::thread::hardware_concurrency())), "worker threads in batch mode")
+        ("input", po::value<std::string>(), "input file, default stdin")
+        ("output", po::value<std::string>(), "output file");
+
+    po::positional_options_description positional;
+    positional.add("input", 1);
+    positional.add("output", 1);
+
+    po::variables_map vm;
+    try
+    {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+        po::notify(vm);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl << desc << std::endl;
+        return 1;
+    }
 
-    if (argc > 1)
-        infine = argv[1];
+    if (vm.count("help"))
+    {
+        std::cout << desc << std::endl
+            << "In batch mode (--batch or --dir) each schema gives one output line:" << std::endl
+            << "  [file\\t]fingerprint\\tnormalized\\tescaped" << std::endl;
+        return 0;
+    }
 
-    if (argc > 2)
-        outfile = argv[2];
+    std::string infine = vm.count("input") ? vm["input"].as<std::string>() : std::string();
+    std::string outfile = vm.count("output") ? vm["output"].as<std::string>() : std::string();
+
+    // --dir reads the directory, the only positional is the output
+    if (vm.count("dir"))
+    {
+        if (!outfile.empty())
+        {
+            std::cerr << "--dir takes no input file, usage: avro_normalize_schema --dir dir [output]" << std::endl;
+            return 1;
+        }
+        outfile.swap(infine);
+    }
+
+    if (vm.count("batch") || vm.count("dir"))
+    {
+        size_t nr_of_threads = std::max<size_t>(1, vm["threads"].as<size_t>());
+        std::ofstream fout;
+        if (!outfile.empty())
+        {
+            fout.open(outfile.c_str());
+            if (!fout)
+            {
+                std::cerr << "Failed to open output file: " << outfile << std::endl;
+                return 1;
+            }
+        }
+        std::ostream& out = outfile.empty() ? std::cout : fout;
+
+        size_t failed = 0;
+        try
+        {
+            if (vm.count("dir"))
+            {
+                failed = run_directory(vm["dir"].as<std::string>(), nr_of_threads, out);
+            }
+            else if (!infine.empty())
+            {
+                std::ifstream in(infine.c_str());
+                if (!in)
+                {
+                    std::cerr << "Failed to open input file: " << infine << std::endl;
+                    return 1;
+                }
+                failed = run_lines(in, nr_of_threads, out);
+            }
+            else
+            {
+                failed = run_lines(std::cin, nr_of_threads, out);
+            }
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << "Failed to read input: " << e.what() << std::endl;
+            return 1;
+        }
+        out.flush();
+        if (!out)
+        {
+            std::cerr << "Failed to write output" << std::endl;
+            return 1;
+        }
+        return failed ? 1 : 0;
+    }
 
     avro::ValidSchema schema;
 
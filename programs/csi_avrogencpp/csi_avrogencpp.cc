@@ -22,12 +22,18 @@
 #endif
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <algorithm>
+#include <cmath>
 #include <map>
 #include <set>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/program_options.hpp>
+#include <boost/property_tree/json_parser.hpp>
 
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int.hpp>
@@ -37,6 +43,9 @@
 #include <avro/Compiler.hh>
 #include <avro/ValidSchema.hh>
 #include <avro/NodeImpl.hh>
+#include <avro/Generic.hh>
+#include <avro/Encoder.hh>
+#include <avro/Stream.hh>
 
 #include <csi_avro_utils/utils.h>
 
@@ -68,10 +77,72 @@ struct PendingSetterGetter {
 
 struct PendingConstructor {
     string structName;
-    string memberName;
-    bool initMember;
-    PendingConstructor(const string& sn, const string& n, bool im) :
-        structName(sn), memberName(n), initMember(im) { }
+    PendingConstructor(const string& sn) : structName(sn) { }
+};
+
+struct PendingVisit {
+    string structName;
+    vector<string> members; // branch types ("" for null)
+    PendingVisit(const string& sn, const vector<string>& m) :
+        structName(sn), members(m) { }
+};
+
+struct PendingOperators {
+    enum Kind { RECORD, UNION, ENUM };
+    string structName;
+    Kind kind;
+    vector<string> members; // record: field names, union: branch types ("" for null)
+    vector<string> orders;  // record: field sort orders, empty when all ascending
+    PendingOperators(const string& sn, Kind k, const vector<string>& m) :
+        structName(sn), kind(k), members(m) { }
+};
+
+struct PendingReflection {
+    enum Kind { RECORD, UNION, ENUM };
+    string structName;
+    Kind kind;
+    vector<string> names;   // record: schema field names, enum: symbols
+    vector<string> members; // record: member names, union: branch types ("" for null)
+    vector<string> types;   // record: avro type constants
+    vector<bool> nullable;  // record: field is a union with a null branch
+    PendingReflection(const string& sn, Kind k) : structName(sn), kind(k) { }
+};
+
+struct PendingPatch {
+    string structName;
+    boost::uuids::uuid hash; // of the record's own normalized json, the patch header
+    vector<string> members; // field members
+    vector<string> codecs;  // namespace of the encode / decode for each field
+    PendingPatch(const string& sn, const boost::uuids::uuid& h) : structName(sn), hash(h) { }
+};
+
+struct PendingJson {
+    enum Kind { RECORD, UNION, ENUM };
+    string structName;
+    Kind kind;
+    vector<string> names;   // record: field names, union: branch names ("" for null), enum: symbols
+    vector<string> members; // record: member names, union: branch types, enum: enumerators
+    PendingJson(const string& sn, Kind k) : structName(sn), kind(k) { }
+};
+
+/**
+ * The c++ type for nodes with a logical type, see csi_avro_utils/logical_types.h.
+ */
+typedef map<const avro::Node*, string> LogicalTypes;
+
+/**
+ * The "order" of every field for records with a descending or ignored field.
+ */
+typedef map<const avro::Node*, vector<string> > FieldOrders;
+
+struct TraitsMember {
+    string returnType;
+    string name;
+    string params;
+    string body;
+    TraitsMember(const string& r, const string& n, const string& p,
+        const string& b) :
+        returnType(r), name(n), params(p), body(b) { }
 };
 
 class CodeGen {
@@ -83,14 +154,33 @@ class CodeGen {
     const std::string headerFile_;
     const std::string includePrefix_;
     const bool noUnion_;
+    const bool instrument_;
+    const bool operators_;
+    const bool reflection_;
+    const bool json_;
+    const bool bulkArrays_;
+    const bool patch_;
+    const LogicalTypes logicalTypes_;
+    const FieldOrders fieldOrders_;
     const std::string guardString_;
     boost::mt19937 random_;
     std::string         escaped_schema_string_;
     boost::uuids::uuid  hash_;
     std::string         root_name_;
 
+    // split mode: out of line definitions go to a separate .cc
+    std::ostream*       implOs_;
+    std::ostringstream  implTypes_;
+    std::ostringstream  implTraits_;
+    vector<string>      instantiated_;
+
     vector<PendingSetterGetter> pendingGettersAndSetters;
     vector<PendingConstructor> pendingConstructors;
+    vector<PendingVisit> pendingVisits;
+    vector<PendingOperators> pendingOperators;
+    vector<PendingReflection> pendingReflection;
+    vector<PendingJson> pendingJson;
+    vector<PendingPatch> pendingPatches;
 
     map<NodePtr, string> done;
     set<NodePtr> doing;
@@ -99,6 +189,13 @@ class CodeGen {
     std::string fullname(const string& name) const;
     std::string generateEnumType(const NodePtr& n);
     std::string cppTypeOf(const NodePtr& n);
+    std::string codecOf(const NodePtr& n);
+    bool hasLogicalType(const NodePtr& n);
+    bool hasLogicalType(const NodePtr& n, set<const avro::Node*>& seen);
+    std::string defaultExpression(const avro::GenericDatum& d, const NodePtr& n);
+    void assignDefault(std::ostream& os, const std::string& lvalue,
+        const avro::GenericDatum& d, const NodePtr& n, bool fresh,
+        size_t& temps);
     std::string generateRecordType(const NodePtr& n);
     std::string unionName();
     std::string generateUnionType(const NodePtr& n);
@@ -111,17 +208,32 @@ class CodeGen {
     void generateRecordTraits(const NodePtr& n);
     void generateUnionTraits(const NodePtr& n);
     void generateExtensions(const ValidSchema& schema);
-    void emitCopyright();
+    void emitTraits(const string& fn, const vector<TraitsMember>& members,
+        const string& types = string());
+    void emitCopyright(std::ostream& os);
+    void generateImpl();
+    void generateVisit();
+    void generateOperators();
+    void generateReflection();
+    void generateJson();
+    void generatePatch();
 public:
     CodeGen(std::ostream& os, const std::string& ns,
         const std::string& schemaFile, const std::string& headerFile,
         const std::string& guardString,
-        const std::string& includePrefix, bool noUnion) :
+        const std::string& includePrefix, bool noUnion, bool instrument,
+        bool operators, bool reflection, bool json, bool bulkArrays,
+        bool patch, const LogicalTypes& logicalTypes,
+        const FieldOrders& fieldOrders, std::ostream* implOs = 0) :
         unionNumber_(0), os_(os), inNamespace_(false), ns_(ns),
         schemaFile_(schemaFile), headerFile_(headerFile),
         includePrefix_(includePrefix), noUnion_(noUnion),
+        instrument_(instrument), operators_(operators),
+        reflection_(reflection), json_(json), bulkArrays_(bulkArrays),
+        patch_(patch), logicalTypes_(logicalTypes), fieldOrders_(fieldOrders),
         guardString_(guardString),
-        random_(static_cast<uint32_t>(::time(0))) { }
+        random_(static_cast<uint32_t>(::time(0))),
+        implOs_(implOs) { }
     void generate(const ValidSchema& schema);
 };
 
@@ -153,11 +265,34 @@ string CodeGen::generateEnumType(const NodePtr& n)
         os_ << "    " << decorate_reserved_words(n->nameAt(i)) << ",\n";
     }
     os_ << "};\n\n";
+    if (operators_) {
+        pendingOperators.push_back(PendingOperators(s,
+            PendingOperators::ENUM, vector<string>()));
+    }
+    if (reflection_) {
+        PendingReflection r(s, PendingReflection::ENUM);
+        for (size_t i = 0; i < c; ++i) {
+            r.names.push_back(n->nameAt(i));
+        }
+        pendingReflection.push_back(r);
+    }
+    if (json_) {
+        PendingJson j(s, PendingJson::ENUM);
+        for (size_t i = 0; i < c; ++i) {
+            j.names.push_back(n->nameAt(i));
+            j.members.push_back(decorate_reserved_words(n->nameAt(i)));
+        }
+        pendingJson.push_back(j);
+    }
     return s;
 }
 
 string CodeGen::cppTypeOf(const NodePtr& n)
 {
+    LogicalTypes::const_iterator lt = logicalTypes_.find(n.get());
+    if (lt != logicalTypes_.end()) {
+        return lt->second;
+    }
     switch (n->type()) {
     case avro::AVRO_STRING:
         return "std::string";
@@ -195,6 +330,27 @@ string CodeGen::cppTypeOf(const NodePtr& n)
     }
 }
 
+/**
+ * The namespace whose encode/decode a record field is coded with,
+ * csi::bulk for arrays of int, long, float and double with --bulk-arrays.
+ */
+string CodeGen::codecOf(const NodePtr& n)
+{
+    if (! bulkArrays_ || n->type() != avro::AVRO_ARRAY ||
+        logicalTypes_.count(n->leafAt(0).get()) != 0) {
+        return "avro";
+    }
+    switch (n->leafAt(0)->type()) {
+    case avro::AVRO_INT:
+    case avro::AVRO_LONG:
+    case avro::AVRO_FLOAT:
+    case avro::AVRO_DOUBLE:
+        return "csi::bulk";
+    default:
+        return "avro";
+    }
+}
+
 static string cppNameOf(const NodePtr& n)
 {
     switch (n->type()) {
@@ -229,6 +385,398 @@ static string cppNameOf(const NodePtr& n)
     }
 }
 
+static string avroTypeConstant(avro::Type t)
+{
+    switch (t) {
+    case avro::AVRO_STRING:
+        return "avro::AVRO_STRING";
+    case avro::AVRO_BYTES:
+        return "avro::AVRO_BYTES";
+    case avro::AVRO_INT:
+        return "avro::AVRO_INT";
+    case avro::AVRO_LONG:
+        return "avro::AVRO_LONG";
+    case avro::AVRO_FLOAT:
+        return "avro::AVRO_FLOAT";
+    case avro::AVRO_DOUBLE:
+        return "avro::AVRO_DOUBLE";
+    case avro::AVRO_BOOL:
+        return "avro::AVRO_BOOL";
+    case avro::AVRO_NULL:
+        return "avro::AVRO_NULL";
+    case avro::AVRO_RECORD:
+        return "avro::AVRO_RECORD";
+    case avro::AVRO_ENUM:
+        return "avro::AVRO_ENUM";
+    case avro::AVRO_ARRAY:
+        return "avro::AVRO_ARRAY";
+    case avro::AVRO_MAP:
+        return "avro::AVRO_MAP";
+    case avro::AVRO_UNION:
+        return "avro::AVRO_UNION";
+    case avro::AVRO_FIXED:
+        return "avro::AVRO_FIXED";
+    default:
+        return "avro::AVRO_UNKNOWN";
+    }
+}
+
+static NodePtr resolved(const NodePtr& n)
+{
+    return (n->type() == avro::AVRO_SYMBOLIC) ? resolveSymbol(n) : n;
+}
+
+/**
+ * Whether field i of record n has a default. The compiler leaves a plain
+ * null datum for fields without one, union defaults are union datums.
+ */
+static bool hasDefault(const NodePtr& n, size_t i)
+{
+    const avro::GenericDatum& d = n->defaultValueAt(static_cast<int>(i));
+    const NodePtr l = resolved(n->leafAt(i));
+    if (l->type() == avro::AVRO_UNION) {
+        return d.isUnion();
+    }
+    return ! d.isUnion() && d.type() == l->type() &&
+        l->type() != avro::AVRO_NULL;
+}
+
+static bool sameValue(const avro::GenericDatum& a, const avro::GenericDatum& b)
+{
+    std::auto_ptr<avro::OutputStream> oa = avro::memoryOutputStream();
+    std::auto_ptr<avro::OutputStream> ob = avro::memoryOutputStream();
+    avro::EncoderPtr e = avro::binaryEncoder();
+    e->init(*oa);
+    avro::encode(*e, a);
+    e->flush();
+    e->init(*ob);
+    avro::encode(*e, b);
+    e->flush();
+    return to_string(*oa) == to_string(*ob);
+}
+
+/**
+ * Whether d, a value of type n, is what the generated type of n holds once
+ * constructed: zero, empty, the first enum symbol, the first union branch
+ * holding such a value, a record whose fields hold their own defaults.
+ */
+static bool isInitial(const avro::GenericDatum& d, const NodePtr& node)
+{
+    const NodePtr n = resolved(node);
+    switch (n->type()) {
+    case avro::AVRO_NULL:
+        return true;
+    case avro::AVRO_BOOL:
+        return ! d.value<bool>();
+    case avro::AVRO_INT:
+        return d.value<int32_t>() == 0;
+    case avro::AVRO_LONG:
+        return d.value<int64_t>() == 0;
+    case avro::AVRO_FLOAT:
+        return d.value<float>() == 0 && ! std::signbit(d.value<float>());
+    case avro::AVRO_DOUBLE:
+        return d.value<double>() == 0 && ! std::signbit(d.value<double>());
+    case avro::AVRO_STRING:
+        return d.value<string>().empty();
+    case avro::AVRO_BYTES:
+        return d.value<vector<uint8_t> >().empty();
+    case avro::AVRO_ENUM:
+        return d.value<avro::GenericEnum>().value() == 0;
+    case avro::AVRO_FIXED:
+        {
+            const vector<uint8_t>& v = d.value<avro::GenericFixed>().value();
+            return std::count(v.begin(), v.end(), 0) ==
+                static_cast<std::ptrdiff_t>(v.size());
+        }
+    case avro::AVRO_ARRAY:
+        return d.value<avro::GenericArray>().value().empty();
+    case avro::AVRO_MAP:
+        return d.value<avro::GenericMap>().value().empty();
+    case avro::AVRO_UNION:
+        return d.unionBranch() == 0 && isInitial(d, n->leafAt(0));
+    case avro::AVRO_RECORD:
+        {
+            const avro::GenericRecord& r = d.value<avro::GenericRecord>();
+            for (size_t i = 0; i < n->leaves(); ++i) {
+                if (hasDefault(n, i) ?
+                    ! sameValue(r.fieldAt(i), n->defaultValueAt(static_cast<int>(i))) :
+                    ! isInitial(r.fieldAt(i), n->leafAt(i))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    default:
+        return false;
+    }
+}
+
+/**
+ * Whether a value of type n can hold a value of record type target, then
+ * a default of type n can not be built in the constructor of target.
+ */
+static bool refersTo(const NodePtr& node, const NodePtr& target,
+    set<const avro::Node*>& seen)
+{
+    const NodePtr n = resolved(node);
+    if (n == target) {
+        return true;
+    }
+    if (! seen.insert(n.get()).second) {
+        return false;
+    }
+    for (size_t i = 0; i < n->leaves(); ++i) {
+        if (refersTo(n->leafAt(i), target, seen)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * A c++ literal for s, octal escapes so digits that follow are not taken
+ * into the escape.
+ */
+static string cppStringLiteral(const string& s)
+{
+    std::ostringstream os;
+    os << '"';
+    for (string::const_iterator it = s.begin(); it != s.end(); ++it) {
+        unsigned char c = *it;
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (' ' <= c && c <= '~' && c != '?') {
+            os << c;
+        } else {
+            os << '\\' << char('0' + (c >> 6)) << char('0' + ((c >> 3) & 7))
+                << char('0' + (c & 7));
+        }
+    }
+    os << '"';
+    if (s.find('\0') != string::npos) {
+        return "std::string(" + os.str() + ", " +
+            lexical_cast<string>(s.size()) + ")";
+    }
+    return os.str();
+}
+
+static string cppBytesLiteral(const vector<uint8_t>& v)
+{
+    std::ostringstream os;
+    os << '{';
+    for (size_t i = 0; i < v.size(); ++i) {
+        os << (i ? ", " : "") << static_cast<unsigned>(v[i]);
+    }
+    os << '}';
+    return os.str();
+}
+
+template<class T>
+static string cppFloatLiteral(T v, const string& type, const string& suffix)
+{
+    if (std::isnan(v)) {
+        return "std::numeric_limits<" + type + ">::quiet_NaN()";
+    }
+    if (std::isinf(v)) {
+        return string(v < 0 ? "-" : "") + "std::numeric_limits<" + type +
+            ">::infinity()";
+    }
+    std::ostringstream os;
+    os << std::setprecision(std::numeric_limits<T>::max_digits10) << v;
+    string s = os.str();
+    if (s.find_first_of(".e") == string::npos) {
+        s += ".0";
+    }
+    return s + suffix;
+}
+
+/**
+ * Whether values of type n hold a logical type, their defaults are the
+ * underlying avro values and are not applied.
+ */
+bool CodeGen::hasLogicalType(const NodePtr& n)
+{
+    set<const avro::Node*> seen;
+    return hasLogicalType(n, seen);
+}
+
+bool CodeGen::hasLogicalType(const NodePtr& n, set<const avro::Node*>& seen)
+{
+    if (logicalTypes_.count(n.get())) {
+        return true;
+    }
+    const NodePtr nn = resolved(n);
+    if (! seen.insert(nn.get()).second) {
+        return false;
+    }
+    if (logicalTypes_.count(nn.get())) {
+        return true;
+    }
+    for (size_t i = 0; i < nn->leaves(); ++i) {
+        if (hasLogicalType(nn->leafAt(i), seen)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * The c++ expression for d, a value of type n, empty for records, arrays,
+ * maps and unions which are built by statements instead.
+ */
+string CodeGen::defaultExpression(const avro::GenericDatum& d,
+    const NodePtr& node)
+{
+    const NodePtr n = resolved(node);
+    switch (n->type()) {
+    case avro::AVRO_BOOL:
+        return d.value<bool>() ? "true" : "false";
+    case avro::AVRO_INT:
+        {
+            int32_t v = d.value<int32_t>();
+            return v == std::numeric_limits<int32_t>::min() ?
+                "(-2147483647 - 1)" : lexical_cast<string>(v);
+        }
+    case avro::AVRO_LONG:
+        {
+            int64_t v = d.value<int64_t>();
+            return v == std::numeric_limits<int64_t>::min() ?
+                "(-9223372036854775807LL - 1)" : lexical_cast<string>(v) + "LL";
+        }
+    case avro::AVRO_FLOAT:
+        return cppFloatLiteral(d.value<float>(), "float", "f");
+    case avro::AVRO_DOUBLE:
+        return cppFloatLiteral(d.value<double>(), "double", "");
+    case avro::AVRO_STRING:
+        return cppStringLiteral(d.value<string>());
+    case avro::AVRO_BYTES:
+        return "std::vector<uint8_t>" +
+            cppBytesLiteral(d.value<vector<uint8_t> >());
+    case avro::AVRO_FIXED:
+        return cppTypeOf(n) + "{" +
+            cppBytesLiteral(d.value<avro::GenericFixed>().value()) + "}";
+    case avro::AVRO_ENUM:
+        {
+            string s = decorate_reserved_words(
+                n->nameAt(d.value<avro::GenericEnum>().value()));
+            return inNamespace_ ? s : fullname(s);
+        }
+    default:
+        return "";
+    }
+}
+
+/**
+ * Emits the statements that give lvalue, of type n, the value d. fresh if
+ * lvalue holds what the generated type holds once constructed, otherwise
+ * arrays and maps are cleared first. Record fields that already hold their
+ * value are left alone.
+ */
+void CodeGen::assignDefault(ostream& os, const string& lvalue,
+    const avro::GenericDatum& d, const NodePtr& node, bool fresh,
+    size_t& temps)
+{
+    const NodePtr n = resolved(node);
+    const string indent = "        ";
+    switch (n->type()) {
+    case avro::AVRO_RECORD:
+        {
+            const avro::GenericRecord& r = d.value<avro::GenericRecord>();
+            for (size_t i = 0; i < n->leaves(); ++i) {
+                const NodePtr& l = n->leafAt(i);
+                const bool defaulted = hasDefault(n, i);
+                if (hasLogicalType(l) || (fresh && (defaulted ?
+                        sameValue(r.fieldAt(i), n->defaultValueAt(static_cast<int>(i))) :
+                        isInitial(r.fieldAt(i), l)))) {
+                    continue;
+                }
+                assignDefault(os, lvalue + "." +
+                    decorate_reserved_words(n->nameAt(i)), r.fieldAt(i), l,
+                    fresh && ! defaulted, temps);
+            }
+        }
+        break;
+    case avro::AVRO_ARRAY:
+        {
+            const vector<avro::GenericDatum>& items =
+                d.value<avro::GenericArray>().value();
+            const NodePtr& l = n->leafAt(0);
+            if (! fresh) {
+                os << indent << lvalue << ".clear();\n";
+            }
+            for (size_t i = 0; i < items.size(); ++i) {
+                string e = defaultExpression(items[i], l);
+                if (! e.empty()) {
+                    os << indent << lvalue << ".push_back(" << e << ");\n";
+                } else {
+                    os << indent << lvalue << ".push_back(" << cppTypeOf(l)
+                        << "());\n";
+                    assignDefault(os, lvalue + ".back()", items[i], l, true,
+                        temps);
+                }
+            }
+        }
+        break;
+    case avro::AVRO_MAP:
+        {
+            const vector<std::pair<string, avro::GenericDatum> >& items =
+                d.value<avro::GenericMap>().value();
+            const NodePtr& l = n->leafAt(1);
+            if (! fresh) {
+                os << indent << lvalue << ".clear();\n";
+            }
+            for (size_t i = 0; i < items.size(); ++i) {
+                const string element = lvalue + "[" +
+                    cppStringLiteral(items[i].first) + "]";
+                string e = defaultExpression(items[i].second, l);
+                if (! e.empty()) {
+                    os << indent << element << " = " << e << ";\n";
+                } else {
+                    os << indent << element << ";\n";
+                    assignDefault(os, element, items[i].second, l, true, temps);
+                }
+            }
+        }
+        break;
+    case avro::AVRO_UNION:
+        {
+            const NodePtr b = resolved(n->leafAt(d.unionBranch()));
+            if (b->type() == avro::AVRO_NULL) {
+                os << indent << lvalue << ".set_null();\n";
+                break;
+            }
+            string e = defaultExpression(d, b);
+            if (! e.empty()) {
+                os << indent << lvalue << ".set_" << cppNameOf(b) << "(" << e
+                    << ");\n";
+            } else {
+                const string t = "t" + lexical_cast<string>(temps++) + "_";
+                os << indent << cppTypeOf(b) << " " << t << ";\n";
+                assignDefault(os, t, d, b, true, temps);
+                os << indent << lvalue << ".set_" << cppNameOf(b) << "(" << t
+                    << ");\n";
+            }
+        }
+        break;
+    default:
+        os << indent << lvalue << " = " << defaultExpression(d, n) << ";\n";
+        break;
+    }
+}
+
+/**
+ * generate_hash of a record on its own, so a nested record's patches do not
+ * apply to the root record. For the root record this is the schema hash.
+ */
+static boost::uuids::uuid recordHash(const NodePtr& n)
+{
+    std::ostringstream os;
+    n->printJson(os, 0);
+    string s = os.str();
+    s.erase(std::remove_if(s.begin(), s.end(), ::isspace), s.end());
+    return hash_normalized(s);
+}
+
 string CodeGen::generateRecordType(const NodePtr& n)
 {
     size_t c = n->leaves();
@@ -261,40 +809,125 @@ string CodeGen::generateRecordType(const NodePtr& n)
         os_ << ' ' << decorate_reserved_words(n->nameAt(i)) << ";\n";
     }
 
+    // schema defaults: scalars, strings, enums and fixed as initializers,
+    // the rest by statements in the body. values the members hold once
+    // value initialized are left out, so nothing is allocated for them
+    std::ostringstream body;
+    size_t temps = 0;
     os_ << "    " << decoratedName << "()";
     if (c > 0) {
         os_ << " :";
     }
     os_ << "\n";
     for (size_t i = 0; i < c; ++i) {
-        os_ << "        " << decorate_reserved_words(n->nameAt(i)) << "(";
-        if (! noUnion_ && n->leafAt(i)->type() == avro::AVRO_UNION) {
-            os_ << decorate_reserved_words(n->nameAt(i)) << "_t";
+        const string member = decorate_reserved_words(n->nameAt(i));
+        const NodePtr& l = n->leafAt(i);
+        string init;
+        if (hasDefault(n, i) && ! hasLogicalType(l)) {
+            const avro::GenericDatum& d = n->defaultValueAt(static_cast<int>(i));
+            set<const avro::Node*> seen;
+            if (isInitial(d, l) || refersTo(l, n, seen)) {
+                // a default holding this record would construct it again
+            } else if (resolved(l)->type() == avro::AVRO_UNION ||
+                (init = defaultExpression(d, l)).empty()) {
+                assignDefault(body, member, d, l, true, temps);
+            }
+        }
+        os_ << "        " << member << "(";
+        if (! init.empty()) {
+            os_ << init;
+        } else if (! noUnion_ && l->type() == avro::AVRO_UNION) {
+            os_ << member << "_t()";
         } else {
-            os_ << types[i];
+            os_ << types[i] << "()";
         }
-        os_ << "())";
+        os_ << ")";
         if (i != (c - 1)) {
             os_ << ',';
         }
         os_ << "\n";
     }
-    os_ << "        { }\n";
+    if (body.str().empty()) {
+        os_ << "        { }\n";
+    } else {
+        os_ << "    {\n" << body.str() << "    }\n";
+    }
 
     //extension
     //should only be here for root level - how??
     //if (n->name().fullname() == root_name_)
     {
         os_ << "//  avro extension\n";
-        os_ << "    static inline const boost::uuids::uuid      schema_hash()      { static const boost::uuids::uuid _hash(boost::uuids::string_generator()(\"" << to_string(hash_) << "\")); return _hash; }\n";
-        os_ << "    static inline const char*                   schema_as_string() { return \"" << escaped_schema_string_ << "\"; } \n";
-		os_ << "    static boost::shared_ptr<avro::ValidSchema> valid_schema()     { static const boost::shared_ptr<avro::ValidSchema> _validSchema(boost::make_shared<avro::ValidSchema>(avro::compileJsonSchemaFromString(schema_as_string()))); return _validSchema; }\n";
+        if (implOs_) {
+            os_ << "    static const " << decoratedName << "& defaults();\n";
+            os_ << "    static const boost::uuids::uuid             schema_hash();\n";
+            os_ << "    static const char*                          schema_as_string();\n";
+            os_ << "    static boost::shared_ptr<avro::ValidSchema> valid_schema();\n";
+
+            implTypes_ << "const " << decoratedName << "& " << decoratedName << "::defaults() { static const " << decoratedName << " _defaults; return _defaults; }\n";
+            implTypes_ << "const boost::uuids::uuid " << decoratedName << "::schema_hash() { static const boost::uuids::uuid _hash(boost::uuids::string_generator()(\"" << to_string(hash_) << "\")); return _hash; }\n";
+            implTypes_ << "const char* " << decoratedName << "::schema_as_string() { return \"" << escaped_schema_string_ << "\"; }\n";
+            implTypes_ << "boost::shared_ptr<avro::ValidSchema> " << decoratedName << "::valid_schema() { static const boost::shared_ptr<avro::ValidSchema> _validSchema(boost::make_shared<avro::ValidSchema>(avro::compileJsonSchemaFromString(schema_as_string()))); return _validSchema; }\n\n";
+        } else {
+            os_ << "    static const " << decoratedName << "& defaults() { static const " << decoratedName << " _defaults; return _defaults; }\n";
+            os_ << "    static inline const boost::uuids::uuid      schema_hash()      { static const boost::uuids::uuid _hash(boost::uuids::string_generator()(\"" << to_string(hash_) << "\")); return _hash; }\n";
+            os_ << "    static inline const char*                   schema_as_string() { return \"" << escaped_schema_string_ << "\"; } \n";
+            os_ << "    static boost::shared_ptr<avro::ValidSchema> valid_schema()     { static const boost::shared_ptr<avro::ValidSchema> _validSchema(boost::make_shared<avro::ValidSchema>(avro::compileJsonSchemaFromString(schema_as_string()))); return _validSchema; }\n";
+        }
     }
 
 	//os_ << "    static const avro::ValidSchema         valid_schema()     { static const avro::ValidSchema _validSchema(avro::compileJsonSchemaFromString(schema_as_string())); return _validSchema; }\n";
 	//end extension
 
     os_ << "};\n\n";
+    if (operators_) {
+        vector<string> fields;
+        for (size_t i = 0; i < c; ++i) {
+            fields.push_back(decorate_reserved_words(n->nameAt(i)));
+        }
+        pendingOperators.push_back(PendingOperators(decoratedName,
+            PendingOperators::RECORD, fields));
+        FieldOrders::const_iterator fo = fieldOrders_.find(n.get());
+        if (fo != fieldOrders_.end()) {
+            pendingOperators.back().orders = fo->second;
+        }
+    }
+    if (reflection_) {
+        PendingReflection r(decoratedName, PendingReflection::RECORD);
+        for (size_t i = 0; i < c; ++i) {
+            NodePtr l = n->leafAt(i);
+            if (l->type() == avro::AVRO_SYMBOLIC) {
+                l = resolveSymbol(l);
+            }
+            bool nullable = false;
+            if (l->type() == avro::AVRO_UNION) {
+                for (size_t j = 0; j < l->leaves(); ++j) {
+                    nullable = nullable || l->leafAt(j)->type() == avro::AVRO_NULL;
+                }
+            }
+            r.names.push_back(n->nameAt(i));
+            r.members.push_back(decorate_reserved_words(n->nameAt(i)));
+            r.types.push_back(avroTypeConstant(l->type()));
+            r.nullable.push_back(nullable);
+        }
+        pendingReflection.push_back(r);
+    }
+    if (json_) {
+        PendingJson j(decoratedName, PendingJson::RECORD);
+        for (size_t i = 0; i < c; ++i) {
+            j.names.push_back(n->nameAt(i));
+            j.members.push_back(decorate_reserved_words(n->nameAt(i)));
+        }
+        pendingJson.push_back(j);
+    }
+    if (patch_) {
+        PendingPatch p(decoratedName, recordHash(n));
+        for (size_t i = 0; i < c; ++i) {
+            p.members.push_back(decorate_reserved_words(n->nameAt(i)));
+            p.codecs.push_back(codecOf(n->leafAt(i)));
+        }
+        pendingPatches.push_back(p);
+    }
     return decorate(n->name());
 }
 
@@ -325,36 +958,63 @@ string CodeGen::unionName()
 
 static void generateGetterAndSetter(ostream& os,
     const string& structName, const string& type, const string& name,
-    size_t idx)
+    size_t idx, bool inlined)
 {
     string sn = " " + structName + "::";
 
-    os << "inline\n";
+    if (inlined) {
+        os << "inline\n";
+    }
 
     os << type << sn << "get_" << name << "() const {\n"
         << "    if (idx_ != " << idx << ") {\n"
         << "        throw avro::Exception(\"Invalid type for "
             << "union\");\n"
         << "    }\n"
-        << "    return boost::any_cast<" << type << " >(value_);\n"
+        << "    return branch_value<" << type << " >();\n"
         << "}\n\n";
 
-    os << "inline\n"
-        << "void" << sn << "set_" << name
+    if (inlined) {
+        os << "inline\n";
+    }
+    os << "void" << sn << "set_" << name
         << "(const " << type << "& v) {\n"
         << "    idx_ = " << idx << ";\n"
         << "    value_ = v;\n"
         << "}\n\n";
 }
 
+/**
+ * The union starts out on its first branch with nothing stored, a value
+ * is only allocated once a branch is set.
+ */
 static void generateConstructor(ostream& os,
-    const string& structName, bool initMember,
-    const string& type) {
-    os << "inline " << structName  << "::" << structName << "() : idx_(0)";
-    if (initMember) {
-        os << ", value_(" << type << "())";
+    const string& structName, bool inlined) {
+    if (inlined) {
+        os << "inline ";
+    }
+    os << structName  << "::" << structName << "() : idx_(0) { }\n";
+}
+
+/**
+ * The name avro json uses for a union branch: the full name of named types,
+ * otherwise the type name. Empty for null, which is written without a wrapper.
+ */
+static string jsonBranchName(const NodePtr& n)
+{
+    NodePtr nn = (n->type() == avro::AVRO_SYMBOLIC) ? resolveSymbol(n) : n;
+    switch (nn->type()) {
+    case avro::AVRO_NULL:
+        return "";
+    case avro::AVRO_BOOL:
+        return "boolean";
+    case avro::AVRO_RECORD:
+    case avro::AVRO_ENUM:
+    case avro::AVRO_FIXED:
+        return nn->name().fullname();
+    default:
+        return cppNameOf(nn);
     }
-    os << " { }\n";
 }
 
 /**
@@ -395,6 +1055,21 @@ string CodeGen::generateUnionType(const NodePtr& n)
         << "private:\n"
         << "    size_t idx_;\n"
         << "    boost::any value_;\n"
+        << "    // value_ is empty on the first branch until it is set\n"
+        << "    template<class T> const T& branch_value() const {\n"
+        << "        const T* p = boost::any_cast<T>(&value_);\n"
+        << "        if (p) {\n"
+        << "            return *p;\n"
+        << "        }\n"
+        << "        static const T empty = T();\n"
+        << "        return empty;\n"
+        << "    }\n"
+        << "    template<class T> T& branch_value() {\n"
+        << "        if (value_.empty()) {\n"
+        << "            value_ = T();\n"
+        << "        }\n"
+        << "        return *boost::any_cast<T>(&value_);\n"
+        << "    }\n"
         << "public:\n"
         << "    size_t idx() const { return idx_; }\n";
 
@@ -419,8 +1094,54 @@ string CodeGen::generateUnionType(const NodePtr& n)
     }
 
     os_ << "    " << result << "();\n";
-    pendingConstructors.push_back(PendingConstructor(result, types[0],
-        n->leafAt(0)->type() != avro::AVRO_NULL));
+    pendingConstructors.push_back(PendingConstructor(result));
+
+    os_ << "    // f(branch value) for the current branch, f(avro::null()) for null\n"
+        << "    template<class F> void visit(F&& f) const;\n"
+        << "    template<class F> void visit(F&& f);\n";
+    {
+        vector<string> branches;
+        for (size_t i = 0; i < c; ++i) {
+            branches.push_back(n->leafAt(i)->type() == avro::AVRO_NULL ?
+                string() : types[i]);
+        }
+        pendingVisits.push_back(PendingVisit(result, branches));
+    }
+    if (operators_) {
+        os_ << "    bool operator==(const " << result << "& o) const;\n"
+            << "    bool operator!=(const " << result << "& o) const { return !(*this == o); }\n"
+            << "    bool operator<(const " << result << "& o) const;\n"
+            << "    size_t hash() const;\n";
+        vector<string> branches;
+        for (size_t i = 0; i < c; ++i) {
+            branches.push_back(n->leafAt(i)->type() == avro::AVRO_NULL ?
+                string() : types[i]);
+        }
+        pendingOperators.push_back(PendingOperators(result,
+            PendingOperators::UNION, branches));
+    }
+    if (reflection_) {
+        os_ << "    friend struct csi::union_info<" << result << ">;\n";
+        // union_info is emitted outside the namespace, so qualified names
+        PendingReflection r(result, PendingReflection::UNION);
+        bool inNamespace = inNamespace_;
+        inNamespace_ = false;
+        for (size_t i = 0; i < c; ++i) {
+            r.members.push_back(n->leafAt(i)->type() == avro::AVRO_NULL ?
+                string() : cppTypeOf(n->leafAt(i)));
+        }
+        inNamespace_ = inNamespace;
+        pendingReflection.push_back(r);
+    }
+    if (json_) {
+        os_ << "    friend void to_json(const " << result << "& v, csi::json_buffer& out);\n";
+        PendingJson j(result, PendingJson::UNION);
+        for (size_t i = 0; i < c; ++i) {
+            j.names.push_back(jsonBranchName(n->leafAt(i)));
+            j.members.push_back(types[i]);
+        }
+        pendingJson.push_back(j);
+    }
     os_ << "};\n\n";
     
     return result;
@@ -541,27 +1262,38 @@ void CodeGen::generateEnumTraits(const NodePtr& n)
         first = decorate_reserved_words(n->nameAt(0));
         last = decorate_reserved_words(n->nameAt(c - 1));
 	}
-	os_ << "template<> struct codec_traits<" << fn << "> {\n"
-		<< "    static void encode(Encoder& e, " << fn << " v) {\n"
-		<< "		if (v < "  << first << " || v > " << last << ")\n" 
+
+    std::ostringstream encode;
+    if (instrument_) {
+        encode << "        CSI_AVRO_STATS_ENCODE(\"" << fn << "\", e);\n";
+    }
+    encode << "		if (v < "  << first << " || v > " << last << ")\n" 
 		<< "		{\n"
 		<< "			std::ostringstream error;\n"
 		<< "			error << \"enum value \" << v << \" is out of bound for " << fn << " and cannot be encoded\";\n"
 		<< "			throw avro::Exception(error.str());\n"
 		<< "		}\n"
-		<< "        e.encodeEnum(v);\n"
-		<< "    }\n"
-		<< "    static void decode(Decoder& d, " << fn << "& v) {\n"
-		<< "		size_t index = d.decodeEnum();\n"
+		<< "        e.encodeEnum(v);\n";
+
+    std::ostringstream decode;
+    if (instrument_) {
+        decode << "        CSI_AVRO_STATS_DECODE(\"" << fn << "\", d);\n";
+    }
+    decode << "		size_t index = d.decodeEnum();\n"
 		<< "		if (index < " << first << " || index > " << last << ")\n" 
 		<< "		{\n"
 		<< "			std::ostringstream error;\n"
 		<< "			error << \"enum value \" << index << \" is out of bound for " << fn << " and cannot be decoded\";\n"
 		<< "			throw avro::Exception(error.str());\n"
 		<< "		}\n"
-		<< "        v = static_cast<" << fn << ">(index);\n"
-		<< "    }\n"
-		<< "};\n\n";
+		<< "        v = static_cast<" << fn << ">(index);\n";
+
+    vector<TraitsMember> members;
+    members.push_back(TraitsMember("void", "encode",
+        "Encoder& e, " + fn + " v", encode.str()));
+    members.push_back(TraitsMember("void", "decode",
+        "Decoder& d, " + fn + "& v", decode.str()));
+    emitTraits(fn, members);
 }
 
 void CodeGen::generateRecordTraits(const NodePtr& n)
@@ -572,39 +1304,47 @@ void CodeGen::generateRecordTraits(const NodePtr& n)
     }
 
     string fn = fullname(decorate(n->name()));
-    os_ << "template<> struct codec_traits<" << fn << "> {\n"
-        << "    static void encode(Encoder& e, const " << fn << "& v) {\n";
 
+    std::ostringstream encode;
+    if (instrument_) {
+        encode << "        CSI_AVRO_STATS_ENCODE(\"" << fn << "\", e);\n";
+    }
     for (size_t i = 0; i < c; ++i) {
-        os_ << "        avro::encode(e, v." << decorate_reserved_words(n->nameAt(i)) << ");\n";
+        encode << "        " << codecOf(n->leafAt(i)) << "::encode(e, v." << decorate_reserved_words(n->nameAt(i)) << ");\n";
     }
 
-    os_ << "    }\n"
-        << "    static void decode(Decoder& d, " << fn << "& v) {\n";
-    os_ << "        if (avro::ResolvingDecoder *rd =\n";
-    os_ << "            dynamic_cast<avro::ResolvingDecoder *>(&d)) {\n";
-    os_ << "            const std::vector<size_t> fo = rd->fieldOrder();\n";
-    os_ << "            for (std::vector<size_t>::const_iterator it = fo.begin();\n";
-    os_ << "                it != fo.end(); ++it) {\n";
-    os_ << "                switch (*it) {\n";
+    std::ostringstream decode;
+    if (instrument_) {
+        decode << "        CSI_AVRO_STATS_DECODE(\"" << fn << "\", d);\n";
+    }
+    decode << "        if (avro::ResolvingDecoder *rd =\n";
+    decode << "            dynamic_cast<avro::ResolvingDecoder *>(&d)) {\n";
+    decode << "            const std::vector<size_t> fo = rd->fieldOrder();\n";
+    decode << "            for (std::vector<size_t>::const_iterator it = fo.begin();\n";
+    decode << "                it != fo.end(); ++it) {\n";
+    decode << "                switch (*it) {\n";
     for (size_t i = 0; i < c; ++i) {
-        os_ << "                case " << i << ":\n";
-        os_ << "                    avro::decode(d, v." << decorate_reserved_words(n->nameAt(i)) << ");\n";
-        os_ << "                    break;\n";
+        decode << "                case " << i << ":\n";
+        decode << "                    avro::decode(d, v." << decorate_reserved_words(n->nameAt(i)) << ");\n";
+        decode << "                    break;\n";
     }
-    os_ << "                default:\n";
-    os_ << "                    break;\n";
-    os_ << "                }\n";
-    os_ << "            }\n";
-    os_ << "        } else {\n";
+    decode << "                default:\n";
+    decode << "                    break;\n";
+    decode << "                }\n";
+    decode << "            }\n";
+    decode << "        } else {\n";
 
     for (size_t i = 0; i < c; ++i) {
-        os_ << "            avro::decode(d, v." << decorate_reserved_words(n->nameAt(i)) << ");\n";
+        decode << "            " << codecOf(n->leafAt(i)) << "::decode(d, v." << decorate_reserved_words(n->nameAt(i)) << ");\n";
     }
-    os_ << "        }\n";
-
-    os_ << "    }\n"
-        << "};\n\n";
+    decode << "        }\n";
+
+    vector<TraitsMember> members;
+    members.push_back(TraitsMember("void", "encode",
+        "Encoder& e, const " + fn + "& v", encode.str()));
+    members.push_back(TraitsMember("void", "decode",
+        "Decoder& d, " + fn + "& v", decode.str()));
+    emitTraits(fn, members);
 }
 
 void CodeGen::generateUnionTraits(const NodePtr& n)
@@ -619,50 +1359,84 @@ void CodeGen::generateUnionTraits(const NodePtr& n)
     string name = done[n];
     string fn = fullname(name);
 
-    os_ << "template<> struct codec_traits<" << fn << "> {\n"
-        << "    static void encode(Encoder& e, " << fn << " v) {\n"
-        << "        e.encodeUnionIndex(v.idx());\n"
-        << "        switch (v.idx()) {\n";
-
-    for (size_t i = 0; i < c; ++i) {
-        const NodePtr& nn = n->leafAt(i);
-        os_ << "        case " << i << ":\n";
-        if (nn->type() == avro::AVRO_NULL) {
-            os_ << "            e.encodeNull();\n";
-        } else {
-            os_ << "            avro::encode(e, v.get_" << cppNameOf(nn)
-                << "());\n";
-        }
-        os_ << "            break;\n";
+    std::ostringstream encode;
+    if (instrument_) {
+        encode << "        CSI_AVRO_STATS_ENCODE(\"" << fn << "\", e);\n"
+            << "        CSI_AVRO_STATS_BRANCH(v.idx());\n";
     }
+    encode << "        e.encodeUnionIndex(v.idx());\n"
+        << "        v.visit(encode_branch{ e });\n";
 
-    os_ << "        }\n"
-        << "    }\n"
-        << "    static void decode(Decoder& d, " << fn << "& v) {\n"
-        << "        size_t n = d.decodeUnionIndex();\n"
+    std::ostringstream decode;
+    if (instrument_) {
+        decode << "        CSI_AVRO_STATS_DECODE(\"" << fn << "\", d);\n";
+    }
+    decode << "        size_t n = d.decodeUnionIndex();\n"
         << "        if (n >= " << c << ") { throw avro::Exception(\""
-            "Union index too big\"); }\n"
-        << "        switch (n) {\n";
+            "Union index too big\"); }\n";
+    if (instrument_) {
+        decode << "        CSI_AVRO_STATS_BRANCH(n);\n";
+    }
+    decode << "        switch (n) {\n";
 
     for (size_t i = 0; i < c; ++i) {
         const NodePtr& nn = n->leafAt(i);
-        os_ << "        case " << i << ":\n";
+        decode << "        case " << i << ":\n";
         if (nn->type() == avro::AVRO_NULL) {
-            os_ << "            d.decodeNull();\n"
+            decode << "            d.decodeNull();\n"
                 << "            v.set_null();\n";
         } else {
-            os_ << "            {\n"
+            decode << "            {\n"
                 << "                " << cppTypeOf(nn) << " vv;\n"
                 << "                avro::decode(d, vv);\n"
                 << "                v.set_" << cppNameOf(nn) << "(vv);\n"
 				<< "                d.decodeUnionEnd();\n"
                 << "            }\n";
         }
-        os_ << "            break;\n";
+        decode << "            break;\n";
     }
-    os_ << "        }\n"
-        << "    }\n"
-        << "};\n\n";
+    decode << "        }\n";
+
+    vector<TraitsMember> members;
+    members.push_back(TraitsMember("void", "encode",
+        "Encoder& e, const " + fn + "& v", encode.str()));
+    members.push_back(TraitsMember("void", "decode",
+        "Decoder& d, " + fn + "& v", decode.str()));
+    emitTraits(fn, members,
+        "    struct encode_branch {\n"
+        "        Encoder& e;\n"
+        "        template<class T> void operator()(const T& v) const { avro::encode(e, v); }\n"
+        "    };\n");
+}
+
+/**
+ * Emits the codec_traits specialization for fn. Inline by default, in split
+ * mode the header only gets the declarations and the bodies go to the .cc.
+ * types are nested types the bodies use, always in the header.
+ */
+void CodeGen::emitTraits(const string& fn, const vector<TraitsMember>& members,
+    const string& types)
+{
+    os_ << "template<> struct codec_traits<" << fn << "> {\n"
+        << types;
+    for (vector<TraitsMember>::const_iterator it = members.begin();
+        it != members.end(); ++it) {
+        os_ << "    static " << it->returnType << ' ' << it->name
+            << "(" << it->params << ")";
+        if (implOs_) {
+            os_ << ";\n";
+            implTraits_ << it->returnType << " codec_traits<" << fn << ">::"
+                << it->name << "(" << it->params << ") {\n"
+                << it->body
+                << "}\n\n";
+        } else {
+            os_ << " {\n"
+                << it->body
+                << "    }\n";
+        }
+    }
+    os_ << "};\n\n";
+    instantiated_.push_back(fn);
 }
 
 void CodeGen::generateTraits(const NodePtr& n)
@@ -697,9 +1471,9 @@ void CodeGen::generateTraits(const NodePtr& n)
     }
 }
 
-void CodeGen::emitCopyright()
+void CodeGen::emitCopyright(std::ostream& os)
 {
-    os_ << 
+    os << 
         "/**\n"
         " * Licensed to the Apache Software Foundation (ASF) under one\n"
         " * or more contributor license agreements.  See the NOTICE file\n"
@@ -775,23 +1549,63 @@ void CodeGen::generate(const ValidSchema& schema)
 {
     generateExtensions(schema);
 
-    emitCopyright();
+    emitCopyright(os_);
 
     string h = guardString_.empty() ? guard() : guardString_;
 
     os_ << "#ifndef " << h << "\n";
     os_ << "#define " << h << "\n\n\n";
 
-    os_ << "#include <sstream>\n"
-        << "#include <boost/any.hpp>\n"
-        << "#include <boost/uuid/uuid.hpp>\n"
-        << "#include <boost/uuid/string_generator.hpp>\n"
-        << "#include <boost/make_shared.hpp>\n"
-        << "#include \"" << includePrefix_ << "Specific.hh\"\n"
-        << "#include \"" << includePrefix_ << "Encoder.hh\"\n"
-        << "#include \"" << includePrefix_ << "Decoder.hh\"\n"
-        << "#include \"" << includePrefix_ << "Compiler.hh\"\n"
-        << "\n";
+    if (implOs_) {
+        os_ << "#include <limits>\n"
+            << "#include <boost/any.hpp>\n"
+            << "#include <boost/uuid/uuid.hpp>\n"
+            << "#include <boost/shared_ptr.hpp>\n"
+            << "#include \"" << includePrefix_ << "Specific.hh\"\n"
+            << "\n";
+    } else {
+        os_ << "#include <sstream>\n"
+            << "#include <limits>\n"
+            << "#include <boost/any.hpp>\n"
+            << "#include <boost/uuid/uuid.hpp>\n"
+            << "#include <boost/uuid/string_generator.hpp>\n"
+            << "#include <boost/make_shared.hpp>\n"
+            << "#include \"" << includePrefix_ << "Specific.hh\"\n"
+            << "#include \"" << includePrefix_ << "Encoder.hh\"\n"
+            << "#include \"" << includePrefix_ << "Decoder.hh\"\n"
+            << "#include \"" << includePrefix_ << "Compiler.hh\"\n";
+        if (instrument_) {
+            os_ << "#include \"csi_avro_utils/codec_stats.h\"\n";
+        }
+        os_ << "\n";
+    }
+    if (! logicalTypes_.empty()) {
+        os_ << "#include \"csi_avro_utils/logical_types.h\"\n"
+            << "\n";
+    }
+    if (operators_) {
+        os_ << "#include <functional>\n"
+            << "#include \"csi_avro_utils/avro_hash.h\"\n"
+            << "\n";
+    }
+    if (reflection_) {
+        os_ << "#include \"csi_avro_utils/reflection.h\"\n"
+            << "\n";
+    }
+    if (json_) {
+        os_ << "#include \"csi_avro_utils/json_writer.h\"\n"
+            << "\n";
+    }
+    if (bulkArrays_) {
+        os_ << "#include \"csi_avro_utils/binary_codec.h\"\n"
+            << "\n";
+    }
+    if (patch_) {
+        os_ << "#include <utility>\n"
+            << "#include <boost/uuid/string_generator.hpp>\n"
+            << "#include \"csi_avro_utils/record_patch.h\"\n"
+            << "\n";
+    }
 
     if (! ns_.empty()) {
         os_ << "namespace " << ns_ << " {\n";
@@ -801,35 +1615,662 @@ void CodeGen::generate(const ValidSchema& schema)
     const NodePtr& root = schema.root();
     generateType(root);
 
+    std::ostream& members = implOs_ ? implTypes_ : os_;
     for (vector<PendingSetterGetter>::const_iterator it =
         pendingGettersAndSetters.begin();
         it != pendingGettersAndSetters.end(); ++it) {
-        generateGetterAndSetter(os_, it->structName, it->type, it->name,
-            it->idx);
+        generateGetterAndSetter(members, it->structName, it->type, it->name,
+            it->idx, implOs_ == 0);
     }
 
     for (vector<PendingConstructor>::const_iterator it =
         pendingConstructors.begin();
         it != pendingConstructors.end(); ++it) {
-        generateConstructor(os_, it->structName,
-            it->initMember, it->memberName);
+        generateConstructor(members, it->structName, implOs_ == 0);
     }
 
+    generateVisit();
+    generateOperators();
+    generateJson();
+
     if (! ns_.empty()) {
         inNamespace_ = false;
         os_ << "}\n";
     }
 
+    if (! pendingOperators.empty()) {
+        os_ << "namespace std {\n";
+        for (vector<PendingOperators>::const_iterator it =
+            pendingOperators.begin(); it != pendingOperators.end(); ++it) {
+            string fn = fullname(it->structName);
+            os_ << "template<> struct hash<" << fn << " > {\n"
+                << "    size_t operator()(const " << fn << "& v) const { return hash_value(v); }\n"
+                << "};\n";
+        }
+        os_ << "}\n";
+    }
+
     os_ << "namespace avro {\n";
 
     unionNumber_ = 0;
 
     generateTraits(root);
 
+    // keep includers from instantiating what the .cc already provides
+    if (implOs_) {
+        for (vector<string>::const_iterator it = instantiated_.begin();
+            it != instantiated_.end(); ++it) {
+            os_ << "extern template void encode<" << *it << " >(Encoder&, const " << *it << "&);\n"
+                << "extern template void decode<" << *it << " >(Decoder&, " << *it << "&);\n";
+        }
+        os_ << "\n";
+    }
+
     os_ << "}\n";
+
+    generatePatch();
+    generateReflection();
     os_ << "#endif\n";
     os_.flush();
 
+    if (implOs_) {
+        generateImpl();
+    }
+}
+
+/**
+ * Emits visit() for unions, in the header also in split mode as they are
+ * templates. One switch on idx_, the value is passed by reference.
+ */
+void CodeGen::generateVisit()
+{
+    for (vector<PendingVisit>::const_iterator it = pendingVisits.begin();
+        it != pendingVisits.end(); ++it) {
+        const string& t = it->structName;
+        const vector<string>& m = it->members;
+        for (int mutating = 0; mutating < 2; ++mutating) {
+            os_ << "template<class F> inline void " << t << "::visit(F&& f)"
+                << (mutating ? "" : " const") << " {\n"
+                << "    switch (idx_) {\n";
+            for (size_t i = 0; i < m.size(); ++i) {
+                if (m[i].empty()) {
+                    os_ << "    case " << i << ": f(avro::null()); break;\n";
+                } else {
+                    os_ << "    case " << i << ": f(branch_value<" << m[i] << " >()); break;\n";
+                }
+            }
+            os_ << "    }\n"
+                << "}\n\n";
+        }
+    }
+}
+
+/**
+ * Emits equality, avro sort order comparison and hashing for the generated
+ * types. Always inline so hash tables keyed on generated records stay fast.
+ * operator< follows the field order attributes, equality and hashing use
+ * every field.
+ * Declarations go first since recursive types refer to each other.
+ */
+void CodeGen::generateOperators()
+{
+    if (pendingOperators.empty()) {
+        return;
+    }
+
+    for (vector<PendingOperators>::const_iterator it =
+        pendingOperators.begin(); it != pendingOperators.end(); ++it) {
+        const string& t = it->structName;
+        if (it->kind == PendingOperators::RECORD) {
+            os_ << "bool operator==(const " << t << "& a, const " << t << "& b);\n"
+                << "bool operator<(const " << t << "& a, const " << t << "& b);\n";
+        }
+        os_ << "size_t hash_value(" << (it->kind == PendingOperators::ENUM ? t : "const " + t + "&") << " v);\n";
+    }
+    os_ << "\n";
+
+    for (vector<PendingOperators>::const_iterator it =
+        pendingOperators.begin(); it != pendingOperators.end(); ++it) {
+        const string& t = it->structName;
+        const vector<string>& m = it->members;
+        switch (it->kind) {
+        case PendingOperators::ENUM:
+            os_ << "inline size_t hash_value(" << t << " v) {\n"
+                << "    return csi::avro_hash::hash_value(static_cast<int32_t>(v));\n"
+                << "}\n\n";
+            break;
+        case PendingOperators::RECORD:
+            os_ << "inline bool operator==(const " << t << "& a, const " << t << "& b) {\n"
+                << "    return true";
+            for (size_t i = 0; i < m.size(); ++i) {
+                os_ << "\n        && a." << m[i] << " == b." << m[i];
+            }
+            os_ << ";\n"
+                << "}\n\n"
+                << "inline bool operator!=(const " << t << "& a, const " << t << "& b) {\n"
+                << "    return !(a == b);\n"
+                << "}\n\n";
+
+            // fields in schema order, maps have no avro order so they compare as std::map
+            os_ << "inline bool operator<(const " << t << "& a, const " << t << "& b) {\n";
+            for (size_t i = 0; i < m.size(); ++i) {
+                const string order = i < it->orders.size() ? it->orders[i] : "ascending";
+                if (order == "ignore") {
+                    continue;
+                }
+                const char* x = order == "descending" ? "b." : "a.";
+                const char* y = order == "descending" ? "a." : "b.";
+                os_ << "    if (" << x << m[i] << " < " << y << m[i] << ") return true;\n"
+                    << "    if (" << y << m[i] << " < " << x << m[i] << ") return false;\n";
+            }
+            os_ << "    return false;\n"
+                << "}\n\n";
+
+            os_ << "inline size_t hash_value(const " << t << "& v) {\n"
+                << "    using csi::avro_hash::hash_value;\n"
+                << "    size_t h = csi::avro_hash::seed;\n";
+            for (size_t i = 0; i < m.size(); ++i) {
+                os_ << "    h = csi::avro_hash::combine(h, hash_value(v." << m[i] << "));\n";
+            }
+            os_ << "    return h;\n"
+                << "}\n\n";
+            break;
+        case PendingOperators::UNION:
+            // branches compare by position first, then by value
+            os_ << "inline bool " << t << "::operator==(const " << t << "& o) const {\n"
+                << "    if (idx_ != o.idx_) return false;\n"
+                << "    switch (idx_) {\n";
+            for (size_t i = 0; i < m.size(); ++i) {
+                if (! m[i].empty()) {
+                    os_ << "    case " << i << ": return branch_value<" << m[i] << " >() == o.branch_value<" << m[i] << " >();\n";
+                }
+            }
+            os_ << "    }\n"
+                << "    return true;\n"
+                << "}\n\n";
+
+            os_ << "inline bool " << t << "::operator<(const " << t << "& o) const {\n"
+                << "    if (idx_ != o.idx_) return idx_ < o.idx_;\n"
+                << "    switch (idx_) {\n";
+            for (size_t i = 0; i < m.size(); ++i) {
+                if (! m[i].empty()) {
+                    os_ << "    case " << i << ": return branch_value<" << m[i] << " >() < o.branch_value<" << m[i] << " >();\n";
+                }
+            }
+            os_ << "    }\n"
+                << "    return false;\n"
+                << "}\n\n";
+
+            os_ << "inline size_t " << t << "::hash() const {\n"
+                << "    using csi::avro_hash::hash_value;\n"
+                << "    size_t h = csi::avro_hash::combine(csi::avro_hash::seed, idx_);\n"
+                << "    switch (idx_) {\n";
+            for (size_t i = 0; i < m.size(); ++i) {
+                if (! m[i].empty()) {
+                    os_ << "    case " << i << ": return csi::avro_hash::combine(h, hash_value(branch_value<" << m[i] << " >()));\n";
+                }
+            }
+            os_ << "    }\n"
+                << "    return h;\n"
+                << "}\n\n"
+                << "inline size_t hash_value(const " << t << "& v) {\n"
+                << "    return v.hash();\n"
+                << "}\n\n";
+            break;
+        }
+    }
+}
+
+/**
+ * Emits diff() and apply_patch() for records, see csi_avro_utils/record_patch.h.
+ * After the traits since the changed fields are coded through them, inline
+ * also in split mode. Fields are compared with the generated operator==.
+ */
+void CodeGen::generatePatch()
+{
+    if (pendingPatches.empty()) {
+        return;
+    }
+
+    if (! ns_.empty()) {
+        os_ << "namespace " << ns_ << " {\n";
+    }
+    for (vector<PendingPatch>::const_iterator it =
+        pendingPatches.begin(); it != pendingPatches.end(); ++it) {
+        const string& t = it->structName;
+        const vector<string>& m = it->members;
+        os_ << "// hash of the normalized json of " << t << " on its own, the patch header\n"
+            << "inline const boost::uuids::uuid& patch_hash(const " << t << "&) {\n"
+            << "    static const boost::uuids::uuid _hash(boost::uuids::string_generator()(\"" << to_string(it->hash) << "\"));\n"
+            << "    return _hash;\n"
+            << "}\n\n";
+
+        os_ << "// the fields of to that differ from from, tied to patch_hash(). false if none do\n"
+            << "inline bool diff(const " << t << "& from, const " << t << "& to, std::vector<uint8_t>& patch) {\n"
+            << "    csi::patch_writer w(patch, patch_hash(to), " << m.size() << ");\n";
+        for (size_t i = 0; i < m.size(); ++i) {
+            os_ << "    if (!(from." << m[i] << " == to." << m[i] << ")) " << it->codecs[i]
+                << "::encode(w.field(" << i << "), to." << m[i] << ");\n";
+        }
+        os_ << "    return w.finish();\n"
+            << "}\n\n"
+            << "inline std::vector<uint8_t> diff(const " << t << "& from, const " << t << "& to) {\n"
+            << "    std::vector<uint8_t> patch;\n"
+            << "    diff(from, to, patch);\n"
+            << "    return patch;\n"
+            << "}\n\n";
+
+        // the changed fields are decoded into a per thread scratch record and
+        // only swapped in once the whole patch has been read, so a patch cut
+        // short leaves v as it was. scratch keeps the replaced values, and
+        // their capacity, for the next patch
+        os_ << "// throws avro::Exception, v is left as it was if the patch is not for " << t << " or is invalid\n"
+            << "inline void apply_patch(" << t << "& v, const uint8_t* data, size_t size) {\n"
+            << "    static thread_local " << t << " scratch;\n"
+            << "    csi::patch_reader r(data, size, patch_hash(v), " << m.size() << ");\n";
+        for (size_t i = 0; i < m.size(); ++i) {
+            os_ << "    if (r.changed(" << i << ")) " << it->codecs[i] << "::decode(r.decoder(), scratch." << m[i] << ");\n";
+        }
+        os_ << "    r.finish();\n";
+        for (size_t i = 0; i < m.size(); ++i) {
+            os_ << "    if (r.changed(" << i << ")) std::swap(v." << m[i] << ", scratch." << m[i] << ");\n";
+        }
+        os_ << "}\n\n"
+            << "inline void apply_patch(" << t << "& v, const std::vector<uint8_t>& patch) {\n"
+            << "    apply_patch(v, patch.data(), patch.size());\n"
+            << "}\n\n";
+    }
+    if (! ns_.empty()) {
+        os_ << "}\n";
+    }
+}
+
+/**
+ * Returns s as the contents of a C string literal and its length once
+ * compiled, for appending precomputed json fragments.
+ */
+static string jsonLiteral(const string& s, size_t& len)
+{
+    string escaped;
+    escape_string(s, std::back_inserter(escaped));
+    len = s.size();
+    return "\"" + escaped + "\"";
+}
+
+/**
+ * Emits to_json() for records, unions and enums following the avro json
+ * encoding. Field names and symbols are precomputed literals, values go
+ * through csi::json::to_json for primitives and containers.
+ */
+void CodeGen::generateJson()
+{
+    if (pendingJson.empty()) {
+        return;
+    }
+
+    for (vector<PendingJson>::const_iterator it =
+        pendingJson.begin(); it != pendingJson.end(); ++it) {
+        const string& t = it->structName;
+        os_ << "void to_json(" << (it->kind == PendingJson::ENUM ? t : "const " + t + "&") << " v, csi::json_buffer& out);\n";
+    }
+    os_ << "\n";
+
+    for (vector<PendingJson>::const_iterator it =
+        pendingJson.begin(); it != pendingJson.end(); ++it) {
+        const string& t = it->structName;
+        const vector<string>& names = it->names;
+        const vector<string>& m = it->members;
+        size_t len;
+        switch (it->kind) {
+        case PendingJson::ENUM:
+            os_ << "inline void to_json(" << t << " v, csi::json_buffer& out) {\n"
+                << "    switch (v) {\n";
+            for (size_t i = 0; i < m.size(); ++i) {
+                string lit = jsonLiteral("\"" + names[i] + "\"", len);
+                os_ << "    case " << m[i] << ": out.append(" << lit << ", " << len << "); break;\n";
+            }
+            os_ << "    default: csi::json::to_json(static_cast<int32_t>(v), out); break;\n"
+                << "    }\n"
+                << "}\n\n";
+            break;
+        case PendingJson::RECORD:
+            os_ << "inline void to_json(const " << t << "& v, csi::json_buffer& out) {\n";
+            if (m.empty()) {
+                os_ << "    out.append(\"{}\", 2);\n";
+            } else {
+                os_ << "    using csi::json::to_json;\n";
+                for (size_t i = 0; i < m.size(); ++i) {
+                    string lit = jsonLiteral((i ? ",\"" : "{\"") + names[i] + "\":", len);
+                    os_ << "    out.append(" << lit << ", " << len << ");\n"
+                        << "    to_json(v." << m[i] << ", out);\n";
+                }
+                os_ << "    out.put('}');\n";
+            }
+            os_ << "}\n\n";
+            break;
+        case PendingJson::UNION:
+            os_ << "inline void to_json(const " << t << "& v, csi::json_buffer& out) {\n"
+                << "    using csi::json::to_json;\n"
+                << "    switch (v.idx_) {\n";
+            for (size_t i = 0; i < m.size(); ++i) {
+                if (names[i].empty()) {
+                    os_ << "    case " << i << ": out.append(\"null\", 4); break;\n";
+                } else {
+                    string lit = jsonLiteral("{\"" + names[i] + "\":", len);
+                    os_ << "    case " << i << ":\n"
+                        << "        out.append(" << lit << ", " << len << ");\n"
+                        << "        to_json(v.branch_value<" << m[i] << " >(), out);\n"
+                        << "        out.put('}');\n"
+                        << "        break;\n";
+                }
+            }
+            os_ << "    }\n"
+                << "}\n\n";
+            break;
+        }
+    }
+}
+
+/**
+ * Emits the csi::record_info, union_info and enum_info specializations
+ * used by csi_avro_utils/reflection.h. Header only in both modes since the
+ * visitors are templates.
+ */
+void CodeGen::generateReflection()
+{
+    if (pendingReflection.empty()) {
+        return;
+    }
+
+    os_ << "namespace csi {\n";
+    for (vector<PendingReflection>::const_iterator it =
+        pendingReflection.begin(); it != pendingReflection.end(); ++it) {
+        const string fn = fullname(it->structName);
+        switch (it->kind) {
+        case PendingReflection::ENUM:
+            os_ << "template<> struct enum_info<" << fn << "> {\n"
+                << "    static const size_t size = " << it->names.size() << ";\n"
+                << "    static const char* const* names() {\n"
+                << "        static const char* const n[] = {";
+            for (size_t i = 0; i < it->names.size(); ++i) {
+                os_ << (i ? ", " : " ") << '"' << it->names[i] << '"';
+            }
+            os_ << " };\n"
+                << "        return n;\n"
+                << "    }\n"
+                << "};\n\n";
+            break;
+        case PendingReflection::RECORD:
+            {
+                const vector<string>& m = it->members;
+                os_ << "template<> struct record_info<" << fn << "> {\n"
+                    << "    static const size_t size = " << m.size() << ";\n"
+                    << "    static const field_info* fields() {\n";
+                if (m.empty()) {
+                    os_ << "        return 0;\n";
+                } else {
+                    os_ << "        static const field_info f[] = {\n";
+                    for (size_t i = 0; i < m.size(); ++i) {
+                        os_ << "            { \"" << it->names[i] << "\", "
+                            << it->types[i] << ", "
+                            << (it->nullable[i] ? "true" : "false") << " },\n";
+                    }
+                    os_ << "        };\n"
+                        << "        return f;\n";
+                }
+                os_ << "    }\n"
+                    << "    template<class T, class F> static void visit(T& v, F& f) {\n";
+                for (size_t i = 0; i < m.size(); ++i) {
+                    os_ << "        f(fields()[" << i << "], v." << m[i] << ");\n";
+                }
+                os_ << "    }\n"
+                    << "    template<class T, class F> static void visit_field(T& v, size_t i, F& f) {\n"
+                    << "        switch (i) {\n";
+                for (size_t i = 0; i < m.size(); ++i) {
+                    os_ << "        case " << i << ": f(fields()[" << i << "], v." << m[i] << "); break;\n";
+                }
+                os_ << "        }\n"
+                    << "    }\n"
+                    << "};\n\n";
+            }
+            break;
+        case PendingReflection::UNION:
+            {
+                const vector<string>& m = it->members;
+                os_ << "template<> struct union_info<" << fn << "> {\n"
+                    << "    static const size_t size = " << m.size() << ";\n"
+                    << "    template<class F> static void visit(const " << fn << "& v, F& f) {\n"
+                    << "        switch (v.idx_) {\n";
+                for (size_t i = 0; i < m.size(); ++i) {
+                    if (m[i].empty()) {
+                        os_ << "        case " << i << ": f(null_value()); break;\n";
+                    } else {
+                        os_ << "        case " << i << ": f(v.branch_value<" << m[i] << " >()); break;\n";
+                    }
+                }
+                os_ << "        }\n"
+                    << "    }\n"
+                    << "};\n\n";
+            }
+            break;
+        }
+    }
+    os_ << "}\n";
+}
+
+/**
+ * Emits the .cc that goes with a split header: extension functions, union
+ * members, codec_traits bodies and the explicit instantiations.
+ */
+void CodeGen::generateImpl()
+{
+    std::ostream& os = *implOs_;
+    emitCopyright(os);
+
+    string header = headerFile_;
+    string::size_type n = header.find_last_of("/\\");
+    if (n != string::npos) {
+        header = header.substr(n + 1);
+    }
+
+    os << "#include \"" << header << "\"\n"
+        << "#include <sstream>\n"
+        << "#include <boost/uuid/string_generator.hpp>\n"
+        << "#include <boost/make_shared.hpp>\n"
+        << "#include \"" << includePrefix_ << "Encoder.hh\"\n"
+        << "#include \"" << includePrefix_ << "Decoder.hh\"\n"
+        << "#include \"" << includePrefix_ << "Compiler.hh\"\n";
+    if (instrument_) {
+        os << "#include \"csi_avro_utils/codec_stats.h\"\n";
+    }
+    os << "\n";
+
+    if (! ns_.empty()) {
+        os << "namespace " << ns_ << " {\n";
+    }
+    os << implTypes_.str();
+    if (! ns_.empty()) {
+        os << "}\n";
+    }
+
+    os << "namespace avro {\n";
+    os << implTraits_.str();
+    for (vector<string>::const_iterator it = instantiated_.begin();
+        it != instantiated_.end(); ++it) {
+        os << "template void encode<" << *it << " >(Encoder&, const " << *it << "&);\n"
+            << "template void decode<" << *it << " >(Decoder&, " << *it << "&);\n";
+    }
+    os << "}\n";
+    os.flush();
+}
+
+/**
+ * The c++ type for a logicalType attribute on n, empty when there is no
+ * native mapping or the logical type is invalid and falls back to the
+ * underlying type, as the avro spec says.
+ */
+static string logicalCppType(const boost::property_tree::ptree& j,
+    const NodePtr& n)
+{
+    string lt = j.get<string>("logicalType", "");
+    switch (n->type()) {
+    case avro::AVRO_BYTES:
+    case avro::AVRO_FIXED:
+        if (lt == "decimal") {
+            int precision = j.get<int>("precision", 0);
+            int scale = j.get<int>("scale", 0);
+            if (precision <= 0 || precision > 38 || scale < 0 || scale > precision) {
+                return "";
+            }
+            string t = (precision <= 18) ? "csi::decimal64<" : "csi::decimal128<";
+            t += lexical_cast<string>(scale);
+            if (n->type() == avro::AVRO_FIXED) {
+                t += ", " + lexical_cast<string>(n->fixedSize());
+            }
+            return t + ">";
+        }
+        break;
+    case avro::AVRO_INT:
+        if (lt == "date") {
+            return "csi::date";
+        } else if (lt == "time-millis") {
+            return "csi::time_millis";
+        }
+        break;
+    case avro::AVRO_LONG:
+        if (lt == "timestamp-millis") {
+            return "csi::timestamp_millis";
+        } else if (lt == "timestamp-micros") {
+            return "csi::timestamp_micros";
+        } else if (lt == "time-micros") {
+            return "csi::time_micros";
+        }
+        break;
+    case avro::AVRO_STRING:
+        if (lt == "uuid") {
+            return "csi::uuid";
+        }
+        break;
+    default:
+        break;
+    }
+    return "";
+}
+
+/**
+ * The avro-cpp compiler drops logicalType attributes so walk the schema
+ * json along with the compiled nodes and collect them.
+ */
+static void findLogicalTypes(const boost::property_tree::ptree& j,
+    const NodePtr& n, LogicalTypes& result)
+{
+    typedef boost::property_tree::ptree ptree;
+    if (j.empty() || n->type() == avro::AVRO_SYMBOLIC) {
+        // a type name, named types are annotated where they are defined
+        return;
+    }
+    if (n->type() == avro::AVRO_UNION && j.front().first.empty()) {
+        size_t i = 0;
+        for (ptree::const_iterator it = j.begin(); it != j.end() && i < n->leaves(); ++it, ++i) {
+            findLogicalTypes(it->second, n->leafAt(i), result);
+        }
+        return;
+    }
+    boost::optional<const ptree&> type = j.get_child_optional("type");
+    if (type && ! type->empty()) {
+        findLogicalTypes(*type, n, result);
+        return;
+    }
+    if (j.count("logicalType")) {
+        string t = logicalCppType(j, n);
+        if (! t.empty()) {
+            result[n.get()] = t;
+        }
+    }
+    switch (n->type()) {
+    case avro::AVRO_RECORD:
+        if (boost::optional<const ptree&> fields = j.get_child_optional("fields")) {
+            size_t i = 0;
+            for (ptree::const_iterator it = fields->begin(); it != fields->end() && i < n->leaves(); ++it, ++i) {
+                if (boost::optional<const ptree&> ft = it->second.get_child_optional("type")) {
+                    findLogicalTypes(*ft, n->leafAt(i), result);
+                }
+            }
+        }
+        break;
+    case avro::AVRO_ARRAY:
+        if (boost::optional<const ptree&> items = j.get_child_optional("items")) {
+            findLogicalTypes(*items, n->leafAt(0), result);
+        }
+        break;
+    case avro::AVRO_MAP:
+        if (boost::optional<const ptree&> values = j.get_child_optional("values")) {
+            findLogicalTypes(*values, n->leafAt(1), result);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * The avro-cpp compiler drops the field order attributes too, walk the
+ * schema json the same way and collect them for operator<.
+ */
+static void findFieldOrders(const boost::property_tree::ptree& j,
+    const NodePtr& n, FieldOrders& result)
+{
+    typedef boost::property_tree::ptree ptree;
+    if (j.empty() || n->type() == avro::AVRO_SYMBOLIC) {
+        return;
+    }
+    if (n->type() == avro::AVRO_UNION && j.front().first.empty()) {
+        size_t i = 0;
+        for (ptree::const_iterator it = j.begin(); it != j.end() && i < n->leaves(); ++it, ++i) {
+            findFieldOrders(it->second, n->leafAt(i), result);
+        }
+        return;
+    }
+    boost::optional<const ptree&> type = j.get_child_optional("type");
+    if (type && ! type->empty()) {
+        findFieldOrders(*type, n, result);
+        return;
+    }
+    switch (n->type()) {
+    case avro::AVRO_RECORD:
+        if (boost::optional<const ptree&> fields = j.get_child_optional("fields")) {
+            vector<string> orders;
+            bool ascending = true;
+            size_t i = 0;
+            for (ptree::const_iterator it = fields->begin(); it != fields->end() && i < n->leaves(); ++it, ++i) {
+                string order = it->second.get<string>("order", "ascending");
+                if (order != "ascending" && order != "descending" && order != "ignore") {
+                    throw avro::Exception("Invalid order \"" + order + "\" for field " + n->nameAt(i));
+                }
+                ascending = ascending && order == "ascending";
+                orders.push_back(order);
+                if (boost::optional<const ptree&> ft = it->second.get_child_optional("type")) {
+                    findFieldOrders(*ft, n->leafAt(i), result);
+                }
+            }
+            if (! ascending) {
+                result[n.get()] = orders;
+            }
+        }
+        break;
+    case avro::AVRO_ARRAY:
+        if (boost::optional<const ptree&> items = j.get_child_optional("items")) {
+            findFieldOrders(*items, n->leafAt(0), result);
+        }
+        break;
+    case avro::AVRO_MAP:
+        if (boost::optional<const ptree&> values = j.get_child_optional("values")) {
+            findFieldOrders(*values, n->leafAt(1), result);
+        }
+        break;
+    default:
+        break;
+    }
 }
 
 namespace po = boost::program_options;
@@ -839,6 +2280,14 @@ static const string OUT("output");
 static const string IN("input");
 static const string INCLUDE_PREFIX("include-prefix");
 static const string NO_UNION_TYPEDEF("no-union-typedef");
+static const string IMPL_OUT("impl-output");
+static const string INSTRUMENT("instrument");
+static const string OPERATORS("operators");
+static const string REFLECTION("reflection");
+static const string JSON("json");
+static const string LOGICAL_TYPES("logical-types");
+static const string BULK_ARRAYS("bulk-arrays");
+static const string PATCH("patch");
 
 static string readGuard(const string& filename)
 {
@@ -872,7 +2321,26 @@ int main(int argc, char** argv)
         ("no-union-typedef,U", "do not generate typedefs for unions in records")
         ("namespace,n", po::value<string>(), "set namespace for generated code")
         ("input,i", po::value<string>(), "input file")
-        ("output,o", po::value<string>(), "output file to generate");
+        ("output,o", po::value<string>(), "output file to generate")
+        ("impl-output,c", po::value<string>(),
+            "split mode: emit declarations only in the output header and "
+            "write traits and extension implementations to this .cc file")
+        ("instrument", "emit per type call, time, byte and union branch "
+            "counters in encode/decode, compiled in with -DCSI_AVRO_ENABLE_STATS")
+        ("operators", "emit operator==, operator< (avro sort order, field "
+            "order attributes included), "
+            "hash_value and std::hash for records, enums and unions")
+        ("reflection", "emit csi::record_info, union_info and enum_info "
+            "field tables and visitors for csi_avro_utils/reflection.h")
+        ("json", "emit to_json() writing the avro json encoding into a "
+            "csi::json_buffer, see csi_avro_utils/json_writer.h")
+        ("logical-types", "map decimal, date, time, timestamp and uuid "
+            "logical types to the native types in csi_avro_utils/logical_types.h")
+        ("bulk-arrays", "encode and decode int, long, float and double array "
+            "fields in bulk when coded with csi::binary_encoder / binary_decoder, "
+            "see csi_avro_utils/binary_codec.h")
+        ("patch", "emit diff() and apply_patch() for records, changed fields "
+            "only behind a bitmask, see csi_avro_utils/record_patch.h. implies --operators");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -887,8 +2355,20 @@ int main(int argc, char** argv)
     string ns = vm.count(NS) > 0 ? vm[NS].as<string>() : string();
     string outf = vm.count(OUT) > 0 ? vm[OUT].as<string>() : string();
     string inf = vm.count(IN) > 0 ? vm[IN].as<string>() : string();
+    string implf = vm.count(IMPL_OUT) > 0 ? vm[IMPL_OUT].as<string>() : string();
+    if (! implf.empty() && outf.empty()) {
+        std::cerr << "-c needs -o, the declarations go to the output header" << std::endl;
+        return 1;
+    }
     string incPrefix = vm[INCLUDE_PREFIX].as<string>();
     bool noUnion = vm.count(NO_UNION_TYPEDEF) != 0;
+    bool instrument = vm.count(INSTRUMENT) != 0;
+    bool patch = vm.count(PATCH) != 0;
+    bool operators = vm.count(OPERATORS) != 0 || patch;
+    bool reflection = vm.count(REFLECTION) != 0;
+    bool json = vm.count(JSON) != 0;
+    bool logical = vm.count(LOGICAL_TYPES) != 0;
+    bool bulkArrays = vm.count(BULK_ARRAYS) != 0;
     if (incPrefix == "-") {
         incPrefix.clear();
     } else if (*incPrefix.rbegin() != '/') {
@@ -897,8 +2377,32 @@ int main(int argc, char** argv)
 
     try {
         ValidSchema schema;
-
-        if (! inf.empty()) {
+        LogicalTypes logicalTypes;
+        FieldOrders fieldOrders;
+
+        if (logical || operators) {
+            // read once, compiled and parsed again for the logicalType and order attributes
+            std::stringstream text;
+            if (! inf.empty()) {
+                ifstream in(inf.c_str());
+                text << in.rdbuf();
+            } else {
+                text << std::cin.rdbuf();
+            }
+            compileJsonSchema(text, schema);
+            // wrapped in an array, read_json only takes an object or an array at the top
+            // and the schema may be a plain type name like "string"
+            std::stringstream wrapped;
+            wrapped << "[" << text.str() << "]";
+            boost::property_tree::ptree j;
+            boost::property_tree::read_json(wrapped, j);
+            if (logical) {
+                findLogicalTypes(j.front().second, schema.root(), logicalTypes);
+            }
+            if (operators) {
+                findFieldOrders(j.front().second, schema.root(), fieldOrders);
+            }
+        } else if (! inf.empty()) {
             ifstream in(inf.c_str());
             compileJsonSchema(in, schema);
         } else {
@@ -908,9 +2412,24 @@ int main(int argc, char** argv)
         if (! outf.empty()) {
             string g = readGuard(outf);
             ofstream out(outf.c_str());
-            CodeGen(out, ns, inf, outf, g, incPrefix, noUnion).generate(schema);
+            if (! out) {
+                std::cerr << "Cannot open output file " << outf << std::endl;
+                return 1;
+            }
+            if (! implf.empty()) {
+                ofstream impl(implf.c_str());
+                if (! impl) {
+                    std::cerr << "Cannot open implementation file " << implf << std::endl;
+                    return 1;
+                }
+                CodeGen(out, ns, inf, outf, g, incPrefix, noUnion, instrument, operators, reflection, json, bulkArrays, patch, logicalTypes, fieldOrders, &impl).
+                    generate(schema);
+            } else {
+                CodeGen(out, ns, inf, outf, g, incPrefix, noUnion, instrument, operators, reflection, json, bulkArrays, patch, logicalTypes, fieldOrders).
+                    generate(schema);
+            }
         } else {
-            CodeGen(std::cout, ns, inf, outf, "", incPrefix, noUnion).
+            CodeGen(std::cout, ns, inf, outf, "", incPrefix, noUnion, instrument, operators, reflection, json, bulkArrays, patch, logicalTypes, fieldOrders).
                 generate(schema);
         }
         return 0;
@@ -0,0 +1,168 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <avro/Compiler.hh>
+#include <avro/Encoder.hh>
+#include <avro/Exception.hh>
+#include <avro/Generic.hh>
+#include <avro/Stream.hh>
+#include <avro/ValidSchema.hh>
+#include <csi_avro_utils/arena_decoder.h>
+#include <tests/test_check.h>
+
+static const char* all_types_schema =
+  "{\"type\":\"record\",\"name\":\"all_types\",\"fields\":["
+  "{\"name\":\"b\",\"type\":\"boolean\"},"
+  "{\"name\":\"i\",\"type\":\"int\"},"
+  "{\"name\":\"l\",\"type\":\"long\"},"
+  "{\"name\":\"f\",\"type\":\"float\"},"
+  "{\"name\":\"d\",\"type\":\"double\"},"
+  "{\"name\":\"s\",\"type\":\"string\"},"
+  "{\"name\":\"by\",\"type\":\"bytes\"},"
+  "{\"name\":\"fx\",\"type\":{\"type\":\"fixed\",\"name\":\"four\",\"size\":4}},"
+  "{\"name\":\"e\",\"type\":{\"type\":\"enum\",\"name\":\"color\",\"symbols\":[\"red\",\"green\",\"blue\"]}},"
+  "{\"name\":\"u\",\"type\":[\"null\",\"string\"]},"
+  "{\"name\":\"a\",\"type\":{\"type\":\"array\",\"items\":\"int\"}},"
+  "{\"name\":\"m\",\"type\":{\"type\":\"map\",\"values\":\"long\"}},"
+  "{\"name\":\"n\",\"type\":{\"type\":\"record\",\"name\":\"inner\",\"fields\":[{\"name\":\"x\",\"type\":\"int\"}]}}]}";
+
+static std::vector<uint8_t> avro_encode(const avro::GenericDatum& d) {
+  std::auto_ptr<avro::OutputStream> os = avro::memoryOutputStream();
+  avro::EncoderPtr                  e = avro::binaryEncoder();
+  e->init(*os);
+  avro::encode(*e, d);
+  e->flush();
+  std::auto_ptr<avro::InputStream> is = avro::memoryInputStream(*os);
+  std::vector<uint8_t>             v;
+  const uint8_t*                   data;
+  size_t                           len;
+  while (is->next(&data, &len))
+    v.insert(v.end(), data, data + len);
+  return v;
+}
+
+static void decode_throws(const avro::ValidSchema& schema, const std::vector<uint8_t>& message, const std::string& what, size_t max_depth = 256) {
+  csi::arena_decoder decoder(schema, max_depth);
+  csi::arena         a;
+  check_throws<avro::Exception>([&]() { decoder.decode(message, a); }, what);
+}
+
+static void decode_ok(const avro::ValidSchema& schema, const std::vector<uint8_t>& message, const std::string& what, size_t max_depth = 256) {
+  csi::arena_decoder decoder(schema, max_depth);
+  csi::arena         a;
+  try {
+    decoder.decode(message, a);
+    check(true, what);
+  } catch (const std::exception& e) {
+    check(false, what + ": " + e.what());
+  }
+}
+
+int main() {
+  avro::ValidSchema schema = avro::compileJsonSchemaFromString(all_types_schema);
+
+  avro::GenericDatum   datum(schema);
+  avro::GenericRecord& r = datum.value<avro::GenericRecord>();
+  r.fieldAt(0).value<bool>() = true;
+  r.fieldAt(1).value<int32_t>() = -42;
+  r.fieldAt(2).value<int64_t>() = 1LL << 40;
+  r.fieldAt(3).value<float>() = 1.5f;
+  r.fieldAt(4).value<double>() = -0.25;
+  r.fieldAt(5).value<std::string>() = "hello";
+  r.fieldAt(6).value<std::vector<uint8_t>>() = std::vector<uint8_t>{ 0, 1, 2 };
+  r.fieldAt(7).value<avro::GenericFixed>().value() = std::vector<uint8_t>{ 'a', 'b', 'c', 'd' };
+  r.fieldAt(8).value<avro::GenericEnum>().set(2);
+  r.fieldAt(9).selectBranch(1);
+  r.fieldAt(9).value<std::string>() = "some";
+  for (int i = 0; i != 3; ++i)
+    r.fieldAt(10).value<avro::GenericArray>().value().push_back(avro::GenericDatum(int32_t(i * 10)));
+  r.fieldAt(11).value<avro::GenericMap>().value().push_back(std::make_pair(std::string("k1"), avro::GenericDatum(int64_t(7))));
+  r.fieldAt(11).value<avro::GenericMap>().value().push_back(std::make_pair(std::string("k2"), avro::GenericDatum(int64_t(-7))));
+  r.fieldAt(12).value<avro::GenericRecord>().fieldAt(0).value<int32_t>() = 99;
+  const std::vector<uint8_t> message = avro_encode(datum);
+
+  // every type decodes to the value the GenericDatum was encoded from
+  {
+    csi::arena_decoder decoder(schema);
+    csi::arena         a(256); // small chunks so the message spans several
+    csi::arena_datum   d = decoder.decode(message, a);
+    check(d.type() == avro::AVRO_RECORD && d.size() == 13, "round trip: record");
+    check(d.field("b").value<bool>() == true, "round trip: boolean");
+    check(d.field("i").value<int32_t>() == -42, "round trip: int");
+    check(d.field("l").value<int64_t>() == 1LL << 40, "round trip: long");
+    check(d.field("f").value<float>() == 1.5f, "round trip: float");
+    check(d.field("d").value<double>() == -0.25, "round trip: double");
+    check(d.field("s").value<std::string>() == "hello", "round trip: string");
+    check(d.field("by").value<std::vector<uint8_t>>() == std::vector<uint8_t>({ 0, 1, 2 }), "round trip: bytes");
+    check(d.field("fx").value<std::vector<uint8_t>>() == std::vector<uint8_t>({ 'a', 'b', 'c', 'd' }), "round trip: fixed");
+    check(d.field("e").enum_index() == 2 && d.field("e").symbol() == "blue", "round trip: enum");
+    check(d.field("u").isUnion() && d.field("u").unionBranch() == 1 && d.field("u").value<std::string>() == "some", "round trip: union");
+    csi::arena_datum arr = d.field("a");
+    check(arr.size() == 3 && arr.at(0).value<int32_t>() == 0 && arr.at(2).value<int32_t>() == 20, "round trip: array");
+    csi::arena_datum m = d.field("m");
+    check(m.size() == 2 && std::string(reinterpret_cast<const char*>(m.key(1).data()), m.key(1).size()) == "k2" && m.at(1).value<int64_t>() == -7,
+          "round trip: map");
+    check(d.field("n").field("x").value<int32_t>() == 99, "round trip: nested record");
+    check(get_field_by_name<std::string>(d, "u") == "some", "round trip: get_field_by_name");
+    check_throws<std::bad_cast>([&]() { d.field("i").value<int64_t>(); }, "round trip: wrong type");
+
+    // reset keeps the memory for the next message
+    size_t capacity = a.capacity();
+    a.reset();
+    d = decoder.decode(message, a);
+    check(a.capacity() == capacity && d.field("s").value<std::string>() == "hello", "arena reset: reused");
+  }
+
+  // every prefix of the message is truncated, one byte more is trailing
+  {
+    bool all_throw = true;
+    csi::arena_decoder decoder(schema);
+    csi::arena         a;
+    for (size_t n = 0; n != message.size(); ++n) {
+      try {
+        decoder.decode(message.data(), n, a);
+        all_throw = false;
+      } catch (const avro::Exception&) {
+      }
+    }
+    check(all_throw, "truncated: every prefix throws");
+    std::vector<uint8_t> longer = message;
+    longer.push_back(0);
+    decode_throws(schema, longer, "trailing bytes");
+  }
+
+  // A reaches itself through an array of B
+  avro::ValidSchema recursive = avro::compileJsonSchemaFromString(
+    "{\"type\":\"record\",\"name\":\"A\",\"fields\":[{\"name\":\"a\",\"type\":{\"type\":\"array\",\"items\":"
+    "{\"type\":\"record\",\"name\":\"B\",\"fields\":[{\"name\":\"x\",\"type\":\"A\"}]}}}]}");
+  {
+    csi::arena_decoder decoder(recursive);
+    csi::arena         a;
+    csi::arena_datum   d = decoder.decode(std::vector<uint8_t>{ 0x04, 0x02, 0x00, 0x00, 0x00, 0x00 }, a);
+    check(d.field("a").size() == 2 && d.field("a").at(0).field("x").field("a").size() == 1, "recursive: nested items");
+  }
+  decode_ok(recursive, { 0x02, 0x00, 0x00 }, "recursive: one item with an empty array");
+  decode_throws(recursive, { 0x06, 0x00, 0x00 }, "recursive: count larger than the message");
+  decode_throws(recursive, { 0x02, 0x00 }, "recursive: missing end of nested array");
+
+  avro::ValidSchema deep = avro::compileJsonSchemaFromString("{\"type\":\"record\",\"name\":\"deep\",\"fields\":[{\"name\":\"d\",\"type\":[\"null\",\"deep\"]}]}");
+  decode_ok(deep, { 0x02, 0x02, 0x00 }, "below the nesting limit", 3);
+  decode_throws(deep, { 0x02, 0x02, 0x02, 0x02, 0x00 }, "nesting limit", 3);
+
+  avro::ValidSchema longs = avro::compileJsonSchemaFromString("{\"type\":\"array\",\"items\":\"long\"}");
+  decode_ok(longs, { 0x03, 0x04, 0x02, 0x04, 0x00 }, "array: negative count with block size");
+  decode_throws(longs, { 0x06, 0x02, 0x04 }, "array: block count exceeds message");
+  decode_throws(longs, { 0x01 }, "array: negative count without block size");
+  decode_throws(longs, { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01 }, "array: smallest long as block count");
+
+  avro::ValidSchema nulls = avro::compileJsonSchemaFromString("{\"type\":\"array\",\"items\":\"null\"}");
+  decode_ok(nulls, { 0x08, 0x00 }, "array of null: items take no bytes");
+  decode_throws(nulls, { 0x80, 0x80, 0x80, 0x02, 0x00 }, "array of null: more than 1M items");
+  decode_ok(nulls, { 0x80, 0x9f, 0x49, 0x00 }, "array of null: one block of 600000 items");
+  decode_throws(nulls, { 0x80, 0x9f, 0x49, 0x80, 0x9f, 0x49, 0x00 }, "array of null: more than 1M items over two blocks");
+
+  avro::ValidSchema ints = avro::compileJsonSchemaFromString("\"int\"");
+  decode_throws(ints, { 0x80, 0x80, 0x80, 0x80, 0x10 }, "int: varint overflows int");
+
+  return test_failures();
+}
@@ -0,0 +1,217 @@
+#include <stdint.h>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+#include <avro/Decoder.hh>
+#include <avro/Encoder.hh>
+#include <avro/Exception.hh>
+#include <avro/Specific.hh>
+#include <avro/Stream.hh>
+#include <csi_avro_utils/binary_codec.h>
+#include <tests/test_check.h>
+
+// a value of every kind the encoders write, in one message
+struct sample {
+  bool                           b;
+  std::vector<int32_t>           ints;
+  std::vector<int64_t>           longs;
+  std::vector<float>             floats;
+  std::vector<double>            doubles;
+  std::string                    s;
+  std::vector<uint8_t>           bytes;
+  std::map<std::string, int64_t> m;
+  size_t                         e;
+  size_t                         branch;
+};
+
+// bulk says whether the arrays go through csi::bulk or avro::encode
+static void write(avro::Encoder& e, const sample& v, bool bulk) {
+  e.encodeBool(v.b);
+  if (bulk) {
+    csi::bulk::encode(e, v.ints);
+    csi::bulk::encode(e, v.longs);
+    csi::bulk::encode(e, v.floats);
+    csi::bulk::encode(e, v.doubles);
+  } else {
+    avro::encode(e, v.ints);
+    avro::encode(e, v.longs);
+    avro::encode(e, v.floats);
+    avro::encode(e, v.doubles);
+  }
+  e.encodeString(v.s);
+  e.encodeBytes(v.bytes);
+  e.encodeFixed(v.bytes.data(), v.bytes.size());
+  avro::encode(e, v.m);
+  e.encodeEnum(v.e);
+  e.encodeUnionIndex(v.branch);
+  e.encodeNull();
+}
+
+static void read(avro::Decoder& d, sample& v, size_t fixed_size) {
+  v.b = d.decodeBool();
+  csi::bulk::decode(d, v.ints);
+  csi::bulk::decode(d, v.longs);
+  csi::bulk::decode(d, v.floats);
+  csi::bulk::decode(d, v.doubles);
+  d.decodeString(v.s);
+  d.decodeBytes(v.bytes);
+  std::vector<uint8_t> fixed;
+  d.decodeFixed(fixed_size, fixed);
+  avro::decode(d, v.m);
+  v.e = d.decodeEnum();
+  v.branch = d.decodeUnionIndex();
+  d.decodeNull();
+}
+
+static bool same(const sample& a, const sample& b) {
+  return a.b == b.b && a.ints == b.ints && a.longs == b.longs && a.floats == b.floats && a.doubles == b.doubles && a.s == b.s &&
+         a.bytes == b.bytes && a.m == b.m && a.e == b.e && a.branch == b.branch;
+}
+
+static std::vector<uint8_t> to_bytes(avro::OutputStream& os) {
+  std::auto_ptr<avro::InputStream> is = avro::memoryInputStream(os);
+  std::vector<uint8_t>             v;
+  const uint8_t*                   data;
+  size_t                           len;
+  while (is->next(&data, &len))
+    v.insert(v.end(), data, data + len);
+  return v;
+}
+
+static std::vector<uint8_t> avro_bytes(const sample& v) {
+  std::auto_ptr<avro::OutputStream> os = avro::memoryOutputStream();
+  avro::EncoderPtr                  e = avro::binaryEncoder();
+  e->init(*os);
+  write(*e, v, false);
+  e->flush();
+  return to_bytes(*os);
+}
+
+// small chunks so values and blocks are split between chunks
+static std::vector<uint8_t> csi_bytes(const sample& v, bool bulk, size_t chunk_size) {
+  std::auto_ptr<avro::OutputStream> os = avro::memoryOutputStream(chunk_size);
+  csi::binary_encoder               e;
+  e.init(*os);
+  write(e, v, bulk);
+  e.flush();
+  check(e.byteCount() == static_cast<int64_t>(os->byteCount()), "byteCount matches the stream");
+  return to_bytes(*os);
+}
+
+static sample make_sample(unsigned seed, size_t n) {
+  srand(seed);
+  sample v;
+  v.b = seed & 1;
+  // varints of every length, runs of single byte values for the vectorized decode
+  const int64_t edges[] = { 0, 1, -1, 63, -64, 64, -65, 8191, 8192, INT32_MAX, INT32_MIN, std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min() };
+  for (size_t i = 0; i != n; ++i) {
+    int64_t x = (i % 17 == 0) ? edges[(i / 17) % 13] : (rand() % 128) - 64;
+    if (i % 29 == 0)
+      x = (static_cast<int64_t>(rand()) << 31) ^ rand();
+    v.longs.push_back(x);
+    v.ints.push_back(x < INT32_MIN || x > INT32_MAX ? static_cast<int32_t>(rand() - RAND_MAX / 2) : static_cast<int32_t>(x));
+    v.floats.push_back(static_cast<float>(x) / 3);
+    v.doubles.push_back(static_cast<double>(x) / 7);
+  }
+  v.s = std::string(n % 300, 'x');
+  v.bytes.assign(n % 50, static_cast<uint8_t>(seed));
+  for (size_t i = 0; i != n % 5; ++i)
+    v.m[std::to_string(i)] = -static_cast<int64_t>(i);
+  v.e = n % 7;
+  v.branch = seed % 3;
+  return v;
+}
+
+int main() {
+  const size_t sizes[] = { 0, 1, 15, 16, 17, 100, 1000, 5000 };
+  for (size_t i = 0; i != sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    const size_t               n = sizes[i];
+    const sample               v = make_sample(static_cast<unsigned>(i + 1), n);
+    const std::vector<uint8_t> expected = avro_bytes(v);
+    const std::string          what = std::to_string(n) + " items";
+    check(csi_bytes(v, false, 4096) == expected, "encode: same bytes as avro::binaryEncoder, " + what);
+    check(csi_bytes(v, true, 4096) == expected, "bulk encode: same bytes as avro::binaryEncoder, " + what);
+    check(csi_bytes(v, true, 7) == expected, "bulk encode: 7 byte chunks, " + what);
+
+    {
+      // bulk encode falls back to avro::encode for another encoder
+      std::auto_ptr<avro::OutputStream> os = avro::memoryOutputStream();
+      avro::EncoderPtr                  e = avro::binaryEncoder();
+      e->init(*os);
+      write(*e, v, true);
+      e->flush();
+      check(to_bytes(*os) == expected, "bulk encode: avro::binaryEncoder fallback, " + what);
+    }
+
+    {
+      csi::binary_decoder d;
+      d.init(expected.data(), expected.size());
+      sample r;
+      read(d, r, v.bytes.size());
+      check(same(r, v) && d.remaining() == 0, "decode: buffer, " + what);
+    }
+
+    {
+      // several chunks, copied into one buffer by init
+      std::auto_ptr<avro::OutputStream> os = avro::memoryOutputStream(7);
+      avro::EncoderPtr                  e = avro::binaryEncoder();
+      e->init(*os);
+      write(*e, v, false);
+      e->flush();
+      std::auto_ptr<avro::InputStream> is = avro::memoryInputStream(*os);
+      csi::binary_decoder              d;
+      d.init(*is);
+      sample r;
+      read(d, r, v.bytes.size());
+      check(same(r, v), "decode: chunked stream, " + what);
+    }
+
+    {
+      // bulk decode falls back to avro::decode for another decoder
+      std::auto_ptr<avro::InputStream> is = avro::memoryInputStream(expected.data(), expected.size());
+      avro::DecoderPtr                 d = avro::binaryDecoder();
+      d->init(*is);
+      sample r;
+      read(*d, r, v.bytes.size());
+      check(same(r, v), "bulk decode: avro::binaryDecoder fallback, " + what);
+    }
+
+    if (!expected.empty()) {
+      bool all_throw = true;
+      for (size_t cut = 0; cut < expected.size(); cut += 1 + expected.size() / 200) {
+        csi::binary_decoder d;
+        d.init(expected.data(), cut);
+        sample r;
+        try {
+          read(d, r, v.bytes.size());
+          all_throw = false;
+        } catch (const avro::Exception&) {
+        }
+      }
+      check(all_throw, "decode: truncated input throws, " + what);
+    }
+  }
+
+  // arrays written in several blocks, the second with a negative count and its size in bytes
+  {
+    const std::vector<uint8_t> blocks = { 0x04, 0x02, 0x04, 0x03, 0x04, 0x06, 0x08, 0x02, 0x0a, 0x00 };
+    csi::binary_decoder        d;
+    d.init(blocks.data(), blocks.size());
+    std::vector<int64_t> v;
+    csi::bulk::decode(d, v);
+    check(v == std::vector<int64_t>({ 1, 2, 3, 4, 5 }) && d.remaining() == 0, "bulk decode: several blocks");
+  }
+
+  // values that do not fit an int
+  {
+    const std::vector<uint8_t> big = { 0x02, 0x80, 0x80, 0x80, 0x80, 0x10, 0x00 };
+    csi::binary_decoder        d;
+    d.init(big.data(), big.size());
+    std::vector<int32_t> v;
+    check_throws<avro::Exception>([&]() { csi::bulk::decode(d, v); }, "bulk decode: int out of range");
+  }
+
+  return test_failures();
+}
@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <avro/Compiler.hh>
+#include <avro/ValidSchema.hh>
+#include <csi_avro_utils/binary_validator.h>
+#include <tests/test_check.h>
+
+struct testcase {
+  const char*          what;
+  std::vector<uint8_t> message;
+  const char*          error; // 0 if valid
+};
+
+static void run(const char* schema, const std::vector<testcase>& tests, size_t max_depth = 256) {
+  csi::binary_validator validator(avro::compileJsonSchemaFromString(schema), max_depth);
+  for (auto& t : tests) {
+    csi::validation_result r = validator.validate(t.message);
+    bool ok = t.error ? (!r.ok() && std::string(r.error) == t.error) : r.ok();
+    check(ok, std::string(t.what) + (r.ok() ? "" : std::string(": ") + r.error + " @" + std::to_string(r.offset)));
+  }
+}
+
+int main() {
+  // A reaches itself through an array of B
+  run("{\"type\":\"record\",\"name\":\"A\",\"fields\":[{\"name\":\"a\",\"type\":{\"type\":\"array\",\"items\":"
+      "{\"type\":\"record\",\"name\":\"B\",\"fields\":[{\"name\":\"x\",\"type\":\"A\"}]}}}]}", {
+    { "recursive: empty array", { 0x00 }, 0 },
+    { "recursive: one item with an empty array", { 0x02, 0x00, 0x00 }, 0 },
+    { "recursive: nested items", { 0x04, 0x02, 0x00, 0x00, 0x00, 0x00 }, 0 },
+    { "recursive: missing end of nested array", { 0x02, 0x00 }, "truncated varint" },
+    { "recursive: count larger than the message", { 0x06, 0x00, 0x00 }, "block count exceeds message" },
+  });
+
+  // a linked list and a tree of two record types referring to each other
+  run("{\"type\":\"record\",\"name\":\"node\",\"fields\":[{\"name\":\"value\",\"type\":\"int\"},"
+      "{\"name\":\"next\",\"type\":[\"null\",\"node\"]}]}", {
+    { "linked list: one node", { 0x02, 0x00 }, 0 },
+    { "linked list: three nodes", { 0x02, 0x02, 0x04, 0x02, 0x06, 0x00 }, 0 },
+    { "linked list: truncated", { 0x02, 0x02, 0x04 }, "truncated varint" },
+    { "linked list: bad branch", { 0x02, 0x04 }, "union branch out of range" },
+  });
+  run("{\"type\":\"record\",\"name\":\"tree\",\"fields\":[{\"name\":\"children\",\"type\":{\"type\":\"map\",\"values\":"
+      "{\"type\":\"record\",\"name\":\"leaf\",\"fields\":[{\"name\":\"up\",\"type\":[\"null\",\"tree\"]}]}}}]}", {
+    { "mutually recursive: no children", { 0x00 }, 0 },
+    { "mutually recursive: leaf", { 0x02, 0x02, 'k', 0x00, 0x00 }, 0 },
+    { "mutually recursive: leaf with a subtree", { 0x02, 0x02, 'k', 0x02, 0x00, 0x00 }, 0 },
+    { "mutually recursive: trailing bytes", { 0x02, 0x02, 'k', 0x00, 0x00, 0x00 }, "trailing bytes" },
+  });
+  run("{\"type\":\"record\",\"name\":\"deep\",\"fields\":[{\"name\":\"d\",\"type\":[\"null\",\"deep\"]}]}", {
+    { "nesting limit", { 0x02, 0x02, 0x02, 0x02, 0x00 }, "nesting too deep" },
+    { "below the nesting limit", { 0x02, 0x02, 0x00 }, 0 },
+  }, 3);
+
+  run("{\"type\":\"array\",\"items\":\"long\"}", {
+    { "array: two blocks", { 0x02, 0x02, 0x04, 0x04, 0x06, 0x00 }, 0 },
+    { "array: truncated block", { 0x06, 0x02, 0x04 }, "block count exceeds message" },
+    { "array: truncated item", { 0x04, 0x02, 0x80 }, "truncated varint" },
+    { "array: no end of array", { 0x02, 0x02 }, "truncated varint" },
+    { "array: negative count with block size", { 0x03, 0x04, 0x02, 0x04, 0x00 }, 0 },
+    { "array: negative count, block size too small", { 0x03, 0x02, 0x02, 0x04, 0x00 }, "block size does not match its items" },
+    { "array: negative count, block size too large", { 0x03, 0x06, 0x02, 0x04, 0x00, 0x00 }, "block size does not match its items" },
+    { "array: negative block size", { 0x03, 0x03, 0x02, 0x04, 0x00 }, "block size exceeds message" },
+    { "array: block size past the end", { 0x03, 0x10, 0x02, 0x04, 0x00 }, "block size exceeds message" },
+    { "array: INT64_MIN count", { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 0x00 }, "invalid block count" },
+  });
+  run("{\"type\":\"map\",\"values\":\"int\"}", {
+    { "map: negative count with block size", { 0x01, 0x08, 0x04, 'a', 'b', 0x02, 0x00 }, 0 },
+    { "map: truncated key", { 0x02, 0x08, 'a', 'b' }, "length exceeds message" },
+    { "map: negative key length", { 0x02, 0x01, 0x00, 0x00 }, "negative length" },
+  });
+
+  // items that always encode to nothing are not walked, the count cannot be checked against the message
+  run("{\"type\":\"array\",\"items\":{\"type\":\"record\",\"name\":\"E\",\"fields\":[{\"name\":\"n\",\"type\":\"null\"}]}}", {
+    { "empty items: many", { 0x80, 0x89, 0x7a, 0x00 }, 0 },
+    { "empty items: negative count, empty block", { 0x03, 0x00, 0x00 }, 0 },
+    { "empty items: negative count, bytes in block", { 0x03, 0x02, 0x00, 0x00 }, "block size does not match its items" },
+  });
+
+  return test_failures();
+}
@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include <avro/Compiler.hh>
+#include <avro/Exception.hh>
+#include <csi_avro_utils/data_file_reader.h>
+#include <csi_avro_utils/data_file_writer.h>
+#include <csi_avro_utils/utils.h>
+#include <tests/test_check.h>
+
+static const char* path = "test-data-file.avro";
+
+static void put_long(std::string& out, int64_t v) {
+  uint64_t n = (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+  while (n & ~0x7fULL) {
+    out.push_back(static_cast<char>((n & 0x7f) | 0x80));
+    n >>= 7;
+  }
+  out.push_back(static_cast<char>(n));
+}
+
+static void put_string(std::string& out, const std::string& s) {
+  put_long(out, s.size());
+  out += s;
+}
+
+static std::string raw_deflate(const std::string& data) {
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+  std::string out(deflateBound(&zs, data.size()), '\0');
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  zs.avail_in = static_cast<uInt>(data.size());
+  zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  zs.avail_out = static_cast<uInt>(out.size());
+  deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return out;
+}
+
+// a container file of longs with one block claiming count records
+static void write_file(const std::string& codec, int64_t count, const std::string& records) {
+  const std::string sync(16, '\x5a');
+  std::string f("Obj\x01", 4);
+  put_long(f, 2);
+  put_string(f, "avro.schema");
+  put_string(f, "\"long\"");
+  put_string(f, "avro.codec");
+  put_string(f, codec);
+  put_long(f, 0);
+  f += sync;
+  const std::string data = codec == "deflate" ? raw_deflate(records) : records;
+  put_long(f, count);
+  put_string(f, data);
+  f += sync;
+  std::ofstream(path, std::ios::binary).write(f.data(), f.size());
+}
+
+static std::vector<int64_t> read_file(size_t nr_of_threads) {
+  csi::mmap_data_file  file(path);
+  std::vector<int64_t> out;
+  csi::read_data_file<int64_t>(file, nr_of_threads, [&](int64_t& v) { out.push_back(v); });
+  return out;
+}
+
+int main() {
+  const std::vector<std::string> codecs = { "null", "deflate" };
+  for (auto& codec : codecs) {
+    {
+      csi::data_file_writer_base w(path, avro::compileJsonSchemaFromString("\"long\""), codec, 2, 256);
+      for (int64_t i = 0; i != 10000; ++i) {
+        avro::encode(w.encoder(), i * i);
+        w.record_written();
+      }
+      w.close();
+    }
+    csi::mmap_data_file file(path);
+    check(file.records() == 10000 && file.blocks().size() > 1, codec + ": writer splits the records into blocks");
+    bool full = true;
+    for (size_t i = 0; codec == "null" && i + 1 < file.blocks().size(); ++i)
+      full = full && file.blocks()[i].size >= 256 && file.blocks()[i].size <= 256 + 10;
+    check(full, codec + ": blocks are shipped once they reach the block size");
+    std::vector<int64_t> read = read_file(3);
+    bool same = read.size() == 10000;
+    for (size_t i = 0; same && i != read.size(); ++i)
+      same = read[i] == static_cast<int64_t>(i * i);
+    check(same, codec + ": records read back in order");
+
+    std::string records;
+    put_long(records, 1000);
+    put_long(records, 2000);
+    write_file(codec, 2, records);
+    check(read_file(1) == std::vector<int64_t>({ 1000, 2000 }), codec + ": hand written block");
+    write_file(codec, 1000000000, records);
+    check_throws<avro::Exception>([]() { read_file(1); }, codec + ": block count larger than the block");
+    write_file(codec, 3, records);
+    check_throws<avro::Exception>([]() { read_file(1); }, codec + ": block count larger than the records in it");
+    write_file(codec, 1, records);
+    check_throws<avro::Exception>([]() { read_file(1); }, codec + ": block count smaller than the records in it");
+    write_file(codec, 2, records + std::string("\x01\x02", 2));
+    check_throws<avro::Exception>([]() { read_file(2); }, codec + ": garbage after the records");
+  }
+
+  // null records take no bytes, any count fits
+  {
+    csi::data_file_writer_base w(path, avro::compileJsonSchemaFromString("\"null\""), "null", 1, 256);
+    for (int i = 0; i != 100; ++i) {
+      w.encoder().encodeNull();
+      w.record_written();
+    }
+    w.close();
+    size_t n = 0;
+    csi::mmap_data_file file(path);
+    csi::read_data_file<avro::GenericDatum>(file, 1, [&](avro::GenericDatum&) { ++n; });
+    check(n == 100, "null records");
+  }
+
+  // avro.schema is the schema as written, normalize() would also strip whitespace inside docs and defaults
+  {
+    avro::ValidSchema schema = avro::compileJsonSchemaFromString("{\"type\": \"record\", \"name\": \"r\", \"fields\": [{\"name\": \"s\", \"type\": \"string\", \"default\": \"a b\"}]}");
+    {
+      csi::data_file_writer_base w(path, schema, "null", 1, 256);
+      w.close();
+    }
+    csi::mmap_data_file file(path);
+    const std::vector<uint8_t>& v = file.metadata().at("avro.schema");
+    check(std::string(v.begin(), v.end()) == to_string(schema), "avro.schema is written with to_string");
+  }
+  return test_failures();
+}
@@ -0,0 +1,108 @@
+#include <stdint.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <avro/Compiler.hh>
+#include <csi_avro_utils/binary_validator.h>
+#include <csi_avro_utils/data_generator.h>
+#include <tests/test_check.h>
+
+static const char* every_type =
+  "{\"type\":\"record\",\"name\":\"csi_test.every_type\",\"fields\":["
+  "{\"name\":\"b\",\"type\":\"boolean\"},{\"name\":\"i\",\"type\":\"int\"},{\"name\":\"l\",\"type\":\"long\"},"
+  "{\"name\":\"f\",\"type\":\"float\"},{\"name\":\"d\",\"type\":\"double\"},{\"name\":\"s\",\"type\":\"string\"},"
+  "{\"name\":\"raw\",\"type\":\"bytes\"},{\"name\":\"id\",\"type\":{\"type\":\"fixed\",\"name\":\"pair\",\"size\":2}},"
+  "{\"name\":\"shade\",\"type\":{\"type\":\"enum\",\"name\":\"color\",\"symbols\":[\"red\",\"green\",\"blue\"]}},"
+  "{\"name\":\"nums\",\"type\":{\"type\":\"array\",\"items\":\"long\"}},"
+  "{\"name\":\"labels\",\"type\":{\"type\":\"map\",\"values\":\"string\"}},"
+  "{\"name\":\"note\",\"type\":[\"null\",\"string\",\"int\"]},"
+  "{\"name\":\"pos\",\"type\":{\"type\":\"record\",\"name\":\"point\",\"fields\":[{\"name\":\"x\",\"type\":\"int\"},{\"name\":\"y\",\"type\":\"double\"}]}}]}";
+
+static const char* list =
+  "{\"type\":\"record\",\"name\":\"csi_test.node\",\"fields\":[{\"name\":\"value\",\"type\":\"int\"},{\"name\":\"next\",\"type\":[\"null\",\"node\"]}]}";
+
+// n messages one after the other
+static std::vector<std::vector<uint8_t> > generate(const avro::ValidSchema& schema, const csi::generator_config& config, size_t n) {
+  csi::data_generator                  g(schema, config);
+  std::vector<std::vector<uint8_t> > out(n);
+  for (auto& m : out)
+    g.generate(m);
+  return out;
+}
+
+static bool all_valid(const avro::ValidSchema& schema, const std::vector<std::vector<uint8_t> >& messages) {
+  csi::binary_validator v(schema);
+  bool                  ok = true;
+  for (auto& m : messages)
+    ok = ok && v.validate(m).ok();
+  return ok;
+}
+
+int main() {
+  const avro::ValidSchema schema = avro::compileJsonSchemaFromString(every_type);
+
+  {
+    csi::generator_config config;
+    config.seed = 42;
+    std::vector<std::vector<uint8_t> > a = generate(schema, config, 100);
+    check(a == generate(schema, config, 100), "same seed, same bytes");
+    config.seed = 43;
+    check(a != generate(schema, config, 100), "different seed, different bytes");
+
+    csi::data_generator g(schema, config);
+    std::vector<uint8_t> m;
+    g.generate(m);
+    g.reseed(42);
+    std::vector<uint8_t> again;
+    g.generate(again);
+    check(again == a[0], "reseed starts over");
+  }
+
+  {
+    csi::generator_config config;
+    check(all_valid(schema, generate(schema, config, 1000)), "default config: every message valid");
+    config.string_length = csi::size_distribution::fixed(0);
+    config.bytes_length = csi::size_distribution::geometric(1, 100, 1000);
+    config.array_size = csi::size_distribution::uniform(0, 200);
+    config.map_size = csi::size_distribution::fixed(3);
+    config.min_number = -1000000000000LL;
+    config.max_number = 1000000000000LL;
+    config.null_probability = 0.9;
+    check(all_valid(schema, generate(schema, config, 1000)), "other sizes and numbers: every message valid");
+    config.branch_weights["csi_test.every_type.note"] = { 0, 0, 1 };
+    std::vector<std::vector<uint8_t> > ints = generate(schema, config, 100);
+    check(all_valid(schema, ints), "branch weights: every message valid");
+  }
+
+  // the union always takes the recursive branch, max_depth ends the list
+  {
+    const avro::ValidSchema recursive = avro::compileJsonSchemaFromString(list);
+    csi::generator_config   config;
+    config.branch_weights["csi_test.node.next"] = { 0, 1 };
+    config.max_depth = 5;
+    std::vector<std::vector<uint8_t> > shallow = generate(recursive, config, 100);
+    config.max_depth = 50;
+    std::vector<std::vector<uint8_t> > deep = generate(recursive, config, 100);
+    bool bounded = true;
+    for (size_t i = 0; i != shallow.size(); ++i)
+      bounded = bounded && shallow[i].size() < deep[i].size() && deep[i].size() <= 51 * 6;
+    check(bounded, "max_depth: recursive schema terminates");
+    check(all_valid(recursive, shallow) && all_valid(recursive, deep), "max_depth: every message valid");
+  }
+
+  {
+    const char* what[] = { "branch weights: field not in the schema", "branch weights: wrong number of branches",
+                           "branch weights: field that is not a union", "branch weights: negative",
+                           "branch weights: add up to 0" };
+    std::vector<std::pair<std::string, std::vector<double> > > bad = {
+      { "csi_test.every_type.missing", { 1, 1, 1 } }, { "csi_test.every_type.note", { 1, 1 } },
+      { "csi_test.every_type.s", { 1 } },             { "csi_test.every_type.note", { 1, -1, 1 } },
+      { "csi_test.every_type.note", { 0, 0, 0 } } };
+    for (size_t i = 0; i != bad.size(); ++i) {
+      csi::generator_config config;
+      config.branch_weights[bad[i].first] = bad[i].second;
+      check_throws<std::domain_error>([&]() { csi::data_generator g(schema, config); }, what[i]);
+    }
+  }
+  return test_failures();
+}
@@ -0,0 +1,171 @@
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/make_shared.hpp>
+#include <avro/Compiler.hh>
+#include <avro/Exception.hh>
+#include <avro/Specific.hh>
+#include <csi_avro_utils/binary_codec.h>
+#include <csi_avro_utils/envelope.h>
+#include <csi_avro_utils/schema_store.h>
+#include <csi_avro_utils/utils.h>
+#include <tests/test_check.h>
+
+static const char* point_schema = "{\"type\":\"record\",\"name\":\"point\",\"fields\":[{\"name\":\"x\",\"type\":\"int\"},{\"name\":\"s\",\"type\":\"string\"}]}";
+static const char* other_schema = "{\"type\":\"record\",\"name\":\"other\",\"fields\":[{\"name\":\"y\",\"type\":\"long\"}]}";
+
+// what csi_avrogencpp generates, as far as envelope_codec uses it
+struct point {
+  int32_t     x;
+  std::string s;
+
+  static const boost::uuids::uuid schema_hash() {
+    static const boost::uuids::uuid hash = generate_hash(avro::compileJsonSchemaFromString(point_schema));
+    return hash;
+  }
+};
+
+namespace avro {
+  template<> struct codec_traits<point> {
+    static void encode(Encoder& e, const point& v) {
+      avro::encode(e, v.x);
+      avro::encode(e, v.s);
+    }
+    static void decode(Decoder& d, point& v) {
+      avro::decode(d, v.x);
+      avro::decode(d, v.s);
+    }
+  };
+};
+
+static csi::envelope_codec::schema_ptr compile(const char* json) {
+  return boost::make_shared<const avro::ValidSchema>(avro::compileJsonSchemaFromString(json));
+}
+
+// n bytes already in the stream, ie messages written back to back
+static void fill(csi::pooled_output_stream& os, size_t n) {
+  while (n) {
+    uint8_t* p;
+    size_t   len;
+    os.next(&p, &len);
+    size_t k = std::min(len, n);
+    memset(p, 'x', k);
+    os.backup(len - k);
+    n -= k;
+  }
+}
+
+int main() {
+  const csi::envelope_codec::schema_ptr point_ptr = compile(point_schema);
+  const csi::envelope_codec::schema_ptr other_ptr = compile(other_schema);
+  const boost::uuids::uuid              point_hash = point::schema_hash();
+  const size_t                          chunk = csi::pooled_output_stream::chunk_size;
+
+  csi::envelope_codec hashed(csi::HASH_ENVELOPE);
+  hashed.add(point_ptr);
+  csi::envelope_codec confluent(csi::CONFLUENT_ENVELOPE);
+  confluent.add(42, point_ptr);
+  confluent.add(7, other_ptr);
+  check(hashed.size() == 1 && confluent.size() == 2, "schemas added");
+  check_throws<avro::Exception>([&]() { hashed.add(7, other_ptr); }, "hash envelopes take no schema id");
+  check_throws<avro::Exception>([&]() { confluent.add(other_ptr); }, "confluent envelopes need a schema id");
+
+  // headers after what the stream already holds, up to and across the end of the first chunk
+  const size_t offsets[] = { 0, 1, chunk - 16, chunk - 5, chunk - 4, chunk - 1, chunk, chunk + 100 };
+  for (size_t i = 0; i != sizeof(offsets) / sizeof(offsets[0]); ++i) {
+    const size_t              at = offsets[i];
+    csi::pooled_output_stream os;
+    fill(os, at);
+    hashed.write_header(os, point_hash);
+    std::string s = os.str();
+    check(s.size() == at + csi::hash_header_size && s.compare(0, at, std::string(at, 'x')) == 0 &&
+              memcmp(s.data() + at, point_hash.data, csi::hash_header_size) == 0,
+          "hash header after " + std::to_string(at) + " bytes");
+
+    os.reset();
+    fill(os, at);
+    confluent.write_header(os, point_hash);
+    s = os.str();
+    check(s.size() == at + csi::confluent_header_size && s.compare(at, 5, std::string("\0\0\0\0\x2a", 5)) == 0,
+          "confluent header after " + std::to_string(at) + " bytes");
+  }
+  {
+    csi::pooled_output_stream os;
+    fill(os, 10);
+    check_throws<avro::Exception>([&]() { confluent.write_header(os, generate_hash(avro::compileJsonSchemaFromString("\"int\""))); },
+                                  "confluent header for a schema without an id");
+    check(os.size() == 10, "stream left as it was");
+  }
+
+  // encode, parse and decode, for both formats
+  point v;
+  v.x = -3;
+  v.s = std::string(5000, 's'); // the body spans chunks
+  csi::binary_encoder e;
+  csi::binary_decoder d;
+  for (int f = 0; f != 2; ++f) {
+    const csi::envelope_codec& codec = f ? confluent : hashed;
+    const std::string          what = f ? "confluent: " : "hash: ";
+    csi::pooled_output_stream  os;
+    codec.encode(os, e, v);
+    std::vector<uint8_t> message;
+    os.append_to(message);
+    csi::envelope env = codec.parse(message.data(), message.size());
+    check(env.schema == point_ptr.get() && env.hash == point_hash && env.schema_id == (f ? 42 : -1) && env.error == 0, what + "parse");
+    check(env.body == message.data() + codec.header_size() && env.body_size == message.size() - codec.header_size(), what + "body in place");
+    point r;
+    codec.decode(env, d, r);
+    check(r.x == v.x && r.s == v.s, what + "decode");
+    check_throws<avro::Exception>([&]() { codec.parse(message.data(), codec.header_size() - 1); }, what + "shorter than the header");
+  }
+
+  // parse errors
+  {
+    const uint8_t no_magic[] = { 1, 0, 0, 0, 42, 0 };
+    const uint8_t unknown_id[] = { 0, 0, 0, 0, 43, 0 };
+    check_throws<avro::Exception>([&]() { confluent.parse(no_magic, sizeof(no_magic)); }, "confluent: no magic byte");
+    check_throws<avro::Exception>([&]() { confluent.parse(unknown_id, sizeof(unknown_id)); }, "confluent: unknown id");
+    uint8_t unknown_hash[20] = { 0 };
+    check_throws<avro::Exception>([&]() { hashed.parse(unknown_hash, sizeof(unknown_hash)); }, "hash: unknown schema");
+    csi::envelope env;
+    env.hash = generate_hash(*other_ptr);
+    check_throws<avro::Exception>([&]() { point r; hashed.decode(env, d, r); }, "decode into another type than the writer's");
+  }
+
+  // hashes not added are looked up in the store
+  {
+    csi::schema_store store;
+    store.intern(other_schema);
+    csi::envelope_codec from_store(csi::HASH_ENVELOPE, &store);
+    uint8_t             message[17];
+    boost::uuids::uuid  other_hash = generate_hash(*other_ptr);
+    memcpy(message, other_hash.data, 16);
+    message[16] = 0;
+    csi::envelope env = from_store.parse(message, sizeof(message));
+    check(env.schema && env.schema->root()->name().simpleName() == "other" && env.body_size == 1, "hash: writer schema from the store");
+  }
+
+  // a batch with runs of the same writer and messages that fail
+  {
+    std::vector<std::vector<uint8_t> > messages;
+    const int32_t                      ids[] = { 42, 42, 7, -1, 7, 99, 42 };
+    for (int32_t id : ids) {
+      std::vector<uint8_t> m = { 0, 0, 0, 0, static_cast<uint8_t>(id), 0x02 };
+      if (id < 0)
+        m.resize(3);
+      messages.push_back(m);
+    }
+    std::vector<std::pair<const uint8_t*, size_t> > batch;
+    for (auto& m : messages)
+      batch.push_back(std::make_pair(m.data(), m.size()));
+    std::vector<csi::envelope> out;
+    check(confluent.parse_batch(batch, out) == 5 && out.size() == 7, "batch: parsed count");
+    check(out[0].schema == point_ptr.get() && out[1].schema == point_ptr.get() && out[2].schema == other_ptr.get() &&
+              out[4].schema == other_ptr.get() && out[6].schema == point_ptr.get(), "batch: writer schemas");
+    check(out[3].schema == 0 && out[3].error && out[5].schema == 0 && std::string(out[5].error) == "unknown writer schema", "batch: failed messages");
+    check(out[6].schema_id == 42 && out[6].body == messages[6].data() + 5 && out[6].body_size == 1, "batch: body after a failed message");
+  }
+
+  return test_failures();
+}
@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <avro/Compiler.hh>
+#include <avro/Encoder.hh>
+#include <avro/Generic.hh>
+#include <avro/Stream.hh>
+#include <avro/ValidSchema.hh>
+#include <csi_avro_utils/arena_decoder.h>
+#include <csi_avro_utils/hive_schema.h>
+#include <csi_avro_utils/utils.h>
+#include <tests/test_check.h>
+
+// name has null first, score null last, kind no null and tag null in the middle
+static const char* value_schema_json =
+  "{\"type\":\"record\",\"name\":\"row\",\"namespace\":\"test\",\"fields\":["
+  "{\"name\":\"id\",\"type\":\"long\"},"
+  "{\"name\":\"name\",\"type\":[\"null\",\"string\"]},"
+  "{\"name\":\"score\",\"type\":[\"double\",\"null\"]},"
+  "{\"name\":\"kind\",\"type\":[\"int\",\"string\"]},"
+  "{\"name\":\"tag\",\"type\":[\"int\",\"null\",\"string\"]}]}";
+
+static avro::GenericDatum make_row(const avro::ValidSchema& schema, int64_t id, const char* name, const double* score) {
+  avro::GenericDatum   d(schema);
+  avro::GenericRecord& r = d.value<avro::GenericRecord>();
+  r.fieldAt(0).value<int64_t>() = id;
+  r.fieldAt(1).selectBranch(name ? 1 : 0);
+  if (name)
+    r.fieldAt(1).value<std::string>() = name;
+  r.fieldAt(2).selectBranch(score ? 0 : 1);
+  if (score)
+    r.fieldAt(2).value<double>() = *score;
+  r.fieldAt(3).selectBranch(1);
+  r.fieldAt(3).value<std::string>() = "k";
+  r.fieldAt(4).selectBranch(id % 2 ? 1 : 2);
+  if (!(id % 2))
+    r.fieldAt(4).value<std::string>() = "t";
+  return d;
+}
+
+static std::string avro_encode(const avro::GenericDatum& d) {
+  std::auto_ptr<avro::OutputStream> os = avro::memoryOutputStream();
+  avro::EncoderPtr                  e = avro::binaryEncoder();
+  e->init(*os);
+  avro::encode(*e, d);
+  e->flush();
+  return to_string(*os);
+}
+
+int main() {
+  const avro::ValidSchema        value_schema(avro::compileJsonSchemaFromString(value_schema_json));
+  const std::vector<std::string> keys = { "id", "name", "score" };
+  const double                   score = 2.5;
+
+  // get_key used to crash on union value columns: type() looks through the union so the union check never matched
+  {
+    auto key_schema = csi::avro_hive::get_key_schema(avro::Name("test.row_key"), keys, false, value_schema);
+    avro::GenericDatum row = make_row(value_schema, 7, "seven", &score);
+    auto key = csi::avro_hive::get_key(row, *key_schema);
+    const avro::GenericRecord& k = key->value<avro::GenericRecord>();
+    check(!k.fieldAt(1).isUnion() && k.fieldAt(1).value<std::string>() == "seven", "strict key: string from [null, string]");
+    check(!k.fieldAt(2).isUnion() && k.fieldAt(2).value<double>() == 2.5, "strict key: double from [double, null]");
+    check(k.fieldAt(0).value<int64_t>() == 7, "strict key: long");
+
+    avro::GenericDatum null_row = make_row(value_schema, 7, 0, &score);
+    check_throws<std::domain_error>([&]() { csi::avro_hive::get_key(null_row, *key_schema); }, "strict key: null value throws");
+  }
+
+  {
+    auto key_schema = csi::avro_hive::get_key_schema(avro::Name("test.row_key"), keys, true, value_schema);
+    avro::GenericDatum row = make_row(value_schema, 8, "eight", 0);
+    auto key = csi::avro_hive::get_key(row, *key_schema);
+    const avro::GenericRecord& k = key->value<avro::GenericRecord>();
+    check(k.fieldAt(1).unionBranch() == 1 && k.fieldAt(1).value<std::string>() == "eight", "nullable key: set string");
+    check(k.fieldAt(2).unionBranch() == 0, "nullable key: null from [double, null] is branch 0");
+
+    avro::GenericDatum other = make_row(value_schema, 9, 0, &score);
+    key = csi::avro_hive::get_key(other, *key_schema);
+    const avro::GenericRecord& k2 = key->value<avro::GenericRecord>();
+    check(k2.fieldAt(1).unionBranch() == 0, "nullable key: null string");
+    check(k2.fieldAt(2).unionBranch() == 1 && k2.fieldAt(2).value<double>() == 2.5, "nullable key: double from [double, null] is branch 1");
+  }
+
+  // the branch each kind of source column ends up on in the value record
+  {
+    csi::avro_hive::hive_row_converter converter(value_schema, std::vector<std::string>(1, "id"), false, avro::Name("test.row_key"), avro::Name("test.row_value"));
+    const avro::NodePtr& v = converter.value_schema()->root();
+    check(v->leaves() == 4 && v->leafAt(0)->leaves() == 2 && v->leafAt(1)->leaves() == 2 && v->leafAt(1)->leafAt(0)->type() == avro::AVRO_NULL,
+          "value schema: [null, string] and [double, null] become [null, T]");
+    check(v->leafAt(2)->leaves() == 3 && v->leafAt(2)->leafAt(0)->type() == avro::AVRO_NULL, "value schema: null added in front of [int, string]");
+    check(v->leafAt(3)->leaves() == 3 && v->leafAt(3)->leafAt(1)->type() == avro::AVRO_NULL, "value schema: [int, null, string] kept as is");
+
+    avro::GenericDatum key(*converter.key_schema());
+    avro::GenericDatum value(*converter.value_schema());
+    converter.convert(make_row(value_schema, 3, 0, &score), key, value);
+    const avro::GenericRecord& r = value.value<avro::GenericRecord>();
+    check(key.value<avro::GenericRecord>().fieldAt(0).value<int64_t>() == 3, "convert: key");
+    check(r.fieldAt(0).unionBranch() == 0, "convert: null name");
+    check(r.fieldAt(1).unionBranch() == 1 && r.fieldAt(1).value<double>() == 2.5, "convert: score from [double, null]");
+    check(r.fieldAt(2).unionBranch() == 2 && r.fieldAt(2).value<std::string>() == "k", "convert: kind shifted by the added null");
+    check(r.fieldAt(3).unionBranch() == 1, "convert: null tag stays in the middle");
+    converter.convert(make_row(value_schema, 4, "four", 0), key, value);
+    check(r.fieldAt(0).unionBranch() == 1 && r.fieldAt(1).unionBranch() == 0 && r.fieldAt(3).unionBranch() == 2 && r.fieldAt(3).value<std::string>() == "t",
+          "convert: the same datums reused for the next row");
+  }
+
+  // get_key from an arena decoded row gives the same key as from the GenericDatum
+  {
+    csi::arena_decoder decoder(value_schema);
+    csi::arena         a;
+    for (int allow_null = 0; allow_null != 2; ++allow_null) {
+      auto key_schema = csi::avro_hive::get_key_schema(avro::Name("test.row_key"), keys, allow_null != 0, value_schema);
+      avro::GenericDatum row = make_row(value_schema, 5, "five", &score);
+      const std::string encoded = avro_encode(row);
+      csi::arena_datum decoded = decoder.decode(reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size(), a);
+      check(avro_encode(*csi::avro_hive::get_key(decoded, *key_schema)) == avro_encode(*csi::avro_hive::get_key(row, *key_schema)),
+            allow_null ? "arena get_key: nullable key" : "arena get_key: strict key");
+    }
+  }
+
+  return test_failures();
+}
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <avro/Decoder.hh>
+#include <avro/Encoder.hh>
+#include <avro/Exception.hh>
+#include <avro/Specific.hh>
+#include <avro/Stream.hh>
+#include <csi_avro_utils/logical_types.h>
+#include <tests/test_check.h>
+
+template<class T> static std::vector<uint8_t> encode(const T& v) {
+  std::auto_ptr<avro::OutputStream> os = avro::memoryOutputStream();
+  avro::EncoderPtr                  e = avro::binaryEncoder();
+  e->init(*os);
+  avro::encode(*e, v);
+  e->flush();
+  std::auto_ptr<avro::InputStream> is = avro::memoryInputStream(*os);
+  std::vector<uint8_t>             bytes;
+  const uint8_t*                   data;
+  size_t                           len;
+  while (is->next(&data, &len))
+    bytes.insert(bytes.end(), data, data + len);
+  return bytes;
+}
+
+template<class T> static T decode(const std::vector<uint8_t>& bytes) {
+  std::auto_ptr<avro::InputStream> is = avro::memoryInputStream(bytes.data(), bytes.size());
+  avro::DecoderPtr                 d = avro::binaryDecoder();
+  d->init(*is);
+  T v;
+  avro::decode(*d, v);
+  return v;
+}
+
+static std::vector<uint8_t> encode_string(const std::string& s) {
+  return encode(s);
+}
+
+int main() {
+  const std::string text = "123e4567-e89b-12d3-a456-426614174000";
+  csi::uuid         u;
+  check(u.is_nil(), "uuid: nil by default");
+  check(csi::logical::parse_uuid(text.data(), text.size(), u) && !u.is_nil(), "uuid: parse");
+  check(encode(u) == encode_string(text), "uuid: encoded as its 36 characters");
+  check(decode<csi::uuid>(encode(u)) == u, "uuid: round trip");
+  check(decode<csi::uuid>(encode_string("123E4567-E89B-12D3-A456-426614174000")) == u, "uuid: upper case hex");
+  check_throws<avro::Exception>([]() { decode<csi::uuid>(encode_string("123e4567e89b12d3a456426614174000")); }, "uuid: no dashes");
+  check_throws<avro::Exception>([]() { decode<csi::uuid>(encode_string("123e4567-e89b-12d3-a456-42661417400g")); }, "uuid: not hex");
+  boost::uuids::uuid plain = u;
+  check(csi::uuid(plain) == u, "uuid: from boost::uuids::uuid");
+
+  // bytes: shortest two's complement, fixed: sign extended to the fixed size
+  check(encode(csi::decimal64<2>(12345)) == std::vector<uint8_t>({ 0x04, 0x30, 0x39 }), "decimal64: bytes");
+  check(encode(csi::decimal64<2>(-1)) == std::vector<uint8_t>({ 0x02, 0xff }), "decimal64: negative bytes");
+  check(encode(csi::decimal64<2, 4>(-2)) == std::vector<uint8_t>({ 0xff, 0xff, 0xff, 0xfe }), "decimal64: fixed");
+  check(decode<csi::decimal64<2> >(encode(csi::decimal64<2>(-12345))).to_string() == "-123.45", "decimal64: round trip");
+  check(decode<csi::decimal128<4, 20> >(encode(csi::decimal128<4, 20>(-5, 1))) == csi::decimal128<4, 20>(-5, 1), "decimal128: fixed larger than 16");
+  check(csi::decimal128<3>(-7).to_string() == "-0.007", "decimal128: to_string");
+  check_throws<avro::Exception>([]() { encode(csi::decimal64<0, 1>(1000)); }, "decimal: does not fit in fixed");
+  check_throws<avro::Exception>([]() { decode<csi::decimal64<0> >(std::vector<uint8_t>({ 0x12, 0x01, 0, 0, 0, 0, 0, 0, 0, 0 })); }, "decimal64: out of range");
+
+  csi::timestamp_millis ts(std::chrono::milliseconds(1500000000123LL));
+  check(decode<csi::timestamp_millis>(encode(ts)) == ts, "timestamp-millis: round trip");
+  csi::date day(csi::days(-3));
+  check(encode(day) == std::vector<uint8_t>({ 0x05 }) && decode<csi::date>(encode(day)) == day, "date: days since epoch as int");
+
+  return test_failures();
+}
@@ -0,0 +1,59 @@
+#include <string>
+#include "order_record.h"
+#include <tests/test_check.h>
+
+static csi_test::order_record make_record() {
+  csi_test::order_record r;
+  r.id = 1;
+  r.name = "m";
+  r.seen = 10;
+  csi_test::part p;
+  p.size = 5;
+  p.label = "p";
+  r.parts.push_back(p);
+  csi_test::note n;
+  n.text = "t";
+  n.rank = 3;
+  r.extra.set_note(n);
+  return r;
+}
+
+int main() {
+  const csi_test::order_record a = make_record();
+
+  {
+    csi_test::order_record b = a;
+    b.id = 2;
+    check(a < b && !(b < a), "ascending field");
+  }
+  {
+    csi_test::order_record b = a;
+    b.name = "z";
+    check(b < a && !(a < b), "descending field compares reversed");
+  }
+  {
+    csi_test::order_record b = a;
+    b.seen = 11;
+    check(!(a < b) && !(b < a), "ignored field is not compared");
+    check(a != b, "ignored field still counts for operator==");
+  }
+  {
+    csi_test::order_record b = a;
+    b.parts[0].size = 6;
+    check(b < a && !(a < b), "descending field of an array item record");
+    b = a;
+    b.parts[0].label = "q";
+    check(a < b && !(b < a), "ascending field of an array item record");
+  }
+  {
+    csi_test::order_record b = a;
+    csi_test::note n = a.extra.get_note();
+    n.text = "u";
+    b.extra.set_note(n);
+    check(!(a < b) && !(b < a), "ignored field of a union branch record");
+    n.rank = 4;
+    b.extra.set_note(n);
+    check(a < b && !(b < a), "ascending field of a union branch record");
+  }
+  return test_failures();
+}
@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <avro/Compiler.hh>
+#include <avro/Exception.hh>
+#include <csi_avro_utils/parallel_decoder.h>
+#include <tests/test_check.h>
+
+static const avro::ValidSchema schema = avro::compileJsonSchemaFromString("\"string\"");
+
+static void put_long(std::vector<uint8_t>& out, int64_t v) {
+  uint64_t n = (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+  while (n & ~0x7fULL) {
+    out.push_back(static_cast<uint8_t>((n & 0x7f) | 0x80));
+    n >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(n));
+}
+
+// message i is a string of i % 7 * 1000 bytes, so some take far longer than their neighbours
+static std::string value(size_t i) {
+  return std::to_string(i) + std::string(i % 7 * 1000, 'x');
+}
+
+static std::vector<uint8_t> message(size_t i) {
+  const std::string  v = value(i);
+  std::vector<uint8_t> m;
+  put_long(m, v.size());
+  m.insert(m.end(), v.begin(), v.end());
+  return m;
+}
+
+// says it is 100 bytes long but has one
+static const std::vector<uint8_t> bad = { 0xc8, 0x01, 'a' };
+
+static bool in_order(const std::vector<std::string>& got, size_t n) {
+  bool same = got.size() == n;
+  for (size_t i = 0; same && i != n; ++i)
+    same = got[i] == value(i);
+  return same;
+}
+
+int main() {
+  for (size_t threads = 1; threads != 5; ++threads) {
+    const std::string what = std::to_string(threads) + " threads: ";
+
+    {
+      std::vector<std::string>          got;
+      csi::parallel_decoder<std::string> d(schema, threads, [&](std::string& v) { got.push_back(v); }, 4);
+      for (size_t i = 0; i != 1000; ++i)
+        d.push(message(i));
+      d.flush();
+      check(in_order(got, 1000) && d.delivered() == 1000, what + "delivered in push order");
+    }
+
+    // the messages before the bad one are delivered, the error stays until the decoder is gone
+    {
+      std::vector<std::string>          got;
+      csi::parallel_decoder<std::string> d(schema, threads, [&](std::string& v) { got.push_back(v); }, 8);
+      for (size_t i = 0; i != 50; ++i)
+        d.push(message(i));
+      d.push(bad);
+      check_throws<avro::Exception>([&]() {
+        for (size_t i = 51; i != 60; ++i)
+          d.push(message(i));
+        d.flush();
+      }, what + "bad message: rethrown by push() or flush()");
+      check(in_order(got, 50), what + "bad message: the messages before it are delivered");
+      check_throws<avro::Exception>([&]() { d.flush(); }, what + "bad message: flush() rethrows again");
+      check_throws<avro::Exception>([&]() { d.push(message(0)); }, what + "bad message: next push() rethrows");
+    }
+
+    {
+      std::vector<std::string>          got;
+      csi::parallel_decoder<std::string> d(schema, threads, [&](std::string& v) {
+        if (got.size() == 20)
+          throw std::runtime_error("callback");
+        got.push_back(v);
+      }, 8);
+      check_throws<std::runtime_error>([&]() {
+        for (size_t i = 0; i != 100; ++i)
+          d.push(message(i));
+        d.flush();
+      }, what + "throwing callback: rethrown by push() or flush()");
+      check(in_order(got, 20), what + "throwing callback: no message after it is delivered");
+    }
+
+    // queued messages are still decoded and delivered by the destructor
+    {
+      std::vector<std::string> got;
+      {
+        csi::parallel_decoder<std::string> d(schema, threads, [&](std::string& v) { got.push_back(v); }, 64);
+        for (size_t i = 0; i != 64; ++i)
+          d.push(message(i));
+      }
+      check(in_order(got, 64), what + "destroyed with work queued");
+    }
+  }
+  return test_failures();
+}
@@ -0,0 +1,94 @@
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <avro/Compiler.hh>
+#include <avro/Encoder.hh>
+#include <avro/Generic.hh>
+#include <avro/Stream.hh>
+#include <csi_avro_utils/hive_schema.h>
+#include <csi_avro_utils/partitioner.h>
+#include <csi_avro_utils/utils.h>
+#include <tests/test_check.h>
+
+struct murmur_case {
+  const char* key;
+  int32_t     hash;
+};
+
+// org.apache.kafka.common.utils.UtilsTest.testMurmur2
+static const murmur_case murmur_cases[] = {
+  { "21", -973932308 },
+  { "foobar", -790332482 },
+  { "a-little-bit-long-string", -985981536 },
+  { "a-little-bit-longer-string", -1486304829 },
+  { "lkjh234lh9fiuh90y23oiuhsafujhadof229phr9h19h89h8", -58897971 },
+  { "abc", 479470107 },
+};
+
+static const char* value_schema_json =
+  "{\"type\":\"record\",\"name\":\"row\",\"fields\":["
+  "{\"name\":\"id\",\"type\":\"long\"},"
+  "{\"name\":\"name\",\"type\":[\"null\",\"string\"]},"
+  "{\"name\":\"ratio\",\"type\":\"double\"},"
+  "{\"name\":\"color\",\"type\":{\"type\":\"enum\",\"name\":\"color\",\"symbols\":[\"RED\",\"GREEN\"]}}]}";
+
+static std::vector<uint8_t> avro_encode(const avro::GenericDatum& d) {
+  std::auto_ptr<avro::OutputStream> os = avro::memoryOutputStream();
+  avro::EncoderPtr                  e = avro::binaryEncoder();
+  e->init(*os);
+  avro::encode(*e, d);
+  e->flush();
+  std::string s = to_string(*os);
+  return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+int main() {
+  for (auto& c : murmur_cases) {
+    int32_t h = csi::kafka_murmur2(reinterpret_cast<const uint8_t*>(c.key), strlen(c.key));
+    check(h == c.hash, std::string("kafka_murmur2 ") + c.key + ": " + std::to_string(h));
+  }
+
+  // toPositive masks the sign bit, abs() would give another partition for negative hashes
+  const uint8_t* foobar = reinterpret_cast<const uint8_t*>("foobar");
+  check(csi::kafka_partition(foobar, 6, 10) == (-790332482 & 0x7fffffff) % 10, "kafka_partition of a negative hash");
+  check(csi::kafka_partition(foobar, 6, 1) == 0, "kafka_partition with one partition");
+  check_throws<std::domain_error>([&]() { csi::kafka_partition(foobar, 6, 0); }, "kafka_partition with 0 partitions throws");
+  check_throws<std::domain_error>([&]() { csi::kafka_partition(foobar, 6, -3); }, "kafka_partition with negative partitions throws");
+
+  const avro::ValidSchema        value_schema(avro::compileJsonSchemaFromString(value_schema_json));
+  const std::vector<std::string> keys = { "id", "name", "ratio", "color" };
+  for (int allow_null = 0; allow_null != 2; ++allow_null) {
+    const std::string mode = allow_null ? "nullable key: " : "strict key: ";
+    auto key_schema = csi::avro_hive::get_key_schema(avro::Name("row_key"), keys, allow_null != 0, value_schema);
+    csi::key_partitioner partitioner(value_schema, *key_schema);
+
+    std::vector<avro::GenericDatum> rows;
+    for (int i = 0; i != 100; ++i) {
+      avro::GenericDatum   d(value_schema);
+      avro::GenericRecord& r = d.value<avro::GenericRecord>();
+      r.fieldAt(0).value<int64_t>() = i * 1000003LL - 50000000;
+      r.fieldAt(1).selectBranch(allow_null && i % 5 == 0 ? 0 : 1);
+      if (r.fieldAt(1).unionBranch())
+        r.fieldAt(1).value<std::string>() = "name-" + std::to_string(i);
+      r.fieldAt(2).value<double>() = i / 7.0;
+      r.fieldAt(3).value<avro::GenericEnum>().set(i % 2);
+      rows.push_back(d);
+    }
+
+    size_t mismatched = 0;
+    std::vector<int32_t> partitions;
+    partitioner.partition(rows, 12, partitions);
+    for (size_t i = 0; i != rows.size(); ++i) {
+      std::vector<uint8_t> expected = avro_encode(*csi::avro_hive::get_key(rows[i], *key_schema));
+      if (partitioner.encode_key(rows[i]) != expected)
+        ++mismatched;
+      int32_t p = csi::kafka_partition(expected.data(), expected.size(), 12);
+      if (partitioner.partition(rows[i], 12) != p || partitions[i] != p)
+        ++mismatched;
+    }
+    check(mismatched == 0, mode + "keys encode and partition as get_key + avro binary encoding, mismatched: " + std::to_string(mismatched));
+    check_throws<std::domain_error>([&]() { partitioner.partition(rows, 0, partitions); }, mode + "batch with 0 partitions throws");
+  }
+  return test_failures();
+}
@@ -0,0 +1,144 @@
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <avro/Encoder.hh>
+#include <avro/Specific.hh>
+#include <avro/Stream.hh>
+#include <csi_avro_utils/binary_codec.h>
+#include <csi_avro_utils/pooled_output_stream.h>
+#include <tests/test_check.h>
+
+struct message {
+  std::string          s;
+  std::vector<int64_t> v;
+};
+
+namespace avro {
+  template<> struct codec_traits<message> {
+    static void encode(Encoder& e, const message& m) {
+      avro::encode(e, m.s);
+      avro::encode(e, m.v);
+    }
+  };
+};
+
+// a string of n bytes and n longs, about 2n bytes encoded
+static message make_value(size_t n) {
+  message m;
+  for (size_t i = 0; i != n; ++i) {
+    m.s.push_back(static_cast<char>('a' + i % 26));
+    m.v.push_back(static_cast<int64_t>(i % 50) - 25);
+  }
+  return m;
+}
+
+static std::string avro_bytes(const message& m) {
+  std::auto_ptr<avro::OutputStream> os = avro::memoryOutputStream();
+  avro::EncoderPtr                  e = avro::binaryEncoder();
+  e->init(*os);
+  avro::encode(*e, m);
+  e->flush();
+  std::auto_ptr<avro::InputStream> is = avro::memoryInputStream(*os);
+  std::string                      s;
+  const uint8_t*                   data;
+  size_t                           len;
+  while (is->next(&data, &len))
+    s.append(reinterpret_cast<const char*>(data), len);
+  return s;
+}
+
+// the same bytes through str(), append_to() and copy_to()
+static bool same_bytes(const csi::pooled_output_stream& os, const std::string& expected) {
+  std::vector<uint8_t> appended(3, 'x');
+  os.append_to(appended);
+  std::string copied(os.size(), '\0');
+  if (!copied.empty())
+    os.copy_to(reinterpret_cast<uint8_t*>(&copied[0]));
+  return os.size() == expected.size() && os.byteCount() == expected.size() && os.str() == expected && copied == expected &&
+         std::string(appended.begin() + 3, appended.end()) == expected && std::string(appended.begin(), appended.begin() + 3) == "xxx";
+}
+
+int main() {
+  const size_t chunk = csi::pooled_output_stream::chunk_size;
+
+  {
+    csi::pooled_output_stream os;
+    check(os.size() == 0 && os.contiguous() && os.str().empty(), "empty stream");
+  }
+
+  // messages below, around and well past one chunk, with avro's encoder and csi::binary_encoder
+  const size_t sizes[] = { 1, 100, chunk / 2 - 3, chunk / 2, chunk, 3 * chunk + 17, 20 * chunk };
+  avro::EncoderPtr          avro_encoder = avro::binaryEncoder();
+  csi::binary_encoder       csi_encoder;
+  csi::pooled_output_stream os; // reused for all of them
+  for (size_t i = 0; i != sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    const message     v = make_value(sizes[i]);
+    const std::string expected = avro_bytes(v);
+    const std::string what = std::to_string(expected.size()) + " bytes";
+
+    csi::encode_to(os, *avro_encoder, v);
+    check(same_bytes(os, expected), "avro::binaryEncoder: " + what);
+    check(os.contiguous() == (expected.size() <= chunk), "contiguous only within one chunk: " + what);
+    if (os.contiguous())
+      check(std::string(reinterpret_cast<const char*>(os.data()), os.size()) == expected, "data(): " + what);
+
+    csi::encode_to(os, csi_encoder, v);
+    check(same_bytes(os, expected), "csi::binary_encoder: " + what);
+  }
+
+  // exactly one chunk, then one byte more
+  {
+    std::string full(chunk - 2, 'z'); // and a 2 byte length
+    csi::encode_to(os, *avro_encoder, full);
+    check(os.size() == chunk && os.contiguous(), "exactly one chunk");
+    full.push_back('z');
+    csi::encode_to(os, *avro_encoder, full);
+    check(os.size() == chunk + 1 && !os.contiguous(), "one byte into the second chunk");
+  }
+
+  // next() and backup() as the encoders use them
+  {
+    csi::pooled_output_stream s;
+    uint8_t*                  p;
+    size_t                    len;
+    check(s.next(&p, &len) && len == chunk, "next: a whole chunk");
+    p[0] = 'a';
+    s.backup(len - 1);
+    check(s.next(&p, &len) && len == chunk - 1, "next: the rest of the chunk after backup");
+    p[0] = 'b';
+    s.backup(len - 1);
+    check(s.str() == "ab" && s.contiguous(), "backup keeps what was written");
+    check(s.next(&p, &len) && len == chunk - 2, "next: rest of the chunk");
+    memset(p, 'c', len);
+    check(s.next(&p, &len) && len == chunk && !s.contiguous(), "next: a new chunk when full");
+    p[0] = 'd';
+    s.backup(len - 1);
+    check(s.size() == chunk + 1 && s.str()[chunk - 1] == 'c' && s.str()[chunk] == 'd', "bytes across two chunks");
+  }
+
+  // chunks go back to the pool on reset and are taken again
+  {
+    csi::pooled_output_stream a;
+    uint8_t*                  p;
+    size_t                    len;
+    a.next(&p, &len);
+    const uint8_t* first = a.data();
+    a.reset();
+    check(a.size() == 0 && a.data() == 0, "reset: empty");
+    csi::pooled_output_stream b;
+    b.next(&p, &len);
+    check(b.data() == first, "reset: chunk reused from the pool");
+  }
+
+  // a stream filled on one thread and reset on another
+  {
+    csi::pooled_output_stream* moved = new csi::pooled_output_stream;
+    std::thread t([moved]() { csi::encode_to(*moved, *avro::binaryEncoder(), make_value(5 * chunk)); });
+    t.join();
+    check(same_bytes(*moved, avro_bytes(make_value(5 * chunk))), "stream filled on another thread");
+    delete moved;
+  }
+
+  return test_failures();
+}
@@ -0,0 +1,56 @@
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "defaults_record.h"
+#include <tests/test_check.h>
+
+// every field as the schema defaults say, plain has none and is value initialized
+static bool has_defaults(const csi_test::defaults_record& r) {
+  return r.i == 7 && r.l == -5 && r.f == 1.5f && r.d == 2.25 && r.b && r.s == "a b"
+    && r.raw == std::vector<uint8_t>({ 1, 'A' }) && r.id[0] == 2 && r.id[1] == 3
+    && r.shade == csi_test::color::green && r.nums == std::vector<int32_t>({ 1, 2, 3 })
+    && r.labels == std::map<std::string, std::string>({ { "k", "v" } }) && r.pos.x == 4 && r.pos.y == 5
+    && r.name.idx() == 0 && r.name.get_string() == "none" && r.maybe.is_null()
+    && r.tree.value == 9 && r.tree.child.is_null() && r.plain == 0;
+}
+
+int main() {
+  const csi_test::defaults_record r;
+  check(r.i == 7 && r.l == -5 && r.f == 1.5f && r.d == 2.25 && r.b, "scalar defaults");
+  check(r.s == "a b", "string default");
+  check(r.raw == std::vector<uint8_t>({ 1, 'A' }), "bytes default");
+  check(r.id[0] == 2 && r.id[1] == 3, "fixed default");
+  check(r.shade == csi_test::color::green, "enum default");
+  check(r.nums == std::vector<int32_t>({ 1, 2, 3 }), "array default");
+  check(r.labels.size() == 1 && r.labels.at("k") == "v", "map default");
+  check(r.pos.x == 4 && r.pos.y == 5, "nested record default overrides the record's own field defaults");
+  check(r.name.idx() == 0 && r.name.get_string() == "none", "non null union default");
+  check(r.maybe.is_null(), "null union default");
+  check(r.tree.value == 9 && r.tree.child.is_null(), "recursive record default");
+  check(r.plain == 0, "no default: value initialized");
+
+  // a record's own field defaults when it is constructed on its own
+  const csi_test::point p;
+  check(p.x == 0 && p.y == 0, "point defaults");
+  const csi_test::node n;
+  check(n.value == 3 && n.child.is_null(), "recursive record defaults");
+
+  check(has_defaults(csi_test::defaults_record::defaults()), "defaults()");
+  check(&csi_test::defaults_record::defaults() == &csi_test::defaults_record::defaults(), "defaults(): one instance");
+  check(csi_test::node::defaults().value == 3 && csi_test::point::defaults().x == 0, "defaults() of the nested records");
+
+  // resetting a used record
+  csi_test::defaults_record used = r;
+  used.i = 1;
+  used.s = "changed";
+  used.nums.clear();
+  used.labels["other"] = "x";
+  used.name.set_null();
+  used.maybe.set_int(3);
+  used.tree.child.set_node(csi_test::node());
+  check(!has_defaults(used), "changed record");
+  used = csi_test::defaults_record::defaults();
+  check(has_defaults(used), "reset from defaults()");
+  return test_failures();
+}
@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <avro/Exception.hh>
+#include "patch_record.h"
+#include <tests/test_check.h>
+
+static csi_test::patch_record make_record() {
+  csi_test::patch_record r;
+  r.id = 1;
+  r.s = "start";
+  r.values = { 1, 2, 3 };
+  r.labels["a"] = "x";
+  r.shade = csi_test::color::red;
+  r.note.set_null();
+  r.nested.x = 0.5;
+  return r;
+}
+
+// the record is untouched when apply_patch throws
+static void apply_throws(const std::vector<uint8_t>& patch, const std::string& what) {
+  csi_test::patch_record v = make_record();
+  bool threw = false;
+  try {
+    csi_test::apply_patch(v, patch);
+  } catch (const avro::Exception&) {
+    threw = true;
+  }
+  check(threw && v == make_record(), what);
+}
+
+int main() {
+  const csi_test::patch_record from = make_record();
+
+  {
+    std::vector<uint8_t> patch;
+    check(!csi_test::diff(from, from, patch), "diff: nothing changed");
+    csi_test::patch_record v = from;
+    csi_test::apply_patch(v, patch);
+    check(v == from, "apply: empty patch");
+  }
+
+  csi_test::patch_record to = from;
+  to.s = "a longer string than the one before";
+  to.labels["b"] = "y";
+  to.note.set_string("note");
+  std::vector<uint8_t> patch = csi_test::diff(from, to);
+  check(patch.size() == 16 + 1 + 36 + 10 + 6, "diff: header, mask and the three changed fields");
+  {
+    csi_test::patch_record v = from;
+    csi_test::apply_patch(v, patch);
+    check(v == to, "apply: changed fields");
+  }
+
+  // every field on its own, and all of them
+  {
+    csi_test::patch_record all = from;
+    all.id = -7;
+    all.s.clear();
+    all.values.clear();
+    all.labels.clear();
+    all.shade = csi_test::color::blue;
+    all.note.set_string("");
+    all.nested.x = -1;
+    csi_test::patch_record v = from;
+    csi_test::apply_patch(v, csi_test::diff(from, all));
+    check(v == all, "apply: every field changed");
+    csi_test::apply_patch(v, csi_test::diff(all, from));
+    check(v == from, "apply: and back");
+  }
+
+  // a stream of updates applied to one state, as a consumer would
+  {
+    csi_test::patch_record state = from;
+    csi_test::patch_record prev = from;
+    bool same = true;
+    for (int i = 0; i != 100; ++i) {
+      csi_test::patch_record next = prev;
+      next.id = i;
+      if (i % 3 == 0)
+        next.values.push_back(i);
+      if (i % 5 == 0)
+        next.s = std::string(i, 's');
+      csi_test::apply_patch(state, csi_test::diff(prev, next));
+      same = same && state == next;
+      prev = next;
+    }
+    check(same, "apply: update stream");
+  }
+
+  // invalid patches leave the record as it was
+  for (size_t n = 0; n != patch.size(); ++n)
+    apply_throws(std::vector<uint8_t>(patch.begin(), patch.begin() + n), "apply: cut short at " + std::to_string(n) + " bytes");
+  {
+    std::vector<uint8_t> longer = patch;
+    longer.push_back(0);
+    apply_throws(longer, "apply: trailing bytes");
+    std::vector<uint8_t> other = patch;
+    other[0] ^= 1;
+    apply_throws(other, "apply: patch for another schema");
+    std::vector<uint8_t> unknown_field = patch;
+    unknown_field[16] |= 0x80;
+    apply_throws(unknown_field, "apply: field the record does not have");
+  }
+
+  // every record has its own hash, a patch for the nested record does not apply to the outer one
+  {
+    csi_test::inner x;
+    x.x = 2;
+    std::vector<uint8_t> nested = csi_test::diff(csi_test::inner(), x);
+    check(csi_test::patch_hash(from) == csi_test::patch_record::schema_hash(), "patch_hash: root record is the schema hash");
+    check(csi_test::patch_hash(x) != csi_test::patch_hash(from), "patch_hash: nested record has its own");
+    check(nested.size() == 16 + 1 + 8 && std::equal(nested.begin(), nested.begin() + 16, csi_test::patch_hash(x).begin()), "diff: nested record patch");
+    apply_throws(nested, "apply: patch for the nested record");
+    csi_test::inner y;
+    csi_test::apply_patch(y, nested);
+    check(y == x, "apply: nested record patch to the nested record");
+  }
+
+  return test_failures();
+}
@@ -0,0 +1,110 @@
+#include <string>
+#include <vector>
+#include <avro/Compiler.hh>
+#include <avro/ValidSchema.hh>
+#include <csi_avro_utils/schema_compatibility.h>
+#include <csi_avro_utils/utils.h>
+#include <tests/test_check.h>
+
+static avro::ValidSchema compile(const std::string& json) {
+  return avro::compileJsonSchemaFromString(json);
+}
+
+// a record named r with the given fields
+static std::string record(const std::string& fields) {
+  return "{\"type\":\"record\",\"name\":\"r\",\"fields\":[" + fields + "]}";
+}
+
+static std::string field(const std::string& name, const std::string& type) {
+  return "{\"name\":\"" + name + "\",\"type\":" + type + "}";
+}
+
+// expected is compatibility_verdict::to_string(), one line per entry
+static void verdict(const char* what, const std::string& writer, const std::string& reader, const std::string& expected) {
+  const std::string actual = csi::check_compatibility(compile(writer), compile(reader)).to_string();
+  check(actual == expected, std::string(what) + (actual == expected ? "" : ", got:\n" + actual));
+}
+
+int main() {
+  const std::string order = "{\"type\":\"record\",\"name\":\"order\",\"fields\":[{\"name\":\"price\",\"type\":\"int\"}]}";
+  const std::string order_long = "{\"type\":\"record\",\"name\":\"order\",\"fields\":[{\"name\":\"price\",\"type\":\"long\"}]}";
+
+  verdict("same schema", record(field("a", "\"int\"")), record(field("a", "\"int\"")), "");
+  verdict("int to long", "\"int\"", "\"long\"", "promoted <top>: int -> long\n");
+  verdict("int to double, float to double", record(field("a", "\"int\"") + "," + field("b", "\"float\"")),
+          record(field("a", "\"double\"") + "," + field("b", "\"double\"")), "promoted a: int -> double\npromoted b: float -> double\n");
+  verdict("long to int", "\"long\"", "\"int\"", "type mismatch <top>: writer long, reader int\n");
+  verdict("string to bytes", "\"string\"", "\"bytes\"", "type mismatch <top>: writer string, reader bytes\n");
+
+  verdict("reader field with a default", record(field("a", "\"int\"")),
+          record(field("a", "\"int\"") + ",{\"name\":\"b\",\"type\":\"string\",\"default\":\"x\"}"), "default b\n");
+  verdict("reader field with a null default", record(field("a", "\"int\"")),
+          record(field("a", "\"int\"") + ",{\"name\":\"b\",\"type\":[\"null\",\"string\"],\"default\":null}"), "default b\n");
+  verdict("reader field without a default", record(field("a", "\"int\"")), record(field("a", "\"int\"") + "," + field("b", "\"string\"")),
+          "missing default b: not written and no default\n");
+  verdict("writer field the reader drops", record(field("a", "\"int\"") + "," + field("b", "\"string\"")), record(field("a", "\"int\"")), "skipped b\n");
+
+  verdict("enum symbol missing in the reader", "{\"type\":\"enum\",\"name\":\"e\",\"symbols\":[\"A\",\"B\",\"C\"]}",
+          "{\"type\":\"enum\",\"name\":\"e\",\"symbols\":[\"C\",\"A\"]}", "missing enum symbol <top>: B\n");
+  verdict("enum with more reader symbols", "{\"type\":\"enum\",\"name\":\"e\",\"symbols\":[\"A\"]}",
+          "{\"type\":\"enum\",\"name\":\"e\",\"symbols\":[\"A\",\"B\"]}", "");
+  verdict("fixed size", "{\"type\":\"fixed\",\"name\":\"f\",\"size\":4}", "{\"type\":\"fixed\",\"name\":\"f\",\"size\":8}",
+          "fixed size mismatch <top>: writer 4 bytes, reader 8\n");
+  check(csi::check_compatibility(compile("{\"type\":\"fixed\",\"name\":\"f\",\"size\":4}"), compile("{\"type\":\"fixed\",\"name\":\"g\",\"size\":4}"))
+            .issues.at(0).kind == csi::compatibility_verdict::NAME_MISMATCH, "record, enum and fixed names");
+
+  verdict("union to union", "[\"null\",\"int\"]", "[\"long\",\"null\"]", "promoted <top>: int -> long\nunion <top>: 0->1 1->0\n");
+  verdict("union branch missing in the reader", "[\"null\",\"string\"]", "[\"string\"]",
+          "missing union branch <top>: writer branch null has no reader branch\nunion <top>: 0->-1 1->0\n");
+  verdict("union to plain type", "[\"int\",\"long\"]", "\"long\"", "promoted <top>: int -> long\nunion <top>: 0->0 1->0\n");
+  verdict("plain type to union", "\"string\"", "[\"null\",\"string\"]", "union <top>: 1\n");
+  verdict("plain type not in the reader union", "\"int\"", "[\"null\",\"string\"]",
+          "missing union branch <top>: writer int is not in the reader union\nunion <top>: -1\n");
+  verdict("same type before promotion", "\"int\"", "[\"long\",\"int\"]", "union <top>: 1\n");
+
+  // paths of nested fields, array items and map values
+  verdict("nested paths",
+          record(field("order", order) + "," + field("tags", "{\"type\":\"array\",\"items\":\"int\"}") + "," + field("attributes", "{\"type\":\"map\",\"values\":\"float\"}")),
+          record(field("order", order_long) + "," + field("tags", "{\"type\":\"array\",\"items\":\"long\"}") + "," + field("attributes", "{\"type\":\"map\",\"values\":\"double\"}")),
+          "promoted order.price: int -> long\npromoted tags[]: int -> long\npromoted attributes{}: float -> double\n");
+  verdict("record met twice",
+          record(field("a", order) + "," + field("b", "\"order\"")), record(field("a", order_long) + "," + field("b", "\"order\"")),
+          "promoted a.price: int -> long\npromoted b.price: int -> long\n");
+
+  // recursive records end where the same pair is met again
+  const std::string list = "{\"type\":\"record\",\"name\":\"node\",\"fields\":[{\"name\":\"value\",\"type\":\"int\"},{\"name\":\"next\",\"type\":[\"null\",\"node\"]}]}";
+  const std::string list_long = "{\"type\":\"record\",\"name\":\"node\",\"fields\":[{\"name\":\"value\",\"type\":\"long\"},{\"name\":\"next\",\"type\":[\"null\",\"node\"]}]}";
+  verdict("recursive", list, list, "union next: 0->0 1->1\n");
+  verdict("recursive with a promotion", list, list_long, "promoted value: int -> long\nunion next: 0->0 1->1\n");
+
+  // memoized by schema fingerprint, batches give the same verdicts as one by one
+  {
+    csi::compatibility_checker checker;
+    avro::ValidSchema          w1 = compile(record(field("a", order)));
+    avro::ValidSchema          w2 = compile(record(field("a", order) + "," + field("b", "\"string\"")));
+    avro::ValidSchema          w3 = compile(record(field("a", "\"int\"")));
+    avro::ValidSchema          reader = compile(record(field("a", order_long)));
+    csi::compatibility_checker::verdict_ptr v = checker.check(w1, reader);
+    check(checker.check(w1, reader) == v && checker.hits() == 1 && checker.size() == 1, "checker: memoized");
+    check(v->compatible() && v->promotions.size() == 1, "checker: verdict");
+
+    std::vector<const avro::ValidSchema*> writers = { &w1, &w2, &w3 };
+    std::vector<csi::compatibility_checker::verdict_ptr> all = checker.check_all(writers, reader);
+    bool same = all.size() == writers.size();
+    for (size_t i = 0; same && i != writers.size(); ++i)
+      same = all[i]->to_string() == csi::check_compatibility(*writers[i], reader).to_string();
+    check(same, "check_all: same verdicts as check_compatibility");
+    check(all[0] == v && checker.hits() == 2 && checker.size() == 3, "check_all: reuses memoized verdicts");
+    check(all[1]->compatible() && !all[2]->compatible(), "check_all: compatible and not");
+
+    // same generate_hash, but only the first reader can fill in b
+    avro::ValidSchema with_default = compile(record(field("a", order_long) + ",{\"name\":\"b\",\"type\":\"int\",\"default\":1}"));
+    avro::ValidSchema without_default = compile(record(field("a", order_long) + "," + field("b", "\"int\"")));
+    check(generate_hash(with_default) == generate_hash(without_default), "generate_hash leaves defaults out");
+    check(checker.check(w1, with_default)->compatible(), "checker: reader field with a default");
+    check(!checker.check(w1, without_default)->compatible(), "checker: reader field without a default is not memoized as the one with");
+    check(!checker.check_all(writers, without_default)[0]->compatible(), "check_all: reader field without a default");
+  }
+
+  return test_failures();
+}
@@ -29,15 +29,18 @@ std::vector<testcase> tests =
   { "095d71cf-1255-6b9d-5e33-0ad575b3df5d", "\"string\"" }
 };
 
-int main(int argc, char** argv) {
+int main() {
+  int failures = 0;
   for(std::vector<testcase>::const_iterator i = tests.begin(); i != tests.end(); ++i) {
     std::string hash = to_string(generate_hash(i->schema));
     if(hash.compare(i->hash) == 0) {
       std::cout << "OK " << hash << std::endl;
     } else {
       std::cout << "FAILED got:" << hash << ", expected:" << i->hash << std::endl;
+      ++failures;
     }
   }
+  return failures;
 }
 
 
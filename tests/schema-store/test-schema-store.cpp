@@ -0,0 +1,49 @@
+#include <string>
+#include <avro/Compiler.hh>
+#include <avro/GenericDatum.hh>
+#include <avro/ValidSchema.hh>
+#include <csi_avro_utils/schema_store.h>
+#include <csi_avro_utils/utils.h>
+#include <tests/test_check.h>
+
+static std::string with_default(const std::string& x_default) {
+  return "{\"type\":\"record\",\"name\":\"S\",\"fields\":[{\"name\":\"x\",\"type\":\"int\",\"default\":" + x_default + "}]}";
+}
+
+// S inside an outer record, so only the shared subtree differs
+static std::string nested(const std::string& x_default, const std::string& outer) {
+  return "{\"type\":\"record\",\"name\":\"" + outer + "\",\"fields\":[{\"name\":\"s\",\"type\":" + with_default(x_default) + "}]}";
+}
+
+static int x_default(const avro::NodePtr& s) {
+  return s->defaultValueAt(0).value<int32_t>();
+}
+
+int main() {
+  csi::schema_store store;
+
+  csi::schema_store::schema_ptr one = store.intern(with_default("1"));
+  csi::schema_store::schema_ptr two = store.intern(with_default("2"));
+  check(one != two, "schemas differing only in a default are kept apart");
+  check(x_default(one->root()) == 1 && x_default(two->root()) == 2, "each keeps its own default");
+  check(store.intern(with_default("2")) == two, "interning again returns the stored schema");
+  check(store.find(generate_hash(*two)) == one, "find by generate_hash returns the first of them");
+
+  csi::schema_store::schema_ptr a = store.intern(nested("1", "A"));
+  csi::schema_store::schema_ptr b = store.intern(nested("2", "B"));
+  check(x_default(a->root()->leafAt(0)) == 1 && x_default(b->root()->leafAt(0)) == 2, "nested records are not shared across defaults");
+  check(a->root()->leafAt(0) == one->root(), "nested record with the same default is shared");
+
+  // string defaults, generate_hash strips their whitespace
+  csi::schema_store::schema_ptr s1 = store.intern("{\"type\":\"record\",\"name\":\"T\",\"fields\":[{\"name\":\"s\",\"type\":\"string\",\"default\":\"a b\"}]}");
+  csi::schema_store::schema_ptr s2 = store.intern("{\"type\":\"record\",\"name\":\"T\",\"fields\":[{\"name\":\"s\",\"type\":\"string\",\"default\":\"ab\"}]}");
+  check(s1->root()->defaultValueAt(0).value<std::string>() == "a b" && s2->root()->defaultValueAt(0).value<std::string>() == "ab", "string defaults");
+
+  // a field without a default and one with a null default on a nullable field
+  csi::schema_store::schema_ptr n1 = store.intern("{\"type\":\"record\",\"name\":\"N\",\"fields\":[{\"name\":\"u\",\"type\":[\"null\",\"int\"]}]}");
+  csi::schema_store::schema_ptr n2 = store.intern("{\"type\":\"record\",\"name\":\"N\",\"fields\":[{\"name\":\"u\",\"type\":[\"null\",\"int\"],\"default\":null}]}");
+  check(n1 != n2 && n2->root()->defaultValueAt(0).isUnion(), "no default and a null default");
+
+  check(store.size() == 8, "one schema per distinct json and defaults");
+  return test_failures();
+}
@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <avro/Compiler.hh>
+#include <avro/Generic.hh>
+#include <avro/ValidSchema.hh>
+#include <csi_avro_utils/sortable_key.h>
+#include <tests/test_check.h>
+
+// the two fixed branches have different sizes, the enum after them must still decode
+static const char* key_schema_json =
+  "{\"type\":\"record\",\"name\":\"key\",\"fields\":["
+  "{\"name\":\"i\",\"type\":\"int\"},"
+  "{\"name\":\"l\",\"type\":\"long\"},"
+  "{\"name\":\"d\",\"type\":\"double\"},"
+  "{\"name\":\"s\",\"type\":\"string\"},"
+  "{\"name\":\"u\",\"type\":[\"null\",{\"type\":\"fixed\",\"name\":\"f4\",\"size\":4},{\"type\":\"fixed\",\"name\":\"f8\",\"size\":8}]},"
+  "{\"name\":\"e\",\"type\":{\"type\":\"enum\",\"name\":\"color\",\"symbols\":[\"A\",\"B\",\"C\"]}}]}";
+
+// the avro sort order of the key: columns in order, unions by branch then value, strings bytewise
+typedef std::tuple<int32_t, int64_t, double, std::string, size_t, std::vector<uint8_t>, size_t> reference_key;
+
+static uint64_t state = 4711;
+static size_t pick(size_t n) {
+  state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (state >> 33) % n;
+}
+
+static reference_key random_key() {
+  static const int32_t     ints[] = { INT32_MIN, -1000, -1, 0, 1, 255, 256, INT32_MAX };
+  static const int64_t     longs[] = { INT64_MIN, -(1LL << 40), -1, 0, 1, 1LL << 40, INT64_MAX };
+  static const double      doubles[] = { -1.0 / 0.0, -1e10, -0.5, 0.0, 1e-300, 0.5, 1e300, 1.0 / 0.0 };
+  static const std::string strings[] = { std::string(), "a", std::string("a\0", 2), std::string("a\0b", 3), "ab", "b", std::string("\0", 1) };
+  size_t branch = pick(3);
+  std::vector<uint8_t> fixed(branch == 0 ? 0 : branch == 1 ? 4 : 8);
+  for (auto& b : fixed)
+    b = pick(3) == 0 ? 0 : 0xff;
+  return reference_key(ints[pick(8)], longs[pick(7)], doubles[pick(8)], strings[pick(7)], branch, fixed, pick(3));
+}
+
+static avro::GenericDatum to_datum(const avro::ValidSchema& schema, const reference_key& k) {
+  avro::GenericDatum   d(schema);
+  avro::GenericRecord& r = d.value<avro::GenericRecord>();
+  r.fieldAt(0).value<int32_t>() = std::get<0>(k);
+  r.fieldAt(1).value<int64_t>() = std::get<1>(k);
+  r.fieldAt(2).value<double>() = std::get<2>(k);
+  r.fieldAt(3).value<std::string>() = std::get<3>(k);
+  r.fieldAt(4).selectBranch(std::get<4>(k));
+  if (std::get<4>(k))
+    r.fieldAt(4).value<avro::GenericFixed>().value() = std::get<5>(k);
+  r.fieldAt(5).value<avro::GenericEnum>().set(std::get<6>(k));
+  return d;
+}
+
+static reference_key from_datum(const avro::GenericDatum& d) {
+  const avro::GenericRecord& r = d.value<avro::GenericRecord>();
+  size_t branch = r.fieldAt(4).unionBranch();
+  return reference_key(r.fieldAt(0).value<int32_t>(), r.fieldAt(1).value<int64_t>(), r.fieldAt(2).value<double>(),
+                       r.fieldAt(3).value<std::string>(), branch,
+                       branch ? r.fieldAt(4).value<avro::GenericFixed>().value() : std::vector<uint8_t>(),
+                       r.fieldAt(5).value<avro::GenericEnum>().value());
+}
+
+static int sign(int v) { return (v > 0) - (v < 0); }
+
+int main() {
+  const avro::ValidSchema          schema(avro::compileJsonSchemaFromString(key_schema_json));
+  const csi::avro_hive::sortable_key_codec codec(schema);
+
+  std::vector<reference_key> keys;
+  std::vector<std::string>   encoded;
+  for (int i = 0; i != 300; ++i) {
+    keys.push_back(random_key());
+    encoded.push_back(codec.encode(to_datum(schema, keys.back())));
+  }
+
+  size_t misordered = 0;
+  for (size_t i = 0; i != keys.size(); ++i) {
+    for (size_t j = 0; j != keys.size(); ++j) {
+      int expected = keys[i] < keys[j] ? -1 : keys[j] < keys[i] ? 1 : 0;
+      if (sign(encoded[i].compare(encoded[j])) != expected)
+        ++misordered;
+    }
+  }
+  check(misordered == 0, "memcmp order of encoded keys is the avro order, misordered pairs: " + std::to_string(misordered));
+
+  size_t mismatched = 0;
+  for (size_t i = 0; i != keys.size(); ++i) {
+    avro::GenericDatum d(schema);
+    codec.decode(encoded[i], d);
+    if (!(from_datum(d) == keys[i]))
+      ++mismatched;
+  }
+  check(mismatched == 0, "decode gives back the encoded key, mismatched: " + std::to_string(mismatched));
+
+  {
+    std::string        e = encoded[0];
+    avro::GenericDatum d(schema);
+    check_throws<std::domain_error>([&]() { codec.decode(e.substr(0, e.size() - 1), d); }, "truncated key throws");
+    check_throws<std::domain_error>([&]() { codec.decode(e + '\x00', d); }, "trailing bytes throw");
+  }
+
+  check_throws<std::domain_error>([]() {
+    csi::avro_hive::sortable_key_codec c(avro::compileJsonSchemaFromString(
+      "{\"type\":\"record\",\"name\":\"k\",\"fields\":[{\"name\":\"a\",\"type\":{\"type\":\"array\",\"items\":\"int\"}}]}"));
+  }, "array key column is rejected");
+
+  return test_failures();
+}
@@ -0,0 +1,33 @@
+#include <iostream>
+#include <string>
+
+#pragma once
+
+// minimal checks for the test programs, main returns test_failures() so ctest sees the failures
+static int& test_failures() {
+  static int failures = 0;
+  return failures;
+}
+
+static void check(bool ok, const std::string& what) {
+  if (ok) {
+    std::cout << "OK " << what << std::endl;
+  } else {
+    std::cout << "FAILED " << what << std::endl;
+    ++test_failures();
+  }
+}
+
+// f must throw E
+template<class E, class F> static void check_throws(F f, const std::string& what) {
+  try {
+    f();
+  } catch (const E& e) {
+    check(true, what + " (" + e.what() + ")");
+    return;
+  } catch (const std::exception& e) {
+    check(false, what + ", wrong exception: " + e.what());
+    return;
+  }
+  check(false, what + ", nothing thrown");
+}
@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <avro/Encoder.hh>
+#include <avro/Generic.hh>
+#include <avro/Specific.hh>
+#include <avro/Stream.hh>
+#include <csi_avro_utils/utils.h>
+#include "visit_record.h"
+#include <tests/test_check.h>
+
+typedef csi_test::visit_record::value_t value_t;
+
+// the branch index each overload stands for, a branch missing here would not compile
+struct branch_of {
+  size_t& seen;
+  void operator()(const avro::null&) const { seen = 0; }
+  void operator()(const int32_t&) const { seen = 1; }
+  void operator()(const int64_t&) const { seen = 2; }
+  void operator()(const bool&) const { seen = 3; }
+  void operator()(const float&) const { seen = 4; }
+  void operator()(const double&) const { seen = 5; }
+  void operator()(const std::string&) const { seen = 6; }
+  void operator()(const std::vector<uint8_t>&) const { seen = 7; }
+  void operator()(const csi_test::point&) const { seen = 8; }
+  void operator()(const csi_test::color&) const { seen = 9; }
+  void operator()(const boost::array<uint8_t, 2>&) const { seen = 10; }
+  void operator()(const std::vector<int32_t>&) const { seen = 11; }
+  void operator()(const std::map<std::string, std::string>&) const { seen = 12; }
+};
+
+// the non const visit hands out the stored value itself
+struct change {
+  size_t& seen;
+  void operator()(const avro::null&) const { seen = 0; }
+  void operator()(int32_t& v) const { seen = 1; v += 1; }
+  void operator()(int64_t& v) const { seen = 2; v += 1; }
+  void operator()(bool& v) const { seen = 3; v = !v; }
+  void operator()(float& v) const { seen = 4; v += 1; }
+  void operator()(double& v) const { seen = 5; v += 1; }
+  void operator()(std::string& v) const { seen = 6; v += "!"; }
+  void operator()(std::vector<uint8_t>& v) const { seen = 7; v.push_back(9); }
+  void operator()(csi_test::point& v) const { seen = 8; v.x += 1; }
+  void operator()(csi_test::color& v) const { seen = 9; v = csi_test::color::blue; }
+  void operator()(boost::array<uint8_t, 2>& v) const { seen = 10; v[0] += 1; }
+  void operator()(std::vector<int32_t>& v) const { seen = 11; v.push_back(9); }
+  void operator()(std::map<std::string, std::string>& v) const { seen = 12; v["added"] = "y"; }
+};
+
+// one value per branch, the same value set on the generated union and on the generic datum
+static void set_branch(size_t i, value_t& u, avro::GenericDatum& g) {
+  g.selectBranch(i);
+  switch (i) {
+    case 0:
+      u.set_null();
+      break;
+    case 1:
+      u.set_int(-3);
+      g.value<int32_t>() = -3;
+      break;
+    case 2:
+      u.set_long(1LL << 40);
+      g.value<int64_t>() = 1LL << 40;
+      break;
+    case 3:
+      u.set_bool(true);
+      g.value<bool>() = true;
+      break;
+    case 4:
+      u.set_float(0.5f);
+      g.value<float>() = 0.5f;
+      break;
+    case 5:
+      u.set_double(-2.25);
+      g.value<double>() = -2.25;
+      break;
+    case 6:
+      u.set_string("branch");
+      g.value<std::string>() = "branch";
+      break;
+    case 7:
+      u.set_bytes({ 0, 1, 255 });
+      g.value<std::vector<uint8_t> >() = { 0, 1, 255 };
+      break;
+    case 8:
+    {
+      csi_test::point p;
+      p.x = 4;
+      p.y = -5;
+      u.set_point(p);
+      g.value<avro::GenericRecord>().fieldAt(0).value<int32_t>() = 4;
+      g.value<avro::GenericRecord>().fieldAt(1).value<int32_t>() = -5;
+      break;
+    }
+    case 9:
+      u.set_color(csi_test::color::green);
+      g.value<avro::GenericEnum>().set(1);
+      break;
+    case 10:
+    {
+      boost::array<uint8_t, 2> t = { { 7, 8 } };
+      u.set_tag(t);
+      g.value<avro::GenericFixed>().value() = { 7, 8 };
+      break;
+    }
+    case 11:
+      u.set_array({ 1, -1, 300 });
+      for (int32_t v : { 1, -1, 300 })
+        g.value<avro::GenericArray>().value().push_back(avro::GenericDatum(v));
+      break;
+    case 12:
+      u.set_map({ { "a", "x" }, { "b", "" } });
+      g.value<avro::GenericMap>().value().push_back(std::make_pair(std::string("a"), avro::GenericDatum(std::string("x"))));
+      g.value<avro::GenericMap>().value().push_back(std::make_pair(std::string("b"), avro::GenericDatum(std::string(""))));
+      break;
+  }
+}
+
+template<class T> static std::string encoded(const T& v) {
+  std::auto_ptr<avro::OutputStream> os = avro::memoryOutputStream();
+  avro::EncoderPtr                  e = avro::binaryEncoder();
+  e->init(*os);
+  avro::encode(*e, v);
+  e->flush();
+  return to_string(*os);
+}
+
+int main() {
+  const avro::ValidSchema& schema = *csi_test::visit_record::valid_schema();
+  for (size_t i = 0; i != 13; ++i) {
+    const std::string what = "branch " + std::to_string(i) + ": ";
+    csi_test::visit_record r;
+    r.id = 42;
+    avro::GenericDatum g(schema);
+    g.value<avro::GenericRecord>().fieldAt(0).value<int32_t>() = 42;
+    set_branch(i, r.value, g.value<avro::GenericRecord>().fieldAt(1));
+
+    size_t seen = 99;
+    const value_t& c = r.value;
+    c.visit(branch_of{ seen });
+    check(seen == i && r.value.idx() == i, what + "const visit");
+
+    check(encoded(r) == encoded(g), what + "encoded through visit() as avro::encode of the GenericDatum");
+
+    seen = 99;
+    r.value.visit(change{ seen });
+    check(seen == i, what + "visit");
+  }
+
+  // changes made through visit() stay in the union
+  {
+    size_t  seen = 0;
+    value_t u;
+    u.set_int(1);
+    u.visit(change{ seen });
+    check(u.get_int() == 2, "visit: int changed in place");
+    u.set_string("s");
+    u.visit(change{ seen });
+    check(u.get_string() == "s!", "visit: string changed in place");
+    csi_test::point p;
+    p.x = 1;
+    u.set_point(p);
+    u.visit(change{ seen });
+    check(u.get_point().x == 2, "visit: record changed in place");
+    u.set_map({});
+    u.visit(change{ seen });
+    check(u.get_map().at("added") == "y", "visit: map changed in place");
+  }
+
+  // a new union is on its first branch, null here
+  {
+    size_t        seen = 99;
+    const value_t u;
+    u.visit(branch_of{ seen });
+    check(seen == 0, "visit: default constructed");
+  }
+  return test_failures();
+}